@@ -0,0 +1,259 @@
+#include <iostream>
+#include "FrameRegistration.h"
+#include "Mesh.h"
+#include "MeshDistance.h"
+#include "MeshVisibility.h"
+#include "PersonSegmentation.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+struct Options {
+  std::filesystem::path dir, output;
+
+  // Recordings that cover a smaller part of the Portal MX mesh are flagged
+  float min_coverage = 0.8f;
+
+  // The person is assumed to be static, otherwise per-frame poses are estimated with ICP
+  bool static_person = false;
+
+  // The mesh is aligned with the first depth map if so many of its points end up on the surface
+  float min_inliers = 0.5f;
+};
+
+// The Portal MX mesh in meters, prepared once per person
+struct Body {
+  std::unique_ptr<MeshVisibility> visibility;
+  std::unique_ptr<MeshDistance> surface;
+};
+
+// Observation counts are stored as raw 32-bit unsigned values (native byte order), one value per vertex
+ErrHandle SaveObservations(const std::filesystem::path &filename, const std::vector<uint32_t> &observations) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(observations.data()),
+             (std::streamsize)(observations.size() * sizeof(uint32_t)));
+  if (!file) {
+    std::ostringstream oss;
+    oss << "failed to write observation counts into '" << filename.string() << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  return ErrHandle();
+}
+
+// Finds the mesh-to-camera pose of the first depth map
+// The person is separated from the floor and the background, the points are moved onto the mesh by their bounding
+// boxes and ICP refines the pose. If it does not converge, the mesh is tried as it is (it may be in the viewer space
+// already), the mesh is rejected if neither start works
+ErrHandle AlignWithFirstFrame(const Options &options, const scanogram::Stage &stage, const scanogram::Stream &stream,
+                              const MeshDistance &surface, RigidTransform &pose, size_t &n_frames) {
+  Camera camera;
+  std::string dir;
+  stream.HasDepth(camera, dir);
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+  if (files.empty()) {
+    return ErrHandle(TEXEL_WHERE, "no depth maps were found in the '" + dir + "' directory");
+  }
+  n_frames = files.size();
+
+  DepthFrame frame;
+  TEXEL_CHECK(DepthFrame::Load(files[0], frame));
+  PersonSegmentation segmentation(camera, stage.BoundingBox());
+  segmentation::Floor floor;
+  PersonMask mask;
+  segmentation.FitFloor(frame, floor);
+  segmentation.Segment(frame, floor, mask);
+
+  auto to_viewer = geometry::CameraToViewer(camera);
+  std::vector<glm::vec3> points;
+  for (size_t y = 0; y < frame.Height(); y += 2) {
+    for (size_t x = 0; x < frame.Width(); x += 2) {
+      if (mask.Row(y)[x] != 0) {
+        float depth = frame.Row(y)[x] * DepthFrame::Scale;
+        points.push_back(to_viewer.Apply(geometry::BackProject(camera, (float)x, (float)y, depth)));
+      }
+    }
+  }
+
+  auto alignment = surface.Align(points, surface.CoarseGuess(points));
+  if (alignment.inliers < options.min_inliers) {
+    auto in_viewer = surface.Align(points, RigidTransform());
+    alignment = in_viewer.inliers > alignment.inliers ? in_viewer : alignment;
+  }
+  if (points.empty() || alignment.inliers < options.min_inliers) {
+    std::ostringstream oss;
+    oss << "the mesh does not match the first depth map (" << alignment.inliers * 100.0f << "% of "
+        << points.size() << " points lie on it), the person may be upside down or not separated from the scene";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  // 'alignment.pose' maps the viewer space into the mesh space
+  pose = geometry::ViewerToCamera(camera) * alignment.pose.Inverse();
+  return ErrHandle();
+}
+
+// The mesh is aligned with the first depth map, the other frames follow ICP (or stay, if the person is static)
+ErrHandle EstimatePoses(const Options &options, const scanogram::Stage &stage, const scanogram::Stream &stream,
+                        const MeshDistance &surface, std::vector<RigidTransform> &poses) {
+  RigidTransform first;
+  size_t n_frames = 0;
+  TEXEL_CHECK(AlignWithFirstFrame(options, stage, stream, surface, first, n_frames));
+  if (options.static_person) {
+    poses.assign(n_frames, first);
+    return ErrHandle();
+  }
+
+  std::vector<icp::Estimate> trajectory;
+  TEXEL_CHECK(FrameRegistration::RegisterStream(stream, icp::Params(), trajectory));
+  poses.resize(trajectory.size());
+  for (size_t i = 0; i < trajectory.size(); i++) {
+    poses[i] = trajectory[i].pose.Inverse() * first;
+  }
+  return ErrHandle();
+}
+
+ErrHandle AnalyzeCoverage(const Options &options, size_t &n_analyzed, size_t &n_flagged, size_t &n_skipped) {
+  ScanogramFinder finder;
+  scan_finder::BindReport report;
+  TEXEL_CHECK(finder.BindDirectory(options.dir.string(), scan_finder::BindParams(), report));
+
+  std::ofstream summary;
+  if (!options.output.empty()) {
+    std::filesystem::create_directories(options.output);
+    summary.open(options.output / "summary.csv");
+    if (!summary) {
+      return ErrHandle(TEXEL_WHERE, "failed to create 'summary.csv' in the output directory");
+    }
+    summary << "id,stage,stream,frames,vertices,covered,coverage,mean_frame_coverage,flagged" << std::endl;
+  }
+
+  // Persons may have a few scans, but only one Portal MX mesh
+  std::filesystem::path mesh_dir;
+  Body body;
+  ErrHandle mesh_err;
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    if (info.scan.Scanner() != scanogram::ScannerType::FreeFusion) {
+      continue;
+    }
+
+    auto person_dir = std::filesystem::path(info.path).parent_path();
+    if (person_dir != mesh_dir) {
+      mesh_dir = person_dir;
+      body = Body();
+      Mesh mesh;
+      mesh_err = Mesh::Load((person_dir / "portal_mx" / "scan.ply").string(), mesh);
+      if (mesh_err.Succeeded()) {
+        float scale = mesh.GuessScale();
+        for (auto &vertex : mesh.Vertices()) {
+          vertex *= scale;
+        }
+        body.visibility.reset(new MeshVisibility(mesh));
+        body.surface.reset(new MeshDistance(mesh));
+      }
+    }
+    if (mesh_err.Failed()) {
+      std::cout << std::endl << "'" << info.id << "': skipped" << std::endl << mesh_err.Message() << std::endl;
+      n_skipped += 1;
+      continue;
+    }
+
+    std::cout << std::endl << "'" << info.id << "':" << std::endl;
+    decltype(auto) stages = info.scan.Stages();
+    for (size_t stage_idx = 0; stage_idx < stages.size(); stage_idx++) {
+      decltype(auto) streams = stages[stage_idx].Streams();
+      for (size_t stream_idx = 0; stream_idx < streams.size(); stream_idx++) {
+        Camera camera;
+        std::string dir;
+        if (!streams[stream_idx].HasDepth(camera, dir)) {
+          continue;
+        }
+
+        std::vector<RigidTransform> poses;
+        visibility::Result result;
+        auto err = EstimatePoses(options, stages[stage_idx], streams[stream_idx], *body.surface, poses);
+        if (err.Succeeded()) {
+          err = body.visibility->Analyze(streams[stream_idx], poses, result);
+        }
+        std::cout << "  Stage " << stage_idx << ", stream " << stream_idx << ": ";
+        if (err.Failed()) {
+          std::cout << "skipped" << std::endl << err.Message() << std::endl;
+          n_skipped += 1;
+          continue;
+        }
+
+        double mean_frame = 0.0;
+        for (const auto &frame : result.frames) {
+          mean_frame += frame.coverage;
+        }
+        mean_frame = result.frames.empty() ? 0.0 : mean_frame / result.frames.size();
+        bool flagged = result.coverage < options.min_coverage;
+        std::cout << result.frames.size() << " frames cover " << result.covered << " of "
+                  << body.visibility->Size() << " vertices (" << result.coverage * 100.0f << "%), "
+                  << mean_frame * 100.0 << "% per frame" << (flagged ? ", POORLY COVERED" : "") << std::endl;
+        n_analyzed += 1;
+        n_flagged += flagged ? 1 : 0;
+
+        if (!options.output.empty()) {
+          std::ostringstream name;
+          name << info.id << "." << stage_idx << "." << stream_idx << ".u32";
+          TEXEL_CHECK(SaveObservations(options.output / name.str(), result.observations));
+          summary << info.id << "," << stage_idx << "," << stream_idx << "," << result.frames.size() << ","
+                  << body.visibility->Size() << "," << result.covered << "," << result.coverage << ","
+                  << mean_frame << "," << (flagged ? 1 : 0) << std::endl;
+        }
+      }
+    }
+  }
+
+  if (!report.failures.empty()) {
+    std::cerr << std::endl << "Skipped " << report.failures.size() << " of " << report.n_files
+              << " files with scans:" << std::endl;
+    for (const auto &failure : report.failures) {
+      std::cerr << "'" << failure.path << "':" << std::endl << failure.error.Message();
+    }
+  }
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::vector<std::string> positional;
+  bool valid = true;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--static") {
+      options.static_person = true;
+    }
+    else if (arg == "--min-coverage" && i + 1 < argc) {
+      options.min_coverage = std::strtof(argv[++i], nullptr);
+    }
+    else if (arg.rfind("--", 0) == 0) {
+      valid = false;
+    }
+    else {
+      positional.emplace_back(arg);
+    }
+  }
+  if (!valid || positional.empty() || positional.size() > 2) {
+    std::cerr << "Wrong arguments, use as './AnalyzeCoverage <path_to_directory_with_scans> [<output_directory>] "
+                 "[--min-coverage <fraction>] [--static]'" << std::endl;
+    return 1;
+  }
+  options.dir = positional[0];
+  if (positional.size() == 2) {
+    options.output = positional[1];
+  }
+
+  size_t n_analyzed{}, n_flagged{}, n_skipped{};
+  auto err = AnalyzeCoverage(options, n_analyzed, n_flagged, n_skipped);
+  if (err.Failed()) {
+    std::cerr << "Failed to analyze coverage of scans from the '" << options.dir.string() << "' directory:"
+              << std::endl;
+    std::cerr << err.Message();
+    return 1;
+  }
+  std::cout << std::endl << "Analyzed " << n_analyzed << " recordings (" << n_flagged << " poorly covered, "
+            << n_skipped << " skipped)" << std::endl;
+  return n_flagged == 0 ? 0 : 2;
+}
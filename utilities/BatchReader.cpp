@@ -0,0 +1,734 @@
+#include "BatchReader.h"
+#include "Metrics.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if __has_include(<linux/io_uring.h>)
+#define TEXEL_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace texel {
+
+namespace batch_io {
+
+std::string ToUserFriendly(Backend backend) {
+  switch (backend) {
+    case Backend::IoUring:    return "io_uring";
+    case Backend::ThreadPool:
+    default:                  return "thread pool";
+  }
+}
+
+} // namespace batch_io
+
+namespace {
+
+struct ReadMetrics {
+  metrics::Counter *files, *bytes;
+  metrics::Gauge *in_flight;
+
+  ReadMetrics() {
+    auto &registry = metrics::Registry::Default();
+    files     = &registry.GetCounter("texel_batch_files_read_total", "Files read by 'BatchReader'");
+    bytes     = &registry.GetCounter("texel_read_bytes_total", "Bytes read from disk", "source=\"batch\"");
+    in_flight = &registry.GetGauge("texel_batch_files_in_flight", "Files being opened or read by 'BatchReader'");
+  }
+
+  static ReadMetrics &Get() {
+    static ReadMetrics instance;
+    return instance;
+  }
+};
+
+ErrHandle SystemError(const std::string &where, const std::string &what,
+                      const std::string &filename, int code) {
+  std::ostringstream oss;
+  oss << "failed to " << what << " '" << filename << "' ("
+      << std::error_code(code, std::generic_category()).message() << ")";
+  return ErrHandle(where, oss.str());
+}
+
+// Reads the whole file into 'buffer', the buffer is reused between calls
+ErrHandle ReadFile(const std::string &filename, std::vector<uint8_t> &buffer, size_t &size) {
+#ifdef __linux__
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || ::fstat(fd, &info) != 0) {
+    int code = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return SystemError(TEXEL_WHERE, "open", filename, code);
+  }
+  if (buffer.size() < (size_t)info.st_size) {
+    buffer.resize((size_t)info.st_size);
+  }
+
+  size = 0;
+  while (size < (size_t)info.st_size) {
+    auto n = ::pread(fd, buffer.data() + size, (size_t)info.st_size - size, (off_t)size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      int code = errno;
+      ::close(fd);
+      return SystemError(TEXEL_WHERE, "read", filename, code);
+    }
+    if (n == 0) {
+      break;
+    }
+    size += (size_t)n;
+  }
+  ::close(fd);
+  return ErrHandle();
+#else
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return ErrHandle(TEXEL_WHERE, "failed to open '" + filename + "'");
+  }
+  size = (size_t)file.tellg();
+  if (buffer.size() < size) {
+    buffer.resize(size);
+  }
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char *>(buffer.data()), (std::streamsize)size)) {
+    return ErrHandle(TEXEL_WHERE, "failed to read '" + filename + "'");
+  }
+  return ErrHandle();
+#endif
+}
+
+} // unnamed namespace
+
+//------------------------
+//--- BatchReader::Ring ---
+//------------------------
+
+#ifdef TEXEL_IO_URING
+
+// A minimal io_uring wrapper, liburing is not required
+// Each slot processes one file at a time: 'openat' first, then 'read' until the whole file is in memory
+class BatchReader::Ring {
+  public:
+    // Returns null if io_uring is not available (old kernel, disabled by seccomp, etc)
+    static std::unique_ptr<Ring> Create(const batch_io::Params &params);
+    Ring(const Ring &) = delete;
+    Ring &operator =(const Ring &) = delete;
+    ~Ring();
+
+    ErrHandle ReadAll(const std::vector<std::string> &files,
+                      const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback);
+
+    // The ring failed and must not be used anymore
+    // Unless 'ReadAll()' returned an error, files it has not passed to the callback are left to the caller
+    bool Broken() const { return broken_; }
+
+    // The kernel has completed all requests, so the buffers may be freed
+    bool Idle() const { return idle_; }
+
+  private:
+    // 'user_data' of cancellation requests, the other requests carry indices of their slots
+    static constexpr uint64_t CancelTag = std::numeric_limits<uint64_t>::max();
+
+    struct Slot {
+      size_t file_idx;
+      int fd;
+      bool busy, opening, fixed;
+      uint8_t *buffer;
+      std::vector<uint8_t> heap;   // for files that do not fit the registered buffer
+      size_t size, offset;
+    };
+
+    Ring()
+      : fd_(-1), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_(MAP_FAILED),
+        sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0),
+        sq_local_tail_(0), to_submit_(0), n_slots_(0), buffer_size_(0), fixed_buffers_(false),
+        broken_(false), idle_(true) {
+    }
+
+    io_uring_sqe *NextSqe();
+    int Enter(unsigned min_complete);
+
+    int fd_;
+    void *sq_ring_, *cq_ring_, *sqes_;
+    size_t sq_ring_size_, cq_ring_size_, sqes_size_;
+    unsigned *sq_head_, *sq_tail_, *sq_array_, sq_mask_, sq_entries_;
+    unsigned *cq_head_, *cq_tail_, cq_mask_;
+    io_uring_cqe *cqes_;
+    unsigned sq_local_tail_, to_submit_;
+
+    size_t n_slots_, buffer_size_;
+    std::unique_ptr<uint8_t[]> buffers_;
+    bool fixed_buffers_;
+
+    bool broken_, idle_;
+    std::vector<Slot> abandoned_;     // slots of requests that never completed, kept alive with the ring
+};
+
+std::unique_ptr<BatchReader::Ring> BatchReader::Ring::Create(const batch_io::Params &params) {
+  std::unique_ptr<Ring> ring(new Ring());
+  io_uring_params setup;
+  std::memset(&setup, 0, sizeof(setup));
+  ring->fd_ = (int)::syscall(__NR_io_uring_setup, (unsigned)std::max<size_t>(params.queue_depth, 1), &setup);
+  if (ring->fd_ < 0) {
+    return nullptr;
+  }
+
+  // Map the submission and completion queues
+  ring->sq_ring_size_ = setup.sq_off.array + setup.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size_ = setup.cq_off.cqes + setup.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (setup.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    ring->sq_ring_size_ = ring->cq_ring_size_ = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+  }
+  ring->sq_ring_ = ::mmap(nullptr, ring->sq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_SQ_RING);
+  if (ring->sq_ring_ == MAP_FAILED) {
+    return nullptr;
+  }
+  ring->cq_ring_ = single_mmap ? ring->sq_ring_
+                               : ::mmap(nullptr, ring->cq_ring_size_, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_CQ_RING);
+  ring->sqes_size_ = setup.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes_ = ::mmap(nullptr, ring->sqes_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_SQES);
+  if (ring->cq_ring_ == MAP_FAILED || ring->sqes_ == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto sq = static_cast<uint8_t *>(ring->sq_ring_);
+  ring->sq_head_    = reinterpret_cast<unsigned *>(sq + setup.sq_off.head);
+  ring->sq_tail_    = reinterpret_cast<unsigned *>(sq + setup.sq_off.tail);
+  ring->sq_array_   = reinterpret_cast<unsigned *>(sq + setup.sq_off.array);
+  ring->sq_mask_    = *reinterpret_cast<unsigned *>(sq + setup.sq_off.ring_mask);
+  ring->sq_entries_ = setup.sq_entries;
+  auto cq = static_cast<uint8_t *>(ring->cq_ring_);
+  ring->cq_head_ = reinterpret_cast<unsigned *>(cq + setup.cq_off.head);
+  ring->cq_tail_ = reinterpret_cast<unsigned *>(cq + setup.cq_off.tail);
+  ring->cq_mask_ = *reinterpret_cast<unsigned *>(cq + setup.cq_off.ring_mask);
+  ring->cqes_    = reinterpret_cast<io_uring_cqe *>(cq + setup.cq_off.cqes);
+  ring->sq_local_tail_ = *ring->sq_tail_;
+
+  // Asynchronous 'openat' and 'read' appeared in Linux 5.6
+  std::vector<uint8_t> probe_data(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+  auto probe = reinterpret_cast<io_uring_probe *>(probe_data.data());
+  if (::syscall(__NR_io_uring_register, ring->fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+    return nullptr;
+  }
+  for (int op : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED }) {
+    if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+      return nullptr;
+    }
+  }
+
+  // Registered buffers save the kernel from pinning pages for each request
+  // It may fail because of RLIMIT_MEMLOCK, then the buffers are used for regular reads
+  ring->n_slots_ = std::min<size_t>(std::max<size_t>(params.queue_depth, 1), setup.sq_entries);
+  ring->buffer_size_ = std::max<size_t>(params.buffer_size, 4096);
+  ring->buffers_.reset(new uint8_t[ring->n_slots_ * ring->buffer_size_]);
+  std::vector<iovec> iovecs(ring->n_slots_);
+  for (size_t i = 0; i < ring->n_slots_; i++) {
+    iovecs[i].iov_base = ring->buffers_.get() + i * ring->buffer_size_;
+    iovecs[i].iov_len  = ring->buffer_size_;
+  }
+  ring->fixed_buffers_ = ::syscall(__NR_io_uring_register, ring->fd_, IORING_REGISTER_BUFFERS,
+                                   iovecs.data(), (unsigned)iovecs.size()) == 0;
+  return ring;
+}
+
+BatchReader::Ring::~Ring() {
+  if (sqes_ != MAP_FAILED) {
+    ::munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    ::munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+io_uring_sqe *BatchReader::Ring::NextSqe() {
+  // Each slot has at most one request in flight, so the queue cannot overflow
+  unsigned idx = sq_local_tail_ & sq_mask_;
+  auto sqe = static_cast<io_uring_sqe *>(sqes_) + idx;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  sq_local_tail_ += 1;
+  to_submit_ += 1;
+  return sqe;
+}
+
+int BatchReader::Ring::Enter(unsigned min_complete) {
+  __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+  while (true) {
+    int ret = (int)::syscall(__NR_io_uring_enter, fd_, to_submit_, min_complete,
+                             min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret > 0) {
+      to_submit_ -= std::min<unsigned>(to_submit_, (unsigned)ret);
+    }
+    return ret < 0 ? -errno : ret;
+  }
+}
+
+ErrHandle BatchReader::Ring::ReadAll(const std::vector<std::string> &files,
+                                     const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback) {
+  std::vector<Slot> slots(n_slots_);
+  std::vector<size_t> free_slots;
+  for (size_t i = n_slots_; i > 0; i--) {
+    free_slots.emplace_back(i - 1);
+  }
+
+  size_t next_file = 0, in_flight = 0;
+  ErrHandle err;
+  bool stop = false;
+
+  auto submit_read = [&](size_t idx) {
+    auto &slot = slots[idx];
+    auto sqe = NextSqe();
+    sqe->opcode    = slot.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd        = slot.fd;
+    sqe->addr      = (uint64_t)(uintptr_t)(slot.buffer + slot.offset);
+    sqe->len       = (uint32_t)std::min<size_t>(slot.size - slot.offset, 1 << 30);
+    sqe->off       = slot.offset;
+    sqe->buf_index = slot.fixed ? (uint16_t)idx : 0;
+    sqe->user_data = idx;
+    in_flight += 1;
+  };
+
+  // Whatever happens, the slot becomes free
+  auto &counters = ReadMetrics::Get();
+  auto release = [&](size_t idx) {
+    auto &slot = slots[idx];
+    counters.in_flight->Add(-1);
+    slot.busy = false;
+    if (slot.fd >= 0) {
+      ::close(slot.fd);
+      slot.fd = -1;
+    }
+    std::vector<uint8_t>().swap(slot.heap);
+    free_slots.emplace_back(idx);
+  };
+  auto fail = [&](size_t idx, const char *what, int code) {
+    if (!stop) {
+      err = SystemError(TEXEL_WHERE, what, files[slots[idx].file_idx], code);
+      stop = true;
+    }
+    release(idx);
+  };
+
+  auto on_completion = [&](size_t idx, int res) {
+    auto &slot = slots[idx];
+    if (slot.opening) {
+      slot.opening = false;
+      if (res < 0) {
+        fail(idx, "open", -res);
+        return;
+      }
+      slot.fd = res;
+      struct stat info;
+      if (::fstat(slot.fd, &info) != 0) {
+        fail(idx, "open", errno);
+        return;
+      }
+      if (stop) {
+        release(idx);
+        return;
+      }
+      slot.size = (size_t)info.st_size;
+      if (slot.size <= buffer_size_) {
+        slot.buffer = buffers_.get() + idx * buffer_size_;
+        slot.fixed  = fixed_buffers_;
+      }
+      else {
+        slot.heap.resize(slot.size);
+        slot.buffer = slot.heap.data();
+        slot.fixed  = false;
+      }
+      if (slot.size > 0) {
+        submit_read(idx);
+        return;
+      }
+    }
+    else {
+      if (res < 0) {
+        fail(idx, "read", -res);
+        return;
+      }
+      slot.offset += (size_t)res;
+      if (res > 0 && slot.offset < slot.size && !stop) {
+        submit_read(idx);
+        return;
+      }
+    }
+
+    // The whole file is in memory (or it was truncated while being read)
+    counters.files->Add(1);
+    counters.bytes->Add(slot.offset);
+    if (!stop) {
+      auto callback_err = callback(slot.file_idx, slot.buffer, slot.offset);
+      if (callback_err.Failed()) {
+        err = callback_err;
+        stop = true;
+      }
+    }
+    release(idx);
+  };
+
+  // Returns 'false' if some requests did not complete in time
+  auto drain = [&]() -> bool {
+    // Requests that the kernel has not consumed yet are simply taken back
+    unsigned sq_head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    for (unsigned i = sq_head; i != sq_local_tail_; i++) {
+      auto sqe = static_cast<io_uring_sqe *>(sqes_) + sq_array_[i & sq_mask_];
+      in_flight -= 1;
+      release((size_t)sqe->user_data);
+    }
+    sq_local_tail_ = sq_head;
+    to_submit_     = 0;
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    // The others are cancelled, the queue has room since each slot has at most one request
+    for (size_t idx = 0; idx < slots.size(); idx++) {
+      if (slots[idx].busy) {
+        auto sqe = NextSqe();
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = idx;
+        sqe->user_data = CancelTag;
+      }
+    }
+    Enter(0);
+
+    // Completions are posted even if 'io_uring_enter' keeps failing, so the queue is polled
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (in_flight > 0) {
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++) {
+        io_uring_cqe cqe = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        if (cqe.user_data == CancelTag) {
+          continue;
+        }
+        auto &slot = slots[(size_t)cqe.user_data];
+        if (slot.opening && cqe.res >= 0) {
+          slot.fd = cqe.res;
+        }
+        in_flight -= 1;
+        release((size_t)cqe.user_data);
+      }
+      if (in_flight > 0) {
+        if (std::chrono::steady_clock::now() > deadline) {
+          return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    return true;
+  };
+
+  while (true) {
+    while (!stop && !free_slots.empty() && next_file < files.size()) {
+      size_t idx = free_slots.back();
+      free_slots.pop_back();
+      auto &slot = slots[idx];
+      slot.file_idx = next_file++;
+      counters.in_flight->Add(1);
+      slot.busy     = true;
+      slot.fd       = -1;
+      slot.opening  = true;
+      slot.fixed    = false;
+      slot.buffer   = nullptr;
+      slot.size     = 0;
+      slot.offset   = 0;
+
+      auto sqe = NextSqe();
+      sqe->opcode     = IORING_OP_OPENAT;
+      sqe->fd         = AT_FDCWD;
+      sqe->addr       = (uint64_t)(uintptr_t)files[slot.file_idx].c_str();
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe->user_data  = idx;
+      in_flight += 1;
+    }
+    if (in_flight == 0) {
+      break;
+    }
+
+    int ret = Enter(1);
+    if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+      // The ring is broken, but requests in flight refer to the slots and to the names of the files,
+      // so they are taken back or cancelled and awaited before the function returns
+      broken_ = true;
+      idle_   = drain();
+      if (!idle_) {
+        // The kernel may still write into these buffers, so they live as long as the ring
+        for (auto &slot : slots) {
+          if (slot.busy) {
+            counters.in_flight->Add(-1);
+          }
+        }
+        abandoned_ = std::move(slots);
+      }
+      return err;
+    }
+
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      io_uring_cqe cqe = cqes_[head & cq_mask_];
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      in_flight -= 1;
+      on_completion((size_t)cqe.user_data, cqe.res);
+    }
+  }
+  return err;
+}
+
+#else
+
+// A stub for systems without io_uring
+class BatchReader::Ring { };
+
+#endif // TEXEL_IO_URING
+
+//-------------------
+//--- BatchReader ---
+//-------------------
+
+BatchReader::BatchReader(const batch_io::Params &params)
+  : params_(params) {
+#ifdef TEXEL_IO_URING
+  if (params.use_io_uring) {
+    ring_ = Ring::Create(params);
+  }
+#endif
+}
+
+BatchReader::~BatchReader() {
+  // nothing
+}
+
+batch_io::Backend BatchReader::Backend() const {
+  return ring_ != nullptr ? batch_io::Backend::IoUring : batch_io::Backend::ThreadPool;
+}
+
+ErrHandle BatchReader::ReadAll(const std::vector<std::string> &files,
+                               const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback) {
+#ifdef TEXEL_IO_URING
+  if (ring_ != nullptr) {
+    std::vector<bool> delivered(files.size(), false);
+    auto err = ring_->ReadAll(files, [&](size_t idx, const uint8_t *data, size_t size) {
+      delivered[idx] = true;
+      return callback(idx, data, size);
+    });
+    if (!ring_->Broken()) {
+      return err;
+    }
+
+    // This and later calls use the threads. If the kernel has not completed some requests, their buffers
+    // (including the registered ones) must stay valid, so the ring is never destroyed
+    if (!ring_->Idle()) {
+      ring_.release();
+    }
+    ring_.reset();
+    TEXEL_CHECK(err);
+
+    std::vector<std::string> rest;
+    std::vector<size_t> rest_idx;
+    for (size_t i = 0; i < files.size(); i++) {
+      if (!delivered[i]) {
+        rest.emplace_back(files[i]);
+        rest_idx.emplace_back(i);
+      }
+    }
+    return ReadWithThreads(rest, [&](size_t idx, const uint8_t *data, size_t size) {
+      return callback(rest_idx[idx], data, size);
+    });
+  }
+#endif
+  return ReadWithThreads(files, callback);
+}
+
+ErrHandle BatchReader::ReadWithThreads(const std::vector<std::string> &files,
+                                       const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback) {
+  // Blocking reads, so there are more threads than cores to keep the device busy
+  ThreadPool pool(std::max<size_t>(params_.n_threads, 1));
+  std::vector<std::vector<uint8_t> > buffers(pool.Concurrency());
+  std::mutex callback_mutex;
+  std::atomic<bool> failed(false);
+  ErrHandle read_err;
+  auto &counters = ReadMetrics::Get();
+  pool.ParallelFor(0, files.size(), 1, [&](size_t first, size_t last, size_t thread_idx) {
+    auto &buffer = buffers[thread_idx];
+    for (size_t i = first; i < last && !failed; i++) {
+      size_t size = 0;
+      counters.in_flight->Add(1);
+      auto err = ReadFile(files[i], buffer, size);
+      counters.in_flight->Add(-1);
+      if (err.Succeeded()) {
+        counters.files->Add(1);
+        counters.bytes->Add(size);
+      }
+
+      std::lock_guard<std::mutex> lock(callback_mutex);
+      if (failed) {
+        return;
+      }
+      if (err.Succeeded()) {
+        err = callback(i, buffer.data(), size);
+      }
+      if (err.Failed()) {
+        read_err = err;
+        failed = true;
+        return;
+      }
+    }
+  });
+  return read_err;
+}
+
+template <typename Frame>
+ErrHandle BatchReader::ReadFrames(const std::vector<std::string> &files,
+                                  const std::function<ErrHandle(const uint8_t *, size_t, Frame &)> &decode,
+                                  const std::function<ErrHandle(size_t, const Frame &)> &callback,
+                                  ThreadPool &pool) {
+  auto decode_file = [&](size_t idx, const uint8_t *data, size_t size, Frame &frame) -> ErrHandle {
+    auto err = decode(data, size, frame);
+    if (err.Failed()) {
+      return ErrHandle(TEXEL_WHERE, "failed to decode '" + files[idx] + "'", err);
+    }
+    return ErrHandle();
+  };
+
+  // The pool cannot take another job, so the frames are decoded in the serialized callback
+  if (ThreadPool::InsideJob() || pool.Concurrency() == 1) {
+    Frame frame;
+    return ReadAll(files, [&](size_t idx, const uint8_t *data, size_t size) -> ErrHandle {
+      TEXEL_CHECK(decode_file(idx, data, size, frame));
+      return callback(idx, frame);
+    });
+  }
+
+  // Encoded files wait in a ring, decoders swap the buffers with their own ones, so they are reused
+  struct Encoded {
+    size_t idx;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Encoded> ring(2 * pool.Concurrency());
+  size_t head = 0, count = 0;
+  bool reading = true, stop = false;
+  ErrHandle decode_err;
+  std::mutex mutex, callback_mutex;
+  std::condition_variable ready, room;
+
+  // The pool is fed from another thread, each of its threads decodes files until the ring is exhausted
+  auto decoders = std::async(std::launch::async, [&]() {
+    std::vector<Frame> frames(pool.Concurrency());
+    std::vector<std::vector<uint8_t> > buffers(pool.Concurrency());
+    pool.ParallelFor(0, pool.Concurrency(), 1, [&](size_t, size_t, size_t thread_idx) {
+      auto &buffer = buffers[thread_idx];
+      while (true) {
+        size_t idx = 0;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          ready.wait(lock, [&]() { return stop || count > 0 || !reading; });
+          if (stop || count == 0) {
+            return;
+          }
+          idx = ring[head].idx;
+          buffer.swap(ring[head].data);
+          head = (head + 1) % ring.size();
+          count -= 1;
+        }
+        room.notify_one();
+
+        auto err = decode_file(idx, buffer.data(), buffer.size(), frames[thread_idx]);
+        if (err.Succeeded()) {
+          std::lock_guard<std::mutex> lock(callback_mutex);
+          err = callback(idx, frames[thread_idx]);
+        }
+        if (err.Failed()) {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!stop) {
+              decode_err = err;
+              stop = true;
+            }
+          }
+          ready.notify_all();
+          room.notify_one();
+          return;
+        }
+      }
+    });
+  });
+
+  // Calls of the reading callback never overlap, so the slot after the queued ones belongs to it
+  auto read_err = ReadAll(files, [&](size_t idx, const uint8_t *data, size_t size) -> ErrHandle {
+    size_t slot = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      room.wait(lock, [&]() { return stop || count < ring.size(); });
+      if (stop) {
+        return ErrHandle(TEXEL_WHERE, "decoding stopped");
+      }
+      slot = (head + count) % ring.size();
+    }
+    ring[slot].idx = idx;
+    ring[slot].data.assign(data, data + size);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      count += 1;
+    }
+    ready.notify_one();
+    return ErrHandle();
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reading = false;
+    stop = stop || read_err.Failed();
+  }
+  ready.notify_all();
+  decoders.get();
+  TEXEL_CHECK(decode_err);
+  return read_err;
+}
+
+ErrHandle BatchReader::ReadDepthFrames(const std::vector<std::string> &files,
+                                       const std::function<ErrHandle(size_t, const DepthFrame &)> &callback,
+                                       ThreadPool &pool) {
+  return ReadFrames<DepthFrame>(files, [](const uint8_t *data, size_t size, DepthFrame &frame) {
+    return DepthFrame::Decode(data, size, frame);
+  }, callback, pool);
+}
+
+ErrHandle BatchReader::ReadColorFrames(const std::vector<std::string> &files,
+                                       const std::function<ErrHandle(size_t, const ColorFrame &)> &callback,
+                                       ThreadPool &pool) {
+  return ReadColorFrames(files, color_decode::Options(), callback, pool);
+}
+
+ErrHandle BatchReader::ReadColorFrames(const std::vector<std::string> &files, const color_decode::Options &options,
+                                       const std::function<ErrHandle(size_t, const ColorFrame &)> &callback,
+                                       ThreadPool &pool) {
+  return ReadFrames<ColorFrame>(files, [&options](const uint8_t *data, size_t size, ColorFrame &frame) {
+    return ColorFrame::Decode(data, size, options, frame);
+  }, callback, pool);
+}
+
+} // namespace texel
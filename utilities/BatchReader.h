@@ -0,0 +1,93 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+
+namespace texel {
+
+namespace batch_io {
+
+enum class Backend {
+  // Linux io_uring, opens and reads of many files are in flight at once
+  IoUring,
+
+  // Blocking 'open()' and 'pread()' calls from a few threads
+  ThreadPool
+};
+std::string ToUserFriendly(Backend backend);
+
+struct Params {
+  // If 'false' or the kernel does not support io_uring, the thread pool is used
+  bool use_io_uring;
+
+  // The number of files that are read at once
+  size_t queue_depth;
+
+  // Size of each pre-allocated (and registered) buffer, larger files get their own buffers
+  size_t buffer_size;
+
+  // Threads of the fallback backend
+  size_t n_threads;
+
+  Params()
+    : use_io_uring(true),
+      queue_depth(32),
+      buffer_size(2 << 20),
+      n_threads(8) {
+  }
+};
+
+} // namespace batch_io
+
+
+// Reads whole files (e.g. frames of a stream) keeping many requests in flight
+// It helps a lot if the page cache is cold, since NVMe drives need deep queues to reach their bandwidth
+class BatchReader {
+  public:
+    explicit BatchReader(const batch_io::Params &params = batch_io::Params());
+    BatchReader(const BatchReader &) = delete;
+    BatchReader &operator =(const BatchReader &) = delete;
+    ~BatchReader();
+
+    // Returns the backend that is actually used
+    batch_io::Backend Backend() const;
+
+    // Reads all files, 'callback(idx, data, size)' receives them in order of completion
+    // The calls never overlap, but they may come from different threads
+    // The data is valid only until the callback returns
+    // If io_uring fails in the middle, the files not passed to the callback yet are read by the threads
+    ErrHandle ReadAll(const std::vector<std::string> &files,
+                      const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback);
+
+    // Reads and decodes depth maps and color frames, the frames are valid until the callbacks return
+    // Frames are decoded concurrently on 'pool' while the next files are read, only the callbacks are
+    // serialized. They run on threads of the pool, so their own 'ParallelFor()' calls run inline
+    // Called from inside a job of any pool, the frames are decoded one by one
+    ErrHandle ReadDepthFrames(const std::vector<std::string> &files,
+                              const std::function<ErrHandle(size_t, const DepthFrame &)> &callback,
+                              ThreadPool &pool = ThreadPool::Default());
+    ErrHandle ReadColorFrames(const std::vector<std::string> &files,
+                              const std::function<ErrHandle(size_t, const ColorFrame &)> &callback,
+                              ThreadPool &pool = ThreadPool::Default());
+
+    // The same, but color frames are decoded at a reduced scale or only partially
+    ErrHandle ReadColorFrames(const std::vector<std::string> &files, const color_decode::Options &options,
+                              const std::function<ErrHandle(size_t, const ColorFrame &)> &callback,
+                              ThreadPool &pool = ThreadPool::Default());
+
+  private:
+    class Ring;
+
+    ErrHandle ReadWithThreads(const std::vector<std::string> &files,
+                              const std::function<ErrHandle(size_t, const uint8_t *, size_t)> &callback);
+
+    template <typename Frame>
+    ErrHandle ReadFrames(const std::vector<std::string> &files,
+                         const std::function<ErrHandle(const uint8_t *, size_t, Frame &)> &decode,
+                         const std::function<ErrHandle(size_t, const Frame &)> &callback, ThreadPool &pool);
+
+    batch_io::Params params_;
+    std::unique_ptr<Ring> ring_;
+};
+
+} // namespace texel
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <iomanip>
+#include "Frames.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+// Encoded frames are kept in memory, so the disk does not take part in the measurements
+struct Sample {
+  std::vector<std::vector<uint8_t> > files;
+  size_t compressed = 0;
+  Camera camera;
+};
+
+ErrHandle ReadFile(const std::string &filename, std::vector<uint8_t> &data) {
+  std::ifstream file(filename, std::ios::binary);
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  if (!file.good() && !file.eof()) {
+    return ErrHandle(TEXEL_WHERE, "failed to read '" + filename + "'");
+  }
+  return ErrHandle();
+}
+
+// Takes up to 'max_frames' depth maps and color frames, evenly from all streams
+ErrHandle CollectFrames(const std::string &dir, size_t max_frames, Sample &depth, Sample &color) {
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(dir));
+  std::unordered_set<std::string> visited;
+  std::vector<std::string> depth_files, color_files;
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    for (const auto &stage : info.scan.Stages()) {
+      for (const auto &stream : stage.Streams()) {
+        Camera camera;
+        std::string frame_dir;
+        std::vector<std::string> files;
+        if (stream.HasDepth(camera, frame_dir) && visited.insert(frame_dir).second &&
+            frames::ListFiles(frame_dir, ".png", files).Succeeded()) {
+          depth.camera = camera;
+          depth_files.insert(depth_files.end(), files.begin(), files.end());
+        }
+        if (stream.HasColor(camera, frame_dir) && visited.insert(frame_dir).second &&
+            frames::ListFiles(frame_dir, ".jpg", files).Succeeded()) {
+          color.camera = camera;
+          color_files.insert(color_files.end(), files.begin(), files.end());
+        }
+      }
+    }
+  }
+
+  for (auto sample : { std::make_pair(&depth, &depth_files), std::make_pair(&color, &color_files) }) {
+    const auto &files = *sample.second;
+    size_t n = std::min(files.size(), max_frames);
+    sample.first->files.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      TEXEL_CHECK(ReadFile(files[i * files.size() / n], sample.first->files[i]));
+      sample.first->compressed += sample.first->files[i].size();
+    }
+  }
+  return ErrHandle();
+}
+
+void PrintResult(const std::string &name, size_t n_frames, size_t decoded_bytes, size_t compressed_bytes,
+                 double seconds, double baseline) {
+  std::cout << "  " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(8) << seconds * 1000.0 / n_frames << " ms/frame, "
+            << std::setw(8) << std::setprecision(1) << n_frames / seconds << " frames/s, "
+            << std::setw(7) << std::setprecision(0) << decoded_bytes / seconds / (1 << 20) << " MB/s decoded, "
+            << std::setw(6) << compressed_bytes / seconds / (1 << 20) << " MB/s compressed";
+  if (baseline > 0.0) {
+    std::cout << ", x" << std::setprecision(2) << baseline / seconds;
+  }
+  std::cout << std::endl;
+}
+
+// Decodes all frames a few times and returns the best time of a pass
+template <typename Decode>
+ErrHandle Measure(const Sample &sample, size_t n_passes, Decode decode, double &seconds, size_t &decoded_bytes) {
+  seconds = std::numeric_limits<double>::max();
+  for (size_t pass = 0; pass < n_passes; pass++) {
+    decoded_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sample.files.size(); i++) {
+      size_t bytes = 0;
+      TEXEL_CHECK(decode(i, bytes));
+      decoded_bytes += bytes;
+    }
+    seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return ErrHandle();
+}
+
+ErrHandle BenchmarkDepth(const Sample &sample, size_t n_passes, size_t &n_mismatches) {
+  std::cout << std::endl << "Depth maps (" << sample.files.size() << " PNG files, single thread):" << std::endl;
+  DepthFrame frame(sample.camera), reference(sample.camera);
+  double libpng_seconds = 0.0, fast_seconds = 0.0;
+  size_t decoded_bytes = 0;
+  TEXEL_CHECK(Measure(sample, n_passes, [&](size_t i, size_t &bytes) -> ErrHandle {
+    TEXEL_CHECK(DepthFrame::Decode(sample.files[i].data(), sample.files[i].size(),
+                                   depth_decode::Decoder::Libpng, frame));
+    bytes = frame.Width() * frame.Height() * sizeof(uint16_t);
+    return ErrHandle();
+  }, libpng_seconds, decoded_bytes));
+  PrintResult("libpng", sample.files.size(), decoded_bytes, sample.compressed, libpng_seconds, 0.0);
+  TEXEL_CHECK(Measure(sample, n_passes, [&](size_t i, size_t &bytes) -> ErrHandle {
+    TEXEL_CHECK(DepthFrame::Decode(sample.files[i].data(), sample.files[i].size(),
+                                   depth_decode::Decoder::Fast, frame));
+    bytes = frame.Width() * frame.Height() * sizeof(uint16_t);
+    return ErrHandle();
+  }, fast_seconds, decoded_bytes));
+  PrintResult("fast", sample.files.size(), decoded_bytes, sample.compressed, fast_seconds, libpng_seconds);
+
+  // Both decoders must give the same values
+  n_mismatches = 0;
+  for (const auto &file : sample.files) {
+    TEXEL_CHECK(DepthFrame::Decode(file.data(), file.size(), depth_decode::Decoder::Libpng, reference));
+    TEXEL_CHECK(DepthFrame::Decode(file.data(), file.size(), depth_decode::Decoder::Fast, frame));
+    if (frame.Width() != reference.Width() || frame.Height() != reference.Height() ||
+        !std::equal(frame.Data(), frame.Data() + frame.Width() * frame.Height(), reference.Data())) {
+      n_mismatches += 1;
+    }
+  }
+  if (n_mismatches > 0) {
+    std::cout << "  The decoders disagree on " << n_mismatches << " frames" << std::endl;
+  }
+  return ErrHandle();
+}
+
+ErrHandle BenchmarkColor(const Sample &sample, size_t n_passes) {
+  std::cout << std::endl << "Color frames (" << sample.files.size() << " JPEG files, single thread):" << std::endl;
+  ColorFrame frame;
+  double full_seconds = 0.0;
+  for (unsigned scale : { 8u, 4u, 2u, 1u }) {
+    color_decode::Options options;
+    options.scale = scale;
+    double seconds = 0.0;
+    size_t decoded_bytes = 0;
+    TEXEL_CHECK(Measure(sample, n_passes, [&](size_t i, size_t &bytes) -> ErrHandle {
+      TEXEL_CHECK(ColorFrame::Decode(sample.files[i].data(), sample.files[i].size(), options, frame));
+      bytes = frame.Width() * frame.Height() * ColorFrame::Channels;
+      return ErrHandle();
+    }, seconds, decoded_bytes));
+    if (scale == 8) {
+      full_seconds = seconds;
+    }
+    PrintResult("scale " + std::to_string(scale) + "/8", sample.files.size(), decoded_bytes, sample.compressed,
+                seconds, scale == 8 ? 0.0 : full_seconds);
+  }
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Wrong arguments, use as './BenchmarkDecoding <path_to_directory_with_scans> [<max_frames>]'"
+              << std::endl;
+    return 1;
+  }
+  std::string dir(argv[1]);
+  size_t max_frames = argc == 3 ? std::strtoul(argv[2], nullptr, 10) : 200;
+  const size_t n_passes = 3;
+
+  Sample depth, color;
+  auto err = CollectFrames(dir, max_frames, depth, color);
+  size_t n_mismatches = 0;
+  if (err.Succeeded() && !depth.files.empty()) {
+    err = BenchmarkDepth(depth, n_passes, n_mismatches);
+  }
+  if (err.Succeeded() && !color.files.empty()) {
+    err = BenchmarkColor(color, n_passes);
+  }
+  if (err.Failed()) {
+    std::cerr << "Failed to benchmark decoding of frames from the '" << dir << "' directory:" << std::endl;
+    std::cerr << err.Message();
+    return 1;
+  }
+  if (depth.files.empty() && color.files.empty()) {
+    std::cout << "No frames found" << std::endl;
+  }
+  return n_mismatches > 0 ? 2 : 0;
+}
@@ -0,0 +1,61 @@
+#include "ColorReader.h"
+
+namespace texel {
+
+//-------------------
+//--- ColorReader ---
+//-------------------
+
+ColorReader::ColorReader(const color_reader::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool) {
+  if (params_.batch_size == 0) {
+    params_.batch_size = pool_.Concurrency() * 2;
+  }
+}
+
+ErrHandle ColorReader::Bind(const scanogram::Stream &stream) {
+  files_.clear();
+  Camera camera;
+  std::string dir;
+  if (!stream.HasColor(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain color frames");
+  }
+  if (!color_decode::Plan(camera.Width(), camera.Height(), params_.decode, layout_)) {
+    std::ostringstream oss;
+    oss << "the region of interest is outside the " << camera.Width() << "x" << camera.Height() << " frames";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  camera_ = color_decode::AdjustCamera(camera, layout_);
+  TEXEL_CHECK(frames::ListFiles(dir, ".jpg", files_));
+  return ErrHandle();
+}
+
+ErrHandle ColorReader::Read(size_t idx, ColorFrame &frame) const {
+  color_decode::Layout layout;
+  TEXEL_CHECK(ColorFrame::Load(files_[idx], params_.decode, frame, &layout));
+  if (layout.full_width != layout_.full_width || layout.full_height != layout_.full_height) {
+    std::ostringstream oss;
+    oss << "the color frame '" << files_[idx] << "' is " << layout.full_width << "x" << layout.full_height
+        << ", but the camera expects " << layout_.full_width << "x" << layout_.full_height;
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  return ErrHandle();
+}
+
+ErrHandle ColorReader::ReadAll(const std::function<ErrHandle(size_t, const ColorFrame &)> &callback) const {
+  std::vector<ColorFrame> frames(std::min(params_.batch_size, files_.size()));
+  std::vector<ErrHandle> errors(frames.size());
+  for (size_t first = 0; first < files_.size(); first += frames.size()) {
+    size_t n = std::min(frames.size(), files_.size() - first);
+    pool_.ParallelFor(0, n, [&](size_t slot) {
+      errors[slot] = Read(first + slot, frames[slot]);
+    });
+    for (size_t slot = 0; slot < n; slot++) {
+      TEXEL_CHECK(errors[slot]);
+      TEXEL_CHECK(callback(first + slot, frames[slot]));
+    }
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,68 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace color_reader {
+
+struct Params {
+  // The scale and the region of the decoded frames, see 'color_decode::Options'
+  color_decode::Options decode;
+
+  // Frames that are decoded at once, zero means twice the concurrency of the pool
+  size_t batch_size;
+
+  Params() : batch_size(0) { }
+};
+
+} // namespace color_reader
+
+
+// Reads color frames of a stream at the requested scale (e.g. 1/2, 1/4 or close to the depth resolution)
+// JPEG frames are scaled while decoding, so the cost drops with the number of output pixels,
+// unlike decoding at full resolution and resizing afterwards
+// All frames of a stream are expected to have the size given by the camera, the intrinsics are
+// adjusted for the decoded frames once
+//
+// Usage:
+//   color_reader::Params params;
+//   params.decode.scale = 2;    // 1/4
+//   ColorReader reader(params);
+//   TEXEL_CHECK(reader.Bind(stream));
+//   TEXEL_CHECK(reader.ReadAll([&](size_t idx, const ColorFrame &frame) { ... }));
+class ColorReader {
+  public:
+    explicit ColorReader(const color_reader::Params &params = color_reader::Params(),
+                         ThreadPool &pool = ThreadPool::Default());
+    ColorReader(const ColorReader &) = delete;
+    ColorReader &operator =(const ColorReader &) = delete;
+
+    // Lists color frames of the stream
+    ErrHandle Bind(const scanogram::Stream &stream);
+
+    // Intrinsics of the decoded frames and how they relate to the full-resolution ones
+    const Camera &ColorCamera() const { return camera_; }
+    const color_decode::Layout &Layout() const { return layout_; }
+
+    const std::vector<std::string> &Files() const { return files_; }
+
+    // Decodes the frame 'idx', fails if its size differs from the camera one
+    ErrHandle Read(size_t idx, ColorFrame &frame) const;
+
+    // Decodes all frames on the pool batch by batch, 'callback(idx, frame)' receives them in order
+    // The frame is valid until the callback returns
+    ErrHandle ReadAll(const std::function<ErrHandle(size_t, const ColorFrame &)> &callback) const;
+
+  private:
+    color_reader::Params params_;
+    ThreadPool &pool_;
+
+    Camera camera_;
+    color_decode::Layout layout_;
+    std::vector<std::string> files_;
+};
+
+} // namespace texel
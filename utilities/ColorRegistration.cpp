@@ -0,0 +1,262 @@
+#include "ColorRegistration.h"
+#include "FramePairs.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+using simd::Float4;
+
+// Everything that is needed to map depth pixels into a color frame of the given size
+struct Mapping {
+  float depth_cx, depth_cy, depth_inv_fx, depth_inv_fy;
+  float color_cx, color_cy, color_fx, color_fy;
+  float max_u, max_v;
+  float min_depth, max_depth;
+  RigidTransform depth_to_color;
+};
+
+Mapping MakeMapping(const Camera &depth_camera, const Camera &color_camera,
+                    size_t color_width, size_t color_height,
+                    const color_registration::Params &params,
+                    const RigidTransform &depth_to_color) {
+  // The color frame may be decoded at a lower resolution
+  float sx = (float)color_width / (float)color_camera.Width();
+  float sy = (float)color_height / (float)color_camera.Height();
+
+  Mapping m;
+  m.depth_cx = depth_camera.Cx();
+  m.depth_cy = depth_camera.Cy();
+  m.depth_inv_fx = 1.0f / depth_camera.Fx();
+  m.depth_inv_fy = 1.0f / depth_camera.Fy();
+  m.color_cx = (color_camera.Cx() + 0.5f) * sx - 0.5f;
+  m.color_cy = (color_camera.Cy() + 0.5f) * sy - 0.5f;
+  m.color_fx = color_camera.Fx() * sx;
+  m.color_fy = color_camera.Fy() * sy;
+  m.max_u = (float)color_width - 1.0f;
+  m.max_v = (float)color_height - 1.0f;
+  m.min_depth = params.min_depth;
+  m.max_depth = params.max_depth;
+  m.depth_to_color = depth_to_color;
+  return m;
+}
+
+// Computes color coordinates ('u', 'v') and depth in the color camera space ('z', optional)
+// for rows [first, last), unmapped pixels get negative values
+void MapRows(const Mapping &m, const DepthFrame &depth,
+             float *u, float *v, float *z,
+             size_t first, size_t last) {
+  const auto &rot = m.depth_to_color.Rotation();
+  const auto &off = m.depth_to_color.Offset();
+  const Float4 r00(rot[0].x), r01(rot[1].x), r02(rot[2].x);
+  const Float4 r10(rot[0].y), r11(rot[1].y), r12(rot[2].y);
+  const Float4 r20(rot[0].z), r21(rot[1].z), r22(rot[2].z);
+  const Float4 tx(off.x), ty(off.y), tz(off.z);
+  const Float4 scale(DepthFrame::Scale), zero(0.0f), one(1.0f), invalid(-1.0f);
+  const Float4 min_depth(m.min_depth), max_depth(m.max_depth);
+  const Float4 cx(m.color_cx), cy(m.color_cy), fx(m.color_fx), fy(m.color_fy);
+  const Float4 max_u(m.max_u), max_v(m.max_v);
+  const Float4 lane(0.0f, 1.0f, 2.0f, 3.0f);
+  const Float4 depth_cx(m.depth_cx), depth_inv_fx(m.depth_inv_fx);
+  const size_t width = depth.Width();
+
+  for (size_t row = first; row < last; row++) {
+    const uint16_t *src = depth.Row(row);
+    const size_t offset = row * width;
+    const Float4 ray_y(((float)row - m.depth_cy) * m.depth_inv_fy);
+    uint16_t tail[Float4::Width];
+    for (size_t x = 0; x < width; x += Float4::Width) {
+      const size_t lanes = std::min(Float4::Width, width - x);
+      const uint16_t *values = src + x;
+      if (lanes < Float4::Width) {
+        std::fill(tail, tail + Float4::Width, 0);
+        std::memcpy(tail, src + x, lanes * sizeof(uint16_t));
+        values = tail;
+      }
+
+      // Back-project depth pixels and move them into the color camera space
+      Float4 d = Float4::FromUInt16(values) * scale;
+      Float4 valid = (d >= min_depth) & (d <= max_depth);
+      Float4 px = (Float4((float)x) + lane - depth_cx) * depth_inv_fx * d;
+      Float4 py = ray_y * d;
+      Float4 qx = r00 * px + r01 * py + r02 * d + tx;
+      Float4 qy = r10 * px + r11 * py + r12 * d + ty;
+      Float4 qz = r20 * px + r21 * py + r22 * d + tz;
+      valid = valid & (qz > zero);
+
+      // Project onto the color frame
+      Float4 inv_z = one / Select(valid, qz, one);
+      Float4 cu = fx * qx * inv_z + cx;
+      Float4 cv = fy * qy * inv_z + cy;
+      valid = valid & (cu >= zero) & (cu <= max_u) & (cv >= zero) & (cv <= max_v);
+
+      float out_u[Float4::Width], out_v[Float4::Width], out_z[Float4::Width];
+      Select(valid, cu, invalid).Store(out_u);
+      Select(valid, cv, invalid).Store(out_v);
+      Select(valid, qz, invalid).Store(out_z);
+      std::memcpy(u + offset + x, out_u, lanes * sizeof(float));
+      std::memcpy(v + offset + x, out_v, lanes * sizeof(float));
+      if (z != nullptr) {
+        std::memcpy(z + offset + x, out_z, lanes * sizeof(float));
+      }
+    }
+  }
+}
+
+// The occlusion test uses a coarse z-buffer, each cell covers a few color pixels
+constexpr size_t ZBufferCell = 4;
+
+// Positive floats preserve their order if compared as integers
+uint32_t FloatBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+} // unnamed namespace
+
+//-------------------------
+//--- ColorRegistration ---
+//-------------------------
+
+ColorRegistration::ColorRegistration(const Camera &depth_camera,
+                                     const Camera &color_camera,
+                                     const color_registration::Params &params,
+                                     ThreadPool &pool)
+  : depth_camera_(depth_camera), color_camera_(color_camera),
+    params_(params), pool_(pool),
+    depth_to_color_(geometry::ViewerToCamera(color_camera) *
+                    geometry::CameraToViewer(depth_camera)) {
+  // nothing
+}
+
+void ColorRegistration::MapDepthToColor(const DepthFrame &depth,
+                                        size_t color_width, size_t color_height,
+                                        std::vector<float> &u, std::vector<float> &v) const {
+  auto mapping = MakeMapping(depth_camera_, color_camera_, color_width, color_height,
+                             params_, depth_to_color_);
+  u.resize(depth.Width() * depth.Height());
+  v.resize(depth.Width() * depth.Height());
+  pool_.ParallelFor(0, depth.Height(), 16, [&](size_t first, size_t last, size_t) {
+    MapRows(mapping, depth, u.data(), v.data(), nullptr, first, last);
+  });
+}
+
+ErrHandle ColorRegistration::ResampleColor(const DepthFrame &depth, const ColorFrame &color,
+                                           ColorFrame &registered,
+                                           std::vector<uint8_t> *colored) const {
+  if (depth.Width() != depth_camera_.Width() || depth.Height() != depth_camera_.Height()) {
+    std::ostringstream oss;
+    oss << "size of the depth frame (" << depth.Width() << "x" << depth.Height() << ") "
+        << "does not match the camera (" << depth_camera_.Width() << "x" << depth_camera_.Height() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  if (color.Empty()) {
+    return ErrHandle(TEXEL_WHERE, "the color frame is empty");
+  }
+
+  const size_t width = depth.Width(), height = depth.Height();
+  const size_t n_pixels = width * height;
+  auto mapping = MakeMapping(depth_camera_, color_camera_, color.Width(), color.Height(),
+                             params_, depth_to_color_);
+  std::vector<float> u(n_pixels), v(n_pixels), z(n_pixels);
+  pool_.ParallelFor(0, height, 16, [&](size_t first, size_t last, size_t) {
+    MapRows(mapping, depth, u.data(), v.data(), z.data(), first, last);
+  });
+
+  // Splat the nearest surface into the z-buffer
+  const size_t zb_width  = (color.Width() + ZBufferCell - 1) / ZBufferCell;
+  const size_t zb_height = (color.Height() + ZBufferCell - 1) / ZBufferCell;
+  std::unique_ptr<std::atomic<uint32_t>[]> zbuffer;
+  if (params_.check_occlusions) {
+    zbuffer.reset(new std::atomic<uint32_t>[zb_width * zb_height]);
+    const uint32_t far_bits = FloatBits(std::numeric_limits<float>::max());
+    for (size_t i = 0; i < zb_width * zb_height; i++) {
+      zbuffer[i].store(far_bits, std::memory_order_relaxed);
+    }
+    pool_.ParallelFor(0, height, 16, [&](size_t first, size_t last, size_t) {
+      for (size_t i = first * width; i < last * width; i++) {
+        if (z[i] <= 0.0f) {
+          continue;
+        }
+        size_t cell = (size_t)v[i] / ZBufferCell * zb_width + (size_t)u[i] / ZBufferCell;
+        uint32_t bits = FloatBits(z[i]);
+        uint32_t prev = zbuffer[cell].load(std::memory_order_relaxed);
+        while (bits < prev &&
+               !zbuffer[cell].compare_exchange_weak(prev, bits, std::memory_order_relaxed)) {
+        }
+      }
+    });
+  }
+
+  // Bilinear sampling of the visible pixels
+  registered.Resize(width, height);
+  if (colored != nullptr) {
+    colored->assign(n_pixels, 0);
+  }
+  const float margin = params_.occlusion_margin;
+  pool_.ParallelFor(0, height, 16, [&](size_t first, size_t last, size_t) {
+    for (size_t i = first * width; i < last * width; i++) {
+      uint8_t *dst = registered.Data() + i * ColorFrame::Channels;
+      bool visible = z[i] > 0.0f;
+      if (visible && zbuffer != nullptr) {
+        size_t cell = (size_t)v[i] / ZBufferCell * zb_width + (size_t)u[i] / ZBufferCell;
+        uint32_t nearest = zbuffer[cell].load(std::memory_order_relaxed);
+        float nearest_z;
+        std::memcpy(&nearest_z, &nearest, sizeof(nearest_z));
+        visible = z[i] <= nearest_z + margin;
+      }
+      if (!visible) {
+        dst[0] = dst[1] = dst[2] = 0;
+        continue;
+      }
+
+      size_t x0 = (size_t)u[i], y0 = (size_t)v[i];
+      size_t x1 = std::min(x0 + 1, color.Width() - 1), y1 = std::min(y0 + 1, color.Height() - 1);
+      float ax = u[i] - (float)x0, ay = v[i] - (float)y0;
+      const uint8_t *p00 = color.Row(y0) + x0 * ColorFrame::Channels;
+      const uint8_t *p01 = color.Row(y0) + x1 * ColorFrame::Channels;
+      const uint8_t *p10 = color.Row(y1) + x0 * ColorFrame::Channels;
+      const uint8_t *p11 = color.Row(y1) + x1 * ColorFrame::Channels;
+      for (size_t c = 0; c < ColorFrame::Channels; c++) {
+        float top    = p00[c] + (p01[c] - p00[c]) * ax;
+        float bottom = p10[c] + (p11[c] - p10[c]) * ax;
+        dst[c] = (uint8_t)(top + (bottom - top) * ay + 0.5f);
+      }
+      if (colored != nullptr) {
+        (*colored)[i] = 1;
+      }
+    }
+  });
+  return ErrHandle();
+}
+
+ErrHandle ColorRegistration::RegisterStream(const scanogram::Stream &stream,
+                                            const color_registration::Params &params,
+                                            const std::function<ErrHandle(size_t, const DepthFrame &,
+                                                                          const ColorFrame &)> &callback) {
+  // Depth pixels are sparser than color ones, so decoding the color at full resolution is wasted
+  frame_pairs::Params pairs_params;
+  Camera depth_camera, color_camera;
+  if (params.downscale_color && stream.HasDepth(depth_camera) && stream.HasColor(color_camera) &&
+      color_camera.Fx() > 0.0f && color_camera.Fy() > 0.0f) {
+    pairs_params.color.min_width = (size_t)std::ceil(color_camera.Width() * depth_camera.Fx() / color_camera.Fx());
+    pairs_params.color.min_height = (size_t)std::ceil(color_camera.Height() * depth_camera.Fy() / color_camera.Fy());
+  }
+
+  // The next pairs are decoded by threads of 'FramePairs' while the current one is registered on the shared pool
+  FramePairs pairs(pairs_params);
+  TEXEL_CHECK(pairs.Bind(stream));
+
+  ColorRegistration registration(pairs.DepthCamera(), pairs.ColorCamera(), params, ThreadPool::Default());
+  ColorFrame registered;
+  while (pairs.FindNext()) {
+    TEXEL_CHECK(registration.ResampleColor(pairs.Depth(), pairs.Color(), registered));
+    TEXEL_CHECK(callback(pairs.Current().depth_idx, pairs.Depth(), registered));
+  }
+  TEXEL_CHECK(pairs.Error());
+  return ErrHandle();
+}
+
+} // namespace texel
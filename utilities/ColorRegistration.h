@@ -0,0 +1,80 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace color_registration {
+
+// Parameters of the color-to-depth registration
+struct Params {
+  // Depth values outside this range are ignored (in meters)
+  float min_depth, max_depth;
+
+  // If 'true', depth pixels hidden from the color camera by closer surfaces are not colored
+  bool check_occlusions;
+
+  // Points that are farther than this distance from the visible surface are occluded (in meters)
+  float occlusion_margin;
+
+  // If 'true', 'RegisterStream()' decodes color frames at the lowest scale that still samples
+  // the scene at least as densely as the depth maps
+  bool downscale_color;
+
+  Params()
+    : min_depth(0.2f), max_depth(5.0f),
+      check_occlusions(true),
+      occlusion_margin(0.02f),
+      downscale_color(true) {
+  }
+};
+
+} // namespace color_registration
+
+
+// Aligns color frames with depth frames recorded by the same sensor
+// Uses intrinsics of both cameras and their relative position given by extrinsics
+class ColorRegistration {
+  public:
+    ColorRegistration(const Camera &depth_camera,
+                      const Camera &color_camera,
+                      const color_registration::Params &params = color_registration::Params(),
+                      ThreadPool &pool = ThreadPool::Default());
+    ColorRegistration(const ColorRegistration &) = delete;
+    ColorRegistration &operator =(const ColorRegistration &) = delete;
+
+    // Maps points of the depth camera space into the color camera space
+    const RigidTransform &DepthToColor() const { return depth_to_color_; }
+
+    // For each depth pixel, computes its position in the color frame of the given size
+    // The color frame may be downscaled, intrinsics are scaled accordingly
+    // Pixels without depth or outside the color frame get negative coordinates
+    void MapDepthToColor(const DepthFrame &depth,
+                         size_t color_width, size_t color_height,
+                         std::vector<float> &u, std::vector<float> &v) const;
+
+    // Resamples the color frame into the depth resolution (bilinear interpolation)
+    // Pixels that have no depth, are not seen by the color camera or are occluded become black
+    // 'colored' (optional) receives 1 for colored pixels and 0 otherwise
+    ErrHandle ResampleColor(const DepthFrame &depth, const ColorFrame &color,
+                            ColorFrame &registered,
+                            std::vector<uint8_t> *colored = nullptr) const;
+
+    // Produces RGB-D pairs for all frames of the stream that have both depth and color
+    // 'callback(depth_idx, depth, registered_color)' receives frames in order
+    static ErrHandle RegisterStream(const scanogram::Stream &stream,
+                                    const color_registration::Params &params,
+                                    const std::function<ErrHandle(size_t, const DepthFrame &,
+                                                                  const ColorFrame &)> &callback);
+
+  private:
+    Camera depth_camera_, color_camera_;
+    color_registration::Params params_;
+    ThreadPool &pool_;
+    RigidTransform depth_to_color_;
+};
+
+} // namespace texel
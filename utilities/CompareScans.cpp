@@ -0,0 +1,182 @@
+#include <future>
+#include <iostream>
+#include "Mesh.h"
+#include "MeshDistance.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+// Portal MX is compared with Free Fusion only if so many of its vertices lie on it after the alignment
+constexpr float MinInliers = 0.5f;
+
+// Both scanners store their meshes next to the scan annotations, the meshes are converted into meters
+struct MeshPair {
+  std::filesystem::path dir;
+  Mesh free_fusion, portal_mx;
+  ErrHandle err;
+};
+
+MeshPair LoadMeshes(const std::filesystem::path &dir) {
+  MeshPair pair;
+  pair.dir = dir;
+  auto ff_path = dir / "free_fusion" / "scan.ply";
+  auto mx_path = dir / "portal_mx" / "scan.ply";
+  if (!std::filesystem::is_regular_file(ff_path) || !std::filesystem::is_regular_file(mx_path)) {
+    pair.err = ErrHandle(TEXEL_WHERE, "no meshes from Free Fusion and Portal MX");
+    return pair;
+  }
+
+  pair.err = Mesh::Load(ff_path.string(), pair.free_fusion);
+  if (pair.err.Succeeded()) {
+    pair.err = Mesh::Load(mx_path.string(), pair.portal_mx);
+  }
+  if (pair.err.Succeeded()) {
+    for (auto *mesh : { &pair.free_fusion, &pair.portal_mx }) {
+      float scale = mesh->GuessScale();
+      for (auto &vertex : mesh->Vertices()) {
+        vertex *= scale;
+      }
+    }
+  }
+  return pair;
+}
+
+// Scanners have their own coordinate systems, so Portal MX is moved onto Free Fusion
+// The bounding boxes give the starting pose, ICP refines it
+ErrHandle AlignMeshes(MeshPair &meshes, mesh_distance::Alignment &alignment) {
+  MeshDistance surface(meshes.free_fusion);
+  if (surface.Empty()) {
+    return ErrHandle(TEXEL_WHERE, "the Free Fusion mesh has no non-degenerate triangles");
+  }
+  auto &vertices = meshes.portal_mx.Vertices();
+  alignment = surface.Align(vertices, surface.CoarseGuess(vertices));
+  if (alignment.inliers < MinInliers) {
+    std::ostringstream oss;
+    oss << "failed to align Portal MX with Free Fusion (" << alignment.inliers * 100.0f << "% of "
+        << vertices.size() << " vertices lie on it)";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  for (auto &vertex : vertices) {
+    vertex = alignment.pose.Apply(vertex);
+  }
+  return ErrHandle();
+}
+
+// Per-vertex errors are stored as raw 32-bit floats (native byte order), one value per vertex
+ErrHandle SaveErrors(const std::filesystem::path &filename, const std::vector<float> &errors) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(errors.data()), (std::streamsize)(errors.size() * sizeof(float)));
+  if (!file) {
+    std::ostringstream oss;
+    oss << "failed to write per-vertex errors into '" << filename.string() << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  return ErrHandle();
+}
+
+void PrintStats(const char *title, const mesh_distance::Stats &stats) {
+  std::cout << "  " << title << " (" << stats.count << " vertices): "
+            << "mean " << stats.mean << ", rms " << stats.rms << ", median " << stats.median
+            << ", p95 " << stats.p95 << ", max " << stats.max << std::endl;
+}
+
+ErrHandle CompareScans(const std::filesystem::path &dir, const std::filesystem::path &output,
+                       size_t &n_compared, size_t &n_skipped) {
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(dir.string()));
+
+  // Persons may have a few scans, but only one pair of meshes
+  std::vector<std::pair<std::filesystem::path, std::vector<std::string> > > persons;
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    auto person_dir = std::filesystem::path(info.path).parent_path();
+    if (persons.empty() || persons.back().first != person_dir) {
+      persons.emplace_back(person_dir, std::vector<std::string>());
+    }
+    persons.back().second.emplace_back(info.id);
+  }
+
+  std::ofstream summary;
+  if (!output.empty()) {
+    std::filesystem::create_directories(output);
+    summary.open(output / "summary.csv");
+    if (!summary) {
+      return ErrHandle(TEXEL_WHERE, "failed to create 'summary.csv' in the output directory");
+    }
+    summary << "id,ff_vertices,mx_vertices,ff_to_mx_mean,ff_to_mx_rms,ff_to_mx_p95,ff_to_mx_max,"
+               "mx_to_ff_mean,mx_to_ff_rms,mx_to_ff_p95,mx_to_ff_max,chamfer,hausdorff" << std::endl;
+  }
+
+  // Meshes of the next person are parsed while the current ones are compared
+  std::future<MeshPair> next;
+  if (!persons.empty()) {
+    next = std::async(std::launch::async, LoadMeshes, persons[0].first);
+  }
+  for (size_t i = 0; i < persons.size(); i++) {
+    auto meshes = next.get();
+    if (i + 1 < persons.size()) {
+      next = std::async(std::launch::async, LoadMeshes, persons[i + 1].first);
+    }
+    const auto &ids = persons[i].second;
+
+    mesh_distance::Alignment alignment;
+    mesh_distance::Comparison cmp;
+    auto err = meshes.err;
+    if (err.Succeeded()) {
+      err = AlignMeshes(meshes, alignment);
+    }
+    if (err.Succeeded()) {
+      err = MeshDistance::Compare(meshes.free_fusion, meshes.portal_mx, cmp);
+    }
+    if (err.Failed()) {
+      std::cout << std::endl << "'" << ids[0] << "': skipped" << std::endl << err.Message() << std::endl;
+      n_skipped += ids.size();
+      continue;
+    }
+
+    std::cout << std::endl;
+    for (const auto &id : ids) {
+      std::cout << "'" << id << "':" << std::endl;
+    }
+    std::cout << "  Aligned with rmse " << alignment.rmse << " m, " << alignment.inliers * 100.0f
+              << "% inliers" << std::endl;
+    PrintStats("Free Fusion -> Portal MX", cmp.forward);
+    PrintStats("Portal MX -> Free Fusion", cmp.backward);
+    std::cout << "  Chamfer " << cmp.chamfer << ", Hausdorff " << cmp.hausdorff << std::endl;
+    n_compared += ids.size();
+
+    if (!output.empty()) {
+      TEXEL_CHECK(SaveErrors(output / (ids[0] + ".free_fusion.f32"), cmp.forward_errors));
+      TEXEL_CHECK(SaveErrors(output / (ids[0] + ".portal_mx.f32"), cmp.backward_errors));
+      for (const auto &id : ids) {
+        summary << id << "," << cmp.forward.count << "," << cmp.backward.count << ","
+                << cmp.forward.mean << "," << cmp.forward.rms << "," << cmp.forward.p95 << ","
+                << cmp.forward.max << "," << cmp.backward.mean << "," << cmp.backward.rms << ","
+                << cmp.backward.p95 << "," << cmp.backward.max << ","
+                << cmp.chamfer << "," << cmp.hausdorff << std::endl;
+      }
+    }
+  }
+
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Wrong arguments, use as './CompareScans <path_to_directory_with_scans> [<output_directory>]'"
+              << std::endl;
+    return 0;
+  }
+  std::filesystem::path dir(argv[1]);
+  std::filesystem::path output(argc == 3 ? argv[2] : "");
+
+  size_t n_compared{}, n_skipped{};
+  auto err = CompareScans(dir, output, n_compared, n_skipped);
+  if (err.Failed()) {
+    std::cerr << "Failed to compare scans from the '" << dir.string() << "' directory:" << std::endl;
+    std::cerr << err.Message();
+  }
+  std::cout << std::endl << "Compared " << n_compared << " scans ("
+            << n_skipped << " skipped)" << std::endl;
+  return 0;
+}
@@ -11,23 +11,31 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <cctype>
+#include <charconv>
 #include <cstring>
 #include <cstdio>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <filesystem>
 #include <functional>
 #include <fstream>
+#include <future>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <limits>
 #include <list>
 #include <map>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <stdint.h>
 #include <thread>
@@ -0,0 +1,476 @@
+#include "DepthFilters.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+using simd::Float4;
+
+// Runs a row kernel over the frame in place
+// The frame is split into horizontal bands (tiles) that are processed concurrently
+// 'kernel(rows, y, out)' receives pointers to the original rows 'y - radius ... y + radius'
+// (clamped by the frame borders) and writes the filtered row 'y' into 'out'
+template <class Kernel>
+void FilterInPlace(DepthFrame &frame, size_t radius, ThreadPool &pool, const Kernel &kernel) {
+  const size_t width = frame.Width(), height = frame.Height();
+  if (width == 0 || height == 0) {
+    return;
+  }
+  const size_t band = std::max<size_t>(std::max<size_t>(32, 2 * radius + 1),
+                                       (height + pool.Concurrency() * 2 - 1) / (pool.Concurrency() * 2));
+  const size_t n_bands = (height + band - 1) / band;
+
+  // Neighbouring bands overwrite rows we need, so save the original rows around the borders
+  std::vector<uint16_t> halos(n_bands * 2 * radius * width);
+  pool.ParallelFor(0, n_bands, [&](size_t b) {
+    const size_t first = b * band, last = std::min(first + band, height);
+    uint16_t *top = halos.data() + b * 2 * radius * width;
+    uint16_t *bottom = top + radius * width;
+    for (size_t k = 0; k < radius; k++) {
+      if (first + k >= radius) {
+        std::memcpy(top + k * width, frame.Row(first + k - radius), width * sizeof(uint16_t));
+      }
+      if (last + k < height) {
+        std::memcpy(bottom + k * width, frame.Row(last + k), width * sizeof(uint16_t));
+      }
+    }
+  });
+
+  pool.ParallelFor(0, n_bands, [&](size_t b) {
+    const size_t first = b * band, last = std::min(first + band, height);
+    const uint16_t *top = halos.data() + b * 2 * radius * width;
+    const uint16_t *bottom = top + radius * width;
+
+    // The rows above the current one are already filtered, so keep their copies in a ring
+    std::vector<uint16_t> ring((radius + 1) * width);
+    std::vector<const uint16_t *> rows(2 * radius + 1);
+    for (size_t y = first; y < last; y++) {
+      std::memcpy(ring.data() + (y % (radius + 1)) * width, frame.Row(y), width * sizeof(uint16_t));
+      for (size_t k = 0; k < rows.size(); k++) {
+        auto yy = (ptrdiff_t)y - (ptrdiff_t)radius + (ptrdiff_t)k;
+        yy = std::min(std::max<ptrdiff_t>(yy, 0), (ptrdiff_t)height - 1);
+        if (yy < (ptrdiff_t)first) {
+          rows[k] = top + (size_t)(yy - ((ptrdiff_t)first - (ptrdiff_t)radius)) * width;
+        }
+        else if (yy <= (ptrdiff_t)y) {
+          rows[k] = ring.data() + ((size_t)yy % (radius + 1)) * width;
+        }
+        else if (yy < (ptrdiff_t)last) {
+          rows[k] = frame.Row((size_t)yy);
+        }
+        else {
+          rows[k] = bottom + ((size_t)yy - last) * width;
+        }
+      }
+      kernel(rows.data(), y, frame.Row(y));
+    }
+  });
+}
+
+//-----------------
+//--- Bilateral ---
+//-----------------
+
+void BilateralRow(const uint16_t *const *rows, size_t width, size_t radius,
+                  const std::vector<float> &spatial, float range_coef,
+                  uint16_t *out) {
+  const size_t size = 2 * radius + 1;
+  const uint16_t *center = rows[radius];
+
+  auto scalar = [&](size_t x) {
+    float c = center[x];
+    if (c <= 0.0f) {
+      out[x] = 0;
+      return;
+    }
+    float sum = 0.0f, weights = 0.0f;
+    for (size_t dy = 0; dy < size; dy++) {
+      for (size_t dx = 0; dx < size; dx++) {
+        auto xx = (ptrdiff_t)x + (ptrdiff_t)dx - (ptrdiff_t)radius;
+        if (xx < 0 || xx >= (ptrdiff_t)width) {
+          continue;
+        }
+        float v = rows[dy][xx];
+        if (v > 0.0f) {
+          float w = spatial[dy * size + dx] * std::exp((v - c) * (v - c) * range_coef);
+          sum += w * v;
+          weights += w;
+        }
+      }
+    }
+    out[x] = (uint16_t)std::lround(sum / weights);
+  };
+
+  const Float4 zero(0.0f), coef(range_coef);
+  size_t x = 0;
+  for (; x < std::min(radius, width); x++) {
+    scalar(x);
+  }
+  for (; x + Float4::Width + radius <= width; x += Float4::Width) {
+    Float4 c = Float4::FromUInt16(center + x);
+    Float4 valid = c > zero;
+    if (MoveMask(valid) == 0) {
+      zero.StoreUInt16(out + x);
+      continue;
+    }
+    Float4 sum, weights;
+    for (size_t dy = 0; dy < size; dy++) {
+      const uint16_t *row = rows[dy] + x - radius;
+      for (size_t dx = 0; dx < size; dx++) {
+        Float4 v = Float4::FromUInt16(row + dx);
+        Float4 diff = v - c;
+        Float4 w = (v > zero) & (Float4(spatial[dy * size + dx]) * Exp(diff * diff * coef));
+        sum = sum + w * v;
+        weights = weights + w;
+      }
+    }
+    Select(valid, sum / Select(valid, weights, Float4(1.0f)), zero).StoreUInt16(out + x);
+  }
+  for (; x < width; x++) {
+    scalar(x);
+  }
+}
+
+//--------------------
+//--- FlyingPixels ---
+//--------------------
+
+void FlyingPixelsRow(const uint16_t *const *rows, size_t width,
+                     float max_jump, size_t min_support, uint16_t *out) {
+  auto scalar = [&](size_t x) {
+    float c = rows[1][x];
+    size_t support = 0;
+    for (size_t dy = 0; dy < 3; dy++) {
+      for (size_t dx = 0; dx < 3; dx++) {
+        auto xx = (ptrdiff_t)x + (ptrdiff_t)dx - 1;
+        if ((dy == 1 && dx == 1) || xx < 0 || xx >= (ptrdiff_t)width) {
+          continue;
+        }
+        float v = rows[dy][xx];
+        support += v > 0.0f && std::fabs(v - c) <= max_jump ? 1 : 0;
+      }
+    }
+    out[x] = support >= min_support ? rows[1][x] : 0;
+  };
+
+  const Float4 zero(0.0f), one(1.0f), jump(max_jump), threshold((float)min_support);
+  size_t x = 0;
+  for (; x < std::min<size_t>(1, width); x++) {
+    scalar(x);
+  }
+  for (; x + Float4::Width + 1 <= width; x += Float4::Width) {
+    Float4 c = Float4::FromUInt16(rows[1] + x);
+    Float4 support;
+    for (size_t dy = 0; dy < 3; dy++) {
+      for (size_t dx = 0; dx < 3; dx++) {
+        if (dy == 1 && dx == 1) {
+          continue;
+        }
+        Float4 v = Float4::FromUInt16(rows[dy] + x + dx - 1);
+        support = support + ((v > zero) & (Abs(v - c) <= jump) & one);
+      }
+    }
+    Select(support >= threshold, c, zero).StoreUInt16(out + x);
+  }
+  for (; x < width; x++) {
+    scalar(x);
+  }
+}
+
+//-----------------
+//--- FillHoles ---
+//-----------------
+
+void FillHolesRow(const uint16_t *const *rows, size_t width, size_t radius,
+                  float min_support, float max_spread, uint16_t *out) {
+  const size_t size = 2 * radius + 1;
+  const uint16_t *center = rows[radius];
+
+  auto scalar = [&](size_t x) {
+    if (center[x] != 0) {
+      out[x] = center[x];
+      return;
+    }
+    float sum = 0.0f, count = 0.0f;
+    float lo = std::numeric_limits<float>::max(), hi = 0.0f;
+    for (size_t dy = 0; dy < size; dy++) {
+      for (size_t dx = 0; dx < size; dx++) {
+        auto xx = (ptrdiff_t)x + (ptrdiff_t)dx - (ptrdiff_t)radius;
+        if (xx < 0 || xx >= (ptrdiff_t)width || rows[dy][xx] == 0) {
+          continue;
+        }
+        float v = rows[dy][xx];
+        sum += v;
+        count += 1.0f;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+      }
+    }
+    out[x] = count >= min_support && hi - lo <= max_spread ?
+             (uint16_t)std::lround(sum / count) : 0;
+  };
+
+  const Float4 zero(0.0f), one(1.0f), support(min_support), spread(max_spread);
+  const Float4 huge(std::numeric_limits<float>::max());
+  size_t x = 0;
+  for (; x < std::min(radius, width); x++) {
+    scalar(x);
+  }
+  for (; x + Float4::Width + radius <= width; x += Float4::Width) {
+    Float4 c = Float4::FromUInt16(center + x);
+    Float4 holes = c == zero;
+    if (MoveMask(holes) == 0) {
+      std::memcpy(out + x, center + x, Float4::Width * sizeof(uint16_t));
+      continue;
+    }
+    Float4 sum, count, lo(huge), hi(zero);
+    for (size_t dy = 0; dy < size; dy++) {
+      const uint16_t *row = rows[dy] + x - radius;
+      for (size_t dx = 0; dx < size; dx++) {
+        Float4 v = Float4::FromUInt16(row + dx);
+        Float4 valid = v > zero;
+        sum = sum + (valid & v);
+        count = count + (valid & one);
+        lo = Min(lo, Select(valid, v, huge));
+        hi = Max(hi, v);
+      }
+    }
+    Float4 fill = holes & (count >= support) & ((hi - lo) <= spread);
+    Select(fill, sum / Max(count, one), c).StoreUInt16(out + x);
+  }
+  for (; x < width; x++) {
+    scalar(x);
+  }
+}
+
+} // unnamed namespace
+
+//---------------------
+//--- depth_filters ---
+//---------------------
+
+namespace depth_filters {
+
+void Bilateral(DepthFrame &frame, const BilateralParams &params, ThreadPool &pool) {
+  const size_t radius = params.radius, size = 2 * radius + 1;
+  std::vector<float> spatial(size * size);
+  for (size_t dy = 0; dy < size; dy++) {
+    for (size_t dx = 0; dx < size; dx++) {
+      float ry = (float)dy - (float)radius, rx = (float)dx - (float)radius;
+      spatial[dy * size + dx] = std::exp(-(rx * rx + ry * ry) /
+                                         (2.0f * params.sigma_space * params.sigma_space));
+    }
+  }
+  const float range_coef = -1.0f / (2.0f * params.sigma_depth * params.sigma_depth);
+  const size_t width = frame.Width();
+  FilterInPlace(frame, radius, pool, [&](const uint16_t *const *rows, size_t, uint16_t *out) {
+    BilateralRow(rows, width, radius, spatial, range_coef, out);
+  });
+}
+
+void RemoveFlyingPixels(DepthFrame &frame, const EdgeParams &params, ThreadPool &pool) {
+  const size_t width = frame.Width(), height = frame.Height();
+
+  // Rows beyond the frame are clamped by 'FilterInPlace()', but here they must be missing
+  const std::vector<uint16_t> missing(width, 0);
+  FilterInPlace(frame, 1, pool, [&](const uint16_t *const *rows, size_t y, uint16_t *out) {
+    const uint16_t *neighbours[3] = { y == 0 ? missing.data() : rows[0],
+                                      rows[1],
+                                      y + 1 == height ? missing.data() : rows[2] };
+    FlyingPixelsRow(neighbours, width, params.max_jump, params.min_support, out);
+  });
+}
+
+void FillHoles(DepthFrame &frame, const HoleParams &params, ThreadPool &pool) {
+  const size_t width = frame.Width();
+  for (size_t iter = 0; iter < params.iterations; iter++) {
+    FilterInPlace(frame, params.radius, pool, [&](const uint16_t *const *rows, size_t, uint16_t *out) {
+      FillHolesRow(rows, width, params.radius, (float)params.min_support, params.max_spread, out);
+    });
+  }
+}
+
+void ApplySpatial(DepthFrame &frame, const Params &params, ThreadPool &pool) {
+  if (params.remove_edges) {
+    RemoveFlyingPixels(frame, params.edges, pool);
+  }
+  if (params.fill_holes) {
+    FillHoles(frame, params.holes, pool);
+  }
+  if (params.smooth) {
+    Bilateral(frame, params.bilateral, pool);
+  }
+}
+
+} // namespace depth_filters
+
+//----------------------------
+//--- TemporalMedianFilter ---
+//----------------------------
+
+namespace {
+
+// Sorting networks are unrolled for the fixed maximal window
+constexpr size_t MaxTemporalWindow = 15;
+
+} // unnamed namespace
+
+TemporalMedianFilter::TemporalMedianFilter(size_t window, ThreadPool &pool)
+  : window_(std::min(std::max<size_t>(window, 1) | 1, MaxTemporalWindow)),
+    half_(window_ / 2),
+    pool_(pool),
+    frames_(window_),
+    n_pushed_(0), n_emitted_(0) {
+  // nothing
+}
+
+void TemporalMedianFilter::Reset() {
+  n_pushed_  = 0;
+  n_emitted_ = 0;
+}
+
+bool TemporalMedianFilter::Push(DepthFrame &&frame, DepthFrame &output) {
+  frames_[n_pushed_ % window_] = std::move(frame);
+  n_pushed_ += 1;
+  if (n_pushed_ <= half_) {
+    return false;
+  }
+  Filter(n_emitted_++, output);
+  return true;
+}
+
+bool TemporalMedianFilter::Flush(DepthFrame &output) {
+  if (n_emitted_ >= n_pushed_) {
+    return false;
+  }
+  Filter(n_emitted_++, output);
+  return true;
+}
+
+void TemporalMedianFilter::Filter(size_t center, DepthFrame &output) {
+  const size_t first = center >= half_ ? center - half_ : 0;
+  const size_t last  = std::min(center + half_ + 1, n_pushed_);
+  const DepthFrame &ref = frames_[center % window_];
+  const size_t width = ref.Width(), height = ref.Height();
+
+  std::vector<const uint16_t *> planes;
+  for (size_t i = first; i < last; i++) {
+    const auto &frame = frames_[i % window_];
+    if (frame.Width() == width && frame.Height() == height) {
+      planes.emplace_back(frame.Data());
+    }
+  }
+  output.Resize(width, height);
+  uint16_t *dst = output.Data();
+  const size_t n = planes.size();
+
+  pool_.ParallelFor(0, height, 16, [&](size_t first_row, size_t last_row, size_t) {
+    const Float4 zero(0.0f), one(1.0f);
+    std::array<Float4, MaxTemporalWindow> values;
+    uint16_t tmp[MaxTemporalWindow][Float4::Width];
+
+    for (size_t row = first_row; row < last_row; row++) {
+      for (size_t x = row * width; x < (row + 1) * width; x += Float4::Width) {
+        // Gather values at the same pixels from all frames, pad the row tail by invalid values
+        const size_t lanes = std::min(Float4::Width, (row + 1) * width - x);
+        Float4 count;
+        for (size_t k = 0; k < n; k++) {
+          if (lanes == Float4::Width) {
+            values[k] = Float4::FromUInt16(planes[k] + x);
+          }
+          else {
+            std::fill(tmp[k], tmp[k] + Float4::Width, 0);
+            std::memcpy(tmp[k], planes[k] + x, lanes * sizeof(uint16_t));
+            values[k] = Float4::FromUInt16(tmp[k]);
+          }
+          count = count + ((values[k] > zero) & one);
+        }
+
+        // Odd-even transposition sort, invalid (zero) values come first
+        for (size_t pass = 0; pass < n; pass++) {
+          for (size_t k = pass & 1; k + 1 < n; k += 2) {
+            Float4 lo = Min(values[k], values[k + 1]);
+            values[k + 1] = Max(values[k], values[k + 1]);
+            values[k] = lo;
+          }
+        }
+
+        // The median of valid values, a pixel must be valid in most frames
+        int32_t counts[Float4::Width];
+        RoundToInt(count, counts);
+        float pos[Float4::Width];
+        for (size_t i = 0; i < Float4::Width; i++) {
+          pos[i] = counts[i] * 2 > (int32_t)n ?
+                   (float)(n - (size_t)counts[i] + ((size_t)counts[i] - 1) / 2) : -1.0f;
+        }
+        Float4 median, target = Float4::Load(pos);
+        for (size_t k = 0; k < n; k++) {
+          median = Select(target == Float4((float)k), values[k], median);
+        }
+
+        if (lanes == Float4::Width) {
+          median.StoreUInt16(dst + x);
+        }
+        else {
+          uint16_t result[Float4::Width];
+          median.StoreUInt16(result);
+          std::memcpy(dst + x, result, lanes * sizeof(uint16_t));
+        }
+      }
+    }
+  });
+}
+
+//-------------------------
+//--- FilterDepthStream ---
+//-------------------------
+
+ErrHandle FilterDepthStream(const scanogram::Stream &stream,
+                            const depth_filters::Params &params,
+                            const std::function<ErrHandle(size_t, const DepthFrame &)> &callback) {
+  Camera camera;
+  std::string dir;
+  if (!stream.HasDepth(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+
+  // Frames of a batch are decoded and filtered concurrently, one thread per frame
+  auto &pool = ThreadPool::Default();
+  const size_t batch_size = pool.Concurrency();
+  std::vector<DepthFrame> batch(batch_size);
+  std::vector<ErrHandle> errors(batch_size);
+  TemporalMedianFilter temporal(params.temporal_window, pool);
+  const bool use_temporal = params.temporal_window > 1;
+
+  size_t n_emitted = 0;
+  DepthFrame filtered;
+  for (size_t first = 0; first < files.size(); first += batch_size) {
+    size_t last = std::min(first + batch_size, files.size());
+    pool.ParallelFor(first, last, [&](size_t i) {
+      auto &frame = batch[i - first];
+      errors[i - first] = DepthFrame::Load(files[i], frame);
+      if (errors[i - first].Succeeded()) {
+        depth_filters::ApplySpatial(frame, params, pool);
+      }
+    });
+
+    for (size_t i = first; i < last; i++) {
+      TEXEL_CHECK(errors[i - first]);
+      if (!use_temporal) {
+        TEXEL_CHECK(callback(n_emitted++, batch[i - first]));
+      }
+      else if (temporal.Push(std::move(batch[i - first]), filtered)) {
+        TEXEL_CHECK(callback(n_emitted++, filtered));
+      }
+    }
+  }
+  while (use_temporal && temporal.Flush(filtered)) {
+    TEXEL_CHECK(callback(n_emitted++, filtered));
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
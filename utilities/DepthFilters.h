@@ -0,0 +1,133 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace depth_filters {
+
+// Edge-preserving smoothing
+struct BilateralParams {
+  // Half-size of the window, in pixels
+  size_t radius;
+
+  // Standard deviation of the spatial Gaussian, in pixels
+  float sigma_space;
+
+  // Standard deviation of the range Gaussian, in millimeters
+  float sigma_depth;
+
+  BilateralParams()
+    : radius(2), sigma_space(1.5f), sigma_depth(15.0f) {
+  }
+};
+
+// Removes 'flying pixels' that appear at depth discontinuities
+struct EdgeParams {
+  // Neighbours that differ more are considered as another surface, in millimeters
+  float max_jump;
+
+  // A pixel must have at least so many neighbours (of 8) on its surface, otherwise it is dropped
+  size_t min_support;
+
+  EdgeParams()
+    : max_jump(30.0f), min_support(3) {
+  }
+};
+
+// Fills small holes using neighbours from the same surface
+struct HoleParams {
+  // Half-size of the window, in pixels
+  size_t radius;
+
+  // A hole is filled only if there are at least so many valid neighbours
+  size_t min_support;
+
+  // Neighbours must not differ more than this value (in millimeters),
+  // so the holes at depth discontinuities are kept
+  float max_spread;
+
+  // Each iteration shrinks holes by 'radius' pixels
+  size_t iterations;
+
+  HoleParams()
+    : radius(1), min_support(3), max_spread(30.0f), iterations(2) {
+  }
+};
+
+// The whole denoising pipeline: spatial filters followed by the temporal one
+struct Params {
+  bool remove_edges;
+  EdgeParams edges;
+
+  bool fill_holes;
+  HoleParams holes;
+
+  bool smooth;
+  BilateralParams bilateral;
+
+  // Number of frames for the temporal median (odd), 1 disables the filter
+  size_t temporal_window;
+
+  Params()
+    : remove_edges(true), fill_holes(true), smooth(true),
+      temporal_window(5) {
+  }
+};
+
+// Smooths depth in place, invalid pixels are neither used nor modified
+void Bilateral(DepthFrame &frame, const BilateralParams &params,
+               ThreadPool &pool = ThreadPool::Default());
+
+// Invalidates isolated pixels at depth discontinuities (in place)
+void RemoveFlyingPixels(DepthFrame &frame, const EdgeParams &params,
+                        ThreadPool &pool = ThreadPool::Default());
+
+// Fills invalid pixels that are surrounded by a consistent surface (in place)
+void FillHoles(DepthFrame &frame, const HoleParams &params,
+               ThreadPool &pool = ThreadPool::Default());
+
+// Applies enabled spatial filters in the order: edges, holes, smoothing
+void ApplySpatial(DepthFrame &frame, const Params &params,
+                  ThreadPool &pool = ThreadPool::Default());
+
+} // namespace depth_filters
+
+
+// Per-pixel median over a sliding window of consecutive frames
+// Frames are pushed one by one, the filtered ones are delayed by half of the window
+class TemporalMedianFilter {
+  public:
+    explicit TemporalMedianFilter(size_t window, ThreadPool &pool = ThreadPool::Default());
+    TemporalMedianFilter(const TemporalMedianFilter &) = delete;
+    TemporalMedianFilter &operator =(const TemporalMedianFilter &) = delete;
+
+    // Appends a new frame, returns 'true' if 'output' received the next filtered frame
+    // All frames must have the same size
+    bool Push(DepthFrame &&frame, DepthFrame &output);
+
+    // Should be called after the last frame until it returns 'false'
+    // The remaining frames are filtered over the truncated windows
+    bool Flush(DepthFrame &output);
+
+    // Forgets all frames, e.g. to start a new stream
+    void Reset();
+
+  private:
+    void Filter(size_t center, DepthFrame &output);
+
+    size_t window_, half_;
+    ThreadPool &pool_;
+    std::vector<DepthFrame> frames_;
+    size_t n_pushed_, n_emitted_;
+};
+
+// Decodes depth maps of the stream and denoises them as soon as they are decoded
+// 'callback(idx, frame)' receives the filtered frames in order, its errors stop the processing
+ErrHandle FilterDepthStream(const scanogram::Stream &stream,
+                            const depth_filters::Params &params,
+                            const std::function<ErrHandle(size_t, const DepthFrame &)> &callback);
+
+} // namespace texel
@@ -0,0 +1,381 @@
+#include "DepthQuality.h"
+#include "Geometry.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+// Everything the per-frame kernel needs to know about the stream
+struct FrameSetup {
+  float cx, cy, inv_fx, inv_fy;
+  RigidTransform to_viewer;
+  glm::vec3 box_min, box_max;
+  float min_mm, max_mm;
+  uint32_t bin_width;
+  size_t n_bins;
+};
+
+FrameSetup MakeSetup(const Camera &camera, const BoundingBox &bbox) {
+  FrameSetup setup;
+  setup.cx        = camera.Cx();
+  setup.cy        = camera.Cy();
+  setup.inv_fx    = 1.0f / camera.Fx();
+  setup.inv_fy    = 1.0f / camera.Fy();
+  setup.to_viewer = geometry::CameraToViewer(camera);
+  setup.box_min   = bbox.Offset();
+  setup.box_max   = bbox.Offset() + bbox.Size();
+  return setup;
+}
+
+// Counts valid pixels and points inside the box, fills the histogram of valid depth values
+void MeasureFrame(const DepthFrame &frame, const FrameSetup &setup,
+                  depth_quality::FrameStats &stats, uint32_t *histogram) {
+  using simd::Float4;
+  const auto &r = setup.to_viewer.Rotation();
+  const auto &t = setup.to_viewer.Offset();
+  Float4 r00(r[0][0]), r01(r[1][0]), r02(r[2][0]);
+  Float4 r10(r[0][1]), r11(r[1][1]), r12(r[2][1]);
+  Float4 r20(r[0][2]), r21(r[1][2]), r22(r[2][2]);
+  Float4 tx(t.x), ty(t.y), tz(t.z);
+  Float4 min_x(setup.box_min.x), min_y(setup.box_min.y), min_z(setup.box_min.z);
+  Float4 max_x(setup.box_max.x), max_y(setup.box_max.y), max_z(setup.box_max.z);
+  Float4 min_mm(setup.min_mm), max_mm(setup.max_mm), scale(DepthFrame::Scale), zero(0.0f);
+  Float4 cx(setup.cx), inv_fx(setup.inv_fx), lanes(0.0f, 1.0f, 2.0f, 3.0f);
+
+  size_t width = frame.Width(), height = frame.Height();
+  size_t n_valid = 0, n_bbox = 0;
+  double sum_depth = 0.0;
+  for (size_t y = 0; y < height; y++) {
+    const uint16_t *row = frame.Row(y);
+    Float4 ray_y(((float)y - setup.cy) * setup.inv_fy);
+    Float4 row_sum(0.0f);
+    size_t x = 0;
+    for (; x + Float4::Width <= width; x += Float4::Width) {
+      Float4 d = Float4::FromUInt16(row + x);
+      Float4 valid = (d >= min_mm) & (d <= max_mm);
+      int valid_bits = MoveMask(valid);
+      if (valid_bits == 0) {
+        continue;
+      }
+
+      Float4 z = d * scale;
+      Float4 px = (Float4((float)x) + lanes - cx) * inv_fx * z;
+      Float4 py = ray_y * z;
+      Float4 vx = r00 * px + r01 * py + r02 * z + tx;
+      Float4 vy = r10 * px + r11 * py + r12 * z + ty;
+      Float4 vz = r20 * px + r21 * py + r22 * z + tz;
+      Float4 inside = valid & (vx >= min_x) & (vx <= max_x) & (vy >= min_y) & (vy <= max_y) &
+                      (vz >= min_z) & (vz <= max_z);
+
+      n_valid += (size_t)simd::CountBits(valid_bits);
+      n_bbox  += (size_t)simd::CountBits(MoveMask(inside));
+      row_sum = row_sum + Select(valid, z, zero);
+
+      // SSE2 has no scatters, so the histogram is updated lane by lane
+      for (size_t k = 0; k < Float4::Width; k++) {
+        if ((valid_bits & (1 << k)) != 0) {
+          histogram[std::min<size_t>(row[x + k] / setup.bin_width, setup.n_bins - 1)] += 1;
+        }
+      }
+    }
+    sum_depth += HorizontalSum(row_sum);
+
+    for (; x < width; x++) {
+      float d = row[x];
+      if (d < setup.min_mm || d > setup.max_mm) {
+        continue;
+      }
+      float z = d * DepthFrame::Scale;
+      glm::vec3 p = setup.to_viewer.Apply(glm::vec3(((float)x - setup.cx) * setup.inv_fx * z,
+                                                    ((float)y - setup.cy) * setup.inv_fy * z, z));
+      n_valid += 1;
+      bool inside = p.x >= setup.box_min.x && p.x <= setup.box_max.x &&
+                    p.y >= setup.box_min.y && p.y <= setup.box_max.y &&
+                    p.z >= setup.box_min.z && p.z <= setup.box_max.z;
+      n_bbox  += inside ? 1 : 0;
+      sum_depth += z;
+      histogram[std::min<size_t>(row[x] / setup.bin_width, setup.n_bins - 1)] += 1;
+    }
+  }
+
+  stats.readable    = true;
+  stats.valid       = n_valid;
+  stats.in_bbox     = n_bbox;
+  stats.valid_ratio = width * height > 0 ? (float)n_valid / (width * height) : 0.0f;
+  stats.mean_depth  = n_valid > 0 ? (float)(sum_depth / n_valid) : 0.0f;
+}
+
+// Compares the frame with the previous one of the same stream
+void CompareFrames(const DepthFrame &prev, const DepthFrame &cur, const FrameSetup &setup,
+                   depth_quality::FrameStats &stats) {
+  using simd::Float4;
+  if (prev.Empty() || cur.Empty()) {
+    // The previous frame is unreadable
+    return;
+  }
+  if (prev.Width() != cur.Width() || prev.Height() != cur.Height()) {
+    // Frames of different sizes do not overlap, everything has changed
+    stats.flicker = 1.0f;
+    return;
+  }
+
+  Float4 min_mm(setup.min_mm), max_mm(setup.max_mm), zero(0.0f);
+  size_t n_prev = 0, n_cur = 0, n_both = 0;
+  double sum_diff = 0.0;
+  for (size_t y = 0; y < cur.Height(); y++) {
+    const uint16_t *a = prev.Row(y), *b = cur.Row(y);
+    Float4 row_sum(0.0f);
+    size_t x = 0;
+    for (; x + Float4::Width <= cur.Width(); x += Float4::Width) {
+      Float4 da = Float4::FromUInt16(a + x), db = Float4::FromUInt16(b + x);
+      Float4 valid_a = (da >= min_mm) & (da <= max_mm);
+      Float4 valid_b = (db >= min_mm) & (db <= max_mm);
+      Float4 both = valid_a & valid_b;
+      n_prev += (size_t)simd::CountBits(MoveMask(valid_a));
+      n_cur  += (size_t)simd::CountBits(MoveMask(valid_b));
+      n_both += (size_t)simd::CountBits(MoveMask(both));
+      row_sum = row_sum + Select(both, Abs(da - db), zero);
+    }
+    sum_diff += HorizontalSum(row_sum);
+
+    for (; x < cur.Width(); x++) {
+      bool valid_a = a[x] >= setup.min_mm && a[x] <= setup.max_mm;
+      bool valid_b = b[x] >= setup.min_mm && b[x] <= setup.max_mm;
+      n_prev += valid_a ? 1 : 0;
+      n_cur  += valid_b ? 1 : 0;
+      if (valid_a && valid_b) {
+        n_both += 1;
+        sum_diff += std::abs((int)a[x] - (int)b[x]);
+      }
+    }
+  }
+
+  stats.change  = n_both > 0 ? (float)(sum_diff / n_both) : 0.0f;
+  stats.flicker = (float)(n_prev + n_cur - 2 * n_both) / (cur.Width() * cur.Height());
+}
+
+} // unnamed namespace
+
+//--------------------
+//--- DepthQuality ---
+//--------------------
+
+struct DepthQuality::Job {
+  FrameSetup setup;
+  std::vector<std::string> files;
+  depth_quality::StreamReport *report;
+};
+
+DepthQuality::DepthQuality(const depth_quality::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool) {
+  params_.bin_width = std::max<uint32_t>(params_.bin_width, 1);
+  params_.n_bins = std::max<size_t>(params_.n_bins, 1);
+}
+
+ErrHandle DepthQuality::Analyze(const scanogram::Stream &stream, const BoundingBox &bbox,
+                                depth_quality::StreamReport &report) const {
+  report = depth_quality::StreamReport();
+  Camera camera;
+  if (!stream.HasDepth(camera, report.dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+
+  std::vector<Job> jobs(1);
+  TEXEL_CHECK(frames::ListFiles(report.dir, ".png", jobs[0].files));
+  jobs[0].setup  = MakeSetup(camera, bbox);
+  jobs[0].report = &report;
+  Process(jobs);
+  Summarize(report);
+  return ErrHandle();
+}
+
+ErrHandle DepthQuality::Analyze(ScanogramFinder &finder, std::vector<depth_quality::ScanReport> &reports) const {
+  reports.clear();
+
+  // Reports are filled first, so the jobs can keep pointers to them
+  struct Pending {
+    size_t scan_idx, stream_idx;
+    FrameSetup setup;
+    std::vector<std::string> files;
+  };
+  std::vector<Pending> pending;
+  finder.Reset();
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    depth_quality::ScanReport scan_report;
+    scan_report.id   = info.id;
+    scan_report.path = info.path;
+
+    decltype(auto) stages = info.scan.Stages();
+    for (size_t stage_idx = 0; stage_idx < stages.size(); stage_idx++) {
+      decltype(auto) streams = stages[stage_idx].Streams();
+      for (size_t stream_idx = 0; stream_idx < streams.size(); stream_idx++) {
+        Camera camera;
+        depth_quality::StreamReport report;
+        if (!streams[stream_idx].HasDepth(camera, report.dir)) {
+          continue;
+        }
+        report.stage_idx  = stage_idx;
+        report.stream_idx = stream_idx;
+
+        Pending job;
+        auto err = frames::ListFiles(report.dir, ".png", job.files);
+        if (err.Failed()) {
+          report.issues.emplace_back("failed to list depth maps: " + err.Message());
+        }
+        else {
+          job.scan_idx   = reports.size();
+          job.stream_idx = scan_report.streams.size();
+          job.setup      = MakeSetup(camera, stages[stage_idx].BoundingBox());
+          pending.emplace_back(std::move(job));
+        }
+        scan_report.streams.emplace_back(std::move(report));
+      }
+    }
+    reports.emplace_back(std::move(scan_report));
+  }
+  finder.Reset();
+
+  std::vector<Job> jobs(pending.size());
+  for (size_t i = 0; i < pending.size(); i++) {
+    jobs[i].setup  = pending[i].setup;
+    jobs[i].files  = std::move(pending[i].files);
+    jobs[i].report = &reports[pending[i].scan_idx].streams[pending[i].stream_idx];
+  }
+  Process(jobs);
+
+  for (auto &scan_report : reports) {
+    for (auto &report : scan_report.streams) {
+      if (report.issues.empty()) {
+        Summarize(report);
+      }
+    }
+  }
+  return ErrHandle();
+}
+
+void DepthQuality::Process(std::vector<Job> &jobs) const {
+  // Frames of all jobs form one sequence, 'starts[j]' is the first frame of the job 'j'
+  std::vector<size_t> starts(jobs.size() + 1, 0);
+  for (size_t j = 0; j < jobs.size(); j++) {
+    auto &job = jobs[j];
+    job.setup.min_mm    = params_.min_depth / DepthFrame::Scale;
+    job.setup.max_mm    = params_.max_depth / DepthFrame::Scale;
+    job.setup.bin_width = params_.bin_width;
+    job.setup.n_bins    = params_.n_bins;
+    job.report->frames.assign(job.files.size(), depth_quality::FrameStats());
+    job.report->histogram.assign(params_.n_bins, 0);
+    starts[j + 1] = starts[j] + job.files.size();
+  }
+  auto locate = [&starts](size_t idx, size_t &job_idx, size_t &frame_idx) {
+    job_idx   = (size_t)(std::upper_bound(starts.begin(), starts.end(), idx) - starts.begin()) - 1;
+    frame_idx = idx - starts[job_idx];
+  };
+
+  // Batches bound the memory consumption, slot 0 keeps the last frame of the previous batch
+  const size_t batch_size = pool_.Concurrency() * 2;
+  std::vector<DepthFrame> frames(batch_size + 1);
+  std::vector<std::vector<uint32_t> > histograms(batch_size + 1);
+  for (size_t first = 0; first < starts.back(); first += batch_size) {
+    size_t last = std::min(first + batch_size, starts.back());
+    if (first > 0) {
+      std::swap(frames[0], frames[batch_size]);
+    }
+
+    pool_.ParallelFor(first, last, [&](size_t idx) {
+      size_t job_idx, frame_idx;
+      locate(idx, job_idx, frame_idx);
+      auto &job = jobs[job_idx];
+      auto &frame = frames[idx - first + 1];
+      auto &histogram = histograms[idx - first + 1];
+      histogram.assign(params_.n_bins, 0);
+      if (DepthFrame::Load(job.files[frame_idx], frame).Failed()) {
+        frame.Resize(0, 0);
+        return;
+      }
+      MeasureFrame(frame, job.setup, job.report->frames[frame_idx], histogram.data());
+    });
+
+    // The first frame of a stream has nothing to compare with
+    pool_.ParallelFor(first, last, [&](size_t idx) {
+      size_t job_idx, frame_idx;
+      locate(idx, job_idx, frame_idx);
+      auto &job = jobs[job_idx];
+      auto &stats = job.report->frames[frame_idx];
+      if (frame_idx > 0 && stats.readable) {
+        CompareFrames(frames[idx - first], frames[idx - first + 1], job.setup, stats);
+      }
+    });
+
+    for (size_t idx = first; idx < last; idx++) {
+      size_t job_idx, frame_idx;
+      locate(idx, job_idx, frame_idx);
+      auto &total = jobs[job_idx].report->histogram;
+      const auto &histogram = histograms[idx - first + 1];
+      for (size_t i = 0; i < total.size(); i++) {
+        total[i] += histogram[i];
+      }
+    }
+  }
+}
+
+void DepthQuality::Summarize(depth_quality::StreamReport &report) const {
+  if (report.frames.empty()) {
+    report.issues.emplace_back("no depth maps");
+    return;
+  }
+
+  size_t n_readable = 0, n_compared = 0, n_sparse = 0, n_outside = 0, n_jumps = 0;
+  double sum_valid = 0.0, sum_bbox = 0.0, sum_change = 0.0;
+  report.min_in_bbox = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < report.frames.size(); i++) {
+    auto &frame = report.frames[i];
+    if (!frame.readable) {
+      report.n_unreadable += 1;
+      frame.bad = true;
+      continue;
+    }
+    bool sparse  = frame.valid_ratio < params_.min_valid_ratio;
+    bool outside = frame.in_bbox < params_.min_bbox_points;
+    bool jump    = frame.change > params_.max_change;
+    n_sparse  += sparse ? 1 : 0;
+    n_outside += outside ? 1 : 0;
+    n_jumps   += jump ? 1 : 0;
+    frame.bad = sparse || outside || jump;
+
+    n_readable += 1;
+    n_compared += i > 0 && report.frames[i - 1].readable ? 1 : 0;
+    sum_valid  += frame.valid_ratio;
+    sum_bbox   += (double)frame.in_bbox;
+    sum_change += frame.change;
+    report.min_in_bbox = std::min(report.min_in_bbox, (float)frame.in_bbox);
+    report.max_change  = std::max(report.max_change, frame.change);
+  }
+  for (const auto &frame : report.frames) {
+    report.n_bad += frame.bad ? 1 : 0;
+  }
+  if (n_readable > 0) {
+    report.mean_valid_ratio = (float)(sum_valid / n_readable);
+    report.mean_in_bbox     = (float)(sum_bbox / n_readable);
+    report.mean_change      = n_compared > 0 ? (float)(sum_change / n_compared) : 0.0f;
+  }
+  else {
+    report.min_in_bbox = 0.0f;
+  }
+
+  if (report.n_unreadable > 0) {
+    std::ostringstream oss;
+    oss << report.n_unreadable << " of " << report.frames.size() << " depth maps cannot be decoded";
+    report.issues.emplace_back(oss.str());
+  }
+  if (report.n_bad > params_.max_bad_ratio * report.frames.size()) {
+    std::ostringstream oss;
+    oss << report.n_bad << " of " << report.frames.size() << " frames are bad: "
+        << n_sparse << " with few valid pixels, " << n_outside << " with few points in the bounding box, "
+        << n_jumps << " with sudden changes";
+    report.issues.emplace_back(oss.str());
+  }
+}
+
+} // namespace texel
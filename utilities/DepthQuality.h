@@ -0,0 +1,127 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+#include "ScanogramFinder.h"
+
+namespace texel {
+
+namespace depth_quality {
+
+struct Params {
+  // Depth values outside this range are invalid (in meters)
+  float min_depth, max_depth;
+
+  // The depth histogram has 'n_bins' bins of 'bin_width' millimeters, the last one takes farther values
+  uint32_t bin_width;
+  size_t n_bins;
+
+  // A frame is bad if it has fewer valid pixels (share of the frame),
+  // fewer points inside the bounding box of the stage,
+  // or its depth changed more than this value since the previous frame (mean, in millimeters)
+  float min_valid_ratio;
+  size_t min_bbox_points;
+  float max_change;
+
+  // A stream is considered as failed if it has more bad frames (share of all frames)
+  float max_bad_ratio;
+
+  Params()
+    : min_depth(0.2f), max_depth(5.0f),
+      bin_width(50), n_bins(100),
+      min_valid_ratio(0.05f),
+      min_bbox_points(2000),
+      max_change(50.0f),
+      max_bad_ratio(0.1f) {
+  }
+};
+
+struct FrameStats {
+  bool readable;
+  size_t valid;           // pixels with depth in the valid range
+  size_t in_bbox;         // of them, points inside the bounding box of the stage
+  float valid_ratio;
+  float mean_depth;       // in meters
+
+  // Difference from the previous frame: mean absolute change over pixels that are valid in both frames
+  // (in millimeters) and the share of pixels that became valid or invalid
+  float change, flicker;
+
+  bool bad;
+
+  FrameStats()
+    : readable(false), valid(0), in_bbox(0), valid_ratio(0.0f), mean_depth(0.0f),
+      change(0.0f), flicker(0.0f), bad(false) {
+  }
+};
+
+struct StreamReport {
+  size_t stage_idx, stream_idx;
+  std::string dir;
+
+  std::vector<FrameStats> frames;
+
+  // Valid depth values of all frames
+  std::vector<uint64_t> histogram;
+
+  // Summary over frames
+  size_t n_unreadable, n_bad;
+  float mean_valid_ratio, mean_in_bbox, min_in_bbox, mean_change, max_change;
+
+  // Reasons why the stream looks like a failed recording, empty if it is fine
+  std::vector<std::string> issues;
+
+  StreamReport()
+    : stage_idx(0), stream_idx(0),
+      n_unreadable(0), n_bad(0),
+      mean_valid_ratio(0.0f), mean_in_bbox(0.0f), min_in_bbox(0.0f), mean_change(0.0f), max_change(0.0f) {
+  }
+
+  bool Failed() const { return !issues.empty(); }
+};
+
+struct ScanReport {
+  std::string id;
+  std::string path;
+  std::vector<StreamReport> streams;
+
+  bool Failed() const {
+    return std::any_of(streams.begin(), streams.end(), [](const StreamReport &s) { return s.Failed(); });
+  }
+};
+
+} // namespace depth_quality
+
+
+// Collects quality statistics of depth maps to find failed recordings
+// Each frame is decoded once. Batches of frames are processed concurrently, they may span a few streams and scans,
+// so the pool stays busy even for short recordings
+class DepthQuality {
+  public:
+    explicit DepthQuality(const depth_quality::Params &params = depth_quality::Params(),
+                          ThreadPool &pool = ThreadPool::Default());
+    DepthQuality(const DepthQuality &) = delete;
+    DepthQuality &operator =(const DepthQuality &) = delete;
+
+    const depth_quality::Params &Params() const { return params_; }
+
+    // Analyzes a single stream, points are counted inside 'bbox' (in the viewer space)
+    ErrHandle Analyze(const scanogram::Stream &stream, const BoundingBox &bbox,
+                      depth_quality::StreamReport &report) const;
+
+    // Analyzes depth streams of all scans found by the finder, one report per scan
+    // Unreadable frames and directories are reported as issues instead of errors
+    ErrHandle Analyze(ScanogramFinder &finder, std::vector<depth_quality::ScanReport> &reports) const;
+
+  private:
+    struct Job;
+
+    void Process(std::vector<Job> &jobs) const;
+    void Summarize(depth_quality::StreamReport &report) const;
+
+    depth_quality::Params params_;
+    ThreadPool &pool_;
+};
+
+} // namespace texel
@@ -0,0 +1,45 @@
+#include <iostream>
+#include "ReleaseExport.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+int main(int argc, char **argv) {
+  bool allow_hardlinks = argc == 4 && std::string(argv[3]) == "--hardlinks";
+  if (argc < 3 || argc > 4 || (argc == 4 && !allow_hardlinks)) {
+    std::cerr << "Wrong arguments, use as './ExportRelease <path_to_directory_with_scans> <release_directory> [--hardlinks]'"
+              << std::endl;
+    return 0;
+  }
+  std::string src(argv[1]), dst(argv[2]);
+
+  release_export::Params params;
+  params.allow_hardlinks = allow_hardlinks;
+  release_export::Report report;
+  ScanogramFinder finder;
+  auto err = finder.BindDirectory(src);
+  if (err.Succeeded()) {
+    err = release_export::Export(finder, src, dst, params, report);
+  }
+  if (err.Failed()) {
+    std::cerr << "Failed to export scans from the '" << src << "' directory:" << std::endl;
+    std::cerr << err.Message();
+    return 0;
+  }
+
+  for (const auto &reason : report.skipped) {
+    std::cout << "Skipped " << reason << std::endl;
+  }
+  std::cout << "Exported " << report.persons_exported << " persons (" << report.scans_exported << " scans), "
+            << report.persons_skipped << " persons skipped" << std::endl;
+  std::cout << "Removed " << report.scans_removed << " scans and " << report.streams_removed
+            << " streams without consent" << std::endl;
+  std::cout << "Copied " << report.files << " files (" << report.bytes / (1024 * 1024) << " MB):";
+  for (size_t i = 0; i < report.by_method.size(); i++) {
+    if (report.by_method[i] > 0) {
+      std::cout << " " << report.by_method[i] << " via " << file_copy::ToUserFriendly((file_copy::Method)i) << ";";
+    }
+  }
+  std::cout << std::endl;
+  return 0;
+}
@@ -0,0 +1,250 @@
+#include "FileCopy.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
+namespace texel {
+
+//-----------------
+//--- file_copy ---
+//-----------------
+
+namespace file_copy {
+
+std::string ToUserFriendly(Method method) {
+  switch (method) {
+    case Method::Reflink:       return "reflink";
+    case Method::Hardlink:      return "hard link";
+    case Method::CopyFileRange: return "copy_file_range";
+    case Method::SendFile:      return "sendfile";
+    case Method::Regular:
+    default:                    return "read/write";
+  }
+}
+
+} // namespace file_copy
+
+namespace {
+
+ErrHandle SystemError(const std::string &where, const std::string &what,
+                      const std::string &filename, int code) {
+  std::ostringstream oss;
+  oss << "failed to " << what << " '" << filename << "' ("
+      << std::error_code(code, std::generic_category()).message() << ")";
+  return ErrHandle(where, oss.str());
+}
+
+#ifdef __linux__
+
+// Closes the descriptor when the copy is over
+class FileDescriptor {
+  public:
+    explicit FileDescriptor(int fd) : fd_(fd) { }
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator =(const FileDescriptor &) = delete;
+    ~FileDescriptor() { Close(); }
+
+    int Get() const { return fd_; }
+    bool Valid() const { return fd_ >= 0; }
+
+    // Returns a non-zero value if the buffered data was not written
+    int Close() {
+      int result = 0;
+      if (fd_ >= 0) {
+        result = ::close(fd_);
+        fd_ = -1;
+      }
+      return result;
+    }
+
+    void Reset(int fd) {
+      Close();
+      fd_ = fd;
+    }
+
+  private:
+    int fd_;
+};
+
+// Each function continues from the current file positions and returns the number of bytes left
+// Errors are detected later, when the fallback also fails to copy the rest
+size_t CopyWithCopyFileRange(int in, int out, size_t left, std::atomic<bool> &enabled) {
+  bool first = true;
+  while (left > 0) {
+    auto n = ::copy_file_range(in, nullptr, out, nullptr, left, 0);
+    if (n <= 0) {
+      // Unsupported file systems are reported at once, do not try them again
+      if (first && n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                             errno == EOPNOTSUPP)) {
+        enabled = false;
+      }
+      break;
+    }
+    left -= (size_t)n;
+    first = false;
+  }
+  return left;
+}
+
+size_t CopyWithSendFile(int in, int out, size_t left, std::atomic<bool> &enabled) {
+  bool first = true;
+  while (left > 0) {
+    auto n = ::sendfile(out, in, nullptr, left);
+    if (n <= 0) {
+      if (first && n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+        enabled = false;
+      }
+      break;
+    }
+    left -= (size_t)n;
+    first = false;
+  }
+  return left;
+}
+
+size_t CopyWithReadWrite(int in, int out, size_t left) {
+  std::vector<char> buffer(1 << 20);
+  while (left > 0) {
+    auto n = ::read(in, buffer.data(), std::min(buffer.size(), left));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    for (ssize_t written = 0; written < n; ) {
+      auto m = ::write(out, buffer.data() + written, (size_t)(n - written));
+      if (m < 0 && errno == EINTR) {
+        continue;
+      }
+      if (m <= 0) {
+        return left;
+      }
+      written += m;
+    }
+    left -= (size_t)n;
+  }
+  return left;
+}
+
+#endif // __linux__
+
+} // unnamed namespace
+
+//------------------
+//--- FileCopier ---
+//------------------
+
+FileCopier::FileCopier(bool allow_hardlinks)
+  : try_reflinks_(true), try_hardlinks_(allow_hardlinks),
+    try_copy_file_range_(true), try_sendfile_(true) {
+  // nothing
+}
+
+#ifdef __linux__
+
+ErrHandle FileCopier::Copy(const std::string &src, const std::string &dst,
+                           file_copy::Method &method) {
+  if (::unlink(dst.c_str()) != 0 && errno != ENOENT) {
+    return SystemError(TEXEL_WHERE, "replace", dst, errno);
+  }
+
+  // If reflinks are known to be unsupported, a hard link is the cheapest option
+  if (try_hardlinks_ && !try_reflinks_) {
+    if (::link(src.c_str(), dst.c_str()) == 0) {
+      method = file_copy::Method::Hardlink;
+      return ErrHandle();
+    }
+    try_hardlinks_ = false;
+  }
+
+  FileDescriptor in(::open(src.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat info;
+  if (!in.Valid() || ::fstat(in.Get(), &info) != 0) {
+    return SystemError(TEXEL_WHERE, "open", src, errno);
+  }
+  FileDescriptor out(::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 0777));
+  if (!out.Valid()) {
+    return SystemError(TEXEL_WHERE, "create", dst, errno);
+  }
+
+  if (try_reflinks_) {
+    if (::ioctl(out.Get(), FICLONE, in.Get()) == 0) {
+      method = file_copy::Method::Reflink;
+      return ErrHandle();
+    }
+    try_reflinks_ = false;
+
+    // The first file on a file system without reflinks
+    if (try_hardlinks_) {
+      out.Close();
+      if (::unlink(dst.c_str()) == 0 && ::link(src.c_str(), dst.c_str()) == 0) {
+        method = file_copy::Method::Hardlink;
+        return ErrHandle();
+      }
+      try_hardlinks_ = false;
+      out.Reset(::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 0777));
+      if (!out.Valid()) {
+        return SystemError(TEXEL_WHERE, "create", dst, errno);
+      }
+    }
+  }
+
+  size_t left = (size_t)info.st_size;
+  errno = 0;
+  method = file_copy::Method::CopyFileRange;
+  if (left > 0 && try_copy_file_range_) {
+    left = CopyWithCopyFileRange(in.Get(), out.Get(), left, try_copy_file_range_);
+  }
+  if (left > 0 && try_sendfile_) {
+    method = file_copy::Method::SendFile;
+    left = CopyWithSendFile(in.Get(), out.Get(), left, try_sendfile_);
+  }
+  if (left > 0) {
+    method = file_copy::Method::Regular;
+    left = CopyWithReadWrite(in.Get(), out.Get(), left);
+  }
+  if (left > 0) {
+    // The source file may be truncated while it is being copied
+    return SystemError(TEXEL_WHERE, "copy", src, errno != 0 ? errno : EIO);
+  }
+  if (out.Close() != 0) {
+    return SystemError(TEXEL_WHERE, "write", dst, errno);
+  }
+  return ErrHandle();
+}
+
+#else
+
+ErrHandle FileCopier::Copy(const std::string &src, const std::string &dst,
+                           file_copy::Method &method) {
+  std::error_code ec;
+  std::filesystem::remove(dst, ec);
+  if (try_hardlinks_) {
+    std::filesystem::create_hard_link(src, dst, ec);
+    if (!ec) {
+      method = file_copy::Method::Hardlink;
+      return ErrHandle();
+    }
+    try_hardlinks_ = false;
+  }
+
+  method = file_copy::Method::Regular;
+  if (!std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing, ec)) {
+    return SystemError(TEXEL_WHERE, "copy", src, ec.value());
+  }
+  return ErrHandle();
+}
+
+#endif // __linux__
+
+} // namespace texel
@@ -0,0 +1,48 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+namespace file_copy {
+
+// How the file was actually copied, from the cheapest to the most expensive way
+enum class Method {
+  // Copy-on-write clone, the data is shared until either file is modified (Btrfs, XFS)
+  Reflink,
+
+  // Both names refer to the same inode, so modifying the copy modifies the source
+  Hardlink,
+
+  // In-kernel copy, some file systems (NFS, CIFS) perform it on the server side
+  CopyFileRange,
+
+  // In-kernel copy through the page cache
+  SendFile,
+
+  // Plain read/write loop
+  Regular
+};
+std::string ToUserFriendly(Method method);
+
+} // namespace file_copy
+
+
+// Copies files using the cheapest mechanism that is supported by the file systems
+// Mechanisms that fail are not tried again, so a failure costs only a single system call
+// Thread-safe, a single instance is expected to be shared by all threads of the export
+class FileCopier {
+  public:
+    explicit FileCopier(bool allow_hardlinks);
+    FileCopier(const FileCopier &) = delete;
+    FileCopier &operator =(const FileCopier &) = delete;
+
+    // Copies 'src' to 'dst', the existing 'dst' file is replaced
+    // The parent directory of 'dst' must exist
+    ErrHandle Copy(const std::string &src, const std::string &dst, file_copy::Method &method);
+
+  private:
+    std::atomic<bool> try_reflinks_, try_hardlinks_;
+    std::atomic<bool> try_copy_file_range_, try_sendfile_;
+};
+
+} // namespace texel
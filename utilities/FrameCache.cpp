@@ -0,0 +1,159 @@
+#include "FrameCache.h"
+
+namespace texel {
+
+namespace {
+
+size_t FrameBytes(const DepthFrame &frame) {
+  return frame.Width() * frame.Height() * sizeof(uint16_t);
+}
+
+size_t FrameBytes(const ColorFrame &frame) {
+  return frame.Width() * frame.Height() * ColorFrame::Channels;
+}
+
+} // unnamed namespace
+
+//-------------------------
+//--- FrameCache::Shard ---
+//-------------------------
+
+struct FrameCache::Key {
+  Kind kind;
+  std::string stream;
+  size_t idx;
+
+  bool operator ==(const Key &other) const {
+    return kind == other.kind && idx == other.idx && stream == other.stream;
+  }
+};
+
+struct FrameCache::KeyHash {
+  size_t operator ()(const Key &key) const {
+    size_t hash = std::hash<std::string>()(key.stream);
+    return hash ^ ((key.idx * 2 + (key.kind == Kind::Color)) * 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+  }
+};
+
+struct FrameCache::Shard {
+  struct Entry {
+    Key key;
+    std::shared_ptr<const void> frame;
+    size_t bytes;
+  };
+
+  std::mutex mutex;
+  std::condition_variable loaded;
+
+  // The most recently used frames are at the front
+  std::list<Entry> lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries;
+  std::unordered_set<Key, KeyHash> loading;
+  size_t bytes = 0;
+};
+
+//------------------
+//--- FrameCache ---
+//------------------
+
+FrameCache::FrameCache(const frame_cache::Params &params)
+  : params_(params), hits_(0), misses_(0), evictions_(0) {
+  params_.n_shards = std::max<size_t>(params_.n_shards, 1);
+  for (size_t i = 0; i < params_.n_shards; i++) {
+    shards_.emplace_back(new Shard());
+  }
+}
+
+FrameCache::~FrameCache() {
+  // nothing
+}
+
+ErrHandle FrameCache::Depth(const std::string &stream, size_t idx, const std::string &filename,
+                            std::shared_ptr<const DepthFrame> &frame) {
+  return Get(Kind::Depth, stream, idx, filename, frame);
+}
+
+ErrHandle FrameCache::Color(const std::string &stream, size_t idx, const std::string &filename,
+                            std::shared_ptr<const ColorFrame> &frame) {
+  return Get(Kind::Color, stream, idx, filename, frame);
+}
+
+template <typename Frame>
+ErrHandle FrameCache::Get(Kind kind, const std::string &stream, size_t idx, const std::string &filename,
+                          std::shared_ptr<const Frame> &frame) {
+  Key key{ kind, stream, idx };
+  uint64_t hash = (uint64_t)KeyHash()(key) * 0xff51afd7ed558ccdull;
+  auto &shard = *shards_[(hash >> 32) % shards_.size()];
+
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    while (true) {
+      auto iter = shard.entries.find(key);
+      if (iter != shard.entries.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+        frame = std::static_pointer_cast<const Frame>(iter->second->frame);
+        hits_ += 1;
+        return ErrHandle();
+      }
+      if (shard.loading.count(key) == 0) {
+        break;
+      }
+      // Another thread decodes this frame right now
+      shard.loaded.wait(lock);
+    }
+    shard.loading.insert(key);
+    misses_ += 1;
+  }
+
+  // Decoding is the expensive part, so the shard is not locked meanwhile
+  auto decoded = std::make_shared<Frame>();
+  auto err = Frame::Load(filename, *decoded);
+  size_t bytes = FrameBytes(*decoded);
+  size_t budget = params_.budget / shards_.size();
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.loading.erase(key);
+    if (err.Succeeded() && bytes <= budget) {
+      shard.lru.push_front(Shard::Entry{ key, decoded, bytes });
+      shard.entries.emplace(key, shard.lru.begin());
+      shard.bytes += bytes;
+      while (shard.bytes > budget) {
+        auto &last = shard.lru.back();
+        shard.bytes -= last.bytes;
+        shard.entries.erase(last.key);
+        shard.lru.pop_back();
+        evictions_ += 1;
+      }
+    }
+  }
+  shard.loaded.notify_all();
+
+  TEXEL_CHECK(err);
+  frame = std::move(decoded);
+  return ErrHandle();
+}
+
+void FrameCache::Clear() {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->entries.clear();
+    shard->lru.clear();
+    shard->bytes = 0;
+  }
+}
+
+frame_cache::Stats FrameCache::Stats() const {
+  frame_cache::Stats stats;
+  stats.hits      = hits_;
+  stats.misses    = misses_;
+  stats.evictions = evictions_;
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    stats.frames += shard->lru.size();
+    stats.bytes  += shard->bytes;
+  }
+  return stats;
+}
+
+} // namespace texel
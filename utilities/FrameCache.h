@@ -0,0 +1,72 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+
+namespace texel {
+
+namespace frame_cache {
+
+struct Params {
+  // Decoded frames are evicted when their total size exceeds the budget (in bytes)
+  size_t budget;
+
+  // Each shard has its own lock and an equal part of the budget
+  // Frames are spread between shards randomly, so keep the budget well above 'n_shards' frames
+  size_t n_shards;
+
+  Params()
+    : budget(size_t(2) << 30),
+      n_shards(16) {
+  }
+};
+
+struct Stats {
+  uint64_t hits, misses, evictions;
+  size_t frames, bytes;   // what is cached at the moment
+
+  Stats() : hits(0), misses(0), evictions(0), frames(0), bytes(0) { }
+};
+
+} // namespace frame_cache
+
+
+// Keeps recently used decoded frames in memory, so repeated passes over the same frames
+// (normals, statistics, reconstruction) decode each of them only once
+// Frames are identified by their stream (the frame directory) and their index in the stream
+// Thread-safe, only the shard of the frame is locked. If a few threads need the same frame,
+// one of them decodes it and the others wait
+class FrameCache {
+  public:
+    explicit FrameCache(const frame_cache::Params &params = frame_cache::Params());
+    FrameCache(const FrameCache &) = delete;
+    FrameCache &operator =(const FrameCache &) = delete;
+    ~FrameCache();
+
+    // Returns the cached frame or loads 'filename' on a miss
+    // Evicted frames stay valid while they are referenced, but they no longer count against the budget
+    ErrHandle Depth(const std::string &stream, size_t idx, const std::string &filename,
+                    std::shared_ptr<const DepthFrame> &frame);
+    ErrHandle Color(const std::string &stream, size_t idx, const std::string &filename,
+                    std::shared_ptr<const ColorFrame> &frame);
+
+    // Drops all cached frames, the statistics are kept
+    void Clear();
+
+    frame_cache::Stats Stats() const;
+
+  private:
+    enum class Kind { Depth, Color };
+    struct Key;
+    struct KeyHash;
+    struct Shard;
+
+    template <typename Frame>
+    ErrHandle Get(Kind kind, const std::string &stream, size_t idx, const std::string &filename,
+                  std::shared_ptr<const Frame> &frame);
+
+    frame_cache::Params params_;
+    std::vector<std::unique_ptr<Shard> > shards_;
+    std::atomic<uint64_t> hits_, misses_, evictions_;
+};
+
+} // namespace texel
@@ -0,0 +1,193 @@
+#include "FrameDedup.h"
+#include "BatchReader.h"
+#include "Simd.h"
+
+namespace texel {
+
+//-------------------
+//--- frame_dedup ---
+//-------------------
+
+namespace frame_dedup {
+
+void ComputeFingerprint(const DepthFrame &frame, const Params &params, Fingerprint &fingerprint) {
+  using simd::Float4;
+  size_t grid_w = std::max<size_t>(params.grid_width, 1), grid_h = std::max<size_t>(params.grid_height, 1);
+  size_t n_cells = grid_w * grid_h;
+  fingerprint.cells.assign((n_cells + Float4::Width - 1) / Float4::Width * Float4::Width, 0.0f);
+  size_t width = frame.Width(), height = frame.Height();
+  if (width < grid_w || height < grid_h) {
+    return;
+  }
+
+  float min_mm = params.min_depth / DepthFrame::Scale, max_mm = params.max_depth / DepthFrame::Scale;
+  Float4 min_v(min_mm), max_v(max_mm), zero(0.0f);
+  std::vector<double> sums(n_cells, 0.0);
+  std::vector<size_t> counts(n_cells, 0);
+  for (size_t y = 0, cell_y = 0; y < height; y++) {
+    const uint16_t *row = frame.Row(y);
+    if (y >= (cell_y + 1) * height / grid_h) {
+      cell_y += 1;
+    }
+    for (size_t cell_x = 0; cell_x < grid_w; cell_x++) {
+      size_t x = cell_x * width / grid_w, x_end = (cell_x + 1) * width / grid_w;
+      Float4 sum(0.0f);
+      size_t count = 0;
+      for (; x + Float4::Width <= x_end; x += Float4::Width) {
+        Float4 d = Float4::FromUInt16(row + x);
+        Float4 valid = (d >= min_v) & (d <= max_v);
+        sum = sum + Select(valid, d, zero);
+        count += (size_t)simd::CountBits(MoveMask(valid));
+      }
+      double total = HorizontalSum(sum);
+      for (; x < x_end; x++) {
+        if (row[x] >= min_mm && row[x] <= max_mm) {
+          total += row[x];
+          count += 1;
+        }
+      }
+      sums[cell_y * grid_w + cell_x] += total;
+      counts[cell_y * grid_w + cell_x] += count;
+    }
+  }
+
+  for (size_t cell_y = 0; cell_y < grid_h; cell_y++) {
+    size_t n_rows = (cell_y + 1) * height / grid_h - cell_y * height / grid_h;
+    for (size_t cell_x = 0; cell_x < grid_w; cell_x++) {
+      size_t n_pixels = n_rows * ((cell_x + 1) * width / grid_w - cell_x * width / grid_w);
+      size_t idx = cell_y * grid_w + cell_x;
+      if (counts[idx] > 0 && counts[idx] >= params.min_cell_coverage * n_pixels) {
+        fingerprint.cells[idx] = (float)(sums[idx] / counts[idx]);
+      }
+    }
+  }
+}
+
+Difference Compare(const Fingerprint &a, const Fingerprint &b) {
+  using simd::Float4;
+  Difference diff;
+  size_t n_cells = std::min(a.cells.size(), b.cells.size());
+  if (n_cells == 0) {
+    return diff;
+  }
+
+  Float4 zero(0.0f), sum(0.0f);
+  size_t n_a = 0, n_b = 0, n_both = 0;
+  for (size_t i = 0; i < n_cells; i += Float4::Width) {
+    Float4 va = Float4::Load(&a.cells[i]), vb = Float4::Load(&b.cells[i]);
+    Float4 valid_a = va > zero, valid_b = vb > zero, both = valid_a & valid_b;
+    n_a    += (size_t)simd::CountBits(MoveMask(valid_a));
+    n_b    += (size_t)simd::CountBits(MoveMask(valid_b));
+    n_both += (size_t)simd::CountBits(MoveMask(both));
+    sum = sum + Select(both, Abs(va - vb), zero);
+  }
+  diff.change  = n_both > 0 ? HorizontalSum(sum) / n_both : 0.0f;
+  diff.flipped = (float)(n_a + n_b - 2 * n_both) / n_cells;
+  return diff;
+}
+
+} // namespace frame_dedup
+
+//------------------
+//--- FrameDedup ---
+//------------------
+
+FrameDedup::FrameDedup(const frame_dedup::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool) {
+}
+
+ErrHandle FrameDedup::Select(const scanogram::Stream &stream, frame_dedup::Selection &selection) const {
+  Camera camera;
+  std::string dir;
+  if (!stream.HasDepth(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+
+  // Many reads are kept in flight and the pool decodes the frames, only the small fingerprints are kept
+  // Fingerprints take a single pass over a frame, so the serialized callback does not hold up the decoders
+  std::vector<frame_dedup::Fingerprint> fingerprints(files.size());
+  BatchReader reader;
+  TEXEL_CHECK(reader.ReadDepthFrames(files, [&](size_t idx, const DepthFrame &frame) {
+    frame_dedup::ComputeFingerprint(frame, params_, fingerprints[idx]);
+    return ErrHandle();
+  }, pool_));
+
+  Select(fingerprints, selection);
+  selection.files = std::move(files);
+  return ErrHandle();
+}
+
+void FrameDedup::Select(const std::vector<frame_dedup::Fingerprint> &fingerprints,
+                        frame_dedup::Selection &selection) const {
+  selection.keyframes.clear();
+  selection.keyframe_of.resize(fingerprints.size());
+  selection.differences.assign(fingerprints.size(), frame_dedup::Difference());
+  selection.max_difference = frame_dedup::Difference();
+
+  // Comparing with the last keyframe rather than with the previous frame, so slow drifts are not lost
+  size_t key = 0;
+  for (size_t i = 0; i < fingerprints.size(); i++) {
+    auto diff = i > 0 ? frame_dedup::Compare(fingerprints[key], fingerprints[i]) : frame_dedup::Difference();
+    bool new_key = i == 0 ||
+                   diff.change > params_.max_change || diff.flipped > params_.max_flipped ||
+                   (params_.max_gap > 0 && i - key >= params_.max_gap);
+    if (new_key) {
+      key = i;
+      selection.keyframes.emplace_back(i);
+      selection.keyframe_of[i] = i;
+      continue;
+    }
+    selection.keyframe_of[i] = key;
+    selection.differences[i] = diff;
+    selection.max_difference.change  = std::max(selection.max_difference.change, diff.change);
+    selection.max_difference.flipped = std::max(selection.max_difference.flipped, diff.flipped);
+  }
+}
+
+ErrHandle FrameDedup::ExportKeyframes(const scanogram::Stream &stream, const frame_dedup::Selection &selection,
+                                      const std::string &depth_dir, const std::string &color_dir,
+                                      FileCopier &copier) {
+  auto copy = [&copier](const std::string &src, const std::string &dir) {
+    auto dst = std::filesystem::path(dir) / std::filesystem::path(src).filename();
+    file_copy::Method method;
+    return copier.Copy(src, dst.string(), method);
+  };
+
+  std::error_code ec;
+  std::filesystem::create_directories(depth_dir, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "failed to create '" << depth_dir << "' (" << ec.message() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  for (auto idx : selection.keyframes) {
+    TEXEL_CHECK(copy(selection.files[idx], depth_dir));
+  }
+
+  Camera camera;
+  std::string src_color_dir;
+  if (color_dir.empty() || !stream.HasColor(camera, src_color_dir)) {
+    return ErrHandle();
+  }
+  std::vector<std::string> color_files;
+  std::vector<std::pair<size_t, size_t> > pairs;
+  TEXEL_CHECK(frames::ListFiles(src_color_dir, ".jpg", color_files));
+  frames::MatchByName(selection.files, color_files, pairs);
+
+  std::filesystem::create_directories(color_dir, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "failed to create '" << color_dir << "' (" << ec.message() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  for (const auto &pair : pairs) {
+    if (selection.keyframe_of[pair.first] == pair.first) {
+      TEXEL_CHECK(copy(color_files[pair.second], color_dir));
+    }
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
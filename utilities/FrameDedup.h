@@ -0,0 +1,104 @@
+#pragma once
+#include "Defs.h"
+#include "FileCopy.h"
+#include "Frames.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace frame_dedup {
+
+struct Params {
+  // Size of the fingerprint grid, each cell keeps the mean depth of its pixels
+  size_t grid_width, grid_height;
+
+  // A cell is valid if at least this share of its pixels is valid
+  float min_cell_coverage;
+
+  // Depth values outside this range are invalid (in meters)
+  float min_depth, max_depth;
+
+  // A frame is dropped if it differs from the last keyframe by less than 'max_change' (mean over cells
+  // valid in both frames, in millimeters) and less than 'max_flipped' of cells changed their validity
+  float max_change, max_flipped;
+
+  // Keyframes are taken at least every 'max_gap' frames, zero disables the limit
+  size_t max_gap;
+
+  Params()
+    : grid_width(32), grid_height(32),
+      min_cell_coverage(0.5f),
+      min_depth(0.2f), max_depth(5.0f),
+      max_change(10.0f), max_flipped(0.02f),
+      max_gap(30) {
+  }
+};
+
+// A compact signature of a depth frame: mean depth per cell (in millimeters), zero for invalid cells
+// The number of cells is padded with invalid ones to whole SIMD blocks
+struct Fingerprint {
+  std::vector<float> cells;
+};
+
+// Difference between two fingerprints
+struct Difference {
+  float change;     // mean absolute difference over cells valid in both, in millimeters
+  float flipped;    // share of cells that are valid only in one of them
+
+  Difference() : change(0.0f), flipped(0.0f) { }
+};
+
+// Computes the fingerprint of a frame
+void ComputeFingerprint(const DepthFrame &frame, const Params &params, Fingerprint &fingerprint);
+
+// Compares two fingerprints computed with the same parameters
+Difference Compare(const Fingerprint &a, const Fingerprint &b);
+
+struct Selection {
+  // Depth maps of the stream and indices of the kept ones
+  std::vector<std::string> files;
+  std::vector<size_t> keyframes;
+
+  // For each frame, the keyframe that replaces it and the difference between them
+  // Every dropped frame is within the thresholds of its keyframe, that bounds the lost information
+  std::vector<size_t> keyframe_of;
+  std::vector<Difference> differences;
+
+  // The worst difference over dropped frames
+  Difference max_difference;
+};
+
+} // namespace frame_dedup
+
+
+// Thins redundant recordings: consecutive depth maps of a slowly turning person are almost identical
+// Frames are decoded concurrently and reduced to small fingerprints, then each frame is compared with
+// the last keyframe and becomes a new keyframe only if it differs enough (or the gap becomes too long)
+class FrameDedup {
+  public:
+    explicit FrameDedup(const frame_dedup::Params &params = frame_dedup::Params(),
+                        ThreadPool &pool = ThreadPool::Default());
+    FrameDedup(const FrameDedup &) = delete;
+    FrameDedup &operator =(const FrameDedup &) = delete;
+
+    const frame_dedup::Params &Params() const { return params_; }
+
+    // Selects keyframes among the depth maps of the stream
+    ErrHandle Select(const scanogram::Stream &stream, frame_dedup::Selection &selection) const;
+
+    // Selects keyframes among already computed fingerprints (in order of frames)
+    void Select(const std::vector<frame_dedup::Fingerprint> &fingerprints, frame_dedup::Selection &selection) const;
+
+    // Copies keyframe depth maps into 'depth_dir' and, if the stream has color frames, the matching
+    // color frames into 'color_dir'. The directories are created if needed
+    static ErrHandle ExportKeyframes(const scanogram::Stream &stream, const frame_dedup::Selection &selection,
+                                     const std::string &depth_dir, const std::string &color_dir,
+                                     FileCopier &copier);
+
+  private:
+    frame_dedup::Params params_;
+    ThreadPool &pool_;
+};
+
+} // namespace texel
@@ -0,0 +1,172 @@
+#include "FramePairs.h"
+#include "Metrics.h"
+
+namespace texel {
+
+namespace {
+
+struct PairMetrics {
+  metrics::Counter *pairs;
+  metrics::Histogram *wait_seconds;
+
+  PairMetrics() {
+    auto &registry = metrics::Registry::Default();
+    pairs        = &registry.GetCounter("texel_frame_pairs_total", "RGB-D pairs delivered by 'FramePairs'");
+    wait_seconds = &registry.GetHistogram("texel_frame_pair_wait_seconds",
+                                          "Time the consumer of 'FramePairs' waits for the next batch");
+  }
+
+  static PairMetrics &Get() {
+    static PairMetrics instance;
+    return instance;
+  }
+};
+
+// Exceptions (e.g. 'std::bad_alloc') must not escape the decoding threads, they stop the iteration instead
+template <typename Func>
+ErrHandle Guard(Func &&func) {
+  try {
+    return func();
+  }
+  catch (const std::exception &e) {
+    return ErrHandle(TEXEL_WHERE, std::string("failed to decode a frame (") + e.what() + ")");
+  }
+}
+
+} // unnamed namespace
+
+//------------------
+//--- FramePairs ---
+//------------------
+
+FramePairs::FramePairs(const frame_pairs::Params &params)
+  : params_(params), decoders_(params.n_threads), position_(0) {
+  if (params_.batch_size == 0) {
+    params_.batch_size = decoders_.Concurrency() * 2;
+  }
+  front_.first = front_.last = 0;
+  back_.first  = back_.last  = 0;
+}
+
+FramePairs::~FramePairs() {
+  Wait();
+}
+
+ErrHandle FramePairs::Bind(const scanogram::Stream &stream) {
+  // The pending batch refers to the previous files
+  Wait();
+  depth_files_.clear();
+  color_files_.clear();
+  pairs_.clear();
+  Reset();
+
+  Camera color_camera;
+  std::string depth_dir, color_dir;
+  if (!stream.HasDepth(depth_camera_, depth_dir) ||
+      !stream.HasColor(color_camera, color_dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream must contain both depth maps and color frames");
+  }
+  color_decode::Layout layout;
+  if (!color_decode::Plan(color_camera.Width(), color_camera.Height(), params_.color, layout)) {
+    return ErrHandle(TEXEL_WHERE, "the region of interest is outside the color frames");
+  }
+  color_camera_ = color_decode::AdjustCamera(color_camera, layout);
+  TEXEL_CHECK(frames::ListFiles(depth_dir, ".png", depth_files_));
+  TEXEL_CHECK(frames::ListFiles(color_dir, ".jpg", color_files_));
+
+  std::vector<std::pair<size_t, size_t> > matched;
+  frames::MatchByName(depth_files_, color_files_, matched);
+  pairs_.reserve(matched.size());
+  for (const auto &pair : matched) {
+    pairs_.push_back(frame_pairs::Pair{ pair.first, pair.second });
+  }
+  Reset();
+  return ErrHandle();
+}
+
+void FramePairs::Reset() {
+  Wait();
+  front_.first = front_.last = 0;
+  back_.first  = back_.last  = 0;
+  position_ = 0;
+  error_ = ErrHandle();
+  Prefetch(0);
+}
+
+void FramePairs::Prefetch(size_t first) {
+  size_t last = std::min(first + params_.batch_size, pairs_.size());
+  back_.first = first;
+  back_.last  = last;
+  if (first >= last) {
+    return;
+  }
+  back_.depth.resize(params_.batch_size);
+  back_.color.resize(params_.batch_size);
+  back_.depth_errors.resize(params_.batch_size);
+  back_.color_errors.resize(params_.batch_size);
+
+  // Depth and color frames are decoded as separate tasks, JPEG decoding takes longer
+  // The task thread submits the job to the decoders and takes part in it
+  pending_ = std::async(std::launch::async, [this, first, last]() {
+    decoders_.ParallelFor(0, 2 * (last - first), [&](size_t task) {
+      size_t slot = task / 2;
+      const auto &pair = pairs_[first + slot];
+      if (task % 2 == 0) {
+        back_.depth_errors[slot] = Guard([&]() {
+          return DepthFrame::Load(depth_files_[pair.depth_idx], back_.depth[slot]);
+        });
+      }
+      else {
+        back_.color_errors[slot] = Guard([&]() {
+          return ColorFrame::Load(color_files_[pair.color_idx], params_.color, back_.color[slot]);
+        });
+      }
+    });
+  });
+}
+
+void FramePairs::Wait() {
+  if (pending_.valid()) {
+    pending_.get();
+  }
+}
+
+bool FramePairs::FindNext() {
+  if (error_.Failed() || position_ >= pairs_.size()) {
+    return false;
+  }
+
+  // The current batch is over, the next one has been decoded meanwhile
+  if (position_ >= front_.last) {
+    {
+      // Near zero while decoding keeps up with the consumer
+      metrics::ScopedTimer timer(PairMetrics::Get().wait_seconds);
+      Wait();
+    }
+    std::swap(front_, back_);
+    Prefetch(front_.last);
+  }
+
+  size_t slot = position_ - front_.first;
+  if (front_.depth_errors[slot].Failed() || front_.color_errors[slot].Failed()) {
+    error_ = front_.depth_errors[slot].Failed() ? front_.depth_errors[slot] : front_.color_errors[slot];
+    return false;
+  }
+  position_ += 1;
+  PairMetrics::Get().pairs->Add(1);
+  return true;
+}
+
+const frame_pairs::Pair &FramePairs::Current() const {
+  return pairs_[position_ - 1];
+}
+
+const DepthFrame &FramePairs::Depth() const {
+  return front_.depth[position_ - 1 - front_.first];
+}
+
+const ColorFrame &FramePairs::Color() const {
+  return front_.color[position_ - 1 - front_.first];
+}
+
+} // namespace texel
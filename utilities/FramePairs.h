@@ -0,0 +1,104 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace frame_pairs {
+
+// Indices of the paired files in the depth and color directories
+struct Pair {
+  size_t depth_idx, color_idx;
+};
+
+struct Params {
+  // Threads that decode frames, zero means as many as the hardware supports
+  size_t n_threads;
+
+  // Pairs that are decoded at once, zero means twice the number of threads
+  size_t batch_size;
+
+  // Color frames may be decoded at a reduced scale or only partially, see 'color_decode::Options'
+  color_decode::Options color;
+
+  Params() : n_threads(0), batch_size(0) { }
+};
+
+} // namespace frame_pairs
+
+
+// Iterates over synchronized RGB-D frames of a stream
+// Depth maps and color frames are paired once by their names (or by their order, see 'frames::MatchByName()')
+// The next batch of pairs is decoded while the current one is consumed, so the consumer mostly finds
+// the frames ready. Decoding has its own threads: the consumer may keep the shared pool busy meanwhile
+// (e.g. 'ColorRegistration'), a common pool would serialize both. Frames are decoded into reusable buffers
+// and delivered in order
+//
+// Usage:
+//   FramePairs pairs;
+//   TEXEL_CHECK(pairs.Bind(stream));
+//   while (pairs.FindNext()) {
+//     Process(pairs.Depth(), pairs.Color());
+//   }
+//   TEXEL_CHECK(pairs.Error());
+class FramePairs {
+  public:
+    explicit FramePairs(const frame_pairs::Params &params = frame_pairs::Params());
+    FramePairs(const FramePairs &) = delete;
+    FramePairs &operator =(const FramePairs &) = delete;
+    ~FramePairs();
+
+    // Pairs frames of the stream, it must contain both depth maps and color frames
+    ErrHandle Bind(const scanogram::Stream &stream);
+
+    // Intrinsics of the decoded color frames are adjusted for 'frame_pairs::Params::color'
+    const Camera &DepthCamera() const { return depth_camera_; }
+    const Camera &ColorCamera() const { return color_camera_; }
+
+    const std::vector<std::string> &DepthFiles() const { return depth_files_; }
+    const std::vector<std::string> &ColorFiles() const { return color_files_; }
+    const std::vector<frame_pairs::Pair> &Pairs() const { return pairs_; }
+
+    // Restarts the iteration from the first pair
+    void Reset();
+
+    // Decodes the next pair and returns 'true'
+    // Returns 'false' if no pairs left or a frame cannot be decoded, see 'Error()'
+    bool FindNext();
+
+    // The failure that stopped the iteration
+    const ErrHandle &Error() const { return error_; }
+
+    // The current pair, valid until the next 'FindNext()' call
+    const frame_pairs::Pair &Current() const;
+    const DepthFrame &Depth() const;
+    const ColorFrame &Color() const;
+
+  private:
+    struct Batch {
+      size_t first, last;
+      std::vector<DepthFrame> depth;
+      std::vector<ColorFrame> color;
+      std::vector<ErrHandle> depth_errors, color_errors;
+    };
+
+    // Starts decoding of the batch that begins with the pair 'first' into 'back_'
+    void Prefetch(size_t first);
+    void Wait();
+
+    frame_pairs::Params params_;
+    ThreadPool decoders_;
+
+    Camera depth_camera_, color_camera_;
+    std::vector<std::string> depth_files_, color_files_;
+    std::vector<frame_pairs::Pair> pairs_;
+
+    Batch front_, back_;
+    std::future<void> pending_;
+    size_t position_;     // the number of delivered pairs
+    ErrHandle error_;
+};
+
+} // namespace texel
@@ -0,0 +1,396 @@
+#include "FrameRegistration.h"
+#include "Normals.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+using simd::Float4;
+
+// Points and normals are stored as planes, this helper gathers 4 neighbouring values
+// Missing values (beyond the row) are padded by zeros, i.e. become invalid points
+Float4 LoadRow(const float *row, size_t x, size_t width) {
+  if (x + Float4::Width <= width) {
+    return Float4::Load(row + x);
+  }
+  float tmp[Float4::Width] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for (size_t i = 0; x + i < width; i++) {
+    tmp[i] = row[x + i];
+  }
+  return Float4::Load(tmp);
+}
+
+// Converts depth (in meters) of the level into 3D points
+void BackProject(icp::Level &level, const std::vector<float> &depth) {
+  const size_t width = level.width, height = level.height;
+  level.x.assign(width * height, 0.0f);
+  level.y.assign(width * height, 0.0f);
+  level.z.assign(width * height, 0.0f);
+
+  const Float4 inv_fx(1.0f / level.fx), inv_fy(1.0f / level.fy);
+  const Float4 cx(level.cx), cy(level.cy);
+  const Float4 lane(0.0f, 1.0f, 2.0f, 3.0f);
+  for (size_t y = 0; y < height; y++) {
+    const Float4 ray_y = (Float4((float)y) - cy) * inv_fy;
+    const size_t offset = y * width;
+    size_t x = 0;
+    for (; x + Float4::Width <= width; x += Float4::Width) {
+      Float4 z = Float4::Load(depth.data() + offset + x);
+      Float4 ray_x = (Float4((float)x) + lane - cx) * inv_fx;
+      (ray_x * z).Store(level.x.data() + offset + x);
+      (ray_y * z).Store(level.y.data() + offset + x);
+      z.Store(level.z.data() + offset + x);
+    }
+    for (; x < width; x++) {
+      float z = depth[offset + x];
+      level.x[offset + x] = ((float)x - level.cx) / level.fx * z;
+      level.y[offset + x] = ((float)y - level.cy) / level.fy * z;
+      level.z[offset + x] = z;
+    }
+  }
+}
+
+// Halves resolution of the depth map, averages only values that are close to the nearest one
+void Downsample(const std::vector<float> &src, size_t width, size_t height,
+                std::vector<float> &dst, float max_jump) {
+  const size_t dst_width = width / 2, dst_height = height / 2;
+  dst.assign(dst_width * dst_height, 0.0f);
+  for (size_t y = 0; y < dst_height; y++) {
+    const float *row0 = src.data() + (2 * y) * width;
+    const float *row1 = row0 + width;
+    for (size_t x = 0; x < dst_width; x++) {
+      float values[4] = { row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1] };
+      float nearest = std::numeric_limits<float>::max();
+      for (float value : values) {
+        if (value > 0.0f) {
+          nearest = std::min(nearest, value);
+        }
+      }
+      float sum = 0.0f;
+      size_t count = 0;
+      for (float value : values) {
+        if (value > 0.0f && value - nearest <= max_jump) {
+          sum += value;
+          count += 1;
+        }
+      }
+      dst[y * dst_width + x] = count > 0 ? sum / (float)count : 0.0f;
+    }
+  }
+}
+
+// See 'geometry::PointToPlaneSystem'
+constexpr size_t SystemSize = geometry::PointToPlaneSize;
+typedef geometry::PointToPlaneSystem System;
+
+// Accumulates normal equations for rows [first, last) of the source level
+void AccumulateRows(const icp::Level &target, const icp::Level &source,
+                    const RigidTransform &pose,
+                    float max_distance, float min_cos,
+                    size_t first, size_t last,
+                    System &system) {
+  const auto &rot = pose.Rotation();
+  const auto &off = pose.Offset();
+  const Float4 r00(rot[0].x), r01(rot[1].x), r02(rot[2].x);
+  const Float4 r10(rot[0].y), r11(rot[1].y), r12(rot[2].y);
+  const Float4 r20(rot[0].z), r21(rot[1].z), r22(rot[2].z);
+  const Float4 tx(off.x), ty(off.y), tz(off.z);
+  const Float4 fx(target.fx), fy(target.fy), cx(target.cx), cy(target.cy);
+  const Float4 zero(0.0f), one(1.0f);
+  const Float4 max_dist2(max_distance * max_distance), cos_threshold(min_cos);
+  const int target_width = (int)target.width, target_height = (int)target.height;
+
+  for (size_t y = first; y < last; y++) {
+    const size_t offset = y * source.width;
+    Float4 acc[SystemSize];
+
+    for (size_t x = 0; x < source.width; x += Float4::Width) {
+      // Transform source points and normals into the target space
+      Float4 sx = LoadRow(source.x.data() + offset, x, source.width);
+      Float4 sy = LoadRow(source.y.data() + offset, x, source.width);
+      Float4 sz = LoadRow(source.z.data() + offset, x, source.width);
+      Float4 snx = LoadRow(source.nx.data() + offset, x, source.width);
+      Float4 sny = LoadRow(source.ny.data() + offset, x, source.width);
+      Float4 snz = LoadRow(source.nz.data() + offset, x, source.width);
+      Float4 valid = (sz > zero) & ((snx * snx + sny * sny + snz * snz) > Float4(0.5f));
+      if (MoveMask(valid) == 0) {
+        continue;
+      }
+
+      Float4 px = r00 * sx + r01 * sy + r02 * sz + tx;
+      Float4 py = r10 * sx + r11 * sy + r12 * sz + ty;
+      Float4 pz = r20 * sx + r21 * sy + r22 * sz + tz;
+      Float4 qx = r00 * snx + r01 * sny + r02 * snz;
+      Float4 qy = r10 * snx + r11 * sny + r12 * snz;
+      Float4 qz = r20 * snx + r21 * sny + r22 * snz;
+      valid = valid & (pz > zero);
+      Float4 safe_z = Select(valid, pz, one);
+
+      // Projective data association: look for the target point in the same pixel
+      int32_t u[Float4::Width], v[Float4::Width];
+      RoundToInt(fx * px / safe_z + cx, u);
+      RoundToInt(fy * py / safe_z + cy, v);
+      int mask = MoveMask(valid);
+      float dx[Float4::Width] = {}, dy[Float4::Width] = {}, dz[Float4::Width] = {};
+      float nx[Float4::Width] = {}, ny[Float4::Width] = {}, nz[Float4::Width] = {};
+      for (size_t i = 0; i < Float4::Width; i++) {
+        if ((mask & (1 << i)) == 0 ||
+            u[i] < 0 || u[i] >= target_width || v[i] < 0 || v[i] >= target_height) {
+          continue;
+        }
+        size_t idx = (size_t)v[i] * target.width + (size_t)u[i];
+        dx[i] = target.x[idx];
+        dy[i] = target.y[idx];
+        dz[i] = target.z[idx];
+        nx[i] = target.nx[idx];
+        ny[i] = target.ny[idx];
+        nz[i] = target.nz[idx];
+      }
+      Float4 tnx = Float4::Load(nx), tny = Float4::Load(ny), tnz = Float4::Load(nz);
+      Float4 ex = px - Float4::Load(dx);
+      Float4 ey = py - Float4::Load(dy);
+      Float4 ez = pz - Float4::Load(dz);
+
+      // Reject outliers by distance and by orientation of normals
+      valid = valid & (Float4::Load(dz) > zero) &
+              ((ex * ex + ey * ey + ez * ez) < max_dist2) &
+              ((qx * tnx + qy * tny + qz * tnz) > cos_threshold);
+      if (MoveMask(valid) == 0) {
+        continue;
+      }
+
+      // Jacobian of the point-to-plane distance: [p x n, n]
+      Float4 j[6] = {
+        valid & (py * tnz - pz * tny),
+        valid & (pz * tnx - px * tnz),
+        valid & (px * tny - py * tnx),
+        valid & tnx,
+        valid & tny,
+        valid & tnz
+      };
+      Float4 e = valid & (tnx * ex + tny * ey + tnz * ez);
+
+      size_t k = 0;
+      for (size_t r = 0; r < 6; r++) {
+        for (size_t c = r; c < 6; c++) {
+          acc[k] = acc[k] + j[r] * j[c];
+          k++;
+        }
+      }
+      for (size_t r = 0; r < 6; r++) {
+        acc[k] = acc[k] + j[r] * e;
+        k++;
+      }
+      acc[k] = acc[k] + e * e;
+      acc[k + 1] = acc[k + 1] + (valid & one);
+    }
+
+    // Single-precision sums are exact enough for one row only
+    for (size_t k = 0; k < SystemSize; k++) {
+      system[k] += (double)HorizontalSum(acc[k]);
+    }
+  }
+}
+
+} // unnamed namespace
+
+//-------------------------
+//--- FrameRegistration ---
+//-------------------------
+
+FrameRegistration::FrameRegistration(const Camera &camera,
+                                     const icp::Params &params,
+                                     ThreadPool &pool)
+  : camera_(camera), params_(params), pool_(pool) {
+  // nothing
+}
+
+ErrHandle FrameRegistration::Prepare(const DepthFrame &frame, icp::Pyramid &pyramid) const {
+  if (frame.Width() != camera_.Width() || frame.Height() != camera_.Height()) {
+    std::ostringstream oss;
+    oss << "size of the depth frame (" << frame.Width() << "x" << frame.Height() << ") "
+        << "does not match the camera (" << camera_.Width() << "x" << camera_.Height() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  if (params_.n_levels == 0) {
+    return ErrHandle(TEXEL_WHERE, "at least one pyramid level is required");
+  }
+
+  // Convert millimeters into meters, drop values outside the working range
+  std::vector<float> depth(frame.Width() * frame.Height());
+  {
+    const uint16_t *src = frame.Data();
+    const Float4 scale(DepthFrame::Scale), zero(0.0f);
+    const Float4 min_depth(params_.min_depth), max_depth(params_.max_depth);
+    size_t i = 0;
+    for (; i + Float4::Width <= depth.size(); i += Float4::Width) {
+      Float4 d = Float4::FromUInt16(src + i) * scale;
+      Select((d >= min_depth) & (d <= max_depth), d, zero).Store(depth.data() + i);
+    }
+    for (; i < depth.size(); i++) {
+      float d = src[i] * DepthFrame::Scale;
+      depth[i] = d >= params_.min_depth && d <= params_.max_depth ? d : 0.0f;
+    }
+  }
+
+  // Depth jumps larger than the rejection distance are considered as discontinuities
+  const float max_jump = params_.max_distance;
+  pyramid.levels.resize(params_.n_levels);
+  for (size_t l = 0; l < params_.n_levels; l++) {
+    auto &level = pyramid.levels[l];
+    if (l == 0) {
+      level.width  = frame.Width();
+      level.height = frame.Height();
+      level.cx = camera_.Cx();
+      level.cy = camera_.Cy();
+      level.fx = camera_.Fx();
+      level.fy = camera_.Fy();
+    }
+    else {
+      const auto &prev = pyramid.levels[l - 1];
+      std::vector<float> coarse;
+      Downsample(depth, prev.width, prev.height, coarse, max_jump);
+      depth.swap(coarse);
+      level.width  = prev.width / 2;
+      level.height = prev.height / 2;
+      level.cx = (prev.cx + 0.5f) * 0.5f - 0.5f;
+      level.cy = (prev.cy + 0.5f) * 0.5f - 0.5f;
+      level.fx = prev.fx * 0.5f;
+      level.fy = prev.fy * 0.5f;
+    }
+    BackProject(level, depth);
+
+    level.nx.resize(level.width * level.height);
+    level.ny.resize(level.width * level.height);
+    level.nz.resize(level.width * level.height);
+    pool_.ParallelFor(0, level.height, 16, [&level, max_jump](size_t first, size_t last, size_t) {
+      normals::EstimateRows(level.x.data(), level.y.data(), level.z.data(),
+                            level.width, level.height, max_jump,
+                            level.nx.data(), level.ny.data(), level.nz.data(),
+                            first, last);
+    });
+  }
+  return ErrHandle();
+}
+
+icp::Estimate FrameRegistration::Align(const icp::Pyramid &target,
+                                       const icp::Pyramid &source,
+                                       const RigidTransform &guess) const {
+  icp::Estimate result;
+  result.pose = guess;
+  const size_t n_levels = std::min(target.levels.size(), source.levels.size());
+  const float min_cos = std::cos(params_.max_angle);
+
+  std::vector<System> partial(pool_.Concurrency());
+  for (size_t l = n_levels; l-- > 0; ) {
+    const auto &target_level = target.levels[l];
+    const auto &source_level = source.levels[l];
+    size_t n_iterations = l < params_.iterations.size() ? params_.iterations[l] : 0;
+
+    // Coarse levels tolerate larger misalignments
+    const float max_distance = params_.max_distance * (float)(1 << l);
+    for (size_t iter = 0; iter < n_iterations; iter++) {
+      for (auto &system : partial) {
+        system.fill(0.0);
+      }
+      pool_.ParallelFor(0, source_level.height, 8,
+        [&](size_t first, size_t last, size_t thread_idx) {
+          AccumulateRows(target_level, source_level, result.pose,
+                         max_distance, min_cos, first, last, partial[thread_idx]);
+        });
+
+      System system{};
+      for (const auto &part : partial) {
+        for (size_t k = 0; k < SystemSize; k++) {
+          system[k] += part[k];
+        }
+      }
+
+      size_t n_correspondences = (size_t)system[SystemSize - 1];
+      double x[6];
+      if (n_correspondences < 6 || !geometry::SolvePointToPlane(system, x)) {
+        break;
+      }
+      result.n_correspondences = n_correspondences;
+      result.rmse = (float)std::sqrt(system[SystemSize - 2] / (double)n_correspondences);
+
+      auto update = RigidTransform::FromTwist(glm::vec3((float)x[0], (float)x[1], (float)x[2]),
+                                              glm::vec3((float)x[3], (float)x[4], (float)x[5]));
+      result.pose = update * result.pose;
+
+      double norm = 0.0;
+      for (size_t k = 0; k < 6; k++) {
+        norm += x[k] * x[k];
+      }
+      if (std::sqrt(norm) < params_.min_update) {
+        break;
+      }
+    }
+  }
+
+  result.tracked = result.n_correspondences >= params_.min_correspondences;
+  return result;
+}
+
+ErrHandle FrameRegistration::RegisterStream(const scanogram::Stream &stream,
+                                            const icp::Params &params,
+                                            std::vector<icp::Estimate> &trajectory) {
+  trajectory.clear();
+  Camera camera;
+  std::string dir;
+  if (!stream.HasDepth(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+  if (files.empty()) {
+    std::ostringstream oss;
+    oss << "no depth maps were found in the '" << dir << "' directory";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  // Pairs of consecutive frames are independent, so we register them concurrently
+  // Each pair is processed by a single thread, batches bound the memory consumption
+  auto &pool = ThreadPool::Default();
+  FrameRegistration registration(camera, params, pool);
+  const size_t batch_size = pool.Concurrency() * 2;
+
+  trajectory.resize(files.size());
+  std::vector<icp::Pyramid> pyramids(batch_size + 1);
+  std::vector<ErrHandle> errors(batch_size + 1);
+  for (size_t first = 0; first < files.size(); first += batch_size) {
+    size_t last = std::min(first + batch_size, files.size());
+
+    // Slot 0 keeps the last pyramid of the previous batch
+    if (first > 0) {
+      std::swap(pyramids[0], pyramids[batch_size]);
+    }
+    pool.ParallelFor(first, last, [&](size_t i) {
+      DepthFrame frame;
+      auto &err = errors[i - first + 1];
+      err = DepthFrame::Load(files[i], frame);
+      if (err.Succeeded()) {
+        err = registration.Prepare(frame, pyramids[i - first + 1]);
+      }
+    });
+    for (size_t i = first; i < last; i++) {
+      TEXEL_CHECK(errors[i - first + 1]);
+    }
+
+    pool.ParallelFor(std::max<size_t>(first, 1), last, [&](size_t i) {
+      trajectory[i] = registration.Align(pyramids[i - first], pyramids[i - first + 1]);
+    });
+  }
+
+  // Chain relative motions, lost frames are assumed to be static
+  trajectory[0] = icp::Estimate();
+  for (size_t i = 1; i < trajectory.size(); i++) {
+    auto relative = trajectory[i].tracked ? trajectory[i].pose : RigidTransform();
+    trajectory[i].pose = trajectory[i - 1].pose * relative;
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,115 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace icp {
+
+// Parameters of the point-to-plane ICP
+struct Params {
+  // Number of pyramid levels, each next level halves the resolution
+  size_t n_levels;
+
+  // Maximal number of iterations per level, from the finest level to the coarsest one
+  std::vector<size_t> iterations;
+
+  // Correspondences that are farther from each other are rejected (in meters)
+  float max_distance;
+
+  // Correspondences with normals that deviate more are rejected (in radians)
+  float max_angle;
+
+  // Depth values outside this range are ignored (in meters)
+  float min_depth, max_depth;
+
+  // Iterations stop when the update becomes smaller (radians + meters)
+  float min_update;
+
+  // Registration is considered as failed if there are fewer correspondences
+  size_t min_correspondences;
+
+  Params()
+    : n_levels(3),
+      iterations{ 4, 6, 10 },
+      max_distance(0.05f),
+      max_angle(0.5f),
+      min_depth(0.2f), max_depth(5.0f),
+      min_update(1e-5f),
+      min_correspondences(1000) {
+  }
+};
+
+// One resolution level of an organized point cloud
+// Coordinates and normals are stored as separate planes to simplify vectorization
+struct Level {
+  size_t width, height;
+  float cx, cy, fx, fy;
+  std::vector<float> x, y, z;
+  std::vector<float> nx, ny, nz;
+
+  Level() : width(0), height(0), cx(0), cy(0), fx(0), fy(0) { }
+};
+
+// A depth frame converted into points and normals at several resolutions
+struct Pyramid {
+  std::vector<Level> levels;
+};
+
+// The result of frame registration
+struct Estimate {
+  // For a pair of frames, maps points of the source frame into the target one
+  // For a trajectory, maps points of the frame into the space of the first frame
+  RigidTransform pose;
+
+  // Root mean square of the point-to-plane distances at the finest level (in meters)
+  float rmse;
+
+  // Number of inliers at the finest level
+  size_t n_correspondences;
+
+  // 'false' if ICP diverged or did not find enough correspondences
+  bool tracked;
+
+  Estimate() : rmse(0.0f), n_correspondences(0), tracked(true) { }
+};
+
+} // namespace icp
+
+
+// Estimates rigid motion between depth frames from the same sensor
+// Uses point-to-plane ICP with projective data association and a coarse-to-fine pyramid
+class FrameRegistration {
+  public:
+    FrameRegistration(const Camera &camera,
+                      const icp::Params &params = icp::Params(),
+                      ThreadPool &pool = ThreadPool::Default());
+    FrameRegistration(const FrameRegistration &) = delete;
+    FrameRegistration &operator =(const FrameRegistration &) = delete;
+
+    const icp::Params &Params() const { return params_; }
+
+    // Converts a depth frame into the pyramid of points and normals
+    ErrHandle Prepare(const DepthFrame &frame, icp::Pyramid &pyramid) const;
+
+    // Finds the transformation that maps 'source' onto 'target'
+    // Iterations use all threads of the pool (if not called from the pool itself)
+    icp::Estimate Align(const icp::Pyramid &target, const icp::Pyramid &source,
+                        const RigidTransform &guess = RigidTransform()) const;
+
+    // Registers each pair of consecutive depth frames of the stream
+    // The resulting 'trajectory[i]' maps frame 'i' into the space of the first frame
+    static ErrHandle RegisterStream(const scanogram::Stream &stream,
+                                    const icp::Params &params,
+                                    std::vector<icp::Estimate> &trajectory);
+
+  private:
+    Camera camera_;
+    icp::Params params_;
+    ThreadPool &pool_;
+};
+
+} // namespace texel
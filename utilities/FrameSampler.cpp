@@ -0,0 +1,194 @@
+#include "FrameSampler.h"
+#include "Frames.h"
+
+namespace texel {
+
+namespace {
+
+// SplitMix64, the standard distributions are implementation-defined and break reproducibility
+class Random {
+  public:
+    explicit Random(uint64_t seed) : state_(seed) { }
+
+    uint64_t Next() {
+      uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+
+    // A value in [0, bound), the modulo bias is negligible for our sizes
+    uint64_t Below(uint64_t bound) {
+      return Next() % bound;
+    }
+
+  private:
+    uint64_t state_;
+};
+
+uint64_t Mix(uint64_t a, uint64_t b) {
+  return Random(a ^ (b * 0xd6e8feb86659fd93ull)).Next();
+}
+
+template <typename T>
+void Shuffle(std::vector<T> &values, Random &random) {
+  for (size_t i = values.size(); i > 1; i--) {
+    std::swap(values[i - 1], values[random.Below(i)]);
+  }
+}
+
+} // unnamed namespace
+
+//--------------------
+//--- FrameSampler ---
+//--------------------
+
+ErrHandle FrameSampler::Build(ScanogramFinder &finder, const frame_sampler::Params &params) {
+  params_ = params;
+  params_.block_size = std::max<size_t>(params_.block_size, 1);
+  sources_.clear();
+  names_.clear();
+  offsets_.assign(1, 0);
+
+  std::vector<std::string> files;
+  size_t scan_idx = 0;
+  finder.Reset();
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    decltype(auto) stages = info.scan.Stages();
+    for (size_t stage_idx = 0; stage_idx < stages.size(); stage_idx++) {
+      decltype(auto) streams = stages[stage_idx].Streams();
+      for (size_t stream_idx = 0; stream_idx < streams.size(); stream_idx++) {
+        frame_sampler::Source source;
+        if (!streams[stream_idx].HasDepth(source.camera, source.dir)) {
+          continue;
+        }
+        auto err = frames::ListFiles(source.dir, ".png", files);
+        if (err.Failed()) {
+          finder.Reset();
+          std::ostringstream oss;
+          oss << "failed to index depth frames of '" << info.id << "'";
+          return ErrHandle(TEXEL_WHERE, oss.str(), err);
+        }
+        if (files.empty()) {
+          continue;
+        }
+
+        source.scan_idx   = scan_idx;
+        source.scan_id    = info.id;
+        source.stage_idx  = stage_idx;
+        source.stream_idx = stream_idx;
+        source.first      = Size();
+        source.count      = files.size();
+        for (const auto &file : files) {
+          names_ += std::filesystem::path(file).filename().string();
+          offsets_.emplace_back(names_.size());
+        }
+        sources_.emplace_back(std::move(source));
+      }
+    }
+    scan_idx += 1;
+  }
+  finder.Reset();
+
+  // Block numbers are stored as 32-bit values
+  if (Size() / params_.block_size >= std::numeric_limits<uint32_t>::max()) {
+    return ErrHandle(TEXEL_WHERE, "too many frames for the block size, use larger blocks");
+  }
+  return ErrHandle();
+}
+
+void FrameSampler::Locate(size_t idx, frame_sampler::Frame &frame) const {
+  auto source = std::upper_bound(sources_.begin(), sources_.end(), idx,
+                                 [](size_t value, const frame_sampler::Source &s) { return value < s.first; });
+  frame.idx        = idx;
+  frame.source_idx = (size_t)(source - sources_.begin()) - 1;
+  frame.path       = (std::filesystem::path(sources_[frame.source_idx].dir) /
+                      names_.substr(offsets_[idx], offsets_[idx + 1] - offsets_[idx])).string();
+}
+
+size_t FrameSampler::RankSize(size_t n_ranks) const {
+  n_ranks = std::max<size_t>(n_ranks, 1);
+  return params_.drop_last ? Size() / n_ranks : (Size() + n_ranks - 1) / n_ranks;
+}
+
+FrameSampler::Epoch FrameSampler::Begin(size_t epoch, size_t rank, size_t n_ranks) const {
+  // Each rank takes a contiguous part of the shuffled sequence, so it still reads whole blocks
+  size_t rank_size = RankSize(n_ranks);
+  size_t first = std::min(rank, std::max<size_t>(n_ranks, 1) - 1) * rank_size;
+  return Epoch(*this, epoch, first, Size() > 0 ? first + rank_size : first);
+}
+
+//---------------------------
+//--- FrameSampler::Epoch ---
+//---------------------------
+
+FrameSampler::Epoch::Epoch(const FrameSampler &sampler, size_t epoch, size_t first, size_t last)
+  : sampler_(&sampler),
+    epoch_seed_(Mix(sampler.params_.seed, epoch)),
+    position_(first),
+    last_(last),
+    short_slot_(0),
+    cached_block_(std::numeric_limits<size_t>::max()) {
+  // The last block may be shorter than the others
+  size_t block_size = sampler.params_.block_size;
+  size_t n_blocks = (sampler.Size() + block_size - 1) / block_size;
+  blocks_.resize(n_blocks);
+  for (size_t i = 0; i < n_blocks; i++) {
+    blocks_[i] = (uint32_t)i;
+  }
+  Random random(epoch_seed_);
+  Shuffle(blocks_, random);
+  for (size_t i = 0; i < n_blocks; i++) {
+    if (blocks_[i] == n_blocks - 1) {
+      short_slot_ = i;
+    }
+  }
+}
+
+size_t FrameSampler::Epoch::FrameAt(size_t position) {
+  // Positions beyond the epoch wrap around, that is the padding of the last ranks
+  size_t n_frames = sampler_->Size();
+  size_t block_size = sampler_->params_.block_size;
+  size_t short_size = n_frames - (blocks_.size() - 1) * block_size;
+  position %= n_frames;
+
+  size_t slot = 0, offset = 0;
+  if (position < short_slot_ * block_size) {
+    slot   = position / block_size;
+    offset = position % block_size;
+  }
+  else if (position < short_slot_ * block_size + short_size) {
+    slot   = short_slot_;
+    offset = position - short_slot_ * block_size;
+  }
+  else {
+    size_t rest = position - short_slot_ * block_size - short_size;
+    slot   = short_slot_ + 1 + rest / block_size;
+    offset = rest % block_size;
+  }
+
+  size_t block = blocks_[slot];
+  if (block != cached_block_) {
+    size_t size = block == blocks_.size() - 1 ? short_size : block_size;
+    block_frames_.resize(size);
+    for (size_t i = 0; i < size; i++) {
+      block_frames_[i] = (uint32_t)i;
+    }
+    Random random(Mix(epoch_seed_, block));
+    Shuffle(block_frames_, random);
+    cached_block_ = block;
+  }
+  return block * block_size + block_frames_[offset];
+}
+
+bool FrameSampler::Epoch::FindNext() {
+  if (position_ >= last_) {
+    return false;
+  }
+  sampler_->Locate(FrameAt(position_), current_);
+  position_ += 1;
+  return true;
+}
+
+} // namespace texel
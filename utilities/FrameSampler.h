@@ -0,0 +1,121 @@
+#pragma once
+#include "Defs.h"
+#include "ScanogramFinder.h"
+
+namespace texel {
+
+namespace frame_sampler {
+
+struct Params {
+  // Consecutive frames (in the order of the global index) that are read together
+  // Larger blocks make reads more sequential, smaller ones make batches more diverse
+  size_t block_size;
+
+  // The same seed, epoch and rank always give the same sequence on any platform
+  uint64_t seed;
+
+  // If 'false', the shortest ranks repeat a few frames, otherwise the tail of the epoch is dropped
+  // Either way, all ranks get the same number of frames
+  bool drop_last;
+
+  Params()
+    : block_size(64),
+      seed(0),
+      drop_last(false) {
+  }
+};
+
+// A depth stream that contributes its frames to the global index
+struct Source {
+  size_t scan_idx;     // the order of 'ScanogramFinder::FindNext()'
+  std::string scan_id;
+  size_t stage_idx, stream_idx;
+  Camera camera;
+  std::string dir;
+  size_t first, count; // frames [first, first + count) of the global index
+};
+
+// A single sampled frame
+struct Frame {
+  size_t idx;          // in the global index
+  size_t source_idx;
+  std::string path;
+};
+
+} // namespace frame_sampler
+
+
+// Enumerates depth frames of the whole dataset in random order for training
+// Frames are split into blocks of sequential frames, blocks are shuffled and then frames inside each
+// block are shuffled too. So reads jump between blocks only, not between single frames.
+// Besides file names, the index takes a few bytes per frame, epochs take nothing per frame
+class FrameSampler {
+  public:
+    FrameSampler() = default;
+    FrameSampler(const FrameSampler &) = delete;
+    FrameSampler &operator =(const FrameSampler &) = delete;
+
+    // Lists the depth frames of all scans found by 'finder', the order of frames is stable
+    ErrHandle Build(ScanogramFinder &finder,
+                    const frame_sampler::Params &params = frame_sampler::Params());
+
+    // The total number of frames
+    size_t Size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+
+    const std::vector<frame_sampler::Source> &Sources() const { return sources_; }
+
+    // Provides the source and the path of the frame from the global index
+    void Locate(size_t idx, frame_sampler::Frame &frame) const;
+
+    // The number of frames each of 'n_ranks' data-parallel workers gets per epoch
+    size_t RankSize(size_t n_ranks) const;
+
+    class Epoch;
+
+    // Frames of the rank for the given epoch, each frame belongs to exactly one rank
+    // (unless padding is required, see 'Params::drop_last')
+    Epoch Begin(size_t epoch, size_t rank, size_t n_ranks) const;
+
+  private:
+    frame_sampler::Params params_;
+    std::vector<frame_sampler::Source> sources_;
+
+    // File names of all frames, packed one after another
+    std::string names_;
+    std::vector<uint64_t> offsets_;
+};
+
+
+// A cursor over the frames of one rank, it only keeps the order of blocks and the current block
+// The sampler must outlive it
+class FrameSampler::Epoch {
+  public:
+    Epoch(const Epoch &) = delete;
+    Epoch(Epoch &&) noexcept = default;
+    Epoch &operator =(const Epoch &) = delete;
+    Epoch &operator =(Epoch &&) noexcept = default;
+
+    // The same semantics as 'ScanogramFinder::FindNext()'
+    bool FindNext();
+    const frame_sampler::Frame &Current() const { return current_; }
+
+  private:
+    Epoch(const FrameSampler &sampler, size_t epoch, size_t first, size_t last);
+    size_t FrameAt(size_t position);
+
+    const FrameSampler *sampler_;
+    uint64_t epoch_seed_;
+    size_t position_, last_;
+
+    // Shuffled blocks, where the shorter last block landed and the shuffled frames of the current one
+    std::vector<uint32_t> blocks_;
+    size_t short_slot_;
+    size_t cached_block_;
+    std::vector<uint32_t> block_frames_;
+
+    frame_sampler::Frame current_;
+
+  friend class FrameSampler;
+};
+
+} // namespace texel
@@ -0,0 +1,669 @@
+#include "Frames.h"
+#include "Metrics.h"
+#include "Simd.h"
+#include <png.h>
+#include <jpeglib.h>
+#include <zlib.h>
+
+namespace texel {
+
+namespace {
+
+// Metrics of decoding, one set for each kind of frames
+struct DecodeMetrics {
+  metrics::Counter *decoded, *failed, *read_bytes;
+  metrics::Histogram *seconds;
+  metrics::Gauge *in_progress;
+
+  explicit DecodeMetrics(const std::string &kind) {
+    auto &registry = metrics::Registry::Default();
+    std::string labels = "kind=\"" + kind + "\"";
+    decoded     = &registry.GetCounter("texel_frames_decoded_total", "Decoded frames", labels);
+    failed      = &registry.GetCounter("texel_frame_decode_failures_total", "Frames that failed to decode", labels);
+    seconds     = &registry.GetHistogram("texel_frame_decode_seconds", "Time to decode a frame", labels);
+    in_progress = &registry.GetGauge("texel_frames_decoding", "Frames being decoded at the moment", labels);
+    read_bytes  = &registry.GetCounter("texel_read_bytes_total", "Bytes read from disk",
+                                       "source=\"" + kind + "\"");
+  }
+
+  void Count(bool succeeded) {
+    (succeeded ? decoded : failed)->Add(1);
+  }
+};
+
+DecodeMetrics &DepthMetrics() {
+  static DecodeMetrics instance("depth");
+  return instance;
+}
+
+DecodeMetrics &ColorMetrics() {
+  static DecodeMetrics instance("color");
+  return instance;
+}
+
+} // unnamed namespace
+
+//------------------
+//--- DepthFrame ---
+//------------------
+
+namespace {
+
+// An encoded image that is already in memory
+struct PngMemory {
+  const uint8_t *data;
+  size_t size, offset;
+};
+
+void ReadPngMemory(png_structp png, png_bytep out, png_size_t length) {
+  auto memory = static_cast<PngMemory *>(png_get_io_ptr(png));
+  if (length > memory->size - memory->offset) {
+    png_error(png, "unexpected end of data");
+  }
+  std::memcpy(out, memory->data + memory->offset, length);
+  memory->offset += length;
+}
+
+// libpng reports errors via 'longjmp()', so keep this function free of C++ objects with destructors
+bool DecodeGrayscalePng(PngMemory *memory, DepthFrame &frame, std::string &reason) {
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  if (png == nullptr) {
+    reason = "failed to initialize libpng";
+    return false;
+  }
+  png_infop info = png_create_info_struct(png);
+  if (info == nullptr) {
+    png_destroy_read_struct(&png, nullptr, nullptr);
+    reason = "failed to initialize libpng";
+    return false;
+  }
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, nullptr);
+    reason = "libpng failed to decode the image";
+    return false;
+  }
+
+  png_set_read_fn(png, memory, ReadPngMemory);
+  png_read_info(png, info);
+  auto width      = png_get_image_width(png, info);
+  auto height     = png_get_image_height(png, info);
+  auto bit_depth  = png_get_bit_depth(png, info);
+  auto color_type = png_get_color_type(png, info);
+  if (color_type != PNG_COLOR_TYPE_GRAY || (bit_depth != 16 && bit_depth != 8)) {
+    png_destroy_read_struct(&png, &info, nullptr);
+    reason = "only grayscale images are supported as depth maps";
+    return false;
+  }
+
+  // PNG stores samples as big-endian values
+  if (bit_depth == 8) {
+    png_set_expand_16(png);
+  }
+  {
+    const uint16_t probe = 1;
+    if (*reinterpret_cast<const uint8_t *>(&probe) == 1) {
+      png_set_swap(png);
+    }
+  }
+  int n_passes = png_set_interlace_handling(png);
+  png_read_update_info(png, info);
+
+  frame.Resize(width, height);
+  for (int pass = 0; pass < n_passes; pass++) {
+    for (png_uint_32 y = 0; y < height; y++) {
+      png_read_row(png, reinterpret_cast<png_bytep>(frame.Row(y)), nullptr);
+    }
+  }
+  png_read_end(png, nullptr);
+  png_destroy_read_struct(&png, &info, nullptr);
+  return true;
+}
+
+enum class PngResult { Decoded, Unsupported, Failed };
+
+enum PngFilter : uint8_t { FilterNone = 0, FilterSub = 1, FilterUp = 2, FilterAverage = 3, FilterPaeth = 4 };
+
+uint32_t ReadBigEndian(const uint8_t *ptr) {
+  return (uint32_t(ptr[0]) << 24) | (uint32_t(ptr[1]) << 16) | (uint32_t(ptr[2]) << 8) | uint32_t(ptr[3]);
+}
+
+// Filters predict each byte from the same byte of the previous pixel (two bytes back) and of the previous row
+// 'row' is unfiltered in place, 'prior' is the previous unfiltered row (zeros for the first one)
+// Sub and Up are vectorized, Average and Paeth depend on the just computed left pixel, so they stay scalar
+void UnfilterSub(uint8_t *row, size_t n) {
+  size_t i = 0;
+#ifdef TEXEL_SIMD_SSE2
+  // A prefix sum over 2-byte pixels, the last pixel of the block is carried into the next one
+  __m128i carry = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi8(v, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), v);
+    carry = _mm_shufflehi_epi16(v, 0xFF);
+    carry = _mm_unpackhi_epi64(carry, carry);
+  }
+#endif
+  for (i = std::max<size_t>(i, 2); i < n; i++) {
+    row[i] = uint8_t(row[i] + row[i - 2]);
+  }
+}
+
+void UnfilterUp(uint8_t *row, const uint8_t *prior, size_t n) {
+  size_t i = 0;
+#ifdef TEXEL_SIMD_SSE2
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prior + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), _mm_add_epi8(v, p));
+  }
+#endif
+  for (; i < n; i++) {
+    row[i] = uint8_t(row[i] + prior[i]);
+  }
+}
+
+// Both bytes of the left pixel are kept in registers, reloading them would wait for the stores
+void UnfilterAverage(uint8_t *row, const uint8_t *prior, size_t n) {
+  unsigned left_hi = 0, left_lo = 0;
+  for (size_t i = 0; i + 1 < n; i += 2) {
+    left_hi = uint8_t(row[i] + ((left_hi + prior[i]) >> 1));
+    left_lo = uint8_t(row[i + 1] + ((left_lo + prior[i + 1]) >> 1));
+    row[i]     = uint8_t(left_hi);
+    row[i + 1] = uint8_t(left_lo);
+  }
+}
+
+// Branchless, since the choice of the predictor is random for noisy depth
+inline int PaethPredictor(int a, int b, int c) {
+  int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+  int use_a = -int(pa <= pb && pa <= pc), use_b = -int(pb <= pc);
+  return (use_a & a) | (~use_a & ((use_b & b) | (~use_b & c)));
+}
+
+void UnfilterPaeth(uint8_t *row, const uint8_t *prior, size_t n) {
+  int left_hi = 0, left_lo = 0, up_left_hi = 0, up_left_lo = 0;
+  for (size_t i = 0; i + 1 < n; i += 2) {
+    int up_hi = prior[i], up_lo = prior[i + 1];
+    left_hi = uint8_t(row[i] + PaethPredictor(left_hi, up_hi, up_left_hi));
+    left_lo = uint8_t(row[i + 1] + PaethPredictor(left_lo, up_lo, up_left_lo));
+    row[i]     = uint8_t(left_hi);
+    row[i + 1] = uint8_t(left_lo);
+    up_left_hi = up_hi;
+    up_left_lo = up_lo;
+  }
+}
+
+// Converts big-endian samples into host values
+void CopySamples(const uint8_t *src, uint16_t *dst, size_t n_samples) {
+  size_t i = 0;
+#ifdef TEXEL_SIMD_SSE2
+  for (; i + 8 <= n_samples; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+  }
+#endif
+  for (; i < n_samples; i++) {
+    dst[i] = uint16_t((src[2 * i] << 8) | src[2 * i + 1]);
+  }
+}
+
+// Decodes non-interlaced 16-bit grayscale images, the only format of our depth maps
+// Image data is inflated into a small buffer, unfiltered there and converted into the frame,
+// so every row of the frame is written once. Chunk CRCs are not verified, the zlib stream has its own checksum
+PngResult DecodeDepthPngFast(const uint8_t *data, size_t size, DepthFrame &frame, std::string &reason) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  const size_t header_end = 8 + 12 + 13;
+  if (size < header_end || std::memcmp(data, signature, 8) != 0 ||
+      ReadBigEndian(data + 8) != 13 || std::memcmp(data + 12, "IHDR", 4) != 0) {
+    reason = "the data is not a PNG image";
+    return PngResult::Failed;
+  }
+  const uint8_t *header = data + 16;
+  size_t width = ReadBigEndian(header), height = ReadBigEndian(header + 4);
+  if (header[8] != 16 || header[9] != 0 || header[12] != 0 || width > (1u << 16) || height > (1u << 16)) {
+    return PngResult::Unsupported;
+  }
+  if (width == 0 || height == 0 || header[10] != 0 || header[11] != 0) {
+    reason = "the PNG header is invalid";
+    return PngResult::Failed;
+  }
+
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  if (inflateInit(&zs) != Z_OK) {
+    reason = "failed to initialize zlib";
+    return PngResult::Failed;
+  }
+
+  // Rows are inflated in blocks, since zlib is much slower when the output space is short
+  // Each row starts with its filter type, the last row of the previous block is kept before the block
+  const size_t stride = 2 * width, line = stride + 1;
+  const size_t block_rows = std::min(height, std::max<size_t>((64 << 10) / line, 1));
+  std::vector<uint8_t> buffer((block_rows + 1) * line, 0);
+  uint8_t *block = buffer.data() + line;
+  uint8_t trailer[16];
+  frame.Resize(width, height);
+
+  const char *error = nullptr;
+  size_t y = 0, filled = 0, done = 0, offset = header_end;
+  int status = Z_OK;
+  while (error == nullptr && status != Z_STREAM_END && offset + 12 <= size) {
+    size_t length = ReadBigEndian(data + offset);
+    const uint8_t *type = data + offset + 4;
+    if (length > size - offset - 12) {
+      error = "a chunk is truncated";
+      break;
+    }
+    offset += length + 12;
+    if (std::memcmp(type, "IEND", 4) == 0) {
+      break;
+    }
+    if (std::memcmp(type, "IDAT", 4) != 0) {
+      continue;
+    }
+
+    zs.next_in = const_cast<Bytef *>(type + 4);
+    zs.avail_in = (uInt)length;
+    while (error == nullptr && status == Z_OK && zs.avail_in > 0) {
+      // After the last row, only the checksum is left
+      size_t n_rows = std::min(block_rows, height - (y - done));
+      zs.next_out  = y < height ? block + filled : trailer;
+      zs.avail_out = y < height ? (uInt)(n_rows * line - filled) : (uInt)sizeof(trailer);
+      status = inflate(&zs, Z_NO_FLUSH);
+      if (status != Z_OK && status != Z_STREAM_END) {
+        error = zs.msg != nullptr ? zs.msg : "the compressed data is corrupted";
+        break;
+      }
+      if (y >= height) {
+        continue;
+      }
+
+      filled = n_rows * line - zs.avail_out;
+      for (; error == nullptr && (done + 1) * line <= filled; done++, y++) {
+        uint8_t *row = block + done * line + 1;
+        const uint8_t *prior = row - line;
+        switch (row[-1]) {
+          case FilterNone:    break;
+          case FilterSub:     UnfilterSub(row, stride); break;
+          case FilterUp:      UnfilterUp(row, prior, stride); break;
+          case FilterAverage: UnfilterAverage(row, prior, stride); break;
+          case FilterPaeth:   UnfilterPaeth(row, prior, stride); break;
+          default:            error = "unknown filter type"; continue;
+        }
+        CopySamples(row, frame.Row(y), width);
+      }
+      if (done == n_rows) {
+        std::memcpy(buffer.data(), block + (done - 1) * line, line);
+        filled = done = 0;
+      }
+    }
+  }
+
+  inflateEnd(&zs);
+  if (error != nullptr) {
+    reason = std::string("failed to decode the image data (") + error + ")";
+    return PngResult::Failed;
+  }
+  if (y < height) {
+    reason = "the image data is incomplete";
+    return PngResult::Failed;
+  }
+  return PngResult::Decoded;
+}
+
+bool DecodeDepthPng(const uint8_t *data, size_t size, depth_decode::Decoder decoder,
+                    DepthFrame &frame, std::string &reason) {
+  auto &counters = DepthMetrics();
+  metrics::ScopedTimer timer(counters.seconds, counters.in_progress);
+  if (decoder == depth_decode::Decoder::Fast) {
+    auto result = DecodeDepthPngFast(data, size, frame, reason);
+    if (result != PngResult::Unsupported) {
+      counters.Count(result == PngResult::Decoded);
+      return result == PngResult::Decoded;
+    }
+  }
+  PngMemory memory{ data, size, 0 };
+  bool decoded = DecodeGrayscalePng(&memory, frame, reason);
+  counters.Count(decoded);
+  return decoded;
+}
+
+} // unnamed namespace
+
+ErrHandle DepthFrame::Load(const std::string &filename, DepthFrame &frame) {
+  // Depth maps are small, so the whole file is read at once and decoded from memory
+  std::vector<uint8_t> data;
+  FILE *file = std::fopen(filename.c_str(), "rb");
+  bool read = file != nullptr && std::fseek(file, 0, SEEK_END) == 0;
+  long size = read ? std::ftell(file) : -1;
+  if (size >= 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+    data.resize((size_t)size);
+    read = std::fread(data.data(), 1, data.size(), file) == data.size();
+  }
+  else {
+    read = false;
+  }
+  if (file != nullptr) {
+    std::fclose(file);
+  }
+  if (!read) {
+    std::ostringstream oss;
+    oss << "failed to " << (file == nullptr ? "open" : "read") << " a depth map ('" << filename << "')";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  DepthMetrics().read_bytes->Add(data.size());
+
+  std::string reason;
+  if (!DecodeDepthPng(data.data(), data.size(), depth_decode::Decoder::Fast, frame, reason)) {
+    std::ostringstream oss;
+    oss << "failed to decode a depth map ('" << filename << "')";
+    return ErrHandle(TEXEL_WHERE, oss.str(), ErrHandle(TEXEL_WHERE, reason));
+  }
+  return ErrHandle();
+}
+
+ErrHandle DepthFrame::Decode(const uint8_t *data, size_t size, DepthFrame &frame) {
+  return Decode(data, size, depth_decode::Decoder::Fast, frame);
+}
+
+ErrHandle DepthFrame::Decode(const uint8_t *data, size_t size, depth_decode::Decoder decoder, DepthFrame &frame) {
+  std::string reason;
+  if (!DecodeDepthPng(data, size, decoder, frame, reason)) {
+    return ErrHandle(TEXEL_WHERE, "failed to decode a depth map", ErrHandle(TEXEL_WHERE, reason));
+  }
+  return ErrHandle();
+}
+
+//------------------
+//--- ColorFrame ---
+//------------------
+
+namespace {
+
+// libjpeg terminates the process on errors by default, so we jump back instead
+struct JpegErrorManager {
+  jpeg_error_mgr base;
+  jmp_buf jump;
+  char message[JMSG_LENGTH_MAX];
+};
+
+void OnJpegError(j_common_ptr cinfo) {
+  auto err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->jump, 1);
+}
+
+// libjpeg rounds scaled sizes up
+size_t ScaledSize(size_t size, unsigned scale) {
+  return (size * scale + 7) / 8;
+}
+
+// Fills the region of 'layout' once its full and scaled sizes are known
+bool PlaceRegion(const color_decode::Options &options, color_decode::Layout &layout) {
+  if (options.roi_width == 0 || options.roi_height == 0) {
+    layout.x = layout.y = 0;
+    layout.width  = layout.scaled_width;
+    layout.height = layout.scaled_height;
+    return true;
+  }
+  if (options.roi_x >= layout.full_width || options.roi_y >= layout.full_height) {
+    return false;
+  }
+
+  // The region is extended to whole scaled pixels
+  size_t x_end = std::min(options.roi_x + options.roi_width, layout.full_width);
+  size_t y_end = std::min(options.roi_y + options.roi_height, layout.full_height);
+  layout.x = options.roi_x * layout.scaled_width / layout.full_width;
+  layout.y = options.roi_y * layout.scaled_height / layout.full_height;
+  layout.width  = (x_end * layout.scaled_width + layout.full_width - 1) / layout.full_width - layout.x;
+  layout.height = (y_end * layout.scaled_height + layout.full_height - 1) / layout.full_height - layout.y;
+  return true;
+}
+
+// Keep this function free of C++ objects with destructors, the same as for libpng
+// Reads either 'file' or 'data' (if 'file' is null)
+bool DecodeJpeg(FILE *file, const uint8_t *data, size_t size,
+                const color_decode::Options &options, ColorFrame &frame, color_decode::Layout &layout,
+                char *reason, size_t reason_size) {
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager err;
+  cinfo.err = jpeg_std_error(&err.base);
+  err.base.error_exit = OnJpegError;
+  err.message[0] = 0;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    std::snprintf(reason, reason_size, "libjpeg failed to decode the image (%s)", err.message);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  if (file != nullptr) {
+    jpeg_stdio_src(&cinfo, file);
+  }
+  else {
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+  }
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  if (!color_decode::Plan(cinfo.image_width, cinfo.image_height, options, layout)) {
+    jpeg_destroy_decompress(&cinfo);
+    std::snprintf(reason, reason_size, "the region of interest is outside the %ux%u image",
+                  (unsigned)cinfo.image_width, (unsigned)cinfo.image_height);
+    return false;
+  }
+  cinfo.scale_num = layout.scale;
+  cinfo.scale_denom = 8;
+  if (options.fast) {
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+  }
+  jpeg_start_decompress(&cinfo);
+
+  // The actual scaled size is up to the library
+  layout.scaled_width  = cinfo.output_width;
+  layout.scaled_height = cinfo.output_height;
+  PlaceRegion(options, layout);
+
+  // Columns are decoded from the iMCU boundary at best, the extra ones are dropped afterwards
+  // The last decoded column is upsampled as the image edge, so one more column is decoded
+  // Without libjpeg-turbo, rows above the region are decoded into a spare row at the bottom
+  JDIMENSION first_column = 0, n_columns = cinfo.output_width;
+#ifdef LIBJPEG_TURBO_VERSION_NUMBER
+  if (layout.width < cinfo.output_width) {
+    first_column = (JDIMENSION)layout.x;
+    n_columns = (JDIMENSION)std::min<size_t>(layout.width + 1, cinfo.output_width - layout.x);
+    jpeg_crop_scanline(&cinfo, &first_column, &n_columns);
+  }
+  frame.Resize(n_columns, layout.height);
+  if (layout.y > 0) {
+    jpeg_skip_scanlines(&cinfo, (JDIMENSION)layout.y);
+  }
+#else
+  frame.Resize(n_columns, layout.height + 1);
+#endif
+  while (cinfo.output_scanline < layout.y + layout.height) {
+    size_t y = cinfo.output_scanline;
+    JSAMPROW row = frame.Row(y >= layout.y ? y - layout.y : layout.height);
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+
+  size_t shift = layout.x - first_column;
+  if (shift > 0 || n_columns != layout.width) {
+    uint8_t *pixels = frame.Data();
+    for (size_t y = 0; y < layout.height; y++) {
+      std::memmove(pixels + y * layout.width * ColorFrame::Channels,
+                   pixels + (y * n_columns + shift) * ColorFrame::Channels,
+                   layout.width * ColorFrame::Channels);
+    }
+  }
+  frame.Resize(layout.width, layout.height);
+
+  if (cinfo.output_scanline < cinfo.output_height) {
+    jpeg_abort_decompress(&cinfo);
+  }
+  else {
+    jpeg_finish_decompress(&cinfo);
+  }
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+// Decodes and updates the metrics, 'DecodeJpeg()' itself cannot have objects with destructors
+bool DecodeColorFrame(FILE *file, const uint8_t *data, size_t size,
+                      const color_decode::Options &options, ColorFrame &frame, color_decode::Layout &layout,
+                      char *reason, size_t reason_size) {
+  auto &counters = ColorMetrics();
+  metrics::ScopedTimer timer(counters.seconds, counters.in_progress);
+  bool decoded = DecodeJpeg(file, data, size, options, frame, layout, reason, reason_size);
+  counters.Count(decoded);
+  if (file != nullptr) {
+    // libjpeg reads ahead in small blocks, so the position is close to what has been read
+    long position = std::ftell(file);
+    counters.read_bytes->Add(position > 0 ? (uint64_t)position : 0);
+  }
+  return decoded;
+}
+
+} // unnamed namespace
+
+namespace color_decode {
+
+bool Plan(size_t full_width, size_t full_height, const Options &options, Layout &layout) {
+  unsigned scale = std::min(std::max(options.scale, 1u), 8u);
+  if (options.min_width > 0 || options.min_height > 0) {
+    scale = 1;
+    while (scale < 8 && (ScaledSize(full_width, scale) < options.min_width ||
+                         ScaledSize(full_height, scale) < options.min_height)) {
+      scale += 1;
+    }
+  }
+  layout.full_width  = full_width;
+  layout.full_height = full_height;
+  layout.scale = scale;
+  layout.scaled_width  = ScaledSize(full_width, scale);
+  layout.scaled_height = ScaledSize(full_height, scale);
+  return PlaceRegion(options, layout);
+}
+
+Camera AdjustCamera(const Camera &camera, const Layout &layout) {
+  if (layout.scaled_width == camera.Width() && layout.scaled_height == camera.Height() &&
+      layout.width == layout.scaled_width && layout.height == layout.scaled_height) {
+    return camera;
+  }
+
+  // The same convention as in 'ColorRegistration': pixel centers are scaled, not pixel corners
+  float sx = camera.Width() > 0 ? (float)layout.scaled_width / (float)camera.Width() : layout.scale / 8.0f;
+  float sy = camera.Height() > 0 ? (float)layout.scaled_height / (float)camera.Height() : layout.scale / 8.0f;
+  return Camera(layout.width, layout.height,
+                (camera.Cx() + 0.5f) * sx - 0.5f - (float)layout.x,
+                (camera.Cy() + 0.5f) * sy - 0.5f - (float)layout.y,
+                camera.Fx() * sx, camera.Fy() * sy,
+                camera.Offset(), camera.Rotation());
+}
+
+} // namespace color_decode
+
+ErrHandle ColorFrame::Load(const std::string &filename, ColorFrame &frame) {
+  return Load(filename, color_decode::Options(), frame);
+}
+
+ErrHandle ColorFrame::Decode(const uint8_t *data, size_t size, ColorFrame &frame) {
+  return Decode(data, size, color_decode::Options(), frame);
+}
+
+ErrHandle ColorFrame::Load(const std::string &filename, const color_decode::Options &options,
+                           ColorFrame &frame, color_decode::Layout *layout) {
+  FILE *file = std::fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    std::ostringstream oss;
+    oss << "failed to open a color frame ('" << filename << "')";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  char reason[JMSG_LENGTH_MAX + 64];
+  color_decode::Layout decoded;
+  bool succeeded = DecodeColorFrame(file, nullptr, 0, options, frame, decoded, reason, sizeof(reason));
+  std::fclose(file);
+  if (!succeeded) {
+    std::ostringstream oss;
+    oss << "failed to decode a color frame ('" << filename << "')";
+    return ErrHandle(TEXEL_WHERE, oss.str(), ErrHandle(TEXEL_WHERE, reason));
+  }
+  if (layout != nullptr) {
+    *layout = decoded;
+  }
+  return ErrHandle();
+}
+
+ErrHandle ColorFrame::Decode(const uint8_t *data, size_t size, const color_decode::Options &options,
+                             ColorFrame &frame, color_decode::Layout *layout) {
+  char reason[JMSG_LENGTH_MAX + 64];
+  color_decode::Layout decoded;
+  if (!DecodeColorFrame(nullptr, data, size, options, frame, decoded, reason, sizeof(reason))) {
+    return ErrHandle(TEXEL_WHERE, "failed to decode a color frame", ErrHandle(TEXEL_WHERE, reason));
+  }
+  if (layout != nullptr) {
+    *layout = decoded;
+  }
+  return ErrHandle();
+}
+
+//--------------
+//--- frames ---
+//--------------
+
+namespace frames {
+
+ErrHandle ListFiles(const std::string &dir, const std::string &extension,
+                    std::vector<std::string> &files) {
+  files.clear();
+  std::error_code ec;
+  std::filesystem::directory_iterator iter(dir, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "failed to enumerate frames in the directory '" << dir << "' (" << ec.message() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  for (const auto &entry : iter) {
+    if (entry.is_regular_file() && entry.path().extension() == extension) {
+      files.emplace_back(entry.path().string());
+    }
+  }
+
+  // Frame names contain zero-padded indices, but let's not rely on padding
+  std::sort(files.begin(), files.end(), [](const std::string &a, const std::string &b) {
+    return a.size() != b.size() ? a.size() < b.size() : a < b;
+  });
+  return ErrHandle();
+}
+
+void MatchByName(const std::vector<std::string> &first,
+                 const std::vector<std::string> &second,
+                 std::vector<std::pair<size_t, size_t> > &pairs) {
+  pairs.clear();
+  std::unordered_map<std::string, size_t> stems;
+  for (size_t i = 0; i < second.size(); i++) {
+    stems.emplace(std::filesystem::path(second[i]).stem().string(), i);
+  }
+  for (size_t i = 0; i < first.size(); i++) {
+    auto iter = stems.find(std::filesystem::path(first[i]).stem().string());
+    if (iter != stems.end()) {
+      pairs.emplace_back(i, iter->second);
+    }
+  }
+
+  if (pairs.empty()) {
+    for (size_t i = 0; i < std::min(first.size(), second.size()); i++) {
+      pairs.emplace_back(i, i);
+    }
+  }
+}
+
+} // namespace frames
+
+} // namespace texel
@@ -0,0 +1,184 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+namespace depth_decode {
+
+// PNG decoders of depth maps
+enum class Decoder {
+  // Our decoder of 16-bit grayscale images, other formats are passed to libpng
+  Fast,
+
+  // libpng only, e.g. as a reference for benchmarks
+  Libpng
+};
+
+} // namespace depth_decode
+
+// A decoded depth map (16-bit grayscale), stored row by row
+// Each value is a distance along the optical axis in millimeters, zero marks invalid pixels
+class DepthFrame {
+  public:
+    // Depth maps from our sensors store millimeters, but the geometry uses meters
+    static constexpr float Scale = 0.001f;
+
+    DepthFrame() : width_(0), height_(0) { }
+    DepthFrame(size_t width, size_t height)
+      : width_(width), height_(height), data_(width * height, 0) {
+    }
+    // Allocates a frame for depth maps of the camera, so decoding does not reallocate it
+    explicit DepthFrame(const Camera &camera) : DepthFrame(camera.Width(), camera.Height()) { }
+    DepthFrame(const DepthFrame &) = default;
+    DepthFrame(DepthFrame &&) noexcept = default;
+    DepthFrame &operator =(const DepthFrame &) = default;
+    DepthFrame &operator =(DepthFrame &&) noexcept = default;
+
+    size_t Width() const { return width_; }
+    size_t Height() const { return height_; }
+    bool Empty() const { return data_.empty(); }
+
+    // Changes size of the frame, the buffer is reused if it is large enough
+    void Resize(size_t width, size_t height) {
+      width_  = width;
+      height_ = height;
+      data_.resize(width * height);
+    }
+
+    const uint16_t *Data() const { return data_.data(); }
+    uint16_t *Data() { return data_.data(); }
+
+    const uint16_t *Row(size_t y) const { return data_.data() + y * width_; }
+    uint16_t *Row(size_t y) { return data_.data() + y * width_; }
+
+    uint16_t At(size_t x, size_t y) const { return data_[y * width_ + x]; }
+
+    // Decodes a 16-bit grayscale PNG file
+    // Values are written straight into the frame, its buffer is reused if it is large enough
+    static ErrHandle Load(const std::string &filename, DepthFrame &frame);
+
+    // The same, but the PNG file is already in memory
+    static ErrHandle Decode(const uint8_t *data, size_t size, DepthFrame &frame);
+
+    // The same, but with the given decoder
+    static ErrHandle Decode(const uint8_t *data, size_t size, depth_decode::Decoder decoder, DepthFrame &frame);
+
+  private:
+    size_t width_, height_;
+    std::vector<uint16_t> data_;
+};
+
+namespace color_decode {
+
+// JPEG frames can be decoded at a reduced scale right in the DCT domain, which skips most of the work
+// Only a part of the frame may be decoded too, then rows above it are skipped without decoding
+struct Options {
+  // The frame is scaled by 'scale / 8' (1 to 8)
+  unsigned scale;
+
+  // If not zero, the smallest scale that gives at least this size is taken instead of 'scale'
+  size_t min_width, min_height;
+
+  // The region of interest in full-resolution pixels, zero size means the whole frame
+  size_t roi_x, roi_y, roi_width, roi_height;
+
+  // Faster but less accurate IDCT and chroma upsampling
+  bool fast;
+
+  Options()
+    : scale(8),
+      min_width(0), min_height(0),
+      roi_x(0), roi_y(0), roi_width(0), roi_height(0),
+      fast(false) {
+  }
+};
+
+// How a decoded frame relates to the full-resolution one
+struct Layout {
+  size_t full_width, full_height;
+  unsigned scale;                    // in eighths
+  size_t scaled_width, scaled_height;
+  size_t x, y, width, height;        // the decoded region in scaled pixels
+
+  Layout()
+    : full_width(0), full_height(0), scale(8),
+      scaled_width(0), scaled_height(0),
+      x(0), y(0), width(0), height(0) {
+  }
+};
+
+// Computes the layout of a frame of the given full size without decoding it
+// Returns 'false' if the region of interest is outside the frame
+bool Plan(size_t full_width, size_t full_height, const Options &options, Layout &layout);
+
+// Intrinsics of the decoded frames, 'camera' describes the full-resolution ones
+Camera AdjustCamera(const Camera &camera, const Layout &layout);
+
+} // namespace color_decode
+
+// A decoded color frame, 8-bit RGB values are interleaved and stored row by row
+class ColorFrame {
+  public:
+    static constexpr size_t Channels = 3;
+
+    ColorFrame() : width_(0), height_(0) { }
+    ColorFrame(size_t width, size_t height)
+      : width_(width), height_(height), data_(width * height * Channels, 0) {
+    }
+    ColorFrame(const ColorFrame &) = default;
+    ColorFrame(ColorFrame &&) noexcept = default;
+    ColorFrame &operator =(const ColorFrame &) = default;
+    ColorFrame &operator =(ColorFrame &&) noexcept = default;
+
+    size_t Width() const { return width_; }
+    size_t Height() const { return height_; }
+    bool Empty() const { return data_.empty(); }
+
+    // Changes size of the frame, the buffer is reused if it is large enough
+    void Resize(size_t width, size_t height) {
+      width_  = width;
+      height_ = height;
+      data_.resize(width * height * Channels);
+    }
+
+    const uint8_t *Data() const { return data_.data(); }
+    uint8_t *Data() { return data_.data(); }
+
+    const uint8_t *Row(size_t y) const { return data_.data() + y * width_ * Channels; }
+    uint8_t *Row(size_t y) { return data_.data() + y * width_ * Channels; }
+
+    // Decodes a JPEG file into RGB values
+    static ErrHandle Load(const std::string &filename, ColorFrame &frame);
+
+    // The same, but the JPEG file is already in memory
+    static ErrHandle Decode(const uint8_t *data, size_t size, ColorFrame &frame);
+
+    // Decodes a JPEG file at a reduced scale or only its region, 'layout' (optional) receives
+    // the actual layout of the decoded frame
+    static ErrHandle Load(const std::string &filename, const color_decode::Options &options,
+                          ColorFrame &frame, color_decode::Layout *layout = nullptr);
+    static ErrHandle Decode(const uint8_t *data, size_t size, const color_decode::Options &options,
+                            ColorFrame &frame, color_decode::Layout *layout = nullptr);
+
+  private:
+    size_t width_, height_;
+    std::vector<uint8_t> data_;
+};
+
+namespace frames {
+
+// Enumerates files with the given extension (e.g. '.png') in the frame directory
+// The result is sorted, so the sequential frames follow each other
+ErrHandle ListFiles(const std::string &dir, const std::string &extension,
+                    std::vector<std::string> &files);
+
+// Pairs frames from two directories (e.g. depth and color ones) using their names
+// Files with the same name (up to the extension) form a pair, unpaired files are skipped
+// If the names have nothing in common, frames are paired by their order
+void MatchByName(const std::vector<std::string> &first,
+                 const std::vector<std::string> &second,
+                 std::vector<std::pair<size_t, size_t> > &pairs);
+
+} // namespace frames
+
+} // namespace texel
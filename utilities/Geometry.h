@@ -0,0 +1,254 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Simd.h"
+
+namespace texel {
+
+// Rigid transformation that maps 'p' to 'Rotation() * p + Offset()'
+// Unlike 'Camera', the rotation is stored as a regular column-major glm matrix
+class RigidTransform {
+  public:
+    RigidTransform() : rotation_(1.0f), offset_(0.0f) { }
+    RigidTransform(const glm::mat3x3 &rotation, const glm::vec3 &offset)
+      : rotation_(rotation), offset_(offset) {
+    }
+    RigidTransform(const RigidTransform &) = default;
+    RigidTransform &operator =(const RigidTransform &) = default;
+
+    // Orthonormal rotation matrix
+    const glm::mat3x3 &Rotation() const { return rotation_; }
+
+    // Translation, in meters
+    const glm::vec3 &Offset() const { return offset_; }
+
+    // Transforms a point
+    glm::vec3 Apply(const glm::vec3 &point) const { return rotation_ * point + offset_; }
+
+    // Transforms a direction (e.g. a normal)
+    glm::vec3 Rotate(const glm::vec3 &dir) const { return rotation_ * dir; }
+
+    RigidTransform Inverse() const {
+      auto inv_rotation = glm::transpose(rotation_);
+      return RigidTransform(inv_rotation, -(inv_rotation * offset_));
+    }
+
+    // 'a * b' applies 'b' first, then 'a'
+    friend RigidTransform operator *(const RigidTransform &a, const RigidTransform &b) {
+      return RigidTransform(a.rotation_ * b.rotation_, a.rotation_ * b.offset_ + a.offset_);
+    }
+
+    // Builds a transformation from the rotation vector (axis * angle) and the translation
+    static RigidTransform FromTwist(const glm::vec3 &omega, const glm::vec3 &offset) {
+      float angle = glm::length(omega);
+      if (angle < 1e-12f) {
+        return RigidTransform(glm::mat3x3(1.0f), offset);
+      }
+      glm::vec3 k = omega / angle;
+      float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+      // glm matrices are indexed by columns
+      glm::mat3x3 rotation(t * k.x * k.x + c,       t * k.x * k.y + s * k.z, t * k.x * k.z - s * k.y,
+                           t * k.x * k.y - s * k.z, t * k.y * k.y + c,       t * k.y * k.z + s * k.x,
+                           t * k.x * k.z + s * k.y, t * k.y * k.z - s * k.x, t * k.z * k.z + c);
+      return RigidTransform(rotation, offset);
+    }
+
+  private:
+    glm::mat3x3 rotation_;
+    glm::vec3 offset_;
+};
+
+namespace geometry {
+
+// Converts a pixel with known depth (in meters) into a point in the camera space
+inline glm::vec3 BackProject(const Camera &camera, float x, float y, float depth) {
+  return glm::vec3((x - camera.Cx()) * depth / camera.Fx(),
+                   (y - camera.Cy()) * depth / camera.Fy(),
+                   depth);
+}
+
+// Projects a point from the camera space onto the image plane
+// Returns 'false' for points behind the camera
+inline bool Project(const Camera &camera, const glm::vec3 &point, float &x, float &y) {
+  if (point.z <= 0.0f) {
+    return false;
+  }
+  x = camera.Fx() * point.x / point.z + camera.Cx();
+  y = camera.Fy() * point.y / point.z + camera.Cy();
+  return true;
+}
+
+// Extrinsics of 'Camera' map the viewer space into the camera space: 'p_camera = R * p_viewer + t'
+// The rows of 'R' are stored as 'Rotation()[0..2]', so the glm matrix itself is 'R^T'
+inline RigidTransform ViewerToCamera(const Camera &camera) {
+  return RigidTransform(glm::transpose(camera.Rotation()), camera.Offset());
+}
+
+// The inverse of 'ViewerToCamera()'
+inline RigidTransform CameraToViewer(const Camera &camera) {
+  return RigidTransform(camera.Rotation(), -(camera.Rotation() * camera.Offset()));
+}
+
+// Normal equations of the point-to-plane problem: upper triangle of 6x6 'JtJ',
+// 6 values of 'Jte', sum of squared errors and the number of correspondences
+// The unknowns are the rotation vector and the translation of the update (see 'RigidTransform::FromTwist()')
+constexpr size_t PointToPlaneSize = 21 + 6 + 2;
+typedef std::array<double, PointToPlaneSize> PointToPlaneSystem;
+
+// Adds a correspondence: 'p' is the transformed point, 'n' is the normal of the plane, 'e' is the signed distance
+inline void AddPointToPlane(const glm::vec3 &p, const glm::vec3 &n, float e, PointToPlaneSystem &system) {
+  glm::vec3 c = glm::cross(p, n);
+  double j[6] = { c.x, c.y, c.z, n.x, n.y, n.z };
+  size_t k = 0;
+  for (size_t r = 0; r < 6; r++) {
+    for (size_t col = r; col < 6; col++) {
+      system[k++] += j[r] * j[col];
+    }
+  }
+  for (size_t r = 0; r < 6; r++) {
+    system[k++] += j[r] * e;
+  }
+  system[k] += (double)e * e;
+  system[k + 1] += 1.0;
+}
+
+// Solves 'JtJ * x = -Jte' using Cholesky decomposition, 'false' if the matrix is not positive definite
+inline bool SolvePointToPlane(const PointToPlaneSystem &system, double x[6]) {
+  double a[6][6], b[6];
+  size_t k = 0;
+  for (size_t i = 0; i < 6; i++) {
+    for (size_t j = i; j < 6; j++) {
+      a[i][j] = a[j][i] = system[k++];
+    }
+  }
+  for (size_t i = 0; i < 6; i++) {
+    b[i] = -system[k++];
+  }
+
+  double l[6][6] = {};
+  for (size_t i = 0; i < 6; i++) {
+    for (size_t j = 0; j <= i; j++) {
+      double sum = a[i][j];
+      for (size_t p = 0; p < j; p++) {
+        sum -= l[i][p] * l[j][p];
+      }
+      if (i == j) {
+        if (sum <= 1e-12) {
+          return false;
+        }
+        l[i][i] = std::sqrt(sum);
+      }
+      else {
+        l[i][j] = sum / l[j][j];
+      }
+    }
+  }
+
+  double y[6];
+  for (size_t i = 0; i < 6; i++) {
+    double sum = b[i];
+    for (size_t p = 0; p < i; p++) {
+      sum -= l[i][p] * y[p];
+    }
+    y[i] = sum / l[i][i];
+  }
+  for (size_t i = 6; i-- > 0; ) {
+    double sum = y[i];
+    for (size_t p = i + 1; p < 6; p++) {
+      sum -= l[p][i] * x[p];
+    }
+    x[i] = sum / l[i][i];
+  }
+  return true;
+}
+
+// Back-projects pixels of depth frames of one sensor into the viewer space and keeps those with valid depth
+// inside a box. Shared by kernels that turn depth maps into points, four pixels are processed at once
+class DepthProjector {
+  public:
+    // Depth values outside [min_depth, max_depth] are invalid (in meters)
+    DepthProjector(const Camera &camera, float min_depth, float max_depth,
+                   const glm::vec3 &box_min, const glm::vec3 &box_max);
+
+    // Calls 'group(x, bits, vx, vy, vz)' for groups of four pixels of the row 'y' starting at every 'stride'-th pixel
+    // Bit 'k' of 'bits' marks the pixel 'x + k' if it is valid and inside the box, coordinates of other pixels
+    // are arbitrary. Returns the pixel where the groups end, the first remaining one if 'stride' is four
+    template <typename Group>
+    size_t Groups(const DepthFrame &frame, size_t y, size_t stride, Group group) const;
+
+    // The scalar version for the remaining pixels, 'false' if the pixel is invalid or outside the box
+    bool Pixel(const DepthFrame &frame, size_t x, size_t y, glm::vec3 &p) const {
+      float d = frame.Row(y)[x];
+      if (d < min_raw_ || d > max_raw_) {
+        return false;
+      }
+      float z = d * DepthFrame::Scale;
+      p = rotation_ * glm::vec3(((float)x - cx_) * inv_fx_ * z, ((float)y - cy_) * inv_fy_ * z, z) + offset_;
+      return p.x >= box_min_.x && p.x <= box_max_.x && p.y >= box_min_.y && p.y <= box_max_.y &&
+             p.z >= box_min_.z && p.z <= box_max_.z;
+    }
+
+  private:
+    float cx_, cy_, inv_fx_, inv_fy_;
+    float min_raw_, max_raw_;          // in units of the frame
+    glm::mat3x3 rotation_;             // camera to viewer
+    glm::vec3 offset_;
+    glm::vec3 box_min_, box_max_;
+
+    // The same values broadcast for the vectorized kernel, the rotation is stored by rows
+    simd::Float4 r4_[9], t4_[3], box_min4_[3], box_max4_[3];
+    simd::Float4 min_raw4_, max_raw4_, cx4_, inv_fx4_;
+};
+
+inline DepthProjector::DepthProjector(const Camera &camera, float min_depth, float max_depth,
+                                      const glm::vec3 &box_min, const glm::vec3 &box_max)
+  : cx_(camera.Cx()), cy_(camera.Cy()), inv_fx_(1.0f / camera.Fx()), inv_fy_(1.0f / camera.Fy()),
+    min_raw_(min_depth / DepthFrame::Scale), max_raw_(max_depth / DepthFrame::Scale),
+    box_min_(box_min), box_max_(box_max) {
+  auto to_viewer = CameraToViewer(camera);
+  rotation_ = to_viewer.Rotation();
+  offset_   = to_viewer.Offset();
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++) {
+      r4_[row * 3 + col] = simd::Float4(rotation_[col][row]);
+    }
+    t4_[row]       = simd::Float4(offset_[row]);
+    box_min4_[row] = simd::Float4(box_min_[row]);
+    box_max4_[row] = simd::Float4(box_max_[row]);
+  }
+  min_raw4_ = simd::Float4(min_raw_);
+  max_raw4_ = simd::Float4(max_raw_);
+  cx4_      = simd::Float4(cx_);
+  inv_fx4_  = simd::Float4(inv_fx_);
+}
+
+template <typename Group>
+size_t DepthProjector::Groups(const DepthFrame &frame, size_t y, size_t stride, Group group) const {
+  using simd::Float4;
+  const Float4 scale(DepthFrame::Scale), lanes(0.0f, 1.0f, 2.0f, 3.0f);
+  const Float4 ray_y(((float)y - cy_) * inv_fy_);
+  const uint16_t *row = frame.Row(y);
+  size_t x = 0;
+  for (; x + Float4::Width <= frame.Width(); x += stride) {
+    Float4 d = Float4::FromUInt16(row + x);
+    Float4 valid = (d >= min_raw4_) & (d <= max_raw4_);
+    Float4 vx, vy, vz;
+    int bits = MoveMask(valid);
+    if (bits != 0) {
+      Float4 z = d * scale;
+      Float4 cam_x = (Float4((float)x) + lanes - cx4_) * inv_fx4_ * z;
+      Float4 cam_y = ray_y * z;
+      vx = r4_[0] * cam_x + r4_[1] * cam_y + r4_[2] * z + t4_[0];
+      vy = r4_[3] * cam_x + r4_[4] * cam_y + r4_[5] * z + t4_[1];
+      vz = r4_[6] * cam_x + r4_[7] * cam_y + r4_[8] * z + t4_[2];
+      bits = MoveMask(valid & (vx >= box_min4_[0]) & (vx <= box_max4_[0]) & (vy >= box_min4_[1]) &
+                      (vy <= box_max4_[1]) & (vz >= box_min4_[2]) & (vz <= box_max4_[2]));
+    }
+    group(x, bits, vx, vy, vz);
+  }
+  return x;
+}
+
+} // namespace geometry
+
+} // namespace texel
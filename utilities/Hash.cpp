@@ -0,0 +1,142 @@
+#include "Hash.h"
+
+namespace texel {
+
+namespace {
+
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotateLeft(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// The hash is defined over little-endian values
+inline bool IsLittleEndian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+inline uint64_t Read64(const uint8_t *ptr) {
+  uint64_t value;
+  if (IsLittleEndian()) {
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+  value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | ptr[i];
+  }
+  return value;
+}
+
+inline uint32_t Read32(const uint8_t *ptr) {
+  return (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * Prime2;
+  acc = RotateLeft(acc, 31);
+  return acc * Prime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+  acc ^= Round(0, value);
+  return acc * Prime1 + Prime4;
+}
+
+} // unnamed namespace
+
+//-------------
+//--- Xxh64 ---
+//-------------
+
+Xxh64::Xxh64(uint64_t seed)
+  : seed_(seed), buffered_(0), total_(0) {
+  acc_[0] = seed + Prime1 + Prime2;
+  acc_[1] = seed + Prime2;
+  acc_[2] = seed;
+  acc_[3] = seed - Prime1;
+}
+
+void Xxh64::Update(const void *data, size_t size) {
+  auto ptr = static_cast<const uint8_t *>(data);
+  auto end = ptr + size;
+  total_ += size;
+
+  // Complete the stripe that was started by the previous call
+  if (buffered_ > 0) {
+    size_t n = std::min(sizeof(buffer_) - buffered_, size);
+    std::memcpy(buffer_ + buffered_, ptr, n);
+    buffered_ += n;
+    ptr += n;
+    if (buffered_ < sizeof(buffer_)) {
+      return;
+    }
+    for (size_t i = 0; i < 4; i++) {
+      acc_[i] = Round(acc_[i], Read64(buffer_ + 8 * i));
+    }
+    buffered_ = 0;
+  }
+
+  // The hot loop, four independent lanes
+  uint64_t a0 = acc_[0], a1 = acc_[1], a2 = acc_[2], a3 = acc_[3];
+  for (; end - ptr >= 32; ptr += 32) {
+    a0 = Round(a0, Read64(ptr));
+    a1 = Round(a1, Read64(ptr + 8));
+    a2 = Round(a2, Read64(ptr + 16));
+    a3 = Round(a3, Read64(ptr + 24));
+  }
+  acc_[0] = a0; acc_[1] = a1; acc_[2] = a2; acc_[3] = a3;
+
+  buffered_ = (size_t)(end - ptr);
+  std::memcpy(buffer_, ptr, buffered_);
+}
+
+uint64_t Xxh64::Digest() const {
+  uint64_t h;
+  if (total_ >= 32) {
+    h = RotateLeft(acc_[0], 1) + RotateLeft(acc_[1], 7) +
+        RotateLeft(acc_[2], 12) + RotateLeft(acc_[3], 18);
+    for (size_t i = 0; i < 4; i++) {
+      h = MergeRound(h, acc_[i]);
+    }
+  }
+  else {
+    h = seed_ + Prime5;
+  }
+  h += total_;
+
+  const uint8_t *ptr = buffer_, *end = buffer_ + buffered_;
+  for (; end - ptr >= 8; ptr += 8) {
+    h ^= Round(0, Read64(ptr));
+    h = RotateLeft(h, 27) * Prime1 + Prime4;
+  }
+  if (end - ptr >= 4) {
+    h ^= (uint64_t)Read32(ptr) * Prime1;
+    h = RotateLeft(h, 23) * Prime2 + Prime3;
+    ptr += 4;
+  }
+  for (; ptr < end; ptr++) {
+    h ^= (uint64_t)(*ptr) * Prime5;
+    h = RotateLeft(h, 11) * Prime1;
+  }
+
+  h ^= h >> 33;
+  h *= Prime2;
+  h ^= h >> 29;
+  h *= Prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t Xxh64::Hash(const void *data, size_t size, uint64_t seed) {
+  Xxh64 state(seed);
+  state.Update(data, size);
+  return state.Digest();
+}
+
+} // namespace texel
@@ -0,0 +1,29 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+// XXH64, a fast non-cryptographic hash by Y. Collet
+// Suitable for integrity checks of large files, but not for protection against tampering
+// The result does not depend on how the data is split between 'Update()' calls
+class Xxh64 {
+  public:
+    explicit Xxh64(uint64_t seed = 0);
+    Xxh64(const Xxh64 &) = default;
+    Xxh64 &operator =(const Xxh64 &) = default;
+
+    void Update(const void *data, size_t size);
+    uint64_t Digest() const;
+
+    // One-shot version
+    static uint64_t Hash(const void *data, size_t size, uint64_t seed = 0);
+
+  private:
+    uint64_t seed_;
+    uint64_t acc_[4];
+    uint8_t buffer_[32];
+    size_t buffered_;
+    uint64_t total_;
+};
+
+} // namespace texel
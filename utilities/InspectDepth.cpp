@@ -0,0 +1,103 @@
+#include <iostream>
+#include "DepthQuality.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+void PrintReport(const depth_quality::ScanReport &scan) {
+  std::cout << std::endl << "'" << scan.id << "': " << (scan.Failed() ? "FAILED" : "ok") << std::endl;
+  for (const auto &stream : scan.streams) {
+    std::cout << "  Stage " << stream.stage_idx << ", stream " << stream.stream_idx << ": "
+              << stream.frames.size() << " frames, " << stream.mean_valid_ratio * 100.0f << "% valid pixels, "
+              << stream.mean_in_bbox << " points in the bounding box (min " << stream.min_in_bbox << "), "
+              << "change " << stream.mean_change << " mm (max " << stream.max_change << ")" << std::endl;
+    for (const auto &issue : stream.issues) {
+      std::cout << "    " << issue << std::endl;
+    }
+  }
+}
+
+// One row per stream in 'summary.csv', per frame in 'frames.csv' and per stream in 'histograms.csv'
+ErrHandle SaveReports(const std::filesystem::path &output, const depth_quality::Params &params,
+                      const std::vector<depth_quality::ScanReport> &reports) {
+  std::filesystem::create_directories(output);
+  std::ofstream summary(output / "summary.csv"), frames(output / "frames.csv"), histograms(output / "histograms.csv");
+  if (!summary || !frames || !histograms) {
+    return ErrHandle(TEXEL_WHERE, "failed to create reports in the output directory");
+  }
+
+  summary << "id,stage,stream,frames,unreadable,bad,mean_valid_ratio,mean_in_bbox,min_in_bbox,"
+             "mean_change,max_change,failed" << std::endl;
+  frames << "id,stage,stream,frame,readable,valid,in_bbox,valid_ratio,mean_depth,change,flicker,bad" << std::endl;
+  histograms << "id,stage,stream";
+  for (size_t i = 0; i < params.n_bins; i++) {
+    histograms << "," << i * params.bin_width;
+  }
+  histograms << std::endl;
+
+  for (const auto &scan : reports) {
+    for (const auto &s : scan.streams) {
+      summary << scan.id << "," << s.stage_idx << "," << s.stream_idx << "," << s.frames.size() << ","
+              << s.n_unreadable << "," << s.n_bad << "," << s.mean_valid_ratio << "," << s.mean_in_bbox << ","
+              << s.min_in_bbox << "," << s.mean_change << "," << s.max_change << "," << (s.Failed() ? 1 : 0)
+              << std::endl;
+      for (size_t i = 0; i < s.frames.size(); i++) {
+        const auto &f = s.frames[i];
+        frames << scan.id << "," << s.stage_idx << "," << s.stream_idx << "," << i << "," << (f.readable ? 1 : 0)
+               << "," << f.valid << "," << f.in_bbox << "," << f.valid_ratio << "," << f.mean_depth << ","
+               << f.change << "," << f.flicker << "," << (f.bad ? 1 : 0) << std::endl;
+      }
+      histograms << scan.id << "," << s.stage_idx << "," << s.stream_idx;
+      for (auto count : s.histogram) {
+        histograms << "," << count;
+      }
+      histograms << std::endl;
+    }
+  }
+
+  if (!summary || !frames || !histograms) {
+    return ErrHandle(TEXEL_WHERE, "failed to write reports into the output directory");
+  }
+  return ErrHandle();
+}
+
+ErrHandle InspectDepth(const std::filesystem::path &dir, const std::filesystem::path &output,
+                       size_t &n_inspected, size_t &n_failed) {
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(dir.string()));
+
+  depth_quality::Params params;
+  DepthQuality quality(params);
+  std::vector<depth_quality::ScanReport> reports;
+  TEXEL_CHECK(quality.Analyze(finder, reports));
+
+  for (const auto &scan : reports) {
+    PrintReport(scan);
+    n_inspected += 1;
+    n_failed += scan.Failed() ? 1 : 0;
+  }
+  if (!output.empty()) {
+    TEXEL_CHECK(SaveReports(output, params, reports));
+  }
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Wrong arguments, use as './InspectDepth <path_to_directory_with_scans> [<output_directory>]'"
+              << std::endl;
+    return 1;
+  }
+  std::filesystem::path dir(argv[1]);
+  std::filesystem::path output(argc == 3 ? argv[2] : "");
+
+  size_t n_inspected{}, n_failed{};
+  auto err = InspectDepth(dir, output, n_inspected, n_failed);
+  if (err.Failed()) {
+    std::cerr << "Failed to inspect depth maps from the '" << dir.string() << "' directory:" << std::endl;
+    std::cerr << err.Message();
+    return 1;
+  }
+  std::cout << std::endl << "Inspected " << n_inspected << " scans (" << n_failed << " look failed)" << std::endl;
+  return n_failed == 0 ? 0 : 2;
+}
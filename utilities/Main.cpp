@@ -1,4 +1,5 @@
 #include <iostream>
+#include "Metrics.h"
 #include "Scanogram.h"
 #include "ScanogramFinder.h"
 
@@ -17,94 +18,96 @@ size_t CountFiles(const std::filesystem::path &dir, const std::string &extension
 };
 
 // Instead of real processing, print all available information about the scan
-void ProcessScan(const scan_finder::ScanInfo &info) {
+void ProcessScan(const scan_finder::ScanInfo &info, std::ostream &out) {
 
   // First line: the almost unique identifier
-  std::cout << std::endl;
-  std::cout << "'" << info.id << "': " << std::endl;
+  out << std::endl;
+  out << "'" << info.id << "': " << std::endl;
         
   // Second line: some basic information about the person (gender, age, etc)
-  std::cout << "  ";
+  out << "  ";
   if (info.name != "NA") {
-    std::cout << info.name << " (" << ToUserFriendly(info.gender) << ")";
+    out << info.name << " (" << ToUserFriendly(info.gender) << ")";
   }
   else {
-    std::cout << ToUserFriendly(info.gender);
+    out << ToUserFriendly(info.gender);
   }
-  std::cout << ": " << ToUserFriendly(info.group);
+  out << ": " << ToUserFriendly(info.group);
   size_t age = 0;
   if (info.scan.HasAgeValue(age)) {
-    std::cout << ", " << age << " years old";
+    out << ", " << age << " years old";
   }
   float height = 0.0f, weight = 0.0f;
   if (info.scan.HasHeightValue(height)) {
-    std::cout << ", " << height << " cm";
+    out << ", " << height << " cm";
   }
   if (info.scan.HasWeightValue(weight)) {
-    std::cout << ", " << weight << " kg";
+    out << ", " << weight << " kg";
   }
-  std::cout << std::endl;
+  out << std::endl;
 
   // Third line: what does the person look like
   decltype(auto) tags = info.scan.Tags();
-  std::cout << "  Appearance: "
-            << ToUserFriendly(tags.hairstyle) << ", "
-            << ToUserFriendly(tags.clothing) << ", "
-            << ToUserFriendly(tags.shoes);
-  std::cout << std::endl;
+  out << "  Appearance: "
+      << ToUserFriendly(tags.hairstyle) << ", "
+      << ToUserFriendly(tags.clothing) << ", "
+      << ToUserFriendly(tags.shoes);
+  out << std::endl;
 
   // Fourth line: basic information about the scanner
-  std::cout << "  " << ToUserFriendly(info.scan.Scanner());
+  out << "  " << ToUserFriendly(info.scan.Scanner());
   if (info.scan.Stages().size() == 1 &&
       info.scan.Stages()[0].Streams().size() == 1) {
     decltype(auto) stream = info.scan.Stages()[0].Streams()[0];
-    std::cout << " (" << ToUserFriendly(stream.Sensor()) << "): ";
+    out << " (" << ToUserFriendly(stream.Sensor()) << "): ";
 
     Camera camera;
     std::string frame_dir;
     if (stream.HasDepth(camera, frame_dir)) {
-      std::cout << "depth " << camera.Width() << "x" << camera.Height()
-                << " (" << CountFiles(frame_dir, ".png") << " frames)";
+      out << "depth " << camera.Width() << "x" << camera.Height()
+          << " (" << CountFiles(frame_dir, ".png") << " frames)";
     }
     else {
-      std::cout << "no depth maps";
+      out << "no depth maps";
     }
 
     if (stream.HasColor(camera, frame_dir)) {
-      std::cout << ", color " << camera.Width() << "x" << camera.Height()
-                << " (" << CountFiles(frame_dir, ".jpg") << " frames)";
+      out << ", color " << camera.Width() << "x" << camera.Height()
+          << " (" << CountFiles(frame_dir, ".jpg") << " frames)";
     }
     else {
-      std::cout << ", no color frames";
+      out << ", no color frames";
     }
     if (tags.placement != scanogram::Placement::NA) {
-      std::cout << ", " << ToUserFriendly(tags.placement);
+      out << ", " << ToUserFriendly(tags.placement);
     }
   }
 
-  std::cout << std::endl << std::endl;
-  std::cout.flush();
+  out << std::endl << std::endl;
 }
 
 ErrHandle IterateScans(const std::filesystem::path &dir,
                        size_t &n_men, size_t &n_women) {
-  // Search for all files with the '.scan.xml' extension
-  // Store their paths somewhere in memory
+  // Search for all files with the '.scan.xml' extension and parse them
+  // Broken files are skipped, so one of them does not stop the whole pass
   ScanogramFinder finder;
-  TEXEL_CHECK(finder.BindDirectory(dir.string()));
+  scan_finder::BindReport report;
+  TEXEL_CHECK(finder.BindDirectory(dir.string(), scan_finder::BindParams(), report));
 
-  // For each such scan, parse its XML-based annotations and process somehow
-  while (finder.FindNext()) {
-    decltype(auto) info = finder.Current();
-    ProcessScan(info);
+  // Scans are processed concurrently, each thread counts its own scans
+  auto &pool = ThreadPool::Default();
+  std::vector<size_t> men(pool.Concurrency(), 0), women(pool.Concurrency(), 0);
+  finder.ForEachOrdered([&](const scan_finder::ScanInfo &info, size_t thread_idx) {
+    std::ostringstream oss;
+    ProcessScan(info, oss);
 
     switch (info.gender) {
       case scanogram::Gender::Male:
-        n_men += 1;
+        men[thread_idx] += 1;
         break;
 
       case scanogram::Gender::Female:
-        n_women += 1;
+        women[thread_idx] += 1;
         break;
 
       case scanogram::Gender::Neutral:
@@ -112,8 +115,25 @@ ErrHandle IterateScans(const std::filesystem::path &dir,
         // Sorry! In my country, only two genders exist
         break;
     }
+    return oss.str();
+  }, [](const scan_finder::ScanInfo &, const std::string &text) {
+    // The output comes in the order of scans
+    std::cout << text;
+    std::cout.flush();
+  }, pool);
+
+  for (size_t i = 0; i < pool.Concurrency(); i++) {
+    n_men += men[i];
+    n_women += women[i];
   }
 
+  if (!report.failures.empty()) {
+    std::cerr << std::endl << "Skipped " << report.failures.size() << " of " << report.n_files
+              << " files with scans:" << std::endl;
+    for (const auto &failure : report.failures) {
+      std::cerr << "'" << failure.path << "':" << std::endl << failure.error.Message();
+    }
+  }
   return ErrHandle();
 }
 
@@ -124,6 +144,12 @@ int main(int argc, char **argv) {
   }
   auto dir = argc == 2 ? argv[1] : std::filesystem::current_path();
 
+  MetricsExporter exporter;
+  auto metrics_err = exporter.StartFromEnvironment();
+  if (metrics_err.Failed()) {
+    std::cerr << "Metrics are not exported:" << std::endl << metrics_err.Message();
+  }
+
   size_t n_men{}, n_women{};
   auto err = IterateScans(dir, n_men, n_women);
   if (err.Failed()) {
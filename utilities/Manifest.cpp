@@ -0,0 +1,358 @@
+#include "Manifest.h"
+#include "Hash.h"
+#include "Parallel.h"
+
+namespace texel {
+
+namespace {
+
+const char Signature[] = "texel-manifest";
+const int Version = 1;
+
+int64_t ModificationTime(const std::filesystem::path &path, std::error_code &ec) {
+  return (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+}
+
+ErrHandle HashFile(const std::string &filename, std::vector<char> &buffer,
+                   uint64_t &hash, uint64_t &size) {
+  FILE *file = std::fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    std::ostringstream oss;
+    oss << "failed to open '" << filename << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  // Blocks are read directly into our buffer, bypassing the stdio one
+  std::setvbuf(file, nullptr, _IONBF, 0);
+  Xxh64 state;
+  size = 0;
+  size_t n;
+  while ((n = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+    state.Update(buffer.data(), n);
+    size += n;
+  }
+  bool failed = std::ferror(file) != 0;
+  std::fclose(file);
+  if (failed) {
+    std::ostringstream oss;
+    oss << "failed to read '" << filename << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  hash = state.Digest();
+  return ErrHandle();
+}
+
+// Hashes 'entries' concurrently, 'func(idx, err, hash, size)' is called for each of them,
+// 'err' tells why the file could not be read. An error returned by 'func' stops the hashing
+ErrHandle HashFiles(const std::filesystem::path &root,
+                    const std::vector<manifest::Entry *> &entries,
+                    const manifest::Params &params,
+                    const std::function<ErrHandle(size_t, const ErrHandle &, uint64_t, uint64_t)> &func) {
+  ThreadPool pool(std::max<size_t>(params.n_threads, 1));
+  std::vector<std::vector<char> > buffers(pool.Concurrency());
+  std::atomic<bool> failed(false);
+  std::mutex err_mutex;
+  ErrHandle hash_err;
+  pool.ParallelFor(0, entries.size(), 1, [&](size_t first, size_t last, size_t thread_idx) {
+    auto &buffer = buffers[thread_idx];
+    if (buffer.empty()) {
+      buffer.resize(std::max<size_t>(params.block_size, 4096));
+    }
+    for (size_t i = first; i < last && !failed; i++) {
+      uint64_t hash = 0, size = 0;
+      auto err = func(i, HashFile((root / entries[i]->path).string(), buffer, hash, size), hash, size);
+      if (err.Failed()) {
+        std::lock_guard<std::mutex> lock(err_mutex);
+        if (!failed) {
+          hash_err = err;
+          failed = true;
+        }
+        return;
+      }
+    }
+  });
+  return hash_err;
+}
+
+std::string JoinIds(const std::vector<std::string> &ids) {
+  std::ostringstream oss;
+  for (size_t i = 0; i < ids.size(); i++) {
+    oss << (i > 0 ? ", " : "") << ids[i];
+  }
+  return oss.str();
+}
+
+std::vector<std::string> SplitTabs(const std::string &line) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  while (true) {
+    size_t tab = line.find('\t', start);
+    fields.emplace_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+    if (tab == std::string::npos) {
+      break;
+    }
+    start = tab + 1;
+  }
+  return fields;
+}
+
+} // unnamed namespace
+
+//----------------
+//--- manifest ---
+//----------------
+
+namespace manifest {
+
+std::string ToUserFriendly(Status status) {
+  switch (status) {
+    case Status::Missing:   return "missing";
+    case Status::Truncated: return "size mismatch";
+    case Status::Corrupted:
+    default:                return "corrupted";
+  }
+}
+
+} // namespace manifest
+
+//----------------
+//--- Manifest ---
+//----------------
+
+ErrHandle Manifest::Build(ScanogramFinder &finder, const std::string &root,
+                          const manifest::Params &params) {
+  auto root_path = std::filesystem::absolute(root).lexically_normal();
+
+  // Files that have not changed keep their hashes
+  std::unordered_map<std::string, manifest::Entry> known;
+  if (params.incremental) {
+    for (auto &group : groups_) {
+      for (auto &entry : group.entries) {
+        auto path = entry.path;
+        known.emplace(std::move(path), std::move(entry));
+      }
+    }
+  }
+  groups_.clear();
+
+  // Each person directory forms a group, even if it contains a few '*.scan.xml' files
+  std::map<std::string, size_t> dir_to_group;
+  finder.Reset();
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    auto dir = std::filesystem::absolute(info.path).lexically_normal().parent_path();
+    auto rel = dir.lexically_relative(root_path);
+    if (rel.empty() || *rel.begin() == "..") {
+      std::ostringstream oss;
+      oss << "scan '" << info.id << "' is located outside the dataset root";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+    auto iter = dir_to_group.emplace(rel.generic_string(), groups_.size());
+    if (iter.second) {
+      groups_.emplace_back();
+      groups_.back().dir = rel.generic_string();
+    }
+    groups_[iter.first->second].ids.emplace_back(info.id);
+  }
+  finder.Reset();
+
+  for (auto &group : groups_) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator iter(root_path / group.dir, ec), end;
+    for (; !ec && iter != end; iter.increment(ec)) {
+      if (!iter->is_regular_file(ec)) {
+        continue;
+      }
+      manifest::Entry entry;
+      entry.path  = iter->path().lexically_relative(root_path).generic_string();
+      entry.size  = (uint64_t)iter->file_size(ec);
+      entry.mtime = ModificationTime(iter->path(), ec);
+      group.entries.emplace_back(std::move(entry));
+    }
+    if (ec) {
+      std::ostringstream oss;
+      oss << "failed to enumerate files of '" << group.dir << "' (" << ec.message() << ")";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+    std::sort(group.entries.begin(), group.entries.end(),
+              [](const manifest::Entry &a, const manifest::Entry &b) { return a.path < b.path; });
+  }
+
+  // Pointers are taken after all groups are filled, so they stay valid
+  std::vector<manifest::Entry *> to_hash;
+  for (auto &group : groups_) {
+    for (auto &entry : group.entries) {
+      auto prev = known.find(entry.path);
+      if (prev != known.end() && prev->second.size == entry.size && prev->second.mtime == entry.mtime) {
+        entry.hash = prev->second.hash;
+      }
+      else {
+        to_hash.emplace_back(&entry);
+      }
+    }
+  }
+  TEXEL_CHECK(HashFiles(root_path, to_hash, params,
+                        [&to_hash](size_t idx, const ErrHandle &err, uint64_t hash, uint64_t size) {
+    TEXEL_CHECK(err);
+    to_hash[idx]->hash = hash;
+    to_hash[idx]->size = size;
+    return ErrHandle();
+  }));
+  return ErrHandle();
+}
+
+ErrHandle Manifest::Verify(const std::string &root, const manifest::Params &params,
+                           manifest::Report &report) {
+  report = manifest::Report();
+  auto root_path = std::filesystem::absolute(root).lexically_normal();
+
+  // Cheap checks first, they touch only metadata
+  std::vector<manifest::Entry *> to_hash;
+  std::vector<const manifest::Group *> owners;
+  for (auto &group : groups_) {
+    auto ids = JoinIds(group.ids);
+    for (auto &entry : group.entries) {
+      report.files += 1;
+      auto path = root_path / entry.path;
+      std::error_code ec;
+      auto size = std::filesystem::file_size(path, ec);
+      if (ec) {
+        report.problems[ids].push_back(manifest::Problem{ entry.path, manifest::Status::Missing });
+        continue;
+      }
+      if (size != entry.size) {
+        report.problems[ids].push_back(manifest::Problem{ entry.path, manifest::Status::Truncated });
+        continue;
+      }
+      if (!params.incremental || ModificationTime(path, ec) != entry.mtime || ec) {
+        to_hash.emplace_back(&entry);
+        owners.emplace_back(&group);
+      }
+    }
+  }
+
+  // A file that cannot be read is reported instead of stopping the check, it is missing if it is gone
+  std::vector<std::optional<manifest::Status> > problems(to_hash.size());
+  TEXEL_CHECK(HashFiles(root_path, to_hash, params,
+                        [&](size_t idx, const ErrHandle &err, uint64_t hash, uint64_t size) {
+    if (err.Failed()) {
+      std::error_code ec;
+      bool exists = std::filesystem::exists(root_path / to_hash[idx]->path, ec);
+      problems[idx] = exists ? manifest::Status::Corrupted : manifest::Status::Missing;
+    }
+    else if (hash != to_hash[idx]->hash || size != to_hash[idx]->size) {
+      problems[idx] = manifest::Status::Corrupted;
+    }
+    return ErrHandle();
+  }));
+  for (size_t i = 0; i < to_hash.size(); i++) {
+    report.hashed_files += 1;
+    report.hashed_bytes += to_hash[i]->size;
+    if (problems[i].has_value()) {
+      auto ids = JoinIds(owners[i]->ids);
+      report.problems[ids].push_back(manifest::Problem{ to_hash[i]->path, *problems[i] });
+    }
+    else {
+      // The content is the same, so there is no need to hash it next time
+      std::error_code ec;
+      auto mtime = ModificationTime(root_path / to_hash[i]->path, ec);
+      if (!ec) {
+        to_hash[i]->mtime = mtime;
+      }
+    }
+  }
+  for (auto &scan : report.problems) {
+    std::sort(scan.second.begin(), scan.second.end(),
+              [](const manifest::Problem &a, const manifest::Problem &b) { return a.path < b.path; });
+  }
+  return ErrHandle();
+}
+
+ErrHandle Manifest::Save(const std::string &filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  file << Signature << "\t" << Version << "\n";
+  for (const auto &group : groups_) {
+    file << "group\t" << group.dir;
+    for (const auto &id : group.ids) {
+      file << "\t" << id;
+    }
+    file << "\n";
+    for (const auto &entry : group.entries) {
+      char hash[17];
+      std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)entry.hash);
+      file << "file\t" << hash << "\t" << entry.size << "\t" << entry.mtime << "\t" << entry.path << "\n";
+    }
+  }
+  file.flush();
+  if (!file) {
+    std::ostringstream oss;
+    oss << "failed to write the manifest into '" << filename << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  return ErrHandle();
+}
+
+ErrHandle Manifest::Load(const std::string &filename, Manifest &manifest) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    std::ostringstream oss;
+    oss << "failed to open the manifest '" << filename << "'";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  auto wrong_line = [&filename](const std::string &where, size_t line_idx) {
+    std::ostringstream oss;
+    oss << "the manifest '" << filename << "' is damaged (line " << line_idx << ")";
+    return ErrHandle(where, oss.str());
+  };
+
+  std::vector<manifest::Group> groups;
+  std::string line;
+  size_t line_idx = 0;
+  while (std::getline(file, line)) {
+    line_idx += 1;
+    auto fields = SplitTabs(line);
+    if (line_idx == 1) {
+      if (fields.size() != 2 || fields[0] != Signature || fields[1] != std::to_string(Version)) {
+        std::ostringstream oss;
+        oss << "'" << filename << "' is not a manifest or has an unsupported version";
+        return ErrHandle(TEXEL_WHERE, oss.str());
+      }
+      continue;
+    }
+    if (line.empty()) {
+      continue;
+    }
+
+    if (fields[0] == "group" && fields.size() >= 2) {
+      manifest::Group group;
+      group.dir = fields[1];
+      group.ids.assign(fields.begin() + 2, fields.end());
+      groups.emplace_back(std::move(group));
+    }
+    else if (fields[0] == "file" && fields.size() == 5 && !groups.empty()) {
+      manifest::Entry entry;
+      try {
+        entry.hash  = std::stoull(fields[1], nullptr, 16);
+        entry.size  = std::stoull(fields[2]);
+        entry.mtime = std::stoll(fields[3]);
+      }
+      catch (const std::exception &) {
+        return wrong_line(TEXEL_WHERE, line_idx);
+      }
+      entry.path = fields[4];
+      groups.back().entries.emplace_back(std::move(entry));
+    }
+    else {
+      return wrong_line(TEXEL_WHERE, line_idx);
+    }
+  }
+  if (line_idx == 0) {
+    return wrong_line(TEXEL_WHERE, 1);
+  }
+
+  manifest.groups_ = std::move(groups);
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,96 @@
+#pragma once
+#include "Defs.h"
+#include "ScanogramFinder.h"
+
+namespace texel {
+
+namespace manifest {
+
+// A single file of the dataset, the path is relative to the dataset root and uses '/' as a separator
+struct Entry {
+  std::string path;
+  uint64_t size;
+  int64_t mtime;     // native ticks of 'std::filesystem::file_time_type'
+  uint64_t hash;     // XXH64 of the content
+
+  Entry() : size(0), mtime(0), hash(0) { }
+};
+
+// All files of the person directory (frames, meshes, measurements, annotations)
+struct Group {
+  std::string dir;                 // relative to the dataset root
+  std::vector<std::string> ids;    // scans described by the '*.scan.xml' file
+  std::vector<Entry> entries;
+};
+
+struct Params {
+  // Threads hash different files, so a few of them are enough to keep the disk busy
+  size_t n_threads;
+
+  // Files are read by large sequential blocks (in bytes)
+  size_t block_size;
+
+  // If 'true', files with the same size and modification time are not hashed again
+  bool incremental;
+
+  Params() : n_threads(4), block_size(4 << 20), incremental(true) { }
+};
+
+enum class Status {
+  Missing,     // the file was deleted
+  Truncated,   // the file has a different size
+  Corrupted    // the content does not match the hash or cannot be read
+};
+std::string ToUserFriendly(Status status);
+
+struct Problem {
+  std::string path;
+  Status status;
+};
+
+struct Report {
+  size_t files;
+  size_t hashed_files;
+  uint64_t hashed_bytes;
+
+  // Problems, grouped by their scans ('Group::ids')
+  std::map<std::string, std::vector<Problem> > problems;
+
+  Report() : files(0), hashed_files(0), hashed_bytes(0) { }
+};
+
+} // namespace manifest
+
+
+// Sizes, modification times and hashes of all files of the dataset
+// Used to check that the dataset was transferred without errors
+class Manifest {
+  public:
+    Manifest() = default;
+    Manifest(const Manifest &) = delete;
+    Manifest(Manifest &&) noexcept = default;
+    Manifest &operator =(const Manifest &) = delete;
+    Manifest &operator =(Manifest &&) noexcept = default;
+
+    const std::vector<manifest::Group> &Groups() const { return groups_; }
+
+    // Hashes all files of the scans found by 'finder' (it must be bound to 'root')
+    // In the incremental mode, hashes of unchanged files are taken from the current manifest
+    ErrHandle Build(ScanogramFinder &finder, const std::string &root,
+                    const manifest::Params &params = manifest::Params());
+
+    // Checks files against the manifest, changed files are hashed again
+    // Files that cannot be read are reported as problems, they do not stop the check
+    // Files that changed only their modification times get the new ones
+    ErrHandle Verify(const std::string &root, const manifest::Params &params,
+                     manifest::Report &report);
+
+    // A tab-separated text file
+    ErrHandle Save(const std::string &filename) const;
+    static ErrHandle Load(const std::string &filename, Manifest &manifest);
+
+  private:
+    std::vector<manifest::Group> groups_;
+};
+
+} // namespace texel
@@ -0,0 +1,171 @@
+#include <cctype>
+#include <deque>
+#include <iostream>
+#include <iomanip>
+#include "Mesh.h"
+#include "MeshMeasurements.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+struct Options {
+  std::filesystem::path dir, output;
+
+  // Measure the fitted SMPL300 model ('model_smpl300.ply') instead of the scan itself ('scan.ply')
+  bool model = false;
+};
+
+// A mesh of one scanner for one person
+struct Job {
+  std::filesystem::path person_dir;
+  std::string scanner;
+  std::vector<std::string> ids;
+};
+
+struct LoadedMesh {
+  Mesh mesh;
+  ErrHandle err;
+};
+
+LoadedMesh LoadMesh(const std::filesystem::path &filename) {
+  LoadedMesh loaded;
+  loaded.err = Mesh::Load(filename.string(), loaded.mesh);
+  return loaded;
+}
+
+// 'Chest girth' -> 'chest_girth'
+std::string ColumnName(const std::string &name) {
+  std::string column(name);
+  for (auto &c : column) {
+    c = c == ' ' ? '_' : (char)std::tolower((unsigned char)c);
+  }
+  return column;
+}
+
+ErrHandle MeasureScans(const Options &options, size_t &n_measured, size_t &n_skipped) {
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(options.dir.string()));
+
+  // Persons may have a few scans, but only one mesh per scanner
+  std::vector<std::pair<std::filesystem::path, std::vector<std::string> > > persons;
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    auto person_dir = std::filesystem::path(info.path).parent_path();
+    if (persons.empty() || persons.back().first != person_dir) {
+      persons.emplace_back(person_dir, std::vector<std::string>());
+    }
+    persons.back().second.emplace_back(info.id);
+  }
+  const char *mesh_name = options.model ? "model_smpl300.ply" : "scan.ply";
+  std::vector<Job> jobs;
+  for (const auto &person : persons) {
+    for (const char *scanner : { "portal_mx", "free_fusion" }) {
+      if (std::filesystem::is_regular_file(person.first / scanner / mesh_name)) {
+        jobs.push_back(Job{ person.first, scanner, person.second });
+      }
+    }
+  }
+
+  std::ofstream summary;
+  if (!options.output.empty()) {
+    std::filesystem::create_directories(options.output);
+    summary.open(options.output / "summary.csv");
+    if (!summary) {
+      return ErrHandle(TEXEL_WHERE, "failed to create 'summary.csv' in the output directory");
+    }
+    summary << std::fixed << std::setprecision(1);
+
+    // Levels without contours are not measured, so columns are fixed and missing values are left empty
+    summary << "id,scanner";
+    for (const auto &name : mesh_measure::Names()) {
+      summary << "," << ColumnName(name);
+    }
+    summary << std::endl;
+  }
+
+  // Parsing PLY files takes longer than measuring, so a few meshes are loaded ahead concurrently
+  const size_t n_ahead = std::max<size_t>(2, std::thread::hardware_concurrency());
+  std::deque<std::future<LoadedMesh> > loading;
+  size_t n_started = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    for (; n_started < jobs.size() && n_started < i + n_ahead; n_started++) {
+      const auto &job = jobs[n_started];
+      loading.push_back(std::async(std::launch::async, LoadMesh, job.person_dir / job.scanner / mesh_name));
+    }
+    auto loaded = loading.front().get();
+    loading.pop_front();
+    const auto &job = jobs[i];
+
+    std::vector<mesh_measure::Measurement> measurements;
+    auto err = loaded.err;
+    if (err.Succeeded()) {
+      err = MeshSlicer::Measure(loaded.mesh, mesh_measure::Params(), measurements);
+    }
+    if (err.Failed()) {
+      std::cout << "'" << job.ids[0] << "' (" << job.scanner << "): skipped" << std::endl << err.Message() << std::endl;
+      n_skipped += 1;
+      continue;
+    }
+
+    std::cout << "'" << job.ids[0] << "' (" << job.scanner << "):" << std::fixed << std::setprecision(1);
+    for (size_t k = 0; k < measurements.size(); k++) {
+      std::cout << (k == 0 ? " " : ", ") << measurements[k].name << " " << measurements[k].value;
+    }
+    std::cout << " cm" << std::endl;
+    n_measured += 1;
+
+    if (!options.output.empty()) {
+      auto dir = options.output / std::filesystem::relative(job.person_dir, options.dir) / job.scanner;
+      std::filesystem::create_directories(dir);
+      TEXEL_CHECK(mesh_measure::Save((dir / "measurements.csv").string(), measurements));
+      for (const auto &id : job.ids) {
+        summary << id << "," << job.scanner;
+        for (const auto &name : mesh_measure::Names()) {
+          summary << ",";
+          auto measurement = std::find_if(measurements.begin(), measurements.end(),
+                                          [&](const mesh_measure::Measurement &m) { return m.name == name; });
+          if (measurement != measurements.end()) {
+            summary << measurement->value;
+          }
+        }
+        summary << std::endl;
+      }
+    }
+  }
+
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--model") {
+      options.model = true;
+    }
+    else {
+      args.emplace_back(argv[i]);
+    }
+  }
+  if (args.empty() || args.size() > 2) {
+    std::cerr << "Wrong arguments, use as './MeasureScans <path_to_directory_with_scans> [<output_directory>] [--model]'"
+              << std::endl;
+    return 0;
+  }
+  options.dir = args[0];
+  if (args.size() == 2) {
+    options.output = args[1];
+  }
+
+  size_t n_measured{}, n_skipped{};
+  auto start = std::chrono::steady_clock::now();
+  auto err = MeasureScans(options, n_measured, n_skipped);
+  if (err.Failed()) {
+    std::cerr << "Failed to measure scans from the '" << options.dir.string() << "' directory:" << std::endl;
+    std::cerr << err.Message();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::endl << "Measured " << n_measured << " meshes (" << n_skipped << " skipped) in "
+            << std::fixed << std::setprecision(1) << seconds << " s" << std::endl;
+  return 0;
+}
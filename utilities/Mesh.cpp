@@ -0,0 +1,358 @@
+#include "Mesh.h"
+
+namespace texel {
+
+namespace {
+
+enum class PlyFormat {
+  Ascii,
+  BinaryLittleEndian,
+  BinaryBigEndian
+};
+
+enum class PlyType {
+  Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+};
+
+struct PlyProperty {
+  std::string name;
+  PlyType type;
+  bool is_list;
+  PlyType count_type;
+};
+
+struct PlyElement {
+  std::string name;
+  size_t count;
+  std::vector<PlyProperty> properties;
+};
+
+bool ParsePlyType(const std::string &str, PlyType &type) {
+  static const std::unordered_map<std::string, PlyType> types = {
+    { "char",  PlyType::Int8 },   { "int8",    PlyType::Int8 },
+    { "uchar", PlyType::UInt8 },  { "uint8",   PlyType::UInt8 },
+    { "short", PlyType::Int16 },  { "int16",   PlyType::Int16 },
+    { "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+    { "int",   PlyType::Int32 },  { "int32",   PlyType::Int32 },
+    { "uint",  PlyType::UInt32 }, { "uint32",  PlyType::UInt32 },
+    { "float", PlyType::Float32 }, { "float32", PlyType::Float32 },
+    { "double", PlyType::Float64 }, { "float64", PlyType::Float64 }
+  };
+  auto iter = types.find(str);
+  if (iter == types.end()) {
+    return false;
+  }
+  type = iter->second;
+  return true;
+}
+
+size_t SizeOf(PlyType type) {
+  switch (type) {
+    case PlyType::Int8:
+    case PlyType::UInt8:
+      return 1;
+    case PlyType::Int16:
+    case PlyType::UInt16:
+      return 2;
+    case PlyType::Int32:
+    case PlyType::UInt32:
+    case PlyType::Float32:
+      return 4;
+    case PlyType::Float64:
+    default:
+      return 8;
+  }
+}
+
+template <typename T>
+T ReadRaw(const char *ptr, bool swap) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, ptr, sizeof(T));
+  if (swap) {
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+// Sequentially reads values of the PLY body, either text or binary ones
+class PlyCursor {
+  public:
+    PlyCursor(const char *begin, const char *end, PlyFormat format)
+      : ptr_(begin), end_(end), format_(format), failed_(false) {
+      const uint16_t probe = 1;
+      bool little_endian = *reinterpret_cast<const uint8_t *>(&probe) == 1;
+      swap_ = (format == PlyFormat::BinaryLittleEndian && !little_endian) ||
+              (format == PlyFormat::BinaryBigEndian && little_endian);
+    }
+
+    bool Failed() const { return failed_; }
+
+    double Read(PlyType type) {
+      if (format_ == PlyFormat::Ascii) {
+        // The body is null-terminated, so 'strtod()' cannot run out of the buffer
+        char *next = nullptr;
+        double value = std::strtod(ptr_, &next);
+        if (next == ptr_) {
+          failed_ = true;
+          return 0.0;
+        }
+        ptr_ = next;
+        return value;
+      }
+
+      size_t size = SizeOf(type);
+      if ((size_t)(end_ - ptr_) < size) {
+        failed_ = true;
+        return 0.0;
+      }
+      double value = 0.0;
+      switch (type) {
+        case PlyType::Int8:    value = ReadRaw<int8_t>(ptr_, swap_); break;
+        case PlyType::UInt8:   value = ReadRaw<uint8_t>(ptr_, swap_); break;
+        case PlyType::Int16:   value = ReadRaw<int16_t>(ptr_, swap_); break;
+        case PlyType::UInt16:  value = ReadRaw<uint16_t>(ptr_, swap_); break;
+        case PlyType::Int32:   value = ReadRaw<int32_t>(ptr_, swap_); break;
+        case PlyType::UInt32:  value = ReadRaw<uint32_t>(ptr_, swap_); break;
+        case PlyType::Float32: value = ReadRaw<float>(ptr_, swap_); break;
+        case PlyType::Float64: value = ReadRaw<double>(ptr_, swap_); break;
+      }
+      ptr_ += size;
+      return value;
+    }
+
+  private:
+    const char *ptr_, *end_;
+    PlyFormat format_;
+    bool swap_, failed_;
+};
+
+ErrHandle ParseHeader(const std::string &header,
+                      PlyFormat &format, std::vector<PlyElement> &elements) {
+  std::istringstream lines(header);
+  std::string line;
+  bool has_format = false;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    std::istringstream tokens(line);
+    std::string keyword;
+    tokens >> keyword;
+
+    if (keyword == "format") {
+      std::string name, version;
+      tokens >> name >> version;
+      if (name == "ascii") {
+        format = PlyFormat::Ascii;
+      }
+      else if (name == "binary_little_endian") {
+        format = PlyFormat::BinaryLittleEndian;
+      }
+      else if (name == "binary_big_endian") {
+        format = PlyFormat::BinaryBigEndian;
+      }
+      else {
+        return ErrHandle(TEXEL_WHERE, "unknown PLY format '" + name + "'");
+      }
+      has_format = true;
+    }
+    else if (keyword == "element") {
+      PlyElement element;
+      if (!(tokens >> element.name >> element.count)) {
+        return ErrHandle(TEXEL_WHERE, "malformed PLY element ('" + line + "')");
+      }
+      elements.emplace_back(std::move(element));
+    }
+    else if (keyword == "property") {
+      if (elements.empty()) {
+        return ErrHandle(TEXEL_WHERE, "PLY property is declared before any element");
+      }
+      PlyProperty property;
+      std::string type;
+      tokens >> type;
+      property.is_list = type == "list";
+      property.count_type = PlyType::UInt8;
+      if (property.is_list) {
+        std::string count_type;
+        tokens >> count_type >> type;
+        if (!ParsePlyType(count_type, property.count_type)) {
+          return ErrHandle(TEXEL_WHERE, "unknown PLY type '" + count_type + "'");
+        }
+      }
+      if (!ParsePlyType(type, property.type) || !(tokens >> property.name)) {
+        return ErrHandle(TEXEL_WHERE, "malformed PLY property ('" + line + "')");
+      }
+      elements.back().properties.emplace_back(std::move(property));
+    }
+    // 'ply', 'comment', 'obj_info' and 'end_header' carry nothing for us
+  }
+
+  if (!has_format) {
+    return ErrHandle(TEXEL_WHERE, "PLY header does not specify the format");
+  }
+  return ErrHandle();
+}
+
+ErrHandle ParseBody(const std::vector<PlyElement> &elements, PlyCursor &cursor, Mesh &mesh) {
+  auto &vertices  = mesh.Vertices();
+  auto &triangles = mesh.Triangles();
+  vertices.clear();
+  triangles.clear();
+
+  std::vector<double> values;
+  std::vector<uint32_t> polygon;
+  for (const auto &element : elements) {
+    bool is_vertex = element.name == "vertex";
+    bool is_face   = element.name == "face";
+    int coords[3] = { -1, -1, -1 };
+    int indices = -1;
+    for (size_t i = 0; i < element.properties.size(); i++) {
+      const auto &property = element.properties[i];
+      if (is_vertex && !property.is_list && property.name.size() == 1 &&
+          property.name[0] >= 'x' && property.name[0] <= 'z') {
+        coords[property.name[0] - 'x'] = (int)i;
+      }
+      if (is_face && property.is_list &&
+          (property.name == "vertex_indices" || property.name == "vertex_index")) {
+        indices = (int)i;
+      }
+    }
+    if (is_vertex && (coords[0] < 0 || coords[1] < 0 || coords[2] < 0)) {
+      return ErrHandle(TEXEL_WHERE, "PLY vertices have no 'x', 'y' or 'z' coordinates");
+    }
+    if (is_vertex) {
+      vertices.reserve(element.count);
+    }
+    if (is_face) {
+      triangles.reserve(element.count);
+    }
+
+    values.resize(element.properties.size());
+    for (size_t n = 0; n < element.count; n++) {
+      polygon.clear();
+      for (size_t i = 0; i < element.properties.size(); i++) {
+        const auto &property = element.properties[i];
+        if (!property.is_list) {
+          values[i] = cursor.Read(property.type);
+          continue;
+        }
+
+        size_t count = (size_t)cursor.Read(property.count_type);
+        bool keep = (int)i == indices;
+        for (size_t k = 0; k < count && !cursor.Failed(); k++) {
+          double value = cursor.Read(property.type);
+          if (keep) {
+            polygon.emplace_back((uint32_t)value);
+          }
+        }
+      }
+      if (cursor.Failed()) {
+        std::ostringstream oss;
+        oss << "PLY file is truncated (element '" << element.name << "' #" << n << ")";
+        return ErrHandle(TEXEL_WHERE, oss.str());
+      }
+
+      if (is_vertex) {
+        vertices.emplace_back((float)values[coords[0]],
+                              (float)values[coords[1]],
+                              (float)values[coords[2]]);
+      }
+      else if (is_face && polygon.size() >= 3) {
+        // Polygons are split into fans
+        for (size_t k = 1; k + 1 < polygon.size(); k++) {
+          triangles.push_back(Mesh::Triangle{ polygon[0], polygon[k], polygon[k + 1] });
+        }
+      }
+    }
+  }
+
+  for (const auto &triangle : triangles) {
+    for (auto idx : triangle) {
+      if (idx >= vertices.size()) {
+        std::ostringstream oss;
+        oss << "PLY face references vertex #" << idx << ", but only "
+            << vertices.size() << " vertices are declared";
+        return ErrHandle(TEXEL_WHERE, oss.str());
+      }
+    }
+  }
+  return ErrHandle();
+}
+
+} // unnamed namespace
+
+//------------
+//--- Mesh ---
+//------------
+
+BoundingBox Mesh::Bounds() const {
+  if (vertices_.empty()) {
+    return BoundingBox();
+  }
+  glm::vec3 min_corner = vertices_[0], max_corner = vertices_[0];
+  for (const auto &v : vertices_) {
+    min_corner = glm::min(min_corner, v);
+    max_corner = glm::max(max_corner, v);
+  }
+  return BoundingBox(min_corner, max_corner - min_corner);
+}
+
+float Mesh::GuessScale() const {
+  auto size = Bounds().Size();
+  float extent = std::max(size.x, std::max(size.y, size.z));
+  return extent > 300.0f ? 0.001f : (extent > 10.0f ? 0.01f : 1.0f);
+}
+
+ErrHandle Mesh::Load(const std::string &filename, Mesh &mesh) {
+  // Meshes are read at once, it is much faster than parsing them from a stream
+  std::vector<char> data;
+  {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+      std::ostringstream oss;
+      oss << "failed to open a mesh ('" << filename << "')";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+    file.seekg(0, std::ios::end);
+    data.resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (!file.read(data.data(), (std::streamsize)data.size())) {
+      std::ostringstream oss;
+      oss << "failed to read a mesh ('" << filename << "')";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+    data.push_back('\0');
+  }
+
+  const char magic[] = "ply";
+  const char end_header[] = "end_header";
+  auto header_end = std::search(data.begin(), data.end(), end_header, end_header + sizeof(end_header) - 1);
+  if (data.size() < 4 || std::memcmp(data.data(), magic, 3) != 0 || header_end == data.end()) {
+    std::ostringstream oss;
+    oss << "'" << filename << "' is not a PLY file";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  auto body = std::find(header_end, data.end(), '\n');
+  if (body != data.end()) {
+    ++body;
+  }
+
+  PlyFormat format = PlyFormat::Ascii;
+  std::vector<PlyElement> elements;
+  auto err = ParseHeader(std::string(data.begin(), header_end), format, elements);
+  if (err.Succeeded()) {
+    // Skip the null terminator that was appended above
+    PlyCursor cursor(data.data() + (body - data.begin()), data.data() + data.size() - 1, format);
+    err = ParseBody(elements, cursor, mesh);
+  }
+  if (err.Failed()) {
+    std::ostringstream oss;
+    oss << "failed to parse a mesh ('" << filename << "')";
+    return ErrHandle(TEXEL_WHERE, oss.str(), err);
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
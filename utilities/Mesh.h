@@ -0,0 +1,41 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+// A triangle mesh, e.g. '3D scan' from Portal MX or Free Fusion
+// Coordinates are kept in units of the source file, faces with more than 3 vertices are triangulated
+class Mesh {
+  public:
+    using Triangle = std::array<uint32_t, 3>;
+
+    Mesh() = default;
+    Mesh(const Mesh &) = default;
+    Mesh(Mesh &&) noexcept = default;
+    Mesh &operator =(const Mesh &) = default;
+    Mesh &operator =(Mesh &&) noexcept = default;
+
+    bool Empty() const { return vertices_.empty(); }
+
+    const std::vector<glm::vec3> &Vertices() const { return vertices_; }
+    std::vector<glm::vec3> &Vertices() { return vertices_; }
+
+    const std::vector<Triangle> &Triangles() const { return triangles_; }
+    std::vector<Triangle> &Triangles() { return triangles_; }
+
+    // Returns the axis-aligned box that contains all vertices
+    BoundingBox Bounds() const;
+
+    // Meshes may be stored in meters, centimeters or millimeters, but a person is never taller than a few meters
+    // Returns the factor that converts coordinates of the mesh into meters
+    float GuessScale() const;
+
+    // Reads a PLY file (ASCII or binary), only vertex positions and faces are kept
+    static ErrHandle Load(const std::string &filename, Mesh &mesh);
+
+  private:
+    std::vector<glm::vec3> vertices_;
+    std::vector<Triangle> triangles_;
+};
+
+} // namespace texel
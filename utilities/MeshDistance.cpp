@@ -0,0 +1,375 @@
+#include "MeshDistance.h"
+
+namespace texel {
+
+namespace {
+
+// Leaves are small, so the traversal prunes most of the triangles
+constexpr uint32_t LeafSize = 4;
+
+// Median splits keep the hierarchy balanced, so its depth is about log2(triangles / LeafSize)
+constexpr size_t MaxDepth = 64;
+
+constexpr uint32_t NoTriangle = std::numeric_limits<uint32_t>::max();
+
+// Returns the vector from the closest point of the triangle to 'p'
+// See 'Real-Time Collision Detection' by C. Ericson, section 5.1.5
+glm::vec3 FromTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+  float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) {
+    return ap;
+  }
+
+  glm::vec3 bp = p - b;
+  float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) {
+    return bp;
+  }
+
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return ap - ab * (d1 / (d1 - d3));
+  }
+
+  glm::vec3 cp = p - c;
+  float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) {
+    return cp;
+  }
+
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return ap - ac * (d2 / (d2 - d6));
+  }
+
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    return bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+
+  // The projection is inside the triangle
+  float denom = 1.0f / (va + vb + vc);
+  return ap - ab * (vb * denom) - ac * (vc * denom);
+}
+
+float SquaredDistanceToTriangle(const glm::vec3 &p,
+                                const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  glm::vec3 d = FromTriangle(p, a, b, c);
+  return glm::dot(d, d);
+}
+
+float SquaredDistanceToBox(const glm::vec3 &p, const glm::vec3 &min, const glm::vec3 &max) {
+  glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+  return glm::dot(d, d);
+}
+
+int LongestAxis(const glm::vec3 &extent) {
+  return extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+}
+
+} // unnamed namespace
+
+//---------------------
+//--- mesh_distance ---
+//---------------------
+
+namespace mesh_distance {
+
+Stats Summarize(const std::vector<float> &distances) {
+  Stats stats;
+  stats.count = distances.size();
+  if (distances.empty()) {
+    return stats;
+  }
+
+  double sum = 0.0, sum_sq = 0.0;
+  for (auto d : distances) {
+    sum += d;
+    sum_sq += (double)d * d;
+    stats.max = std::max(stats.max, d);
+  }
+  stats.mean = (float)(sum / distances.size());
+  stats.rms  = (float)std::sqrt(sum_sq / distances.size());
+
+  std::vector<float> sorted(distances);
+  auto nth = [&sorted](double q) {
+    auto iter = sorted.begin() + (size_t)(q * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), iter, sorted.end());
+    return *iter;
+  };
+  stats.median = nth(0.5);
+  stats.p95    = nth(0.95);
+  return stats;
+}
+
+} // namespace mesh_distance
+
+//--------------------
+//--- MeshDistance ---
+//--------------------
+
+MeshDistance::MeshDistance(const Mesh &mesh) {
+  const auto &vertices = mesh.Vertices();
+
+  // Degenerate triangles cannot be the closest ones, so drop them
+  std::vector<uint32_t> order;
+  std::vector<glm::vec3> centroids;
+  order.reserve(mesh.Triangles().size());
+  centroids.reserve(mesh.Triangles().size());
+  for (const auto &tri : mesh.Triangles()) {
+    const auto &a = vertices[tri[0]], &b = vertices[tri[1]], &c = vertices[tri[2]];
+    auto normal = glm::cross(b - a, c - a);
+    if (glm::dot(normal, normal) > 0.0f) {
+      order.emplace_back((uint32_t)centroids.size());
+      centroids.emplace_back((a + b + c) / 3.0f);
+      corners_.emplace_back(a);
+      corners_.emplace_back(b);
+      corners_.emplace_back(c);
+    }
+  }
+  if (order.empty()) {
+    corners_.clear();
+    return;
+  }
+
+  // Top-down construction, each node is split at the median along its longest axis
+  nodes_.reserve(2 * (order.size() / LeafSize + 1));
+  nodes_.push_back(Node{ glm::vec3(0.0f), glm::vec3(0.0f), 0, (uint32_t)order.size() });
+  std::vector<uint32_t> pending{ 0 };
+  while (!pending.empty()) {
+    uint32_t idx = pending.back();
+    pending.pop_back();
+    uint32_t first = nodes_[idx].first, count = nodes_[idx].count;
+
+    glm::vec3 min( std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    glm::vec3 c_min = min, c_max = max;
+    for (uint32_t i = first; i < first + count; i++) {
+      for (size_t k = 0; k < 3; k++) {
+        min = glm::min(min, corners_[3 * order[i] + k]);
+        max = glm::max(max, corners_[3 * order[i] + k]);
+      }
+      c_min = glm::min(c_min, centroids[order[i]]);
+      c_max = glm::max(c_max, centroids[order[i]]);
+    }
+    nodes_[idx].min = min;
+    nodes_[idx].max = max;
+
+    glm::vec3 extent = c_max - c_min;
+    int axis = LongestAxis(extent);
+    if (count <= LeafSize || extent[axis] <= 0.0f) {
+      continue;
+    }
+
+    uint32_t half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                     [&centroids, axis](uint32_t a, uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+    uint32_t left = (uint32_t)nodes_.size();
+    nodes_.push_back(Node{ glm::vec3(0.0f), glm::vec3(0.0f), first, half });
+    nodes_.push_back(Node{ glm::vec3(0.0f), glm::vec3(0.0f), first + half, count - half });
+    nodes_[idx].first = left;
+    nodes_[idx].count = 0;
+    pending.emplace_back(left + 1);
+    pending.emplace_back(left);
+  }
+
+  // Store corners in order of leaves, so the traversal reads memory sequentially
+  std::vector<glm::vec3> sorted(corners_.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    for (size_t k = 0; k < 3; k++) {
+      sorted[3 * i + k] = corners_[3 * order[i] + k];
+    }
+  }
+  corners_.swap(sorted);
+}
+
+float MeshDistance::SquaredDistance(const glm::vec3 &point, uint32_t &hint) const {
+  if (nodes_.empty()) {
+    return std::numeric_limits<float>::infinity();
+  }
+
+  // Neighbouring query points usually share the closest triangle, it gives a tight initial bound
+  float best = std::numeric_limits<float>::infinity();
+  uint32_t best_idx = NoTriangle;
+  if (hint != NoTriangle) {
+    best = SquaredDistanceToTriangle(point, corners_[3 * hint], corners_[3 * hint + 1], corners_[3 * hint + 2]);
+    best_idx = hint;
+  }
+
+  uint32_t stack[MaxDepth];
+  size_t top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const auto &node = nodes_[stack[--top]];
+    if (SquaredDistanceToBox(point, node.min, node.max) >= best) {
+      continue;
+    }
+
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        float d = SquaredDistanceToTriangle(point, corners_[3 * i], corners_[3 * i + 1], corners_[3 * i + 2]);
+        if (d < best) {
+          best = d;
+          best_idx = i;
+        }
+      }
+      continue;
+    }
+
+    // The closer child is visited first, so it is pushed last
+    const auto &left = nodes_[node.first], &right = nodes_[node.first + 1];
+    float d_left  = SquaredDistanceToBox(point, left.min, left.max);
+    float d_right = SquaredDistanceToBox(point, right.min, right.max);
+    uint32_t near = node.first, far = node.first + 1;
+    if (d_right < d_left) {
+      std::swap(near, far);
+      std::swap(d_left, d_right);
+    }
+    if (d_right < best) {
+      stack[top++] = far;
+    }
+    if (d_left < best) {
+      stack[top++] = near;
+    }
+  }
+
+  hint = best_idx;
+  return best;
+}
+
+float MeshDistance::Distance(const glm::vec3 &point) const {
+  uint32_t hint = NoTriangle;
+  return std::sqrt(SquaredDistance(point, hint));
+}
+
+void MeshDistance::Distances(const std::vector<glm::vec3> &points, std::vector<float> &distances,
+                             ThreadPool &pool) const {
+  distances.resize(points.size());
+  pool.ParallelFor(0, points.size(), 4096, [&](size_t first, size_t last, size_t) {
+    uint32_t hint = NoTriangle;
+    for (size_t i = first; i < last; i++) {
+      distances[i] = std::sqrt(SquaredDistance(points[i], hint));
+    }
+  });
+}
+
+RigidTransform MeshDistance::CoarseGuess(const std::vector<glm::vec3> &points) const {
+  if (nodes_.empty() || points.empty()) {
+    return RigidTransform();
+  }
+  glm::vec3 min( std::numeric_limits<float>::max());
+  glm::vec3 max(-std::numeric_limits<float>::max());
+  for (const auto &point : points) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  // A quarter turn around the third axis takes the longest side of the points onto the longest side of the surface
+  int from = LongestAxis(max - min), to = LongestAxis(nodes_[0].max - nodes_[0].min);
+  glm::mat3x3 rotation(1.0f);
+  if (from != to) {
+    int other = 3 - from - to;
+    rotation = glm::mat3x3(0.0f);
+    rotation[from][to] = 1.0f;
+    rotation[to][from] = -1.0f;
+    rotation[other][other] = 1.0f;
+  }
+  glm::vec3 center = (nodes_[0].min + nodes_[0].max) * 0.5f;
+  return RigidTransform(rotation, center - rotation * ((min + max) * 0.5f));
+}
+
+mesh_distance::Alignment MeshDistance::Align(const std::vector<glm::vec3> &points, const RigidTransform &guess,
+                                             const mesh_distance::Params &params, ThreadPool &pool) const {
+  mesh_distance::Alignment result;
+  result.pose = guess;
+  if (nodes_.empty() || points.empty()) {
+    return result;
+  }
+
+  // Each chunk of points keeps its own hint, neighbouring points usually share the closest triangle
+  const size_t chunk = 1024;
+  const size_t n_chunks = (points.size() + chunk - 1) / chunk;
+  const float max_distance2 = params.max_distance * params.max_distance;
+  std::vector<geometry::PointToPlaneSystem> partial(n_chunks);
+  for (size_t iter = 0; iter < params.iterations; iter++) {
+    pool.ParallelFor(0, n_chunks, [&](size_t c) {
+      auto &system = partial[c];
+      system.fill(0.0);
+      uint32_t hint = NoTriangle;
+      for (size_t i = c * chunk; i < std::min(points.size(), (c + 1) * chunk); i++) {
+        glm::vec3 p = result.pose.Apply(points[i]);
+        if (SquaredDistance(p, hint) > max_distance2) {
+          continue;
+        }
+        const glm::vec3 *corners = corners_.data() + 3 * hint;
+        glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        float length = glm::length(normal);
+        if (!(length > 0.0f)) {
+          continue;
+        }
+        normal /= length;
+        geometry::AddPointToPlane(p, normal, glm::dot(normal, FromTriangle(p, corners[0], corners[1], corners[2])),
+                                  system);
+      }
+    });
+
+    geometry::PointToPlaneSystem system{};
+    for (const auto &part : partial) {
+      for (size_t k = 0; k < geometry::PointToPlaneSize; k++) {
+        system[k] += part[k];
+      }
+    }
+    size_t n_correspondences = (size_t)system[geometry::PointToPlaneSize - 1];
+    double x[6];
+    if (n_correspondences < 6 || !geometry::SolvePointToPlane(system, x)) {
+      break;
+    }
+    result.rmse = (float)std::sqrt(system[geometry::PointToPlaneSize - 2] / (double)n_correspondences);
+    auto update = RigidTransform::FromTwist(glm::vec3((float)x[0], (float)x[1], (float)x[2]),
+                                            glm::vec3((float)x[3], (float)x[4], (float)x[5]));
+    result.pose = update * result.pose;
+
+    double norm = 0.0;
+    for (size_t k = 0; k < 6; k++) {
+      norm += x[k] * x[k];
+    }
+    if (std::sqrt(norm) < params.min_update) {
+      break;
+    }
+  }
+
+  std::vector<glm::vec3> aligned(points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    aligned[i] = result.pose.Apply(points[i]);
+  }
+  std::vector<float> distances;
+  Distances(aligned, distances, pool);
+  size_t n_inliers = 0;
+  for (float distance : distances) {
+    n_inliers += distance < params.inlier_distance ? 1 : 0;
+  }
+  result.inliers = (float)n_inliers / (float)points.size();
+  return result;
+}
+
+ErrHandle MeshDistance::Compare(const Mesh &source, const Mesh &target,
+                                mesh_distance::Comparison &result,
+                                ThreadPool &pool) {
+  MeshDistance to_target(target), to_source(source);
+  if (to_target.Empty() || to_source.Empty()) {
+    return ErrHandle(TEXEL_WHERE, "meshes must have at least one non-degenerate triangle");
+  }
+
+  to_target.Distances(source.Vertices(), result.forward_errors, pool);
+  to_source.Distances(target.Vertices(), result.backward_errors, pool);
+  result.forward   = mesh_distance::Summarize(result.forward_errors);
+  result.backward  = mesh_distance::Summarize(result.backward_errors);
+  result.chamfer   = result.forward.mean + result.backward.mean;
+  result.hausdorff = std::max(result.forward.max, result.backward.max);
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,124 @@
+#pragma once
+#include "Defs.h"
+#include "Geometry.h"
+#include "Mesh.h"
+#include "Parallel.h"
+
+namespace texel {
+
+namespace mesh_distance {
+
+// Parameters of the alignment of points to the surface, distances are in units of the mesh
+struct Params {
+  // Correspondences that are farther from the surface are rejected
+  float max_distance;
+
+  // Maximal number of iterations
+  size_t iterations;
+
+  // Iterations stop when the update becomes smaller (radians + units of the mesh)
+  float min_update;
+
+  // Points that end up closer to the surface are inliers
+  float inlier_distance;
+
+  Params() : max_distance(0.1f), iterations(30), min_update(1e-5f), inlier_distance(0.02f) { }
+};
+
+// The result of the alignment
+struct Alignment {
+  // Maps the points onto the surface
+  RigidTransform pose;
+
+  // Root mean square of the point-to-plane distances of the last iteration
+  float rmse;
+
+  // Share of points closer to the surface than 'inlier_distance'
+  float inliers;
+
+  Alignment() : rmse(0.0f), inliers(0.0f) { }
+};
+
+// Summary of distances from vertices of one mesh to the surface of another one
+struct Stats {
+  size_t count;
+  float mean, rms, median, p95, max;
+
+  Stats() : count(0), mean(0.0f), rms(0.0f), median(0.0f), p95(0.0f), max(0.0f) { }
+};
+
+// Result of the symmetric comparison of two meshes, all values are in units of the meshes
+struct Comparison {
+  // From 'source' vertices to the 'target' surface and vice versa
+  Stats forward, backward;
+
+  // Sum of both mean distances
+  float chamfer;
+
+  // The largest distance in both directions
+  float hausdorff;
+
+  // Per-vertex errors of 'source' and 'target' respectively
+  std::vector<float> forward_errors, backward_errors;
+
+  Comparison() : chamfer(0.0f), hausdorff(0.0f) { }
+};
+
+// Computes statistics over the distances
+Stats Summarize(const std::vector<float> &distances);
+
+} // namespace mesh_distance
+
+
+// Answers closest-point queries to the surface of a triangle mesh
+// Triangles are organized into a bounding volume hierarchy, so a query takes logarithmic time
+class MeshDistance {
+  public:
+    // Builds the hierarchy, the mesh itself is not referenced afterwards
+    explicit MeshDistance(const Mesh &mesh);
+    MeshDistance(const MeshDistance &) = delete;
+    MeshDistance &operator =(const MeshDistance &) = delete;
+
+    // 'false' if the mesh has no non-degenerate triangles
+    bool Empty() const { return nodes_.empty(); }
+
+    // Returns the distance from the point to the closest triangle
+    float Distance(const glm::vec3 &point) const;
+
+    // Computes distances for a batch of points concurrently
+    void Distances(const std::vector<glm::vec3> &points, std::vector<float> &distances,
+                   ThreadPool &pool = ThreadPool::Default()) const;
+
+    // Refines 'guess' that maps the points onto the surface with point-to-plane ICP on the closest points
+    // It converges only from a rough alignment, e.g. a depth frame and a scan of the same person
+    mesh_distance::Alignment Align(const std::vector<glm::vec3> &points, const RigidTransform &guess,
+                                   const mesh_distance::Params &params = mesh_distance::Params(),
+                                   ThreadPool &pool = ThreadPool::Default()) const;
+
+    // A rough guess for 'Align()' if the points are far from the surface: centers of the bounding boxes are matched
+    // and the longest side of the points (the vertical axis of a standing person) is turned along the longest side
+    // of the surface. The direction along it is kept, so the points must not be upside down
+    RigidTransform CoarseGuess(const std::vector<glm::vec3> &points) const;
+
+    // Compares two meshes in both directions, e.g. Free Fusion ('source') and Portal MX ('target')
+    // Meshes are expected to be in the same coordinate system
+    static ErrHandle Compare(const Mesh &source, const Mesh &target,
+                             mesh_distance::Comparison &result,
+                             ThreadPool &pool = ThreadPool::Default());
+
+  private:
+    // Children of an inner node are stored together, starting from 'first'
+    // Leaves refer to 'count' triangles, starting from 'first'
+    struct Node {
+      glm::vec3 min, max;
+      uint32_t first, count;
+    };
+
+    // Squared distance, 'hint' is a triangle to start from (updated with the closest one)
+    float SquaredDistance(const glm::vec3 &point, uint32_t &hint) const;
+
+    std::vector<Node> nodes_;
+    std::vector<glm::vec3> corners_;   // three per triangle, in order of leaves
+};
+
+} // namespace texel
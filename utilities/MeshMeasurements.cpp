@@ -0,0 +1,445 @@
+#include "MeshMeasurements.h"
+#include <iomanip>
+
+namespace texel {
+
+namespace {
+
+constexpr uint32_t NoLink = std::numeric_limits<uint32_t>::max();
+
+// Contours smaller than this part of the largest one are arms, hands or noise
+constexpr float MinLimbArea = 0.25f;
+
+// The girth of the torso grows at least this much per plane where arms join it
+constexpr float ArmpitJump = 1.15f;
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+  return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+float Cross(const glm::vec2 &o, const glm::vec2 &a, const glm::vec2 &b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Andrew's monotone chain, 'points' are reordered
+float HullLength(std::vector<glm::vec2> &points) {
+  if (points.size() < 2) {
+    return 0.0f;
+  }
+  std::sort(points.begin(), points.end(), [](const glm::vec2 &a, const glm::vec2 &b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+  });
+  std::vector<glm::vec2> hull(2 * points.size());
+  size_t n = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    while (n >= 2 && Cross(hull[n - 2], hull[n - 1], points[i]) <= 0.0f) {
+      n--;
+    }
+    hull[n++] = points[i];
+  }
+  for (size_t i = points.size() - 1, lower = n + 1; i-- > 0;) {
+    while (n >= lower && Cross(hull[n - 2], hull[n - 1], points[i]) <= 0.0f) {
+      n--;
+    }
+    hull[n++] = points[i];
+  }
+
+  // The first point is repeated at the end
+  float length = 0.0f;
+  for (size_t i = 1; i < n; i++) {
+    length += glm::length(hull[i] - hull[i - 1]);
+  }
+  return length;
+}
+
+float TorsoGirth(const mesh_measure::Section &section) {
+  return section.contours.empty() ? 0.0f : section.contours[0].hull_length;
+}
+
+size_t CountLimbs(const mesh_measure::Section &section) {
+  size_t n = 0;
+  for (const auto &contour : section.contours) {
+    n += contour.area >= MinLimbArea * section.contours[0].area ? 1 : 0;
+  }
+  return n;
+}
+
+// The first plane at or above 'h', the last one if all are below
+size_t Level(const std::vector<mesh_measure::Section> &sections, float h) {
+  auto it = std::lower_bound(sections.begin(), sections.end(), h,
+                             [](const mesh_measure::Section &section, float h) { return section.height < h; });
+  return std::min((size_t)(it - sections.begin()), sections.size() - 1);
+}
+
+// Legs join below the crotch, the lowest plane between 'low' and 'high' parts of the height where only
+// one large contour is left. Returns 'sections.size()' if there is no such plane
+size_t FindCrotch(const std::vector<mesh_measure::Section> &sections, float height, float low, float high) {
+  for (size_t i = std::max<size_t>(Level(sections, low * height), 1); i < Level(sections, high * height); i++) {
+    if (CountLimbs(sections[i]) == 1 && CountLimbs(sections[i - 1]) >= 2) {
+      return i;
+    }
+  }
+  return sections.size();
+}
+
+} // unnamed namespace
+
+
+namespace mesh_measure {
+
+ContourStats Describe(const Contour &contour) {
+  ContourStats stats;
+  const auto &points = contour.points;
+  stats.n_points = points.size();
+  stats.closed = contour.closed;
+  if (points.empty()) {
+    return stats;
+  }
+
+  // Open contours are joined by a straight line
+  double area = 0.0, cx = 0.0, cy = 0.0, mx = 0.0, my = 0.0;
+  for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+    stats.length += glm::length(points[i] - points[j]);
+    double cross = (double)points[j].x * points[i].y - (double)points[i].x * points[j].y;
+    area += cross;
+    cx += ((double)points[j].x + points[i].x) * cross;
+    cy += ((double)points[j].y + points[i].y) * cross;
+    mx += points[i].x;
+    my += points[i].y;
+  }
+  stats.area = (float)std::abs(area * 0.5);
+  stats.centroid = std::abs(area) > 1e-12 ? glm::vec2((float)(cx / (3.0 * area)), (float)(cy / (3.0 * area))) :
+                                            glm::vec2((float)(mx / points.size()), (float)(my / points.size()));
+
+  auto hull = points;
+  stats.hull_length = HullLength(hull);
+  return stats;
+}
+
+const std::vector<std::string> &Names() {
+  static const std::vector<std::string> names = {
+    "Body height", "Crotch height", "Chest girth", "Waist girth", "Waist height", "Hip girth", "Hip height",
+    "Neck girth", "Thigh girth", "Calf girth", "Minimum leg girth"
+  };
+  return names;
+}
+
+ErrHandle Save(const std::string &filename, const std::vector<Measurement> &measurements) {
+  std::ofstream file(filename);
+  file << "measurement,value" << std::endl;
+  file << std::fixed << std::setprecision(1);
+  for (const auto &measurement : measurements) {
+    file << measurement.name << "," << measurement.value << std::endl;
+  }
+  if (!file) {
+    return ErrHandle(TEXEL_WHERE, "failed to write measurements into '" + filename + "'");
+  }
+  return ErrHandle();
+}
+
+} // namespace mesh_measure
+
+
+// The plane crosses two edges of the triangle, ends are identified by the edges
+// Neighboring triangles compute the same point for a shared edge, so the ends match exactly
+struct MeshSlicer::Scratch {
+  struct Segment {
+    glm::vec2 points[2];
+  };
+
+  std::vector<Segment> segments;
+  std::vector<std::pair<uint64_t, uint32_t> > ends;   // the edge and '2 * segment + side'
+  std::vector<uint32_t> links;                        // the matching end of another segment
+  std::vector<bool> visited;
+  std::vector<mesh_measure::Contour> contours;
+};
+
+MeshSlicer::MeshSlicer(const Mesh &mesh, const mesh_measure::Params &params) : step_(params.step), height_(0.0f) {
+  const auto &vertices = mesh.Vertices();
+  if (vertices.empty() || !(step_ > 0.0f)) {
+    return;
+  }
+
+  auto bounds = mesh.Bounds();
+  auto size = bounds.Size();
+  float scale = params.mesh_scale > 0.0f ? params.mesh_scale : mesh.GuessScale();
+  int up = params.up_axis >= 0 && params.up_axis < 3 ? params.up_axis :
+           (size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2));
+  int u = (up + 1) % 3, v = (up + 2) % 3;
+  float bottom = bounds.Offset()[up];
+
+  heights_.resize(vertices.size());
+  points_.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    heights_[i] = (vertices[i][up] - bottom) * scale;
+    points_[i] = glm::vec2(vertices[i][u], vertices[i][v]) * scale;
+  }
+  height_ = size[up] * scale;
+
+  // Flat triangles never cross a plane, vertices on the plane count as lying above it
+  triangles_.reserve(mesh.Triangles().size());
+  for (const auto &triangle : mesh.Triangles()) {
+    if (triangle[0] < vertices.size() && triangle[1] < vertices.size() && triangle[2] < vertices.size() &&
+        (heights_[triangle[0]] != heights_[triangle[1]] || heights_[triangle[0]] != heights_[triangle[2]])) {
+      triangles_.push_back(triangle);
+    }
+  }
+
+  // Plane 'i' is at '(i + 0.5) * step', triangles are sorted into the planes they may cross
+  size_t n_sections = (size_t)(height_ / step_);
+  if (n_sections == 0) {
+    return;
+  }
+  auto range = [&](const Mesh::Triangle &triangle, size_t &first, size_t &last) {
+    float low = std::min(heights_[triangle[0]], std::min(heights_[triangle[1]], heights_[triangle[2]]));
+    float high = std::max(heights_[triangle[0]], std::max(heights_[triangle[1]], heights_[triangle[2]]));
+    first = (size_t)std::max(0.0f, std::floor(low / step_ - 0.5f));
+    last = std::min(n_sections - 1, (size_t)std::max(0.0f, std::floor(high / step_ - 0.5f)));
+  };
+  section_offsets_.assign(n_sections + 1, 0);
+  for (const auto &triangle : triangles_) {
+    size_t first = 0, last = 0;
+    range(triangle, first, last);
+    for (size_t i = first; i <= last; i++) {
+      section_offsets_[i + 1]++;
+    }
+  }
+  for (size_t i = 0; i < n_sections; i++) {
+    section_offsets_[i + 1] += section_offsets_[i];
+  }
+  section_triangles_.resize(section_offsets_.back());
+  std::vector<uint32_t> filled(section_offsets_.begin(), section_offsets_.end() - 1);
+  for (size_t t = 0; t < triangles_.size(); t++) {
+    size_t first = 0, last = 0;
+    range(triangles_[t], first, last);
+    for (size_t i = first; i <= last; i++) {
+      section_triangles_[filled[i]++] = (uint32_t)t;
+    }
+  }
+}
+
+void MeshSlicer::Slice(float height, std::vector<mesh_measure::Contour> &contours) const {
+  std::vector<uint32_t> triangles(triangles_.size());
+  for (size_t t = 0; t < triangles.size(); t++) {
+    triangles[t] = (uint32_t)t;
+  }
+  Scratch scratch;
+  Cut(height, triangles.data(), triangles.size(), scratch, contours);
+}
+
+void MeshSlicer::Profile(std::vector<mesh_measure::Section> &sections, ThreadPool &pool) const {
+  size_t n_sections = section_offsets_.empty() ? 0 : section_offsets_.size() - 1;
+  sections.assign(n_sections, mesh_measure::Section());
+  std::vector<Scratch> scratches(pool.Concurrency());
+  pool.ParallelFor(0, n_sections, 4, [&](size_t first, size_t last, size_t thread_idx) {
+    auto &scratch = scratches[thread_idx];
+    for (size_t i = first; i < last; i++) {
+      auto &section = sections[i];
+      section.height = ((float)i + 0.5f) * step_;
+      Cut(section.height, section_triangles_.data() + section_offsets_[i],
+          section_offsets_[i + 1] - section_offsets_[i], scratch, scratch.contours);
+      for (const auto &contour : scratch.contours) {
+        section.contours.push_back(mesh_measure::Describe(contour));
+      }
+      std::sort(section.contours.begin(), section.contours.end(),
+                [](const mesh_measure::ContourStats &a, const mesh_measure::ContourStats &b) {
+        return a.area > b.area;
+      });
+    }
+  });
+}
+
+void MeshSlicer::Cut(float height, const uint32_t *triangles, size_t n_triangles, Scratch &scratch,
+                     std::vector<mesh_measure::Contour> &contours) const {
+  auto &segments = scratch.segments;
+  auto &ends = scratch.ends;
+  segments.clear();
+  ends.clear();
+  for (size_t t = 0; t < n_triangles; t++) {
+    const auto &triangle = triangles_[triangles[t]];
+    bool above[3];
+    for (size_t k = 0; k < 3; k++) {
+      above[k] = heights_[triangle[k]] >= height;
+    }
+    if (above[0] == above[1] && above[0] == above[2]) {
+      continue;
+    }
+
+    Scratch::Segment segment;
+    size_t side = 0;
+    for (size_t k = 0; k < 3; k++) {
+      uint32_t a = triangle[k], b = triangle[(k + 1) % 3];
+      if (above[k] == above[(k + 1) % 3]) {
+        continue;
+      }
+      if (a > b) {
+        std::swap(a, b);
+      }
+      float w = (height - heights_[a]) / (heights_[b] - heights_[a]);
+      segment.points[side] = points_[a] + (points_[b] - points_[a]) * w;
+      ends.emplace_back(EdgeKey(a, b), (uint32_t)(2 * segments.size() + side));
+      side++;
+    }
+    segments.push_back(segment);
+  }
+
+  // An edge of a manifold mesh is shared by two triangles, otherwise the contour is broken there
+  std::sort(ends.begin(), ends.end());
+  auto &links = scratch.links;
+  links.assign(2 * segments.size(), NoLink);
+  for (size_t i = 0; i < ends.size();) {
+    size_t j = i + 1;
+    while (j < ends.size() && ends[j].first == ends[i].first) {
+      j++;
+    }
+    if (j - i == 2) {
+      links[ends[i].second] = ends[i + 1].second;
+      links[ends[i + 1].second] = ends[i].second;
+    }
+    i = j;
+  }
+
+  auto &visited = scratch.visited;
+  visited.assign(segments.size(), false);
+  contours.clear();
+  for (uint32_t s = 0; s < segments.size(); s++) {
+    if (visited[s]) {
+      continue;
+    }
+    visited[s] = true;
+    contours.emplace_back();
+    auto &contour = contours.back();
+    contour.points.push_back(segments[s].points[0]);
+    contour.points.push_back(segments[s].points[1]);
+
+    // Forward from the second end, then backward from the first one if the contour is open
+    uint32_t end = 2 * s + 1;
+    while (links[end] != NoLink && !visited[links[end] / 2]) {
+      uint32_t next = links[end] ^ 1;
+      visited[next / 2] = true;
+      contour.points.push_back(segments[next / 2].points[next & 1]);
+      end = next;
+    }
+    // The last point of a closed contour is the first one again
+    contour.closed = links[end] == 2 * s;
+    if (contour.closed) {
+      contour.points.pop_back();
+    }
+    else {
+      std::vector<glm::vec2> backward;
+      end = 2 * s;
+      while (links[end] != NoLink && !visited[links[end] / 2]) {
+        uint32_t next = links[end] ^ 1;
+        visited[next / 2] = true;
+        backward.push_back(segments[next / 2].points[next & 1]);
+        end = next;
+      }
+      contour.points.insert(contour.points.begin(), backward.rbegin(), backward.rend());
+    }
+  }
+}
+
+void MeshSlicer::Measure(const std::vector<mesh_measure::Section> &sections, float height,
+                         std::vector<mesh_measure::Measurement> &measurements) {
+  measurements.clear();
+  measurements.emplace_back("Body height", height * 100.0f, 0.0f);
+  if (sections.empty()) {
+    return;
+  }
+
+  // Levels are searched in ranges of typical body proportions
+  auto level = [&](float part) {
+    return Level(sections, part * height);
+  };
+  const size_t none = sections.size();
+  auto girth = [&](const char *name, size_t idx) {
+    if (idx != none) {
+      measurements.emplace_back(name, TorsoGirth(sections[idx]) * 100.0f, sections[idx].height * 100.0f);
+    }
+  };
+  auto length = [&](const char *name, size_t idx) {
+    if (idx != none) {
+      measurements.emplace_back(name, sections[idx].height * 100.0f, 0.0f);
+    }
+  };
+  // The plane with the smallest or the largest girth of the largest contour in [first, last),
+  // 'none' if the range is empty or the mesh has no contours there
+  auto extreme = [&](size_t first, size_t last, bool largest) {
+    size_t best = none;
+    for (size_t i = first; i < last; i++) {
+      float value = TorsoGirth(sections[i]);
+      if (value > 0.0f && (best == none ||
+                           (largest ? value > TorsoGirth(sections[best]) : value < TorsoGirth(sections[best])))) {
+        best = i;
+      }
+    }
+    return best;
+  };
+
+  size_t crotch = FindCrotch(sections, height, 0.3f, 0.6f);
+  if (crotch == none) {
+    crotch = level(0.47f);
+  }
+  length("Crotch height", crotch);
+
+  // Hips are the widest part of the pelvis, the waist is the narrowest part of the torso above them
+  // A level that is not found is searched for from where the previous one starts
+  size_t hip = extreme(crotch, std::max(level(sections[crotch].height / height + 0.1f), crotch + 1), true);
+  size_t above_hip = hip != none ? hip : crotch;
+  size_t waist = extreme(above_hip, std::max(level(0.7f), above_hip + 1), false);
+  size_t above_waist = waist != none ? waist : above_hip;
+
+  // Chest is the widest part of the torso below the armpits, where arms join it
+  size_t armpit = std::max(level(0.8f), above_waist + 1);
+  for (size_t i = above_waist + 1; i < armpit; i++) {
+    if (TorsoGirth(sections[i]) > ArmpitJump * TorsoGirth(sections[i - 1])) {
+      armpit = i;
+      break;
+    }
+  }
+  size_t chest = extreme(above_waist, armpit, true);
+
+  // Above the shoulders, the narrowest part is the neck
+  size_t neck = extreme(level(0.8f), std::max(level(0.9f), level(0.8f) + 1), false);
+
+  girth("Chest girth", chest);
+  girth("Waist girth", waist);
+  length("Waist height", waist);
+  girth("Hip girth", hip);
+  length("Hip height", hip);
+  girth("Neck girth", neck);
+
+  // Below the crotch, the largest contours are legs
+  girth("Thigh girth", extreme(level(0.4f), std::max(crotch, level(0.4f) + 1), true));
+  girth("Calf girth", extreme(level(0.12f), level(0.25f), true));
+  girth("Minimum leg girth", extreme(level(0.03f), level(0.12f), false));
+}
+
+ErrHandle MeshSlicer::Measure(const Mesh &mesh, const mesh_measure::Params &params,
+                              std::vector<mesh_measure::Measurement> &measurements, ThreadPool &pool) {
+  MeshSlicer slicer(mesh, params);
+  if (slicer.Height() < 0.5f || slicer.Height() > 3.0f) {
+    std::ostringstream oss;
+    oss << "the mesh is " << slicer.Height() << " m tall, it does not look like a standing person";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  std::vector<mesh_measure::Section> sections;
+  slicer.Profile(sections, pool);
+
+  // Only legs form a large pair of contours, so the crotch tells which end is the head
+  // A mesh standing on its head is measured from the other end
+  if (FindCrotch(sections, slicer.Height(), 0.3f, 0.6f) == sections.size()) {
+    std::reverse(sections.begin(), sections.end());
+    for (auto &section : sections) {
+      section.height = slicer.Height() - section.height;
+    }
+    if (FindCrotch(sections, slicer.Height(), 0.3f, 0.6f) == sections.size()) {
+      return ErrHandle(TEXEL_WHERE, "legs are not found along the vertical axis, the mesh does not look like "
+                                    "a person standing upright in the A-pose or the T-pose");
+    }
+  }
+  Measure(sections, slicer.Height(), measurements);
+  return ErrHandle();
+}
+
+} // namespace texel
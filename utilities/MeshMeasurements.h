@@ -0,0 +1,124 @@
+#pragma once
+#include "Defs.h"
+#include "Mesh.h"
+#include "Parallel.h"
+
+namespace texel {
+
+namespace mesh_measure {
+
+struct Params {
+  // Converts mesh coordinates into meters, zero means 'guess from the size of the mesh'
+  // (meshes may be stored in meters, centimeters or millimeters)
+  float mesh_scale;
+
+  // The vertical axis of the mesh (0 - x, 1 - y, 2 - z), heights are measured from its minimum
+  // A negative value means 'the longest side of the bounding box'
+  int up_axis;
+
+  // Distance between cutting planes (in meters)
+  float step;
+
+  Params() : mesh_scale(0.0f), up_axis(-1), step(0.005f) { }
+};
+
+// A cross-section of the mesh surface by a horizontal plane, in meters
+// Holes of the mesh break contours, such contours are open and measured as if their ends were joined
+struct Contour {
+  std::vector<glm::vec2> points;
+  bool closed;
+
+  Contour() : closed(false) { }
+};
+
+// What is measured along a contour, the tape of a girth follows its convex hull
+struct ContourStats {
+  float length, hull_length, area;
+  glm::vec2 centroid;
+  size_t n_points;
+  bool closed;
+
+  ContourStats() : length(0.0f), hull_length(0.0f), area(0.0f), centroid(0.0f), n_points(0), closed(false) { }
+};
+
+// All contours of a single cutting plane, the largest ones first
+struct Section {
+  float height;     // above the lowest point of the mesh
+  std::vector<ContourStats> contours;
+
+  Section() : height(0.0f) { }
+};
+
+// A girth or a length in terms of ISO 8559-1 (in centimeters)
+struct Measurement {
+  std::string name;
+  float value;
+  float height;     // the level where the value was taken (in centimeters), zero for lengths
+
+  Measurement() : value(0.0f), height(0.0f) { }
+  Measurement(const std::string &name, float value, float height) : name(name), value(value), height(height) { }
+};
+
+// Computes length, convex hull and area of the contour
+ContourStats Describe(const Contour &contour);
+
+// Names of all measurements in the order 'MeshSlicer::Measure()' emits them, some may be missing from its result
+const std::vector<std::string> &Names();
+
+// Writes measurements as 'measurement,value' rows (in centimeters)
+ErrHandle Save(const std::string &filename, const std::vector<Measurement> &measurements);
+
+} // namespace mesh_measure
+
+
+// Cuts a body mesh (e.g. 'scan.ply' or 'model_smpl300.ply') with horizontal planes and measures girths and lengths
+// The mesh is expected to stand upright in the A-pose or the T-pose, so legs and arms are separate from the torso
+//
+// Usage:
+//   std::vector<mesh_measure::Measurement> measurements;
+//   TEXEL_CHECK(MeshSlicer::Measure(mesh, mesh_measure::Params(), measurements));
+//   TEXEL_CHECK(mesh_measure::Save("measurements.csv", measurements));
+class MeshSlicer {
+  public:
+    // Projects the mesh onto the vertical axis, the mesh itself is not referenced afterwards
+    explicit MeshSlicer(const Mesh &mesh, const mesh_measure::Params &params = mesh_measure::Params());
+    MeshSlicer(const MeshSlicer &) = delete;
+    MeshSlicer &operator =(const MeshSlicer &) = delete;
+
+    // Distance from the lowest to the highest point (in meters)
+    float Height() const { return height_; }
+
+    // Cuts the mesh with a plane at 'height' above its lowest point
+    void Slice(float height, std::vector<mesh_measure::Contour> &contours) const;
+
+    // Cuts the mesh with planes 'step' apart from the bottom to the top, planes are processed concurrently
+    void Profile(std::vector<mesh_measure::Section> &sections, ThreadPool &pool = ThreadPool::Default()) const;
+
+    // Finds levels of the body (crotch, waist, hips, chest, neck) in the profile and measures them
+    // The feet are expected at the bottom, levels that have no contours are not measured
+    static void Measure(const std::vector<mesh_measure::Section> &sections, float height,
+                        std::vector<mesh_measure::Measurement> &measurements);
+
+    // The same for the whole mesh, which may stand on its head: the end with the legs is found by the crotch
+    // Fails if neither end has it, e.g. if the vertical axis is wrong
+    static ErrHandle Measure(const Mesh &mesh, const mesh_measure::Params &params,
+                             std::vector<mesh_measure::Measurement> &measurements,
+                             ThreadPool &pool = ThreadPool::Default());
+
+  private:
+    // Buffers reused between cuts
+    struct Scratch;
+
+    // Cuts the given triangles and chains the segments into contours
+    void Cut(float height, const uint32_t *triangles, size_t n_triangles, Scratch &scratch,
+             std::vector<mesh_measure::Contour> &contours) const;
+
+    float step_, height_;
+    std::vector<float> heights_;                 // per vertex, above the lowest point
+    std::vector<glm::vec2> points_;              // per vertex, the horizontal plane
+    std::vector<Mesh::Triangle> triangles_;      // only those that are not flat
+    std::vector<uint32_t> section_offsets_;      // triangles of section 'i' start at 'section_triangles_[offsets[i]]'
+    std::vector<uint32_t> section_triangles_;
+};
+
+} // namespace texel
@@ -0,0 +1,138 @@
+#include "MeshVisibility.h"
+#include "Simd.h"
+
+namespace texel {
+
+//----------------------
+//--- MeshVisibility ---
+//----------------------
+
+MeshVisibility::MeshVisibility(const Mesh &mesh, const visibility::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool), n_vertices_(mesh.Vertices().size()) {
+  // NaN coordinates fail all comparisons, so the padding is never observed
+  const size_t width = simd::Float4::Width;
+  size_t padded = (n_vertices_ + width - 1) / width * width;
+  x_.assign(padded, std::numeric_limits<float>::quiet_NaN());
+  y_.assign(padded, std::numeric_limits<float>::quiet_NaN());
+  z_.assign(padded, std::numeric_limits<float>::quiet_NaN());
+  for (size_t i = 0; i < n_vertices_; i++) {
+    const auto &v = mesh.Vertices()[i];
+    x_[i] = v.x;
+    y_[i] = v.y;
+    z_[i] = v.z;
+  }
+}
+
+void MeshVisibility::Observe(const Camera &camera, const RigidTransform &pose, const DepthFrame &frame,
+                             uint32_t *observations, visibility::FrameCoverage &coverage) const {
+  using simd::Float4;
+  coverage = visibility::FrameCoverage();
+
+  // glm matrices are indexed by columns, the scale of the mesh is folded into the rotation
+  const auto &r = pose.Rotation();
+  const auto &t = pose.Offset();
+  float s = params_.mesh_scale;
+  Float4 r00(r[0][0] * s), r01(r[1][0] * s), r02(r[2][0] * s);
+  Float4 r10(r[0][1] * s), r11(r[1][1] * s), r12(r[2][1] * s);
+  Float4 r20(r[0][2] * s), r21(r[1][2] * s), r22(r[2][2] * s);
+  Float4 tx(t.x), ty(t.y), tz(t.z);
+  Float4 fx(camera.Fx()), fy(camera.Fy()), cx(camera.Cx()), cy(camera.Cy());
+
+  // Pixel centers have integer coordinates, rounding picks the pixel that contains the projection
+  Float4 min_uv(-0.5f), max_u((float)frame.Width() - 0.5f), max_v((float)frame.Height() - 0.5f);
+  Float4 min_depth(params_.min_depth), max_depth(params_.max_depth);
+  Float4 tolerance(params_.tolerance), scale(DepthFrame::Scale), zero(0.0f), one(1.0f);
+
+  int32_t u_idx[Float4::Width], v_idx[Float4::Width];
+  float measured[Float4::Width];
+  for (size_t i = 0; i < x_.size(); i += Float4::Width) {
+    Float4 x = Float4::Load(&x_[i]), y = Float4::Load(&y_[i]), z = Float4::Load(&z_[i]);
+    Float4 cam_x = r00 * x + r01 * y + r02 * z + tx;
+    Float4 cam_y = r10 * x + r11 * y + r12 * z + ty;
+    Float4 cam_z = r20 * x + r21 * y + r22 * z + tz;
+
+    // Points behind the camera get garbage coordinates, but the depth range rejects them
+    Float4 inv_z = one / cam_z;
+    Float4 u = fx * cam_x * inv_z + cx;
+    Float4 v = fy * cam_y * inv_z + cy;
+    Float4 inside = (cam_z >= min_depth) & (cam_z <= max_depth) &
+                    (u >= min_uv) & (u < max_u) & (v >= min_uv) & (v < max_v);
+    int projected = MoveMask(inside);
+    if (projected == 0) {
+      continue;
+    }
+
+    // SSE2 has no gathers, so the measured depth is fetched lane by lane
+    // Lanes outside the frame (NaN padding, points behind the camera) are zeroed before rounding
+    RoundToInt(Select(inside, u, zero), u_idx);
+    RoundToInt(Select(inside, v, zero), v_idx);
+    for (size_t k = 0; k < Float4::Width; k++) {
+      measured[k] = (projected & (1 << k)) != 0 ? (float)frame.At((size_t)u_idx[k], (size_t)v_idx[k]) : 0.0f;
+    }
+    Float4 depth = Float4::Load(measured) * scale;
+    int observed = MoveMask(inside & (depth > zero) & (Abs(cam_z - depth) <= tolerance));
+
+    coverage.projected += (size_t)simd::CountBits(projected);
+    coverage.observed  += (size_t)simd::CountBits(observed);
+    for (size_t k = 0; observed != 0; k++, observed >>= 1) {
+      observations[i + k] += (uint32_t)(observed & 1);
+    }
+  }
+  coverage.coverage = n_vertices_ > 0 ? (float)coverage.observed / n_vertices_ : 0.0f;
+}
+
+ErrHandle MeshVisibility::Analyze(const scanogram::Stream &stream, const std::vector<RigidTransform> &poses,
+                                  visibility::Result &result) const {
+  result = visibility::Result();
+  Camera camera;
+  std::string dir;
+  if (!stream.HasDepth(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+  if (!poses.empty() && poses.size() != files.size()) {
+    std::ostringstream oss;
+    oss << "expected " << files.size() << " poses (one per depth map), but got " << poses.size();
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  auto extrinsics = geometry::ViewerToCamera(camera);
+
+  // Frames are independent, each thread decodes its own frames and accumulates its own counters
+  std::vector<DepthFrame> frames(pool_.Concurrency());
+  std::vector<std::vector<uint32_t> > counters(pool_.Concurrency());
+  std::vector<ErrHandle> errors(files.size());
+  result.frames.resize(files.size());
+  pool_.ParallelFor(0, files.size(), 1, [&](size_t first, size_t last, size_t thread) {
+    auto &frame = frames[thread];
+    auto &counts = counters[thread];
+    counts.resize(n_vertices_, 0);
+    for (size_t i = first; i < last; i++) {
+      errors[i] = DepthFrame::Load(files[i], frame);
+      if (errors[i].Succeeded()) {
+        Observe(camera, poses.empty() ? extrinsics : poses[i], frame, counts.data(), result.frames[i]);
+      }
+    }
+  });
+  for (const auto &err : errors) {
+    TEXEL_CHECK(err);
+  }
+
+  result.observations.assign(n_vertices_, 0);
+  for (const auto &counts : counters) {
+    if (counts.empty()) {
+      continue;
+    }
+    for (size_t i = 0; i < n_vertices_; i++) {
+      result.observations[i] += counts[i];
+    }
+  }
+  for (auto count : result.observations) {
+    result.covered += count >= params_.min_observations ? 1 : 0;
+  }
+  result.coverage = n_vertices_ > 0 ? (float)result.covered / n_vertices_ : 0.0f;
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,93 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Geometry.h"
+#include "Mesh.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace visibility {
+
+struct Params {
+  // A vertex is observed if its depth differs from the measured one by less than this (in meters)
+  float tolerance;
+
+  // Depth values outside this range are ignored (in meters)
+  float min_depth, max_depth;
+
+  // Converts mesh coordinates into meters
+  float mesh_scale;
+
+  // A vertex is considered as covered if it was observed in so many frames
+  uint32_t min_observations;
+
+  Params()
+    : tolerance(0.02f),
+      min_depth(0.2f), max_depth(5.0f),
+      mesh_scale(1.0f),
+      min_observations(1) {
+  }
+};
+
+// How much of the mesh a single depth frame sees
+struct FrameCoverage {
+  size_t projected;   // vertices in front of the camera and inside the frame
+  size_t observed;    // of them, vertices that agree with the measured depth
+  float coverage;     // 'observed' divided by the number of vertices
+
+  FrameCoverage() : projected(0), observed(0), coverage(0.0f) { }
+};
+
+struct Result {
+  // Number of frames that observed each vertex
+  std::vector<uint32_t> observations;
+
+  std::vector<FrameCoverage> frames;
+
+  // Vertices observed at least 'min_observations' times and their share
+  size_t covered;
+  float coverage;
+
+  Result() : covered(0), coverage(0.0f) { }
+};
+
+} // namespace visibility
+
+
+// Projects vertices of a mesh into depth frames and tests them against the measured depth
+// It tells which parts of the body a recording actually covers (e.g. 'portal_mx/scan.ply' vs Free Fusion frames)
+// Vertices are stored as separate planes, so four of them are projected and tested at once
+class MeshVisibility {
+  public:
+    // Copies vertices of the mesh, triangles are not needed
+    MeshVisibility(const Mesh &mesh,
+                   const visibility::Params &params = visibility::Params(),
+                   ThreadPool &pool = ThreadPool::Default());
+    MeshVisibility(const MeshVisibility &) = delete;
+    MeshVisibility &operator =(const MeshVisibility &) = delete;
+
+    const visibility::Params &Params() const { return params_; }
+
+    size_t Size() const { return n_vertices_; }
+
+    // Tests all vertices against a single frame, 'pose' maps the mesh (in meters) into the camera space
+    // Increments 'observations' of the observed vertices
+    void Observe(const Camera &camera, const RigidTransform &pose, const DepthFrame &frame,
+                 uint32_t *observations, visibility::FrameCoverage &coverage) const;
+
+    // Tests all depth frames of the stream concurrently
+    // 'poses' are per-frame mesh-to-camera transformations, if they are empty,
+    // the mesh is expected to be in the viewer space and the camera extrinsics are used for all frames
+    ErrHandle Analyze(const scanogram::Stream &stream, const std::vector<RigidTransform> &poses,
+                      visibility::Result &result) const;
+
+  private:
+    visibility::Params params_;
+    ThreadPool &pool_;
+    size_t n_vertices_;
+    std::vector<float> x_, y_, z_;   // padded to whole SIMD blocks
+};
+
+} // namespace texel
@@ -0,0 +1,401 @@
+#include "Metrics.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace texel {
+
+namespace {
+
+enum Type { CounterType, GaugeType, HistogramType };
+
+const char *TypeName(int type) {
+  switch (type) {
+    case CounterType: return "counter";
+    case GaugeType:   return "gauge";
+    default:          return "histogram";
+  }
+}
+
+// Joins the labels of a series with an extra label, e.g. 'le' of histogram buckets
+std::string Labels(const std::string &labels, const std::string &extra = "") {
+  if (labels.empty() && extra.empty()) {
+    return "";
+  }
+  return "{" + labels + (!labels.empty() && !extra.empty() ? "," : "") + extra + "}";
+}
+
+// Counters are named '*_total', their rates are named '*_per_second'
+std::string RateName(const std::string &name) {
+  const std::string suffix("_total");
+  bool has_suffix = name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+  return (has_suffix ? name.substr(0, name.size() - suffix.size()) : name) + "_per_second";
+}
+
+} // unnamed namespace
+
+//---------------
+//--- metrics ---
+//---------------
+
+namespace metrics {
+
+double Histogram::Snapshot::Quantile(double q) const {
+  if (count == 0) {
+    return 0.0;
+  }
+  double target = std::clamp(q, 0.0, 1.0) * count, seen = 0.0;
+  for (size_t i = 0; i <= NumBuckets; i++) {
+    if (counts[i] == 0 || seen + counts[i] < target) {
+      seen += counts[i];
+      continue;
+    }
+    // Values above the last bucket are reported as its bound
+    double lower = i > 0 ? UpperBound(i - 1) : 0.0, upper = i < NumBuckets ? UpperBound(i) : lower;
+    return lower + (upper - lower) * (target - seen) / counts[i];
+  }
+  return UpperBound(NumBuckets - 1);
+}
+
+Histogram::Histogram() : sum_ns_(0) {
+  for (auto &count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(std::chrono::nanoseconds duration) {
+  uint64_t ns = (uint64_t)std::max<int64_t>(duration.count(), 0);
+  uint64_t us = (ns + 999) / 1000;
+  size_t bucket = 0;
+  while (bucket < NumBuckets && (uint64_t(1) << bucket) < us) {
+    bucket += 1;
+  }
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void Histogram::Take(Snapshot &snapshot) const {
+  // Not an atomic snapshot, but the total is consistent with the buckets
+  snapshot.count = 0;
+  for (size_t i = 0; i <= NumBuckets; i++) {
+    snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.counts[i];
+  }
+  snapshot.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+}
+
+//--- Registry ---
+
+struct Registry::Series {
+  std::string labels;
+  std::unique_ptr<Counter> counter;
+  std::unique_ptr<Gauge> gauge;
+  std::unique_ptr<Histogram> histogram;
+
+  // The state of the previous 'Write()' call
+  uint64_t previous;
+  Histogram::Snapshot previous_snapshot;
+};
+
+struct Registry::Family {
+  std::string help;
+  int type;
+  std::vector<std::unique_ptr<Series> > series;
+};
+
+Registry::Registry()
+  : last_write_(std::chrono::steady_clock::now()) {
+}
+
+Registry::~Registry() {
+  // nothing
+}
+
+Registry::Family &Registry::GetFamily(const std::string &name, const std::string &help, int type) {
+  auto &family = families_[name];
+  if (family == nullptr) {
+    family.reset(new Family());
+    family->help = help;
+    family->type = type;
+  }
+  return *family;
+}
+
+Registry::Series &Registry::GetSeries(Family &family, const std::string &labels) {
+  for (auto &series : family.series) {
+    if (series->labels == labels) {
+      return *series;
+    }
+  }
+  family.series.emplace_back(new Series());
+  auto &series = *family.series.back();
+  series.labels = labels;
+  series.previous = 0;
+  switch (family.type) {
+    case CounterType: series.counter.reset(new Counter());     break;
+    case GaugeType:   series.gauge.reset(new Gauge());         break;
+    default:          series.histogram.reset(new Histogram()); break;
+  }
+  return series;
+}
+
+Counter &Registry::GetCounter(const std::string &name, const std::string &help, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return *GetSeries(GetFamily(name, help, CounterType), labels).counter;
+}
+
+Gauge &Registry::GetGauge(const std::string &name, const std::string &help, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return *GetSeries(GetFamily(name, help, GaugeType), labels).gauge;
+}
+
+Histogram &Registry::GetHistogram(const std::string &name, const std::string &help, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return *GetSeries(GetFamily(name, help, HistogramType), labels).histogram;
+}
+
+void Registry::Write(std::ostream &stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::max(std::chrono::duration<double>(now - last_write_).count(), 1e-3);
+  last_write_ = now;
+
+  // Sums of durations need more digits than the default six
+  std::ostringstream out, derived;
+  out.precision(12);
+  derived.precision(6);
+  for (const auto &item : families_) {
+    const auto &name = item.first;
+    const auto &family = *item.second;
+    out << "# HELP " << name << " " << family.help << "\n";
+    out << "# TYPE " << name << " " << TypeName(family.type) << "\n";
+
+    if (family.type == CounterType) {
+      derived << "# HELP " << RateName(name) << " " << family.help << ", per second since the previous dump\n";
+      derived << "# TYPE " << RateName(name) << " gauge\n";
+    }
+    if (family.type == HistogramType) {
+      derived << "# HELP " << name << "_quantile " << family.help << ", quantiles since the previous dump\n";
+      derived << "# TYPE " << name << "_quantile gauge\n";
+    }
+
+    for (const auto &series_ptr : family.series) {
+      auto &series = *series_ptr;
+      if (series.counter != nullptr) {
+        uint64_t value = series.counter->Value();
+        out << name << Labels(series.labels) << " " << value << "\n";
+        derived << RateName(name) << Labels(series.labels) << " " << (value - series.previous) / elapsed << "\n";
+        series.previous = value;
+      }
+      else if (series.gauge != nullptr) {
+        out << name << Labels(series.labels) << " " << series.gauge->Value() << "\n";
+      }
+      else {
+        Histogram::Snapshot snapshot;
+        series.histogram->Take(snapshot);
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < Histogram::NumBuckets; i++) {
+          cumulative += snapshot.counts[i];
+          // Bounds are powers of two, six digits would merge neighbouring ones into one label
+          std::ostringstream le;
+          le.precision(std::numeric_limits<double>::max_digits10);
+          le << "le=\"" << Histogram::UpperBound(i) << "\"";
+          out << name << "_bucket" << Labels(series.labels, le.str()) << " " << cumulative << "\n";
+        }
+        out << name << "_bucket" << Labels(series.labels, "le=\"+Inf\"") << " " << snapshot.count << "\n";
+        out << name << "_sum" << Labels(series.labels) << " " << snapshot.sum_ns * 1e-9 << "\n";
+        out << name << "_count" << Labels(series.labels) << " " << snapshot.count << "\n";
+
+        // Only the values observed since the previous dump
+        Histogram::Snapshot recent;
+        for (size_t i = 0; i <= Histogram::NumBuckets; i++) {
+          recent.counts[i] = snapshot.counts[i] - series.previous_snapshot.counts[i];
+          recent.count += recent.counts[i];
+        }
+        for (double q : { 0.5, 0.9, 0.99 }) {
+          std::ostringstream quantile;
+          quantile << "quantile=\"" << q << "\"";
+          derived << name << "_quantile" << Labels(series.labels, quantile.str()) << " " << recent.Quantile(q) << "\n";
+        }
+        series.previous_snapshot = snapshot;
+      }
+    }
+  }
+  stream << out.str() << derived.str();
+}
+
+Registry &Registry::Default() {
+  static Registry registry;
+  return registry;
+}
+
+bool Params::FromEnvironment(Params &params) {
+  const char *path = std::getenv("TEXEL_METRICS");
+  if (path == nullptr || *path == 0) {
+    return false;
+  }
+  params.path = path;
+  const char *period = std::getenv("TEXEL_METRICS_PERIOD_MS");
+  if (period != nullptr && std::strtoul(period, nullptr, 10) > 0) {
+    params.period_ms = std::strtoul(period, nullptr, 10);
+  }
+  return true;
+}
+
+} // namespace metrics
+
+//-----------------------
+//--- MetricsExporter ---
+//-----------------------
+
+MetricsExporter::MetricsExporter(metrics::Registry &registry)
+  : registry_(registry), socket_(-1), stop_(false) {
+}
+
+MetricsExporter::~MetricsExporter() {
+  Stop();
+}
+
+ErrHandle MetricsExporter::Start(const metrics::Params &params) {
+  Stop();
+  params_ = params;
+  params_.period_ms = std::max<size_t>(params_.period_ms, 1);
+  stop_ = false;
+
+  const std::string unix_prefix("unix:");
+  if (params_.path.compare(0, unix_prefix.size(), unix_prefix) != 0) {
+    file_ = params_.path;
+    TEXEL_CHECK(WriteFile());
+    thread_ = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!wake_up_.wait_for(lock, std::chrono::milliseconds(params_.period_ms), [this]() { return stop_; })) {
+        lock.unlock();
+        // A failed dump (e.g. a full disk) is retried on the next period
+        WriteFile();
+        lock.lock();
+      }
+    });
+    return ErrHandle();
+  }
+
+#ifdef __linux__
+  const auto &path = socket_path_ = params_.path.substr(unix_prefix.size());
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return ErrHandle(TEXEL_WHERE, "'" + path + "' is not a valid path for a Unix socket");
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size());
+
+  // A socket left by a previous run is replaced
+  ::unlink(path.c_str());
+  socket_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_ < 0 || ::bind(socket_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      ::listen(socket_, 8) != 0) {
+    std::ostringstream oss;
+    oss << "failed to listen on '" << path << "' ("
+        << std::error_code(errno, std::generic_category()).message() << ")";
+    Stop();
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  thread_ = std::thread([this]() { Serve(); });
+  return ErrHandle();
+#else
+  return ErrHandle(TEXEL_WHERE, "Unix sockets for metrics are supported only on Linux");
+#endif
+}
+
+ErrHandle MetricsExporter::StartFromEnvironment() {
+  metrics::Params params;
+  if (!metrics::Params::FromEnvironment(params)) {
+    return ErrHandle();
+  }
+  return Start(params);
+}
+
+void MetricsExporter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_up_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+    if (!file_.empty()) {
+      WriteFile();
+    }
+  }
+#ifdef __linux__
+  if (socket_ >= 0) {
+    ::close(socket_);
+    ::unlink(socket_path_.c_str());
+    socket_ = -1;
+  }
+#endif
+  file_.clear();
+}
+
+ErrHandle MetricsExporter::WriteFile() {
+  // Readers never see a partially written file
+  std::string temp = file_ + ".tmp";
+  {
+    std::ofstream out(temp, std::ios::trunc);
+    registry_.Write(out);
+    if (!out.good()) {
+      return ErrHandle(TEXEL_WHERE, "failed to write metrics to '" + temp + "'");
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, file_, ec);
+  if (ec) {
+    return ErrHandle(TEXEL_WHERE, "failed to replace '" + file_ + "' (" + ec.message() + ")");
+  }
+  return ErrHandle();
+}
+
+void MetricsExporter::Serve() {
+#ifdef __linux__
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) {
+        return;
+      }
+    }
+    pollfd request{ socket_, POLLIN, 0 };
+    if (::poll(&request, 1, 200) <= 0) {
+      continue;
+    }
+    int client = ::accept4(socket_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      continue;
+    }
+
+    // The request (if any arrives soon) is ignored, any path returns the metrics
+    char buffer[1024];
+    pollfd incoming{ client, POLLIN, 0 };
+    if (::poll(&incoming, 1, 100) > 0) {
+      ::recv(client, buffer, sizeof(buffer), MSG_DONTWAIT);
+    }
+    std::ostringstream body;
+    registry_.Write(body);
+    std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                           std::to_string(body.str().size()) + "\r\n\r\n" + body.str();
+    for (size_t sent = 0; sent < response.size();) {
+      auto n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      sent += (size_t)n;
+    }
+    ::close(client);
+  }
+#endif
+}
+
+} // namespace texel
@@ -0,0 +1,186 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+namespace metrics {
+
+// A monotonically increasing value, e.g. the number of decoded frames
+// Updates are single relaxed atomic additions, so counters stay on permanently
+class alignas(64) Counter {
+  public:
+    Counter() : value_(0) { }
+    Counter(const Counter &) = delete;
+    Counter &operator =(const Counter &) = delete;
+
+    void Add(uint64_t value = 1) { value_.fetch_add(value, std::memory_order_relaxed); }
+    uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value_;
+};
+
+// A value that goes up and down, e.g. the number of requests in flight
+class alignas(64) Gauge {
+  public:
+    Gauge() : value_(0) { }
+    Gauge(const Gauge &) = delete;
+    Gauge &operator =(const Gauge &) = delete;
+
+    void Add(int64_t value = 1) { value_.fetch_add(value, std::memory_order_relaxed); }
+    void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> value_;
+};
+
+// A distribution of durations, bucket 'i' counts values up to 2^i microseconds (from 1 us to about 9 min)
+// Observing takes two relaxed atomic additions, quantiles are estimated when the metrics are written
+class alignas(64) Histogram {
+  public:
+    static const size_t NumBuckets = 30;
+
+    struct Snapshot {
+      std::array<uint64_t, NumBuckets + 1> counts;    // the last one is for larger values
+      uint64_t count, sum_ns;
+
+      Snapshot() : count(0), sum_ns(0) { counts.fill(0); }
+
+      // Linear interpolation inside the bucket, zero if there are no values
+      double Quantile(double q) const;
+    };
+
+    Histogram();
+    Histogram(const Histogram &) = delete;
+    Histogram &operator =(const Histogram &) = delete;
+
+    void Observe(std::chrono::nanoseconds duration);
+    void Take(Snapshot &snapshot) const;
+
+    // The upper bound of the bucket in seconds
+    static double UpperBound(size_t bucket) { return std::ldexp(1e-6, (int)bucket); }
+
+  private:
+    std::atomic<uint64_t> counts_[NumBuckets + 1];
+    std::atomic<uint64_t> sum_ns_;
+};
+
+// Adds the time between construction and destruction to the histogram and keeps the gauge
+// incremented meanwhile (e.g. the number of frames being decoded), both are optional
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(Histogram *histogram, Gauge *in_progress = nullptr)
+      : histogram_(histogram), in_progress_(in_progress), start_(std::chrono::steady_clock::now()) {
+      if (in_progress_ != nullptr) {
+        in_progress_->Add(1);
+      }
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator =(const ScopedTimer &) = delete;
+    ~ScopedTimer() {
+      if (histogram_ != nullptr) {
+        histogram_->Observe(std::chrono::steady_clock::now() - start_);
+      }
+      if (in_progress_ != nullptr) {
+        in_progress_->Add(-1);
+      }
+    }
+
+  private:
+    Histogram *histogram_;
+    Gauge *in_progress_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Owns all metrics of the process and writes them in the Prometheus text format
+// Metrics are created on the first request and never destroyed, so callers look them up once
+// (e.g. into a function-local static) and then update them without any locks
+class Registry {
+  public:
+    Registry();
+    Registry(const Registry &) = delete;
+    Registry &operator =(const Registry &) = delete;
+    ~Registry();
+
+    // 'name' follows Prometheus rules (counters end with '_total', durations are in seconds),
+    // 'labels' is either empty or a list like 'kind="depth"'. Names must not repeat across types
+    Counter &GetCounter(const std::string &name, const std::string &help, const std::string &labels = "");
+    Gauge &GetGauge(const std::string &name, const std::string &help, const std::string &labels = "");
+    Histogram &GetHistogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    // Besides the raw metrics, writes what is hard to get without a Prometheus server:
+    // the rate of each counter ('*_per_second') and quantiles of each histogram ('*_quantile'),
+    // both over the time since the previous call, so only one exporter should use the registry
+    void Write(std::ostream &stream);
+
+    // The registry used by our algorithms
+    static Registry &Default();
+
+  private:
+    struct Series;
+    struct Family;
+
+    Family &GetFamily(const std::string &name, const std::string &help, int type);
+    Series &GetSeries(Family &family, const std::string &labels);
+
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Family> > families_;
+    std::chrono::steady_clock::time_point last_write_;
+};
+
+struct Params {
+  // Where to write the metrics: a file (replaced atomically on each dump, e.g. for the textfile
+  // collector of node_exporter) or 'unix:<path>' for a Unix socket that answers each connection
+  // with the current metrics (e.g. 'curl --unix-socket <path> http://localhost/metrics')
+  std::string path;
+
+  // How often the file is rewritten (in milliseconds)
+  size_t period_ms;
+
+  Params() : period_ms(10000) { }
+
+  // Takes 'path' from the TEXEL_METRICS environment variable and 'period_ms' from TEXEL_METRICS_PERIOD_MS
+  // Returns 'false' if TEXEL_METRICS is not set
+  static bool FromEnvironment(Params &params);
+};
+
+} // namespace metrics
+
+
+// Dumps metrics of the registry in the background until it is destroyed
+//
+// Usage:
+//   MetricsExporter exporter;
+//   TEXEL_CHECK(exporter.StartFromEnvironment());
+class MetricsExporter {
+  public:
+    explicit MetricsExporter(metrics::Registry &registry = metrics::Registry::Default());
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator =(const MetricsExporter &) = delete;
+    ~MetricsExporter();
+
+    ErrHandle Start(const metrics::Params &params);
+
+    // Live metrics for long runs of our tools: starts with 'metrics::Params::FromEnvironment()'
+    // if TEXEL_METRICS is set, otherwise does nothing
+    ErrHandle StartFromEnvironment();
+
+    // Writes the final state of the metrics (into the file) and stops
+    void Stop();
+
+  private:
+    ErrHandle WriteFile();
+    void Serve();
+
+    metrics::Registry &registry_;
+    metrics::Params params_;
+    std::string file_, socket_path_;
+    int socket_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+    bool stop_;
+};
+
+} // namespace texel
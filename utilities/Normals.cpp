@@ -0,0 +1,165 @@
+#include "Normals.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+using simd::Float4;
+
+// The same as the vectorized kernel, but for a single pixel
+void EstimatePixel(const float *x, const float *y, const float *z,
+                   size_t idx, size_t width, float max_jump,
+                   float *nx, float *ny, float *nz) {
+  nx[idx] = ny[idx] = nz[idx] = 0.0f;
+  size_t l = idx - 1, r = idx + 1, u = idx - width, d = idx + width;
+  if (z[idx] <= 0.0f || z[l] <= 0.0f || z[r] <= 0.0f || z[u] <= 0.0f || z[d] <= 0.0f ||
+      std::fabs(z[r] - z[l]) > max_jump || std::fabs(z[d] - z[u]) > max_jump) {
+    return;
+  }
+
+  glm::vec3 h(x[r] - x[l], y[r] - y[l], z[r] - z[l]);
+  glm::vec3 v(x[d] - x[u], y[d] - y[u], z[d] - z[u]);
+  glm::vec3 n = glm::cross(h, v);
+  float len = glm::length(n);
+  if (len <= 0.0f) {
+    return;
+  }
+  n /= len;
+  if (n.x * x[idx] + n.y * y[idx] + n.z * z[idx] > 0.0f) {
+    n = -n;
+  }
+  nx[idx] = n.x;
+  ny[idx] = n.y;
+  nz[idx] = n.z;
+}
+
+} // unnamed namespace
+
+namespace normals {
+
+void EstimateRows(const float *x, const float *y, const float *z,
+                  size_t width, size_t height, float max_jump,
+                  float *nx, float *ny, float *nz,
+                  size_t first_row, size_t last_row) {
+  const Float4 zero(0.0f), one(1.0f), minus_one(-1.0f);
+  const Float4 jump(max_jump), min_len2(1e-20f);
+
+  for (size_t row = first_row; row < last_row; row++) {
+    const size_t offset = row * width;
+    if (row == 0 || row + 1 >= height || width < 3) {
+      std::fill(nx + offset, nx + offset + width, 0.0f);
+      std::fill(ny + offset, ny + offset + width, 0.0f);
+      std::fill(nz + offset, nz + offset + width, 0.0f);
+      continue;
+    }
+    nx[offset] = ny[offset] = nz[offset] = 0.0f;
+    nx[offset + width - 1] = ny[offset + width - 1] = nz[offset + width - 1] = 0.0f;
+
+    size_t col = 1;
+    for (; col + Float4::Width < width; col += Float4::Width) {
+      const size_t idx = offset + col;
+      const size_t l = idx - 1, r = idx + 1, u = idx - width, d = idx + width;
+      Float4 pz = Float4::Load(z + idx);
+      Float4 zl = Float4::Load(z + l), zr = Float4::Load(z + r);
+      Float4 zu = Float4::Load(z + u), zd = Float4::Load(z + d);
+      Float4 valid = (pz > zero) & (zl > zero) & (zr > zero) & (zu > zero) & (zd > zero) &
+                     (Abs(zr - zl) <= jump) & (Abs(zd - zu) <= jump);
+      if (MoveMask(valid) == 0) {
+        zero.Store(nx + idx);
+        zero.Store(ny + idx);
+        zero.Store(nz + idx);
+        continue;
+      }
+
+      // Cross product of horizontal and vertical central differences
+      Float4 hx = Float4::Load(x + r) - Float4::Load(x + l);
+      Float4 hy = Float4::Load(y + r) - Float4::Load(y + l);
+      Float4 hz = zr - zl;
+      Float4 vx = Float4::Load(x + d) - Float4::Load(x + u);
+      Float4 vy = Float4::Load(y + d) - Float4::Load(y + u);
+      Float4 vz = zd - zu;
+      Float4 cx = hy * vz - hz * vy;
+      Float4 cy = hz * vx - hx * vz;
+      Float4 cz = hx * vy - hy * vx;
+      Float4 len2 = cx * cx + cy * cy + cz * cz;
+      valid = valid & (len2 > min_len2);
+
+      // Normalize and orient towards the camera (that is located at the origin)
+      Float4 inv_len = one / Sqrt(Select(valid, len2, one));
+      Float4 side = cx * Float4::Load(x + idx) + cy * Float4::Load(y + idx) + cz * pz;
+      Float4 scale = Select(side > zero, minus_one, one) * inv_len;
+      Select(valid, cx * scale, zero).Store(nx + idx);
+      Select(valid, cy * scale, zero).Store(ny + idx);
+      Select(valid, cz * scale, zero).Store(nz + idx);
+    }
+    for (; col + 1 < width; col++) {
+      EstimatePixel(x, y, z, offset + col, width, max_jump, nx, ny, nz);
+    }
+  }
+}
+
+void BackProjectRows(const Camera &camera, const DepthFrame &frame,
+                     float min_depth, float max_depth,
+                     float *x, float *y, float *z,
+                     size_t first_row, size_t last_row) {
+  const size_t width = frame.Width();
+  const float inv_fx = 1.0f / camera.Fx(), inv_fy = 1.0f / camera.Fy();
+  const Float4 scale(DepthFrame::Scale), zero(0.0f);
+  const Float4 lo(min_depth), hi(max_depth);
+  const Float4 cx(camera.Cx()), step_x(inv_fx);
+  const Float4 lane(0.0f, 1.0f, 2.0f, 3.0f);
+
+  for (size_t row = first_row; row < last_row; row++) {
+    const uint16_t *src = frame.Row(row);
+    const size_t offset = row * width;
+    const Float4 ray_y(((float)row - camera.Cy()) * inv_fy);
+    size_t col = 0;
+    for (; col + Float4::Width <= width; col += Float4::Width) {
+      Float4 d = Float4::FromUInt16(src + col) * scale;
+      d = Select((d >= lo) & (d <= hi), d, zero);
+      Float4 ray_x = (Float4((float)col) + lane - cx) * step_x;
+      (ray_x * d).Store(x + offset + col);
+      (ray_y * d).Store(y + offset + col);
+      d.Store(z + offset + col);
+    }
+    for (; col < width; col++) {
+      float d = src[col] * DepthFrame::Scale;
+      d = d >= min_depth && d <= max_depth ? d : 0.0f;
+      x[offset + col] = ((float)col - camera.Cx()) * inv_fx * d;
+      y[offset + col] = ((float)row - camera.Cy()) * inv_fy * d;
+      z[offset + col] = d;
+    }
+  }
+}
+
+} // namespace normals
+
+ErrHandle EstimateNormals(const Camera &camera, const DepthFrame &frame,
+                          const normals::Params &params, NormalMap &normals,
+                          ThreadPool &pool) {
+  if (frame.Width() != camera.Width() || frame.Height() != camera.Height()) {
+    std::ostringstream oss;
+    oss << "size of the depth frame (" << frame.Width() << "x" << frame.Height() << ") "
+        << "does not match the camera (" << camera.Width() << "x" << camera.Height() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+
+  const size_t width = frame.Width(), height = frame.Height();
+  std::vector<float> x(width * height), y(width * height), z(width * height);
+  normals.Resize(width, height);
+
+  // Normals of a row depend on its neighbours, so we need two passes
+  const size_t grain = 16;
+  pool.ParallelFor(0, height, grain, [&](size_t first, size_t last, size_t) {
+    normals::BackProjectRows(camera, frame, params.min_depth, params.max_depth,
+                             x.data(), y.data(), z.data(), first, last);
+  });
+  pool.ParallelFor(0, height, grain, [&](size_t first, size_t last, size_t) {
+    normals::EstimateRows(x.data(), y.data(), z.data(), width, height, params.max_jump,
+                          normals.X(), normals.Y(), normals.Z(), first, last);
+  });
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,91 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Parallel.h"
+
+namespace texel {
+
+// Per-pixel unit normals aligned with a depth frame
+// Components are stored as separate planes, zero vectors mark invalid pixels
+class NormalMap {
+  public:
+    NormalMap() : width_(0), height_(0) { }
+    NormalMap(const NormalMap &) = default;
+    NormalMap(NormalMap &&) noexcept = default;
+    NormalMap &operator =(const NormalMap &) = default;
+    NormalMap &operator =(NormalMap &&) noexcept = default;
+
+    size_t Width() const { return width_; }
+    size_t Height() const { return height_; }
+
+    // Changes size of the map, the buffers are reused if they are large enough
+    void Resize(size_t width, size_t height) {
+      width_  = width;
+      height_ = height;
+      x_.resize(width * height);
+      y_.resize(width * height);
+      z_.resize(width * height);
+    }
+
+    const float *X() const { return x_.data(); }
+    const float *Y() const { return y_.data(); }
+    const float *Z() const { return z_.data(); }
+    float *X() { return x_.data(); }
+    float *Y() { return y_.data(); }
+    float *Z() { return z_.data(); }
+
+    glm::vec3 At(size_t x, size_t y) const {
+      size_t idx = y * width_ + x;
+      return glm::vec3(x_[idx], y_[idx], z_[idx]);
+    }
+
+    bool IsValid(size_t x, size_t y) const {
+      size_t idx = y * width_ + x;
+      return x_[idx] != 0.0f || y_[idx] != 0.0f || z_[idx] != 0.0f;
+    }
+
+  private:
+    size_t width_, height_;
+    std::vector<float> x_, y_, z_;
+};
+
+namespace normals {
+
+// Parameters of the normal estimation
+struct Params {
+  // Neighbours with larger difference in depth are considered as another surface (in meters)
+  float max_jump;
+
+  // Depth values outside this range are ignored (in meters)
+  float min_depth, max_depth;
+
+  Params()
+    : max_jump(0.05f),
+      min_depth(0.2f), max_depth(5.0f) {
+  }
+};
+
+// Low-level kernel for organized point clouds stored as planes (zero 'z' means no point)
+// Estimates normals for rows [first_row, last_row) using the cross product of central differences
+// Normals are oriented towards the camera, border pixels are always invalid
+void EstimateRows(const float *x, const float *y, const float *z,
+                  size_t width, size_t height, float max_jump,
+                  float *nx, float *ny, float *nz,
+                  size_t first_row, size_t last_row);
+
+// Converts depth (in millimeters) into camera space points, rows [first_row, last_row) only
+// Values outside the [min_depth, max_depth] range become invalid points
+void BackProjectRows(const Camera &camera, const DepthFrame &frame,
+                     float min_depth, float max_depth,
+                     float *x, float *y, float *z,
+                     size_t first_row, size_t last_row);
+
+} // namespace normals
+
+// Estimates the normal map for a depth frame
+// Rows are processed by the threads of the pool
+ErrHandle EstimateNormals(const Camera &camera, const DepthFrame &frame,
+                          const normals::Params &params, NormalMap &normals,
+                          ThreadPool &pool = ThreadPool::Default());
+
+} // namespace texel
@@ -0,0 +1,154 @@
+#include "Parallel.h"
+
+namespace texel {
+
+namespace {
+
+// Marks threads that are executing some job, nested jobs are processed inline
+thread_local bool inside_job = false;
+
+} // unnamed namespace
+
+struct ThreadPool::Job {
+  size_t begin, end, grain;
+  const std::function<void(size_t, size_t, size_t)> *func;
+  std::atomic<size_t> next_chunk;
+  std::atomic<size_t> n_active;
+
+  Job(size_t begin_, size_t end_, size_t grain_,
+      const std::function<void(size_t, size_t, size_t)> *func_)
+    : begin(begin_), end(end_), grain(grain_), func(func_),
+      next_chunk(0), n_active(0) {
+  }
+};
+
+ThreadPool::ThreadPool(size_t n_threads)
+  : generation_(0), stop_(false) {
+  if (n_threads == 0) {
+    n_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  for (size_t i = 1; i < n_threads; i++) {
+    workers_.emplace_back([this, i]() { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_up_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::RunChunks(Job &job, size_t thread_idx) {
+  bool was_inside = inside_job;
+  inside_job = true;
+  size_t n_chunks = (job.end - job.begin + job.grain - 1) / job.grain;
+  while (true) {
+    size_t chunk = job.next_chunk.fetch_add(1);
+    if (chunk >= n_chunks) {
+      break;
+    }
+    size_t first = job.begin + chunk * job.grain;
+    size_t last  = std::min(first + job.grain, job.end);
+    (*job.func)(first, last, thread_idx);
+  }
+  inside_job = was_inside;
+}
+
+void ThreadPool::WorkerLoop(size_t thread_idx) {
+  size_t seen_generation = 0;
+  while (true) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_up_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+      job = job_;
+      if (job == nullptr) {
+        continue;
+      }
+      job->n_active += 1;
+    }
+
+    RunChunks(*job, thread_idx);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job->n_active -= 1;
+    }
+    job_done_.notify_all();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain,
+                             const std::function<void(size_t, size_t, size_t)> &func) {
+  if (begin >= end) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+
+  // Small, nested or single-threaded jobs are not worth the synchronization
+  if (workers_.empty() || inside_job || end - begin <= grain) {
+    bool was_inside = inside_job;
+    inside_job = true;
+    for (size_t first = begin; first < end; first += grain) {
+      func(first, std::min(first + grain, end), 0);
+    }
+    inside_job = was_inside;
+    return;
+  }
+
+  // Only one job is processed by the workers at any moment
+  std::lock_guard<std::mutex> submit_lock(submit_mutex_);
+  auto job = std::make_shared<Job>(begin, end, grain, &func);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = job;
+    generation_ += 1;
+  }
+  wake_up_.notify_all();
+
+  RunChunks(*job, 0);
+
+  // Wait for the workers that have grabbed the job, others will ignore it
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_.reset();
+  job_done_.wait(lock, [&]() { return job->n_active == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end,
+                             const std::function<void(size_t)> &func) {
+  size_t n_chunks = Concurrency() * 4;
+  size_t grain = std::max<size_t>((end - std::min(begin, end) + n_chunks - 1) / n_chunks, 1);
+  ParallelFor(begin, end, grain, [&func](size_t first, size_t last, size_t) {
+    for (size_t i = first; i < last; i++) {
+      func(i);
+    }
+  });
+}
+
+bool ThreadPool::InsideJob() {
+  return inside_job;
+}
+
+ThreadPool::InlineScope::InlineScope() : was_inside_(inside_job) {
+  inside_job = true;
+}
+
+ThreadPool::InlineScope::~InlineScope() {
+  inside_job = was_inside_;
+}
+
+ThreadPool &ThreadPool::Default() {
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace texel
@@ -0,0 +1,65 @@
+#pragma once
+#include "Defs.h"
+
+namespace texel {
+
+// A fixed set of worker threads that processes index ranges
+// The thread that calls 'ParallelFor()' participates in the work as well
+class ThreadPool {
+  public:
+    // Zero means 'as many workers as the hardware supports'
+    explicit ThreadPool(size_t n_threads = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator =(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    // The maximal number of threads that may execute a single job
+    // Use it to allocate per-thread accumulators
+    size_t Concurrency() const { return workers_.size() + 1; }
+
+    // Splits [begin, end) into chunks of 'grain' elements and calls 'func(first, last, thread_idx)'
+    // for each of them, 'thread_idx' is less than 'Concurrency()'
+    // Blocks until all chunks are processed. Nested calls are executed by the calling thread
+    void ParallelFor(size_t begin, size_t end, size_t grain,
+                     const std::function<void(size_t, size_t, size_t)> &func);
+
+    // A version that calls 'func(idx)' for each index
+    void ParallelFor(size_t begin, size_t end,
+                     const std::function<void(size_t)> &func);
+
+    // Whether the calling thread is executing a job of some pool
+    static bool InsideJob();
+
+    // While an instance lives, 'ParallelFor()' calls of the thread that created it run inline,
+    // as if it executed a job. For callbacks that run while the pool is busy with a job
+    // the thread waits for, submitting another job from them would deadlock
+    class InlineScope {
+      public:
+        InlineScope();
+        InlineScope(const InlineScope &) = delete;
+        InlineScope &operator =(const InlineScope &) = delete;
+        ~InlineScope();
+
+      private:
+        bool was_inside_;
+    };
+
+    // The pool shared by all our algorithms
+    static ThreadPool &Default();
+
+  private:
+    struct Job;
+
+    void WorkerLoop(size_t thread_idx);
+    static void RunChunks(Job &job, size_t thread_idx);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_up_, job_done_;
+    std::shared_ptr<Job> job_;
+    size_t generation_;
+    bool stop_;
+    std::mutex submit_mutex_;
+};
+
+} // namespace texel
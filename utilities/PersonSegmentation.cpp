@@ -0,0 +1,391 @@
+#include "PersonSegmentation.h"
+#include "Geometry.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+// SplitMix64, so hypotheses do not depend on the number of threads and the standard library
+class Random {
+  public:
+    explicit Random(uint64_t seed) : state_(seed) { }
+
+    uint64_t Next() {
+      uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+
+    uint64_t Below(uint64_t bound) {
+      return Next() % bound;
+    }
+
+  private:
+    uint64_t state_;
+};
+
+// Points with '|dot(normal, p) + offset| < distance' among 'n' points stored as separate coordinates
+size_t CountInliers(const float *xs, const float *ys, const float *zs, size_t n,
+                    const glm::vec3 &normal, float offset, float distance) {
+  using simd::Float4;
+  Float4 nx(normal.x), ny(normal.y), nz(normal.z), d(offset), limit(distance);
+  size_t count = 0, i = 0;
+  for (; i + Float4::Width <= n; i += Float4::Width) {
+    Float4 h = nx * Float4::Load(xs + i) + ny * Float4::Load(ys + i) + nz * Float4::Load(zs + i) + d;
+    count += (size_t)simd::CountBits(MoveMask(Abs(h) < limit));
+  }
+  for (; i < n; i++) {
+    count += std::abs(normal.x * xs[i] + normal.y * ys[i] + normal.z * zs[i] + offset) < distance ? 1 : 0;
+  }
+  return count;
+}
+
+// Bytes of the mask for each combination of four bits (0xff where the bit is set)
+const std::array<uint32_t, 16> Expand = []() {
+  std::array<uint32_t, 16> expand;
+  for (uint32_t bits = 0; bits < 16; bits++) {
+    uint8_t bytes[4];
+    for (uint32_t k = 0; k < 4; k++) {
+      bytes[k] = (bits & (1 << k)) != 0 ? 255 : 0;
+    }
+    std::memcpy(&expand[bits], bytes, sizeof(bytes));
+  }
+  return expand;
+}();
+
+struct Hypothesis {
+  size_t count, idx;
+  glm::vec3 normal;
+  float offset;
+
+  Hypothesis() : count(0), idx(std::numeric_limits<size_t>::max()), normal(0.0f), offset(0.0f) { }
+
+  // More inliers win, ties go to the earlier hypothesis, so the result does not depend on scheduling
+  bool Better(const Hypothesis &other) const {
+    return count > other.count || (count == other.count && idx < other.idx);
+  }
+};
+
+} // unnamed namespace
+
+//------------------
+//--- PersonMask ---
+//------------------
+
+size_t PersonMask::Count() const {
+  size_t count = 0;
+  for (uint8_t value : data_) {
+    count += value != 0 ? 1 : 0;
+  }
+  return count;
+}
+
+//--------------------------
+//--- PersonSegmentation ---
+//--------------------------
+
+PersonSegmentation::PersonSegmentation(const Camera &camera, const BoundingBox &bbox,
+                                       const segmentation::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool),
+    box_min_(bbox.Offset()), box_max_(bbox.Offset() + bbox.Size()),
+    projector_(camera, params.min_depth, params.max_depth, box_min_, box_max_),
+    sampler_(camera, params.min_depth, params.max_depth, box_min_ - glm::vec3(params.floor_margin),
+             box_max_ + glm::vec3(params.floor_margin)) {
+  params_.sample_step = std::max<size_t>(params_.sample_step, 1);
+  params_.max_score_points = std::max<size_t>(params_.max_score_points, 3);
+
+  // A standing person is taller than wide
+  auto size = bbox.Size();
+  up_axis_ = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+}
+
+void PersonSegmentation::Sample(const DepthFrame &frame, Samples &samples) const {
+  using simd::Float4;
+  samples.x.clear();
+  samples.y.clear();
+  samples.z.clear();
+  const size_t step = params_.sample_step;
+  float px[Float4::Width], py[Float4::Width], pz[Float4::Width];
+  for (size_t y = 0; y < frame.Height(); y += step) {
+    sampler_.Groups(frame, y, step * Float4::Width, [&](size_t, int bits, Float4 vx, Float4 vy, Float4 vz) {
+      if (bits == 0) {
+        return;
+      }
+      vx.Store(px);
+      vy.Store(py);
+      vz.Store(pz);
+      for (size_t k = 0; k < Float4::Width; k++) {
+        if ((bits & (1 << k)) != 0) {
+          samples.x.push_back(px[k]);
+          samples.y.push_back(py[k]);
+          samples.z.push_back(pz[k]);
+        }
+      }
+    });
+  }
+}
+
+void PersonSegmentation::FitFloor(const DepthFrame &frame, segmentation::Floor &floor) const {
+  floor = segmentation::Floor();
+  Samples samples;
+  Sample(frame, samples);
+  const size_t n = samples.Size();
+  if (n < 3) {
+    return;
+  }
+
+  // Hypotheses are scored on evenly spread points
+  Samples score;
+  if (n > params_.max_score_points) {
+    for (size_t i = 0; i < params_.max_score_points; i++) {
+      size_t idx = i * n / params_.max_score_points;
+      score.x.push_back(samples.x[idx]);
+      score.y.push_back(samples.y[idx]);
+      score.z.push_back(samples.z[idx]);
+    }
+  }
+  const Samples &scored = n > params_.max_score_points ? score : samples;
+
+  const float min_cos = std::cos(params_.max_tilt * 3.14159265f / 180.0f);
+  std::vector<Hypothesis> best(pool_.Concurrency());
+  pool_.ParallelFor(0, params_.iterations, 16, [&](size_t first, size_t last, size_t thread_idx) {
+    for (size_t h = first; h < last; h++) {
+      Random random(0x6a09e667f3bcc909ull ^ (h * 0xd6e8feb86659fd93ull));
+      size_t a = random.Below(n), b = random.Below(n), c = random.Below(n);
+      glm::vec3 pa(samples.x[a], samples.y[a], samples.z[a]);
+      glm::vec3 pb(samples.x[b], samples.y[b], samples.z[b]);
+      glm::vec3 pc(samples.x[c], samples.y[c], samples.z[c]);
+      glm::vec3 normal = glm::cross(pb - pa, pc - pa);
+      float length = glm::length(normal);
+      if (!(length > 1e-6f)) {
+        continue;
+      }
+      normal /= length;
+      if (std::abs(normal[up_axis_]) < min_cos) {
+        continue;
+      }
+
+      Hypothesis hypothesis;
+      hypothesis.idx    = h;
+      hypothesis.normal = normal;
+      hypothesis.offset = -glm::dot(normal, pa);
+      hypothesis.count  = CountInliers(scored.x.data(), scored.y.data(), scored.z.data(), scored.Size(),
+                                       normal, hypothesis.offset, params_.floor_distance);
+      if (hypothesis.Better(best[thread_idx])) {
+        best[thread_idx] = hypothesis;
+      }
+    }
+  });
+  Hypothesis winner;
+  for (const auto &hypothesis : best) {
+    if (hypothesis.Better(winner)) {
+      winner = hypothesis;
+    }
+  }
+  if (winner.count < 3) {
+    return;
+  }
+
+  // Least squares over all inliers: the height along the up axis is a linear function of the other two
+  int u = (up_axis_ + 1) % 3, v = (up_axis_ + 2) % 3;
+  double count = 0.0, mean[3] = { 0.0, 0.0, 0.0 };
+  std::vector<size_t> inliers;
+  for (size_t i = 0; i < n; i++) {
+    glm::vec3 p(samples.x[i], samples.y[i], samples.z[i]);
+    if (std::abs(glm::dot(winner.normal, p) + winner.offset) < params_.floor_distance) {
+      inliers.push_back(i);
+      for (int k = 0; k < 3; k++) {
+        mean[k] += p[k];
+      }
+      count += 1.0;
+    }
+  }
+  for (int k = 0; k < 3; k++) {
+    mean[k] /= count;
+  }
+  double suu = 0.0, suv = 0.0, svv = 0.0, suh = 0.0, svh = 0.0;
+  for (size_t i : inliers) {
+    glm::vec3 p(samples.x[i], samples.y[i], samples.z[i]);
+    double du = p[u] - mean[u], dv = p[v] - mean[v], dh = p[up_axis_] - mean[up_axis_];
+    suu += du * du;
+    suv += du * dv;
+    svv += dv * dv;
+    suh += du * dh;
+    svh += dv * dh;
+  }
+  double det = suu * svv - suv * suv;
+  glm::vec3 normal = winner.normal;
+  if (std::abs(det) > 1e-12) {
+    double alpha = (suh * svv - svh * suv) / det, beta = (svh * suu - suh * suv) / det;
+    normal[u] = (float)-alpha;
+    normal[v] = (float)-beta;
+    normal[up_axis_] = 1.0f;
+    normal = glm::normalize(normal);
+  }
+  glm::vec3 center((float)mean[0], (float)mean[1], (float)mean[2]);
+
+  floor.normal = normal;
+  floor.offset = -glm::dot(normal, center);
+  if (floor.Height((box_min_ + box_max_) * 0.5f) < 0.0f) {
+    floor.normal = -floor.normal;
+    floor.offset = -floor.offset;
+  }
+  floor.support = CountInliers(samples.x.data(), samples.y.data(), samples.z.data(), n,
+                               floor.normal, floor.offset, params_.floor_distance);
+  floor.found = true;
+}
+
+size_t PersonSegmentation::Support(const DepthFrame &frame, const segmentation::Floor &floor) const {
+  if (!floor.found) {
+    return 0;
+  }
+  Samples samples;
+  Sample(frame, samples);
+  return CountInliers(samples.x.data(), samples.y.data(), samples.z.data(), samples.Size(),
+                      floor.normal, floor.offset, params_.floor_distance);
+}
+
+void PersonSegmentation::Segment(const DepthFrame &frame, const segmentation::Floor &floor, PersonMask &mask) const {
+  using simd::Float4;
+
+  // Without the floor, the plane is far below everything
+  glm::vec3 normal = floor.found ? floor.normal : glm::vec3(0.0f);
+  float offset = floor.found ? floor.offset : std::numeric_limits<float>::max();
+  Float4 nx(normal.x), ny(normal.y), nz(normal.z), d(offset), min_height(params_.floor_distance);
+
+  mask.Resize(frame.Width(), frame.Height());
+  pool_.ParallelFor(0, frame.Height(), 16, [&](size_t first, size_t last, size_t) {
+    for (size_t y = first; y < last; y++) {
+      uint8_t *out = mask.Row(y);
+      size_t x = projector_.Groups(frame, y, Float4::Width, [&](size_t start, int bits, Float4 vx, Float4 vy, Float4 vz) {
+        if (bits != 0) {
+          bits &= MoveMask((nx * vx + ny * vy + nz * vz + d) > min_height);
+        }
+        std::memcpy(out + start, &Expand[bits], Float4::Width);
+      });
+
+      for (; x < frame.Width(); x++) {
+        glm::vec3 p;
+        bool inside = projector_.Pixel(frame, x, y, p);
+        out[x] = inside && glm::dot(normal, p) + offset > params_.floor_distance ? 255 : 0;
+      }
+    }
+  });
+
+  if (params_.max_jump > 0.0f) {
+    KeepLargestParts(frame, mask);
+  }
+}
+
+void PersonSegmentation::KeepLargestParts(const DepthFrame &frame, PersonMask &mask) const {
+  // Flood fill over 4-connected pixels of the mask, neighbours must lie on the same surface
+  const size_t width = frame.Width(), height = frame.Height();
+  const uint32_t none = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> labels(width * height, none);
+  std::vector<size_t> sizes;
+  std::vector<uint32_t> stack;
+  const uint16_t *depth = frame.Data();
+  uint8_t *values = mask.Data();
+  for (size_t start = 0; start < width * height; start++) {
+    if (values[start] == 0 || labels[start] != none) {
+      continue;
+    }
+    uint32_t label = (uint32_t)sizes.size();
+    size_t size = 0;
+    labels[start] = label;
+    stack.push_back((uint32_t)start);
+    while (!stack.empty()) {
+      uint32_t idx = stack.back();
+      stack.pop_back();
+      size += 1;
+      size_t x = idx % width, y = idx / width;
+      auto visit = [&](size_t next) {
+        if (values[next] != 0 && labels[next] == none &&
+            std::abs((float)depth[next] - (float)depth[idx]) <= params_.max_jump) {
+          labels[next] = label;
+          stack.push_back((uint32_t)next);
+        }
+      };
+      if (x > 0) {
+        visit(idx - 1);
+      }
+      if (x + 1 < width) {
+        visit(idx + 1);
+      }
+      if (y > 0) {
+        visit(idx - width);
+      }
+      if (y + 1 < height) {
+        visit(idx + width);
+      }
+    }
+    sizes.push_back(size);
+  }
+  if (sizes.empty()) {
+    return;
+  }
+
+  size_t largest = *std::max_element(sizes.begin(), sizes.end());
+  std::vector<bool> keep(sizes.size());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    keep[i] = (float)sizes[i] >= params_.min_part * (float)largest;
+  }
+  for (size_t i = 0; i < width * height; i++) {
+    if (values[i] != 0 && !keep[labels[i]]) {
+      values[i] = 0;
+    }
+  }
+}
+
+ErrHandle PersonSegmentation::SegmentStream(const scanogram::Stream &stream, const BoundingBox &bbox,
+                                            const segmentation::Params &params,
+                                            const std::function<ErrHandle(size_t, const DepthFrame &,
+                                                                          const PersonMask &)> &callback) {
+  Camera camera;
+  std::string dir;
+  if (!stream.HasDepth(camera, dir)) {
+    return ErrHandle(TEXEL_WHERE, "the stream does not contain depth maps");
+  }
+  std::vector<std::string> files;
+  TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+
+  // Frames of a batch are decoded and segmented concurrently, one thread per frame
+  auto &pool = ThreadPool::Default();
+  PersonSegmentation segmentation(camera, bbox, params, pool);
+  const size_t batch_size = pool.Concurrency();
+  std::vector<DepthFrame> batch(batch_size);
+  std::vector<PersonMask> masks(batch_size);
+  std::vector<segmentation::Floor> floors(batch_size);
+  std::vector<ErrHandle> errors(batch_size);
+
+  // The sensor rarely moves, so the floor of the previous batch is checked before RANSAC is run again
+  segmentation::Floor reference;
+  for (size_t first = 0; first < files.size(); first += batch_size) {
+    size_t last = std::min(first + batch_size, files.size());
+    pool.ParallelFor(first, last, [&](size_t i) {
+      auto &frame = batch[i - first];
+      auto &floor = floors[i - first];
+      errors[i - first] = DepthFrame::Load(files[i], frame);
+      if (errors[i - first].Failed()) {
+        return;
+      }
+      floor = reference;
+      if (!floor.found ||
+          (float)segmentation.Support(frame, floor) < params.refit_ratio * (float)floor.support) {
+        segmentation.FitFloor(frame, floor);
+      }
+      segmentation.Segment(frame, floor, masks[i - first]);
+    });
+
+    for (size_t i = first; i < last; i++) {
+      TEXEL_CHECK(errors[i - first]);
+      TEXEL_CHECK(callback(i, batch[i - first], masks[i - first]));
+    }
+    reference = floors[last - first - 1];
+  }
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,152 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+namespace segmentation {
+
+struct Params {
+  // Depth values outside this range are invalid (in meters)
+  float min_depth, max_depth;
+
+  // The floor is searched around the bounding box of the stage, extended by this margin (in meters)
+  float floor_margin;
+
+  // Points closer to the floor are the floor itself (in meters)
+  float floor_distance;
+
+  // The floor is perpendicular to the longest side of the bounding box, up to this angle (in degrees)
+  float max_tilt;
+
+  // RANSAC tries so many planes, each one is scored against at most 'max_score_points' points
+  size_t iterations, max_score_points;
+
+  // Every 'sample_step'-th group of four pixels in every 'sample_step'-th row takes part in the floor search
+  size_t sample_step;
+
+  // A stream reuses the floor of previous frames until it loses this share of its points
+  float refit_ratio;
+
+  // Parts of the mask separated by depth jumps larger than this (in millimeters) are different objects,
+  // the largest one is the person. Objects smaller than 'min_part' of the person are dropped
+  // Zero keeps everything inside the bounding box
+  float max_jump;
+  float min_part;
+
+  Params()
+    : min_depth(0.2f), max_depth(5.0f),
+      floor_margin(0.3f),
+      floor_distance(0.02f),
+      max_tilt(15.0f),
+      iterations(256), max_score_points(4096),
+      sample_step(2),
+      refit_ratio(0.8f),
+      max_jump(50.0f), min_part(0.05f) {
+  }
+};
+
+// A plane in the viewer space: 'dot(normal, p) + offset' is the height of 'p' above it
+// The normal is directed to the person
+struct Floor {
+  glm::vec3 normal;
+  float offset;
+  size_t support;     // the number of sampled points on the plane
+  bool found;
+
+  Floor() : normal(0.0f), offset(0.0f), support(0), found(false) { }
+
+  float Height(const glm::vec3 &p) const { return glm::dot(normal, p) + offset; }
+};
+
+} // namespace segmentation
+
+
+// A binary mask of the depth frame, 255 marks pixels of the person
+class PersonMask {
+  public:
+    PersonMask() : width_(0), height_(0) { }
+    PersonMask(const PersonMask &) = default;
+    PersonMask(PersonMask &&) noexcept = default;
+    PersonMask &operator =(const PersonMask &) = default;
+    PersonMask &operator =(PersonMask &&) noexcept = default;
+
+    size_t Width() const { return width_; }
+    size_t Height() const { return height_; }
+    bool Empty() const { return data_.empty(); }
+
+    // Changes size of the mask, the buffer is reused if it is large enough
+    void Resize(size_t width, size_t height) {
+      width_  = width;
+      height_ = height;
+      data_.resize(width * height);
+    }
+
+    const uint8_t *Data() const { return data_.data(); }
+    uint8_t *Data() { return data_.data(); }
+
+    const uint8_t *Row(size_t y) const { return data_.data() + y * width_; }
+    uint8_t *Row(size_t y) { return data_.data() + y * width_; }
+
+    // The number of pixels of the person
+    size_t Count() const;
+
+  private:
+    size_t width_, height_;
+    std::vector<uint8_t> data_;
+};
+
+
+// Separates the person from the floor, the platform and the background on depth frames of one sensor
+// Points are taken into the viewer space, where the floor is fitted with RANSAC (hypotheses are scored
+// concurrently) and everything outside the bounding box of the stage or on the floor is removed
+// Per-pixel kernels process four pixels at once
+class PersonSegmentation {
+  public:
+    PersonSegmentation(const Camera &camera, const BoundingBox &bbox,
+                       const segmentation::Params &params = segmentation::Params(),
+                       ThreadPool &pool = ThreadPool::Default());
+    PersonSegmentation(const PersonSegmentation &) = delete;
+    PersonSegmentation &operator =(const PersonSegmentation &) = delete;
+
+    const segmentation::Params &Params() const { return params_; }
+
+    // Fits the floor, 'found' is 'false' if the frame has no plane that could be the floor
+    void FitFloor(const DepthFrame &frame, segmentation::Floor &floor) const;
+
+    // Counts sampled points of the frame that lie on the floor
+    size_t Support(const DepthFrame &frame, const segmentation::Floor &floor) const;
+
+    // Marks valid points inside the bounding box and above the floor (if it is found)
+    void Segment(const DepthFrame &frame, const segmentation::Floor &floor, PersonMask &mask) const;
+
+    // Decodes depth maps of the stream and segments them, batches of frames are processed concurrently
+    // The floor is fitted on the first frame and again when the sensor moves away from it
+    // 'callback(idx, frame, mask)' receives the frames in order, its errors stop the processing
+    static ErrHandle SegmentStream(const scanogram::Stream &stream, const BoundingBox &bbox,
+                                   const segmentation::Params &params,
+                                   const std::function<ErrHandle(size_t, const DepthFrame &,
+                                                                 const PersonMask &)> &callback);
+
+  private:
+    // Sampled points around the bounding box (in the viewer space), coordinates are stored separately
+    struct Samples {
+      std::vector<float> x, y, z;
+      size_t Size() const { return x.size(); }
+    };
+
+    void Sample(const DepthFrame &frame, Samples &samples) const;
+    void KeepLargestParts(const DepthFrame &frame, PersonMask &mask) const;
+
+    segmentation::Params params_;
+    ThreadPool &pool_;
+    glm::vec3 box_min_, box_max_;
+    geometry::DepthProjector projector_;     // keeps points inside the box
+    geometry::DepthProjector sampler_;       // keeps points around the box, for the floor search
+    int up_axis_;                            // the longest side of the box
+};
+
+} // namespace texel
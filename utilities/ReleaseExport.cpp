@@ -0,0 +1,268 @@
+#include "ReleaseExport.h"
+#include "Parallel.h"
+
+namespace texel {
+
+namespace {
+
+// All scans of a single '*.scan.xml' file
+struct Person {
+  std::string xml;
+  std::string id;
+  std::vector<scanogram::Consents> consents;
+};
+
+struct CopyJob {
+  std::string src, dst;
+};
+
+// Both paths are expected to be absolute and normalized
+bool IsInside(const std::filesystem::path &path, const std::filesystem::path &root) {
+  auto rel = path.lexically_relative(root);
+  return !rel.empty() && *rel.begin() != "..";
+}
+
+bool IsCameraSection(const std::string &name) {
+  return name == "depth" || name == "color" || name == "ir" || name == "intensity";
+}
+
+// Removes streams the person did not agree to publish, collects directories of the remaining ones
+ErrHandle FilterScans(const Person &person, const std::filesystem::path &person_dir,
+                      tinyxml2::XMLDocument &doc,
+                      std::vector<std::filesystem::path> &dirs,
+                      bool &allow_meshes, size_t &n_scans,
+                      release_export::Report &report) {
+  using namespace tinyxml2;
+  if (doc.LoadFile(person.xml.c_str()) != XML_SUCCESS || doc.RootElement() == nullptr) {
+    return ErrHandle(TEXEL_WHERE, "failed to parse the XML file");
+  }
+
+  auto root = doc.RootElement();
+  size_t idx = 0;
+  n_scans = 0;
+  for (auto scan = root->FirstChildElement("scan"); scan != nullptr; ) {
+    auto next_scan = scan->NextSiblingElement("scan");
+    if (idx >= person.consents.size()) {
+      return ErrHandle(TEXEL_WHERE, "the file was modified after it was parsed");
+    }
+    const auto &consents = person.consents[idx++];
+    allow_meshes = allow_meshes && consents.make_scans_publicly_available;
+    bool allow_depth = consents.make_depth_maps_publicly_available;
+    bool allow_color = consents.make_color_frames_publicly_available && consents.do_not_blur_face;
+
+    for (auto stage = scan->FirstChildElement("stage"); stage != nullptr; ) {
+      auto next_stage = stage->NextSiblingElement("stage");
+      for (auto stream = stage->FirstChildElement("stream"); stream != nullptr; ) {
+        auto next_stream = stream->NextSiblingElement("stream");
+        size_t n_cameras = 0;
+        for (auto camera = stream->FirstChildElement(); camera != nullptr; ) {
+          auto next_camera = camera->NextSiblingElement();
+          std::string name = camera->Name();
+          if (IsCameraSection(name)) {
+            if (name == "color" ? allow_color : allow_depth) {
+              auto path = camera->Attribute("path");
+              if (path != nullptr) {
+                dirs.emplace_back((person_dir / path).lexically_normal());
+              }
+              n_cameras += 1;
+            }
+            else {
+              stream->DeleteChild(camera);
+              report.streams_removed += 1;
+            }
+          }
+          camera = next_camera;
+        }
+
+        // Our parser requires at least one camera per stream and one stream per stage
+        if (n_cameras == 0) {
+          stage->DeleteChild(stream);
+        }
+        stream = next_stream;
+      }
+      if (stage->FirstChildElement("stream") == nullptr) {
+        scan->DeleteChild(stage);
+      }
+      stage = next_stage;
+    }
+
+    if (scan->FirstChildElement("stage") == nullptr) {
+      root->DeleteChild(scan);
+      report.scans_removed += 1;
+    }
+    else {
+      n_scans += 1;
+    }
+    scan = next_scan;
+  }
+
+  if (idx != person.consents.size()) {
+    return ErrHandle(TEXEL_WHERE, "the file was modified after it was parsed");
+  }
+  return ErrHandle();
+}
+
+ErrHandle CollectFiles(const std::filesystem::path &dir,
+                       const std::filesystem::path &src_root, const std::filesystem::path &dst_root,
+                       std::vector<CopyJob> &jobs, std::set<std::filesystem::path> &dst_dirs,
+                       release_export::Report &report) {
+  std::error_code ec;
+  std::filesystem::recursive_directory_iterator iter(dir, ec), end;
+  for (; !ec && iter != end; iter.increment(ec)) {
+    if (!iter->is_regular_file(ec)) {
+      continue;
+    }
+    auto dst = dst_root / iter->path().lexically_relative(src_root);
+    dst_dirs.emplace(dst.parent_path());
+    report.bytes += (size_t)iter->file_size(ec);
+    jobs.push_back(CopyJob{ iter->path().string(), dst.string() });
+  }
+  if (ec) {
+    std::ostringstream oss;
+    oss << "failed to enumerate files in '" << dir.string() << "' (" << ec.message() << ")";
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  return ErrHandle();
+}
+
+} // unnamed namespace
+
+namespace release_export {
+
+ErrHandle Export(ScanogramFinder &finder,
+                 const std::string &src_root, const std::string &dst_root,
+                 const Params &params, Report &report) {
+  report = Report();
+  auto src = std::filesystem::absolute(src_root).lexically_normal();
+  auto dst = std::filesystem::absolute(dst_root).lexically_normal();
+  if (src == dst || IsInside(dst, src)) {
+    return ErrHandle(TEXEL_WHERE, "the release must be located outside the source directory");
+  }
+
+  // Scans of the same file follow each other
+  std::vector<Person> persons;
+  finder.Reset();
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    if (persons.empty() || persons.back().xml != info.path) {
+      persons.push_back(Person{ info.path, info.id, {} });
+    }
+    persons.back().consents.emplace_back(info.scan.Consents());
+  }
+  finder.Reset();
+
+  // Only metadata is touched here: XML files are rewritten, the copy list is prepared
+  std::vector<CopyJob> jobs;
+  std::set<std::filesystem::path> dst_dirs;
+  std::unordered_set<std::string> listed_dirs;
+  for (const auto &person : persons) {
+    auto xml = std::filesystem::absolute(person.xml).lexically_normal();
+    auto person_dir = xml.parent_path();
+    std::vector<std::filesystem::path> dirs;
+    bool allow_meshes = true;
+    size_t n_scans = 0;
+    tinyxml2::XMLDocument doc;
+    auto err = FilterScans(person, person_dir, doc, dirs, allow_meshes, n_scans, report);
+    if (err.Failed()) {
+      std::ostringstream oss;
+      oss << "failed to filter scans of '" << person.xml << "'";
+      return ErrHandle(TEXEL_WHERE, oss.str(), err);
+    }
+    if (n_scans == 0) {
+      report.persons_skipped += 1;
+      report.skipped.emplace_back("'" + person.id + "': no consent to publish depth maps or color frames");
+      continue;
+    }
+
+    if (allow_meshes) {
+      for (const char *name : { "portal_mx", "free_fusion" }) {
+        if (std::filesystem::is_directory(person_dir / name)) {
+          dirs.emplace_back(person_dir / name);
+        }
+      }
+    }
+    bool outside = !IsInside(xml, src);
+    for (const auto &dir : dirs) {
+      outside = outside || !IsInside(dir, src);
+    }
+    if (outside) {
+      report.persons_skipped += 1;
+      report.skipped.emplace_back("'" + person.id + "': some files are located outside the source directory");
+      continue;
+    }
+
+    auto out_xml = dst / xml.lexically_relative(src);
+    std::error_code ec;
+    std::filesystem::create_directories(out_xml.parent_path(), ec);
+    if (ec || doc.SaveFile(out_xml.string().c_str()) != tinyxml2::XML_SUCCESS) {
+      std::ostringstream oss;
+      oss << "failed to write '" << out_xml.string() << "'";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+
+    // Camera parameters and the bounding box only
+    auto json = person_dir / "person.json";
+    if (std::filesystem::is_regular_file(json)) {
+      jobs.push_back(CopyJob{ json.string(), (dst / json.lexically_relative(src)).string() });
+      report.bytes += (size_t)std::filesystem::file_size(json, ec);
+    }
+
+    // Different scans may share frames
+    for (const auto &dir : dirs) {
+      if (listed_dirs.insert(dir.string()).second) {
+        TEXEL_CHECK(CollectFiles(dir, src, dst, jobs, dst_dirs, report));
+      }
+    }
+    report.persons_exported += 1;
+    report.scans_exported += n_scans;
+  }
+
+  for (const auto &dir : dst_dirs) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      std::ostringstream oss;
+      oss << "failed to create '" << dir.string() << "' (" << ec.message() << ")";
+      return ErrHandle(TEXEL_WHERE, oss.str());
+    }
+  }
+
+  // Copies are mostly metadata operations, so threads wait for the file system rather than compute
+  ThreadPool pool(std::max<size_t>(params.n_threads, 1));
+  FileCopier copier(params.allow_hardlinks);
+  std::vector<std::array<size_t, 5> > by_method(pool.Concurrency());
+  for (auto &counts : by_method) {
+    counts.fill(0);
+  }
+  std::atomic<bool> failed(false);
+  std::mutex err_mutex;
+  ErrHandle copy_err;
+  pool.ParallelFor(0, jobs.size(), 16, [&](size_t first, size_t last, size_t thread_idx) {
+    for (size_t i = first; i < last && !failed; i++) {
+      file_copy::Method method;
+      auto err = copier.Copy(jobs[i].src, jobs[i].dst, method);
+      if (err.Failed()) {
+        std::lock_guard<std::mutex> lock(err_mutex);
+        if (!failed) {
+          copy_err = err;
+          failed = true;
+        }
+        return;
+      }
+      by_method[thread_idx][(size_t)method] += 1;
+    }
+  });
+  TEXEL_CHECK(copy_err);
+
+  for (const auto &counts : by_method) {
+    for (size_t i = 0; i < counts.size(); i++) {
+      report.by_method[i] += counts[i];
+      report.files += counts[i];
+    }
+  }
+  return ErrHandle();
+}
+
+} // namespace release_export
+
+} // namespace texel
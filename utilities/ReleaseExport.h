@@ -0,0 +1,55 @@
+#pragma once
+#include "Defs.h"
+#include "FileCopy.h"
+#include "ScanogramFinder.h"
+
+namespace texel {
+
+namespace release_export {
+
+struct Params {
+  // Hard links are used if reflinks are not supported
+  // It is the fastest way, but files of the release share inodes with the original ones
+  bool allow_hardlinks;
+
+  // Number of threads that copy files, it is limited by I/O rather than by CPU
+  size_t n_threads;
+
+  Params() : allow_hardlinks(false), n_threads(8) { }
+};
+
+struct Report {
+  size_t persons_exported, persons_skipped;
+  size_t scans_exported, scans_removed;
+
+  // Depth, color and IR sections that were removed from '*.scan.xml' files
+  size_t streams_removed;
+
+  size_t files, bytes;
+
+  // How many files were copied by each method, indexed by 'file_copy::Method'
+  std::array<size_t, 5> by_method;
+
+  // Persons that were not exported, with reasons
+  std::vector<std::string> skipped;
+
+  Report()
+    : persons_exported(0), persons_skipped(0),
+      scans_exported(0), scans_removed(0),
+      streams_removed(0), files(0), bytes(0) {
+    by_method.fill(0);
+  }
+};
+
+// Builds a public release of the scans found by 'finder' (it must be bound to 'src_root')
+// Only data the persons agreed to publish is copied, the directory structure is preserved
+// Each '*.scan.xml' is rewritten without the removed streams (and scans that have no streams left)
+// Color frames are published only if the person also agreed to leave their face unblurred
+// Meshes ('portal_mx/', 'free_fusion/') are published only if all scans of the person allow it
+ErrHandle Export(ScanogramFinder &finder,
+                 const std::string &src_root, const std::string &dst_root,
+                 const Params &params, Report &report);
+
+} // namespace release_export
+
+} // namespace texel
@@ -393,31 +393,63 @@ std::string ToUserFriendly(scanogram::ScanPass type) {
 
 namespace {
 
-ErrHandle FromString(const std::string &str, size_t &value) {
-  std::istringstream iss(str);
-  if (!(iss >> value) || iss.bad()) {
+// Parses the whole range or its prefix, returns 'false' if it does not start with a number
+template <typename T>
+bool ParseChars(const char *first, const char *last, T &value) {
+  return std::from_chars(first, last, value).ec == std::errc();
+}
+
+#ifndef __cpp_lib_to_chars
+// Standard libraries before GCC 11 (and libc++) have 'std::from_chars()' only for integers
+// The classic locale keeps the decimal point whatever the global locale is
+template <>
+bool ParseChars(const char *first, const char *last, float &value) {
+  std::istringstream iss(std::string(first, last));
+  iss.imbue(std::locale::classic());
+  iss >> value;
+  return !iss.fail();
+}
+#endif
+
+// Values are views of the XML document, numbers are parsed without any allocations or copies
+// The behaviour matches 'std::istringstream': leading spaces are skipped, trailing symbols are ignored
+// Unlike it, negative values of unsigned fields are rejected instead of being wrapped around
+template <typename T>
+ErrHandle ParseNumber(std::string_view str, const char *expected, T &value) {
+  size_t begin = 0;
+  while (begin < str.size() && std::isspace((unsigned char)str[begin])) {
+    begin++;
+  }
+  if (begin < str.size() && str[begin] == '+') {
+    begin++;
+  }
+  if (!ParseChars(str.data() + begin, str.data() + str.size(), value)) {
     std::ostringstream oss;
-    oss << "failed to parse the '" << str << "' (expected to be uint)";
+    oss << "failed to parse the '" << str << "' (expected to be " << expected << ")";
     return ErrHandle(TEXEL_WHERE, oss.str());
   }
   return ErrHandle();
 }
 
-ErrHandle FromString(const std::string &str, float &value) {
-  std::istringstream iss(str);
-  if (!(iss >> value) || iss.bad()) {
-    std::ostringstream oss;
-    oss << "failed to parse the '" << str << "' (expected to be float)";
-    return ErrHandle(TEXEL_WHERE, oss.str());
-  }
-  return ErrHandle();
+ErrHandle FromString(std::string_view str, size_t &value) {
+  return ParseNumber(str, "uint", value);
+}
+
+ErrHandle FromString(std::string_view str, float &value) {
+  return ParseNumber(str, "float", value);
 }
 
-ErrHandle FromString(const std::string &str, std::string &value) {
+ErrHandle FromString(std::string_view str, std::string &value) {
   value = str;
   return ErrHandle();
 }
 
+// Enumerations are parsed by the public functions, their names fit into short strings
+template <class T>
+ErrHandle FromString(std::string_view str, T &value) {
+  return scanogram::FromString(std::string(str), value);
+}
+
 } // unnamed namespace
 
 namespace scanogram {
@@ -560,6 +592,12 @@ bool Scanogram::HasHeightValue(float &height) const {
 
 namespace {
 
+// Temporaries of parsing: views of the XML document in containers allocated from the arena of the file
+using Values = std::pmr::unordered_map<std::string_view, std::string_view>;
+using MultipleValues = std::pmr::unordered_map<std::string_view, std::pmr::vector<std::string_view> >;
+using Names = std::initializer_list<const char *>;
+using SectionNames = std::initializer_list<std::pair<const char *, bool> >;
+
 ErrHandle WrongOrMissedSection(const std::string &where,
                                const tinyxml2::XMLElement *actual,
                                const std::string &expected) {
@@ -589,10 +627,9 @@ ErrHandle WrongSectionContent(const std::string &where,
 
 // A helper that extracts and parses optional values
 template <class T>
-ErrHandle ExtractValue(const std::unordered_map<std::string, std::string> &values,
-                       const std::string &name,
+ErrHandle ExtractValue(const Values &values,
+                       const char *name,
                        bool &has_value, T &value_itself) {
-  using namespace scanogram;
   ErrHandle err;
 
   auto iter = values.find(name);
@@ -612,8 +649,8 @@ ErrHandle ExtractValue(const std::unordered_map<std::string, std::string> &value
 }
 
 template <class T>
-ErrHandle ExtractOptionalValue(const std::unordered_map<std::string, std::string> &values,
-                               const std::string &name, T &value) {
+ErrHandle ExtractOptionalValue(const Values &values,
+                               const char *name, T &value) {
   bool stub = false;
   auto err = ExtractValue(values, name, stub, value);
   if (err.Failed()) {
@@ -623,39 +660,34 @@ ErrHandle ExtractOptionalValue(const std::unordered_map<std::string, std::string
 }
 
 // Ensures that all requested attributes are presented and no unknown parameters are specified
+// There are only a few names, so they are searched linearly
 ErrHandle CheckAttributes(const tinyxml2::XMLElement *sect,
-                          const std::vector<std::string> &required_names,
-                          std::unordered_map<std::string, std::string> &values) {
+                          Names required_names,
+                          Values &values) {
   using namespace tinyxml2;
 
   values.clear();
-  std::unordered_map<std::string, size_t> refs;
-  for (const auto &name : required_names) {
-    refs[name] = 0;
-  }
+  std::pmr::vector<size_t> refs(required_names.size(), 0, values.get_allocator().resource());
 
   const XMLAttribute *attr = sect->FirstAttribute();
   while (attr != nullptr) {
-    auto iter = refs.find(attr->Name());
-    if (iter == refs.end()) {
+    auto iter = std::find_if(required_names.begin(), required_names.end(),
+                             [attr](const char *name) { return std::strcmp(name, attr->Name()) == 0; });
+    if (iter == required_names.end()) {
       std::ostringstream oss;
       oss << "met an unknown attribute ('" << attr->Name() << "')";
       return ErrHandle(TEXEL_WHERE, oss.str());
     }
-    iter->second += 1;
+    refs[(size_t)(iter - required_names.begin())] += 1;
 
-    std::string attr_value;
-    if (attr->Value() != nullptr) {
-      attr_value = attr->Value();
-    }
-    values[attr->Name()] = attr_value;
+    values[attr->Name()] = attr->Value() != nullptr ? attr->Value() : "";
     attr = attr->Next();
   }
 
-  for (const auto &ref : refs) {
-    if (ref.second != 1) {
+  for (size_t i = 0; i < refs.size(); i++) {
+    if (refs[i] != 1) {
       std::ostringstream oss;
-      oss << "value for the required attribute is not provided ('" << ref.first << "')";
+      oss << "value for the required attribute is not provided ('" << required_names.begin()[i] << "')";
       return ErrHandle(TEXEL_WHERE, oss.str());
     }
   }
@@ -666,30 +698,31 @@ ErrHandle CheckAttributes(const tinyxml2::XMLElement *sect,
 // Like 'CheckAttributes()', but checks sections and extracts values from the selected ones
 // The 'bool' flag defines single/multiple occurrence
 ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
-                        const std::unordered_map<std::string, bool> &allowed_names,
-                        std::unordered_map<std::string, std::vector<std::string>> &values) {
+                        SectionNames allowed_names,
+                        MultipleValues &values) {
+  auto find_name = [&allowed_names](std::string_view name) {
+    return std::find_if(allowed_names.begin(), allowed_names.end(),
+                        [name](const std::pair<const char *, bool> &allowed) { return name == allowed.first; });
+  };
+
   // Extract values
   const tinyxml2::XMLElement *child = sect->FirstChildElement();
   while (child != nullptr) {
-    auto iter = allowed_names.find(child->Name());
+    auto iter = find_name(child->Name());
     if (iter == allowed_names.end()) {
       std::ostringstream oss;
       oss << "section with the name '" << child->Name() << "' is not allowed here";
       auto err = ErrHandle(TEXEL_WHERE, oss.str());
       return WrongSectionContent(TEXEL_WHERE, sect, err);
     }
-    std::string text;
-    if (child->GetText() != nullptr) {
-      text = child->GetText();
-    }
-    values[child->Name()].emplace_back(text);
+    values[child->Name()].emplace_back(child->GetText() != nullptr ? child->GetText() : "");
     child = child->NextSiblingElement();
   }
 
   // Check that multiple occurrences do not violate the requirements
   for (const auto &value : values) {
-    const auto iter = allowed_names.find(value.first);
-    if (iter != allowed_names.cend() &&
+    const auto iter = find_name(value.first);
+    if (iter != allowed_names.end() &&
         !iter->second &&
         value.second.size() > 1) {
       std::ostringstream oss;
@@ -703,9 +736,9 @@ ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
 
 // A version that returns single value with such name instead of multiple ones
 ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
-                        const std::unordered_map<std::string, bool> &allowed_names,
-                        std::unordered_map<std::string, std::string> &values) {
-  std::unordered_map<std::string, std::vector<std::string>> multiple_values;
+                        SectionNames allowed_names,
+                        Values &values) {
+  MultipleValues multiple_values(values.get_allocator().resource());
   auto err = CheckSections(sect, allowed_names, multiple_values);
   if (err.Failed()) {
     return ErrHandle(TEXEL_WHERE, "trace holder", err);
@@ -721,8 +754,9 @@ ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
 
 // A version that ignores values but checks sections
 ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
-                        const std::unordered_map<std::string, bool> &allowed_names) {
-  std::unordered_map<std::string, std::vector<std::string>> tmp;
+                        SectionNames allowed_names,
+                        std::pmr::memory_resource *resource) {
+  MultipleValues tmp(resource);
   auto err = CheckSections(sect, allowed_names, tmp);
   if (err.Failed()) {
     return ErrHandle(TEXEL_WHERE, "trace holder", err);
@@ -731,6 +765,7 @@ ErrHandle CheckSections(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseInvariantPersonInfo(const tinyxml2::XMLElement *sect,
+                                   std::pmr::memory_resource *resource,
                                    scanogram::Gender &gender,
                                    bool &has_name, std::string &name,
                                    bool &has_group, scanogram::AgeGroup &group) {
@@ -741,7 +776,7 @@ ErrHandle ParseInvariantPersonInfo(const tinyxml2::XMLElement *sect,
   }
 
   // 'gender' is the required parameter
-  std::unordered_map<std::string, std::string> attrs;
+  Values attrs(resource);
   if ((err = CheckAttributes(sect, { "gender" }, attrs)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, sect, err);
   }
@@ -750,7 +785,7 @@ ErrHandle ParseInvariantPersonInfo(const tinyxml2::XMLElement *sect,
   }
 
   // 'name' and 'group' are optional
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckSections(sect,
                            { { "name", false }, { "group", false } },
                            values)).Failed()) {
@@ -766,13 +801,14 @@ ErrHandle ParseInvariantPersonInfo(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseChangeablePersonInfo(const tinyxml2::XMLElement *sect,
+                                    std::pmr::memory_resource *resource,
                                     size_t &age, float &weight, float &height) {
   if (sect == nullptr || std::string(sect->Name()) != "person") {
     return WrongOrMissedSection(TEXEL_WHERE, sect, "person");
   }
 
   ErrHandle err;
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckSections(sect,
                            { { "age", false }, { "weight", false }, { "height", false } },
                            values)).Failed()) {
@@ -789,13 +825,14 @@ ErrHandle ParseChangeablePersonInfo(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseConsents(const tinyxml2::XMLElement *sect,
+                        std::pmr::memory_resource *resource,
                         scanogram::Consents &consents) {
   if (sect == nullptr || (std::string(sect->Name())) != "consents") {
     return WrongOrMissedSection(TEXEL_WHERE, sect, "consents");
   }
 
   ErrHandle err;
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckSections(sect, {
                              { "make_depth_maps_publicly_available", false },
                              { "make_color_frames_publicly_available", false },
@@ -807,7 +844,7 @@ ErrHandle ParseConsents(const tinyxml2::XMLElement *sect,
     return WrongSectionContent(TEXEL_WHERE, sect, err);
   }
 
-  auto yes_or_no = [&values](std::string &&name, bool &value) -> ErrHandle {
+  auto yes_or_no = [&values](const char *name, bool &value) -> ErrHandle {
     bool has_value = false;
     std::string str_value;
     ErrHandle err = ExtractValue(values, name, has_value, str_value);
@@ -849,13 +886,14 @@ ErrHandle ParseConsents(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseTags(const tinyxml2::XMLElement *sect,
+                    std::pmr::memory_resource *resource,
                     scanogram::Tags &tags) {
   if (sect == nullptr || std::string(sect->Name()) != "tags") {
     return WrongOrMissedSection(TEXEL_WHERE, sect, "tags");
   }
 
   ErrHandle err;
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckSections(sect, {
                              { "hairstyle", false },
                              { "clothing", false },
@@ -879,19 +917,20 @@ ErrHandle ParseTags(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseGarments(const tinyxml2::XMLElement *sect,
+                        std::pmr::memory_resource *resource,
                         std::unordered_set<scanogram::Garment> &garments) {
   if (sect == nullptr || std::string(sect->Name()) != "garments") {
     return WrongOrMissedSection(TEXEL_WHERE, sect, "garments");
   }
 
   ErrHandle err;
-  std::unordered_map<std::string, std::vector<std::string> > values;
+  MultipleValues values(resource);
   if ((err = CheckSections(sect, { { "item", true } },
                            values)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, sect, err);
   }
 
-  std::vector<std::string> items = values["item"];
+  const auto &items = values["item"];
   for (const auto &item : items) {
     ErrHandle err;
     scanogram::Garment garment;
@@ -904,6 +943,7 @@ ErrHandle ParseGarments(const tinyxml2::XMLElement *sect,
 }
 
 ErrHandle ParseCamera(const tinyxml2::XMLElement *sect,
+                      std::pmr::memory_resource *resource,
                       Camera &camera, std::string &path) {
   if (sect == nullptr ||
       (std::string("depth") != sect->Name() &&
@@ -914,7 +954,7 @@ ErrHandle ParseCamera(const tinyxml2::XMLElement *sect,
 
   // Common parameters: directory with frames, their width and height
   ErrHandle err;
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   size_t width = 0, height = 0;
   if ((err = CheckAttributes(sect, { "path", "width", "height" }, values)).Failed() ||
       (err = FromString(values["width"], width)).Failed() ||
@@ -926,7 +966,7 @@ ErrHandle ParseCamera(const tinyxml2::XMLElement *sect,
   if ((err = CheckSections(sect, {
                              { "intrinsics", false },
                              { "extrinsics", false }
-                           })).Failed()) {
+                           }, resource)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, sect, err);
   }
 
@@ -986,6 +1026,7 @@ ErrHandle ParseCamera(const tinyxml2::XMLElement *sect,
 
 ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
                                  const std::string &parent_dir,
+                                 std::pmr::memory_resource *resource,
                                  scanogram::Stream &stream) {
   ErrHandle err;
 
@@ -997,24 +1038,24 @@ ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
                              { "depth", false },
                              { "color", false },
                              { "intensity", false }
-                           })).Failed()) {
+                           }, resource)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, stream_sect, err);
   }
 
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckAttributes(stream_sect, { "sensor", "sensor_data" }, values)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, stream_sect, err);
   }
 
   scanogram::SensorType sensor(scanogram::SensorType::Syntethic);
-  std::string sensor_data = values["sensor_data"];
+  std::string sensor_data(values["sensor_data"]);
   if ((err = FromString(values["sensor"], sensor)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, stream_sect, err);
   }
 
-  // Read information about each camera
+  // Read information about each camera ('parent_dir' is already absolute)
   auto extend_path = [&parent_dir](const std::string &path) -> auto {
-    return std::filesystem::absolute(std::filesystem::path(parent_dir) / path).string();
+    return (std::filesystem::path(parent_dir) / path).string();
   };
 
   Camera depth_camera, color_camera, ir_camera;
@@ -1022,7 +1063,7 @@ ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
   {
     auto depth_sect = stream_sect->FirstChildElement("depth");
     if (depth_sect != nullptr) {
-      if ((err = ParseCamera(depth_sect, depth_camera, depth_path)).Failed()) {
+      if ((err = ParseCamera(depth_sect, resource, depth_camera, depth_path)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, depth_sect, err);
       }
       depth_path = extend_path(depth_path);
@@ -1030,7 +1071,7 @@ ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
 
     auto color_sect = stream_sect->FirstChildElement("color");
     if (color_sect != nullptr) {
-      if ((err = ParseCamera(color_sect, color_camera, color_path)).Failed()) {
+      if ((err = ParseCamera(color_sect, resource, color_camera, color_path)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, color_sect, err);
       }
       color_path = extend_path(color_path);
@@ -1038,7 +1079,7 @@ ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
 
     auto ir_sect = stream_sect->FirstChildElement("ir");
     if (ir_sect != nullptr) {
-      if ((err = ParseCamera(ir_sect, ir_camera, ir_path)).Failed()) {
+      if ((err = ParseCamera(ir_sect, resource, ir_camera, ir_path)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, ir_sect, err);
       }
       ir_path = extend_path(ir_path);
@@ -1059,6 +1100,7 @@ ErrHandle Scanogram::ParseStream(const tinyxml2::XMLElement *stream_sect,
 
 ErrHandle Scanogram::ParseStage(const tinyxml2::XMLElement *stage_sect,
                                 const std::string &parent_dir,
+                                std::pmr::memory_resource *resource,
                                 scanogram::Stage &stage) {
   ErrHandle err;
   using namespace scanogram;
@@ -1068,7 +1110,7 @@ ErrHandle Scanogram::ParseStage(const tinyxml2::XMLElement *stage_sect,
     return WrongOrMissedSection(TEXEL_WHERE, stage_sect, "stage");
   }
 
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckAttributes(stage_sect, { "pass" }, values)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, stage_sect, err);
   }
@@ -1081,7 +1123,7 @@ ErrHandle Scanogram::ParseStage(const tinyxml2::XMLElement *stage_sect,
   if ((err = CheckSections(stage_sect, {
                              { "bounding_box", false },
                              { "stream", true }
-                           })).Failed()) {
+                           }, resource)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, stage_sect, err);
   }
 
@@ -1119,7 +1161,7 @@ ErrHandle Scanogram::ParseStage(const tinyxml2::XMLElement *stage_sect,
 
     while (stream_sect != nullptr) {
       Stream stream;
-      if ((err = ParseStream(stream_sect, parent_dir, stream)).Failed()) {
+      if ((err = ParseStream(stream_sect, parent_dir, resource, stream)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, stage_sect, err);
       }
       streams.emplace_back(std::move(stream));
@@ -1133,6 +1175,7 @@ ErrHandle Scanogram::ParseStage(const tinyxml2::XMLElement *stage_sect,
 
 ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
                                const std::string &parent_dir,
+                               std::pmr::memory_resource *resource,
                                Scanogram &scanogram) {
   ErrHandle err;
 
@@ -1141,7 +1184,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
     return WrongOrMissedSection(TEXEL_WHERE, scan_sect, "scan");
   }
 
-  std::unordered_map<std::string, std::string> values;
+  Values values(resource);
   if ((err = CheckAttributes(scan_sect, { "scanner", "date" }, values)).Failed()) {
     return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
   }
@@ -1152,7 +1195,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   }
   std::chrono::time_point<std::chrono::system_clock, std::chrono::seconds> date_time;
   {
-    std::istringstream iss(values["date"]);
+    std::istringstream iss{ std::string(values["date"]) };
     if (!(iss >> date::parse("%FT%TZ", date_time))) {
       std::ostringstream oss;
       oss << "the 'date' library failed to parse time ('" << values["date"] << "'), "
@@ -1163,7 +1206,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   }
 
   // Read additional information about the person and their consents
-  std::unordered_map<std::string, std::string> stub;
+  Values stub(resource);
   if ((err = CheckSections(scan_sect,
                           { { "person", false }, { "consents", false },
                             { "tags", false }, { "garments", false }, { "stage", true } },
@@ -1177,7 +1220,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   {
     auto person_sect = scan_sect->FirstChildElement("person");
     if (person_sect != nullptr) {
-      if ((err = ParseChangeablePersonInfo(person_sect, age,
+      if ((err = ParseChangeablePersonInfo(person_sect, resource, age,
                                            weight, height)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
       }
@@ -1189,7 +1232,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   {
     auto consents_sect = scan_sect->FirstChildElement("consents");
     if (consents_sect != nullptr) {
-      if ((err = ParseConsents(consents_sect, consents)).Failed()) {
+      if ((err = ParseConsents(consents_sect, resource, consents)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
       }
     }
@@ -1200,7 +1243,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   {
     auto tags_sect = scan_sect->FirstChildElement("tags");
     if (tags_sect != nullptr) {
-      if ((err = ParseTags(tags_sect, tags)).Failed()) {
+      if ((err = ParseTags(tags_sect, resource, tags)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
       }
     }
@@ -1211,7 +1254,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
   {
     auto garments_sect = scan_sect->FirstChildElement("garments");
     if (garments_sect != nullptr) {
-      if ((err = ParseGarments(garments_sect, garments)).Failed()) {
+      if ((err = ParseGarments(garments_sect, resource, garments)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
       }
     }
@@ -1226,7 +1269,7 @@ ErrHandle Scanogram::ParseScan(const tinyxml2::XMLElement *scan_sect,
     }
     while (stage_sect != nullptr) {
       scanogram::Stage stage;
-      if ((err = ParseStage(stage_sect, parent_dir, stage)).Failed()) {
+      if ((err = ParseStage(stage_sect, parent_dir, resource, stage)).Failed()) {
         return WrongSectionContent(TEXEL_WHERE, scan_sect, err);
       }
       stages.emplace_back(std::move(stage));
@@ -1245,9 +1288,18 @@ ErrHandle Scanogram::Load(const std::string &filename,
                           scanogram::Gender &gender,
                           std::string &name,
                           scanogram::AgeGroup &group,
-                          std::vector<Scanogram> &scanograms) {
+                          std::vector<Scanogram> &scanograms,
+                          std::pmr::memory_resource *resource) {
   using namespace tinyxml2;
   ErrHandle err;
+
+  // Temporaries of a typical file fit into this buffer
+  alignas(std::max_align_t) std::byte local_buffer[16 << 10];
+  std::pmr::monotonic_buffer_resource local_arena(local_buffer, sizeof(local_buffer));
+  if (resource == nullptr) {
+    resource = &local_arena;
+  }
+
   auto append_filename = [&filename](const std::string &where,
                                      const ErrHandle &inner) -> ErrHandle {
     std::stringstream ss;
@@ -1256,23 +1308,28 @@ ErrHandle Scanogram::Load(const std::string &filename,
   };
 
   // Parse and locate the root element
-  std::ifstream xml_stream(filename);
+  std::ifstream xml_stream(filename, std::ios::binary | std::ios::ate);
   if (!xml_stream.good()) {
     err = ErrHandle(TEXEL_WHERE, "failed to open a file with scanograms");
     return append_filename(TEXEL_WHERE, err);
   }
 
-  std::string xml;
+  // The file is read at once into the arena
+  std::pmr::string xml(resource);
   {
-    std::ostringstream oss;
-    oss << xml_stream.rdbuf();
-    xml = oss.str();
+    auto size = xml_stream.tellg();
+    xml.resize(size > 0 ? (size_t)size : 0);
+    xml_stream.seekg(0);
+    if (!xml_stream.read(&xml[0], (std::streamsize)xml.size())) {
+      err = ErrHandle(TEXEL_WHERE, "failed to read a file with scanograms");
+      return append_filename(TEXEL_WHERE, err);
+    }
   }
 
   XMLDocument doc;
   XMLElement *root = nullptr;
   {
-    if (doc.Parse(xml.c_str()) != XML_SUCCESS ||
+    if (doc.Parse(xml.data(), xml.size()) != XML_SUCCESS ||
         (root = doc.RootElement()) == nullptr) {
       err = ErrHandle(TEXEL_WHERE, "failed to recognize XML-based project format");
       return append_filename(TEXEL_WHERE, err);
@@ -1282,7 +1339,7 @@ ErrHandle Scanogram::Load(const std::string &filename,
       return append_filename(TEXEL_WHERE, err);
     }
   }
-  std::unordered_map<std::string, std::string> stub;
+  Values stub(resource);
   if ((err = CheckSections(root, { { "person", false }, { "scan", true } }, stub)).Failed()) {
     err = WrongSectionContent(TEXEL_WHERE, root, err);
     return append_filename(TEXEL_WHERE, err);
@@ -1292,7 +1349,7 @@ ErrHandle Scanogram::Load(const std::string &filename,
   auto person = root->FirstChildElement("person");
   bool has_name = false, has_group = false;
   if (person != nullptr) {
-    if ((err = ParseInvariantPersonInfo(person, gender,
+    if ((err = ParseInvariantPersonInfo(person, resource, gender,
                                         has_name, name,
                                         has_group, group)).Failed()) {
       err = WrongSectionContent(TEXEL_WHERE, person, err);
@@ -1307,11 +1364,14 @@ ErrHandle Scanogram::Load(const std::string &filename,
   }
 
   // Process each pre-recorded scanogram
-  auto parent_scan = std::filesystem::path(filename).parent_path().string();
+  // Paths of frame directories are relative to the file, so the absolute path is resolved only once
+  auto parent_path = std::filesystem::path(filename).parent_path();
+  auto parent_scan = (parent_path.empty() ? std::filesystem::current_path()
+                                          : std::filesystem::absolute(parent_path)).string();
   auto scan = root->FirstChildElement("scan");
   while (scan != nullptr) {
     Scanogram scanogram;
-    if ((err = ParseScan(scan, parent_scan, scanogram)).Failed()) {
+    if ((err = ParseScan(scan, parent_scan, resource, scanogram)).Failed()) {
       err = WrongSectionContent(TEXEL_WHERE, root, err);
       return append_filename(TEXEL_WHERE, err);
     }
@@ -429,11 +429,13 @@ class Scanogram {
 
     // Loads scanograms from our XML-based project file
     // The project provides information about only one person but may contain multiple scanograms
+    // Temporaries of parsing are allocated from 'resource' (e.g. an arena), by default a local arena is used
     static ErrHandle Load(const std::string &filename,
                           scanogram::Gender &gender,
                           std::string &name,
                           scanogram::AgeGroup &group,
-                          std::vector<Scanogram> &scanograms);
+                          std::vector<Scanogram> &scanograms,
+                          std::pmr::memory_resource *resource = nullptr);
 
   private:
     Scanogram(size_t age,
@@ -449,14 +451,17 @@ class Scanogram {
     
     static ErrHandle ParseStream(const tinyxml2::XMLElement *stream_sect,
                                  const std::string &parent_dir,
+                                 std::pmr::memory_resource *resource,
                                  scanogram::Stream &stream);
 
     static ErrHandle ParseStage(const tinyxml2::XMLElement *stage_sect,
                                 const std::string &parent_dir,
+                                std::pmr::memory_resource *resource,
                                 scanogram::Stage &stage);
 
     static ErrHandle ParseScan(const tinyxml2::XMLElement *scan_sect,
                                const std::string &parent_dir,
+                               std::pmr::memory_resource *resource,
                                Scanogram &scanogram);
 
     size_t age_;
@@ -50,18 +50,121 @@ std::string PathToIdentifier(const std::filesystem::path &params) {
   return string_id.empty() ? "scan" : string_id;
 }
 
-ErrHandle PopulateScans(const std::string &filename,
-                        std::vector<scan_finder::ScanInfo> &scans) {
+// A failure of the walk, it goes before the file 'position' of the list
+struct WalkFailure {
+  size_t position;
+  std::string dir;
+  ErrHandle error;
+};
+
+// Lists '*.scan.xml' files in the order of 'recursive_directory_iterator'
+// Unlike it, the walk goes on after an error: only the directory that cannot be listed is skipped
+void ListScanFiles(const std::filesystem::path &root, std::vector<std::string> &files,
+                   std::vector<WalkFailure> &failures) {
+  auto fail = [&](const std::filesystem::path &dir, const std::error_code &ec, const char *skipped) {
+    std::ostringstream oss;
+    oss << "failed to list '" << dir.string() << "', " << skipped << " (" << ec.message() << ")";
+    failures.push_back(WalkFailure{files.size(), dir.string(), ErrHandle(TEXEL_WHERE, oss.str())});
+  };
+
+  std::vector<std::filesystem::path> dirs;
+  std::vector<std::filesystem::directory_iterator> stack;
+  auto open = [&](const std::filesystem::path &dir) {
+    std::error_code ec;
+    std::filesystem::directory_iterator iter(dir, std::filesystem::directory_options::skip_permission_denied, ec);
+    if (ec) {
+      fail(dir, ec, "its subtree is skipped");
+      return;
+    }
+    dirs.push_back(dir);
+    stack.push_back(std::move(iter));
+  };
+
+  open(root);
+  while (!stack.empty()) {
+    if (stack.back() == std::filesystem::directory_iterator()) {
+      dirs.pop_back();
+      stack.pop_back();
+      continue;
+    }
+    std::filesystem::directory_entry entry = *stack.back();
+
+    // The rest of the directory is lost if it cannot be advanced, its subdirectories are still walked
+    std::error_code ec;
+    stack.back().increment(ec);
+    if (ec) {
+      fail(dirs.back(), ec, "the rest of it is skipped");
+      dirs.pop_back();
+      stack.pop_back();
+    }
+
+    // Symbolic links to directories are not followed, as in 'recursive_directory_iterator'
+    std::error_code entry_ec;
+    if (entry.is_directory(entry_ec) && !entry.is_symlink(entry_ec)) {
+      open(entry.path());
+    }
+    else if (entry.is_regular_file(entry_ec) && HasScanXmlExtension(entry.path().string())) {
+      files.emplace_back(entry.path().string());
+    }
+  }
+}
+
+} // unnamed namespace
+
+//-------------------
+//--- scan_finder ---
+//-------------------
+
+namespace scan_finder {
+
+Metrics &Metrics::Get() {
+  static Metrics instance = []() {
+    auto &registry = metrics::Registry::Default();
+    Metrics result;
+    result.files_parsed    = &registry.GetCounter("texel_scan_files_parsed_total", "Parsed '*.scan.xml' files");
+    result.files_failed    = &registry.GetCounter("texel_scan_files_failed_total",
+                                                  "'*.scan.xml' files that failed to parse");
+    result.scans_found     = &registry.GetCounter("texel_scans_found_total", "Scans found in parsed files");
+    result.scans_processed = &registry.GetCounter("texel_scans_processed_total",
+                                                  "Scans processed by 'ForEach()' and 'ForEachOrdered()'");
+    result.process_seconds = &registry.GetHistogram("texel_scan_process_seconds", "Time to process a scan");
+    result.in_progress     = &registry.GetGauge("texel_scans_in_progress", "Scans being processed at the moment");
+    result.waiting         = &registry.GetGauge("texel_scan_results_waiting",
+                                                "Processed scans waiting for the preceding ones");
+    return result;
+  }();
+  return instance;
+}
+
+} // namespace scan_finder
+
+//-------------------
+//--- ScansFinder ---
+//-------------------
+
+ErrHandle ScanogramFinder::ParseFile(const std::string &filename, std::pmr::memory_resource *upstream,
+                                     std::unique_ptr<std::byte[]> &arena_buffer,
+                                     std::vector<scan_finder::ScanInfo> &scans) {
+  // All temporaries of the file are released at once, the buffer is reused for the next file
+  const size_t arena_size = 64 << 10;
+  if (arena_buffer == nullptr) {
+    arena_buffer.reset(new std::byte[arena_size]);
+  }
+  std::pmr::monotonic_buffer_resource arena(arena_buffer.get(), arena_size, upstream);
+
   std::string name;
   scanogram::Gender gender = scanogram::Gender::Neutral;
   scanogram::AgeGroup group = scanogram::AgeGroup::NA;
   std::vector<Scanogram> new_scans;
-  auto err = Scanogram::Load(filename, gender, name, group, new_scans);
+  auto err = Scanogram::Load(filename, gender, name, group, new_scans, &arena);
+  auto &counters = scan_finder::Metrics::Get();
+  (err.Succeeded() ? counters.files_parsed : counters.files_failed)->Add(1);
   if (err.Failed()) {
     std::ostringstream oss;
     oss << "failed to open pre-recorded scanograms from a file '" << filename << "'";
     return ErrHandle(TEXEL_WHERE, oss.str(), err);
   }
+  counters.scans_found->Add(new_scans.size());
 
   auto id_prefix = PathToIdentifier(filename);
   for (size_t i = 0; i < new_scans.size(); i++) {
@@ -71,16 +174,14 @@ ErrHandle PopulateScans(const std::string &filename,
       oss << "_" << i;
     }
 
-    scans.emplace_back(scan_finder::ScanInfo(new_scans[i], name, group, gender, oss.str()));
+    scans.emplace_back(scan_finder::ScanInfo(new_scans[i], name, group, gender, oss.str(), filename));
   }
   return ErrHandle();
 }
 
-} // unnamed namespace
-
-//-------------------
-//--- ScansFinder ---
-//-------------------
+ErrHandle ScanogramFinder::PopulateScans(const std::string &filename) {
+  return ParseFile(filename, upstream_, arena_buffer_, scans_);
+}
 
 ErrHandle ScanogramFinder::BindFile(const std::string &filename) {
   cur_scan_ = -1;
@@ -94,7 +195,7 @@ ErrHandle ScanogramFinder::BindFile(const std::string &filename) {
     return ErrHandle(TEXEL_WHERE, oss.str());
   }
 
-  auto err = PopulateScans(filename, scans_);
+  auto err = PopulateScans(filename);
   if (err.Failed()) {
     return ErrHandle(TEXEL_WHERE, "trace holder", err);
   }
@@ -102,24 +203,81 @@ ErrHandle ScanogramFinder::BindFile(const std::string &filename) {
 }
 
 ErrHandle ScanogramFinder::BindDirectory(const std::string &dir) {
+  scan_finder::BindParams params;
+  params.tolerant = false;
+  scan_finder::BindReport report;
+  return BindDirectory(dir, params, report);
+}
+
+ErrHandle ScanogramFinder::BindDirectory(const std::string &dir, const scan_finder::BindParams &params,
+                                         scan_finder::BindReport &report, ThreadPool &pool) {
   cur_scan_ = -1;
   scans_.clear();
+  report = scan_finder::BindReport();
 
   std::filesystem::path path(dir);
   if (!std::filesystem::is_directory(path)) {
     return ErrHandle(TEXEL_WHERE, "'path' must refer to a directory");
   }
-  
-  for (const auto &iter : std::filesystem::recursive_directory_iterator(path)) {
-    if (std::filesystem::is_regular_file(iter.path()) &&
-        HasScanXmlExtension(iter.path().string())) {
-      auto err = PopulateScans(iter.path().string(), scans_);
-      if (err.Failed()) {
-        return ErrHandle(TEXEL_WHERE, "trace holder", err);
+
+  // The walk itself does not throw, unreadable directories are skipped
+  std::vector<std::string> files;
+  std::vector<WalkFailure> walk_failures;
+  ListScanFiles(path, files, walk_failures);
+  if (!params.tolerant && !walk_failures.empty()) {
+    return walk_failures.front().error;
+  }
+  report.n_files = files.size();
+
+  // Scans of each file are kept apart until all files are parsed, so their order does not depend on threads
+  std::vector<std::vector<scan_finder::ScanInfo> > scans(files.size());
+  std::vector<ErrHandle> errors(files.size());
+  // A strict bind reports the first broken file in the walk order, so only files after the earliest
+  // failure seen so far are skipped, the ones before it are still parsed
+  std::atomic<size_t> first_failure(files.size());
+  if (params.parallel && files.size() > 1) {
+    std::pmr::synchronized_pool_resource shared_upstream(upstream_);
+    std::vector<std::unique_ptr<std::byte[]> > arena_buffers(pool.Concurrency());
+    pool.ParallelFor(0, files.size(), 1, [&](size_t first, size_t last, size_t thread_idx) {
+      for (size_t i = first; i < last && (params.tolerant || i < first_failure); i++) {
+        errors[i] = ParseFile(files[i], &shared_upstream, arena_buffers[thread_idx], scans[i]);
+        if (errors[i].Failed()) {
+          size_t current = first_failure;
+          while (i < current && !first_failure.compare_exchange_weak(current, i)) {
+          }
+        }
+      }
+    });
+  }
+  else {
+    for (size_t i = 0; i < files.size() && (params.tolerant || i < first_failure); i++) {
+      errors[i] = ParseFile(files[i], upstream_, arena_buffer_, scans[i]);
+      if (errors[i].Failed()) {
+        first_failure = std::min<size_t>(first_failure, i);
       }
     }
   }
 
+  // Walk failures are merged with the broken files, so the report follows the walk order
+  auto walk_failure = walk_failures.begin();
+  for (size_t i = 0; i < files.size(); i++) {
+    for (; walk_failure != walk_failures.end() && walk_failure->position <= i; ++walk_failure) {
+      report.failures.emplace_back(walk_failure->dir, walk_failure->error);
+    }
+    if (errors[i].Failed()) {
+      if (!params.tolerant) {
+        return ErrHandle(TEXEL_WHERE, "trace holder", errors[i]);
+      }
+      report.failures.emplace_back(files[i], errors[i]);
+      continue;
+    }
+    for (auto &info : scans[i]) {
+      scans_.emplace_back(std::move(info));
+    }
+  }
+  for (; walk_failure != walk_failures.end(); ++walk_failure) {
+    report.failures.emplace_back(walk_failure->dir, walk_failure->error);
+  }
   return ErrHandle();
 }
 
@@ -142,4 +300,18 @@ const scan_finder::ScanInfo &ScanogramFinder::Current() const {
   }
 }
 
+void ScanogramFinder::ForEach(const std::function<void(const scan_finder::ScanInfo &, size_t)> &func,
+                              ThreadPool &pool) const {
+  auto &counters = scan_finder::Metrics::Get();
+  pool.ParallelFor(0, scans_.size(), 1, [&](size_t first, size_t last, size_t thread_idx) {
+    for (size_t i = first; i < last; i++) {
+      {
+        metrics::ScopedTimer timer(counters.process_seconds, counters.in_progress);
+        func(scans_[i], thread_idx);
+      }
+      counters.scans_processed->Add(1);
+    }
+  });
+}
+
 } // namespace texel
@@ -1,5 +1,7 @@
 #pragma once
 #include "Defs.h"
+#include "Metrics.h"
+#include "Parallel.h"
 #include "Scanogram.h"
 
 namespace texel {
@@ -13,6 +15,7 @@ struct ScanInfo {
   scanogram::AgeGroup group;
   scanogram::Gender gender;
   std::string id;
+  std::string path;       // the '*.scan.xml' file, other data of the person is located nearby
 
   ScanInfo()
     : name("NA"),
@@ -23,9 +26,10 @@ struct ScanInfo {
            const std::string &name_,
            scanogram::AgeGroup group_,
            scanogram::Gender gender_,
-           const std::string &id_) noexcept
+           const std::string &id_,
+           const std::string &path_) noexcept
     : scan(std::move(scan_)), name(name_), group(group_),
-      gender(gender_), id(id_) {
+      gender(gender_), id(id_), path(path_) {
   }
   ScanInfo(ScanInfo &) = delete;
   ScanInfo(ScanInfo &&) noexcept = default;
@@ -33,13 +37,55 @@ struct ScanInfo {
   ScanInfo &operator =(ScanInfo &&) noexcept = default;
 };
 
+struct BindParams {
+  // Files that fail to parse are skipped and reported instead of failing the whole bind
+  bool tolerant;
+
+  // Files are parsed concurrently on the pool, the order of scans stays the same
+  bool parallel;
+
+  BindParams() : tolerant(true), parallel(true) { }
+};
+
+// A file (or a directory that cannot be listed) skipped by a tolerant bind
+struct BindFailure {
+  std::string path;
+  ErrHandle error;
+
+  BindFailure(const std::string &path_, const ErrHandle &error_) : path(path_), error(error_) { }
+};
+
+struct BindReport {
+  size_t n_files;                       // '*.scan.xml' files found, including the failed ones
+  std::vector<BindFailure> failures;    // in the order of the directory walk
+
+  BindReport() : n_files(0) { }
+};
+
+// Metrics of all finders, see 'metrics::Registry'
+struct Metrics {
+  metrics::Counter *files_parsed, *files_failed, *scans_found, *scans_processed;
+  metrics::Histogram *process_seconds;
+  metrics::Gauge *in_progress, *waiting;    // 'waiting' are results of 'ForEachOrdered()' not consumed yet
+
+  static Metrics &Get();
+};
+
 } // namespace scan_finder
 
 
 // Searches for scans located somewhere on disk
+// 'FindNext()' and 'Current()' share a cursor, so only 'Size()', 'At()' and 'ForEach()' are safe
+// to call from many threads at once
 class ScanogramFinder {
   public:
-    ScanogramFinder() : cur_scan_(-1) { }
+    ScanogramFinder() : cur_scan_(-1), upstream_(std::pmr::get_default_resource()) { }
+
+    // Temporaries of parsing are allocated from a reusable per-file arena,
+    // the arena takes memory from 'upstream' only if a file does not fit its buffer
+    explicit ScanogramFinder(std::pmr::memory_resource *upstream)
+      : cur_scan_(-1), upstream_(upstream) {
+    }
     ScanogramFinder(const ScanogramFinder &) = delete;
     ScanogramFinder &operator =(const ScanogramFinder &) = delete;
 
@@ -51,6 +97,13 @@ class ScanogramFinder {
     // enumerates all the scans (*.scan.xml) they contain
     ErrHandle BindDirectory(const std::string &dir);
 
+    // The same with options, a tolerant bind fails only if 'dir' is not a directory
+    // and keeps the scans of all valid files, a strict one fails on the first broken file in the walk
+    // order, with or without concurrent parsing. With concurrent parsing, 'upstream' is accessed
+    // through a synchronized pool, so it does not have to be thread-safe
+    ErrHandle BindDirectory(const std::string &dir, const scan_finder::BindParams &params,
+                            scan_finder::BindReport &report, ThreadPool &pool = ThreadPool::Default());
+
     // Resets the built-in enumerator
     void Reset() { cur_scan_ = -1; }
 
@@ -61,10 +114,156 @@ class ScanogramFinder {
     // Returns the current scannogram provided by 'FindNext()'
     const scan_finder::ScanInfo &Current() const;
 
+    // The bound scans in the order of 'FindNext()'
+    size_t Size() const { return scans_.size(); }
+    const scan_finder::ScanInfo &At(size_t idx) const { return scans_[idx]; }
+
+    // Calls 'func(info, thread_idx)' for all bound scans concurrently, 'thread_idx' is less than
+    // 'pool.Concurrency()', so per-thread accumulators (counters, etc) need no locks
+    // Scans are handed out one at a time, so a few heavy scans do not hold up the others
+    void ForEach(const std::function<void(const scan_finder::ScanInfo &, size_t)> &func,
+                 ThreadPool &pool = ThreadPool::Default()) const;
+
+    // The ordered version: 'process(info, thread_idx)' runs concurrently and returns a result,
+    // 'consume(info, result)' is called on the calling thread in the order of scans
+    // A result is consumed as soon as it and all preceding ones are ready, a scan is not processed
+    // until fewer than '4 * pool.Concurrency()' results wait before it, so a slow consumer bounds memory
+    // The first exception of either callback stops the processing and is rethrown here
+    // Called from inside a job of any pool, scans are processed and consumed one by one on the calling
+    // thread (the pool accepts one job at a time, so feeding it from another thread would deadlock)
+    // For the same reason, 'ParallelFor()' calls of 'consume' and 'process' (of any pool) run inline
+    // on their threads, they do not use the pool's workers
+    template <typename Process, typename Consume>
+    void ForEachOrdered(Process process, Consume consume, ThreadPool &pool = ThreadPool::Default()) const;
+
   private:
+    ErrHandle PopulateScans(const std::string &filename);
+
+    // Parses the file into 'scans', the arena buffer is allocated on the first use
+    static ErrHandle ParseFile(const std::string &filename, std::pmr::memory_resource *upstream,
+                               std::unique_ptr<std::byte[]> &arena_buffer,
+                               std::vector<scan_finder::ScanInfo> &scans);
+
     std::vector<scan_finder::ScanInfo> scans_;
     int cur_scan_;
     scan_finder::ScanInfo empty_scan_;
+
+    std::pmr::memory_resource *upstream_;
+    std::unique_ptr<std::byte[]> arena_buffer_;
 };
 
+template <typename Process, typename Consume>
+void ScanogramFinder::ForEachOrdered(Process process, Consume consume, ThreadPool &pool) const {
+  using Result = std::decay_t<std::invoke_result_t<Process &, const scan_finder::ScanInfo &, size_t> >;
+  auto &counters = scan_finder::Metrics::Get();
+
+  if (ThreadPool::InsideJob()) {
+    for (const auto &info : scans_) {
+      std::optional<Result> result;
+      {
+        metrics::ScopedTimer timer(counters.process_seconds, counters.in_progress);
+        result.emplace(process(info, 0));
+      }
+      counters.scans_processed->Add(1);
+      consume(info, std::move(*result));
+    }
+    return;
+  }
+
+  // Results wait in a ring, the scan 'i' takes the slot 'i % max_pending'
+  const size_t max_pending = 4 * pool.Concurrency();
+  std::vector<std::optional<Result> > pending(max_pending);
+  size_t consumed = 0;
+  bool stop = false;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable ready, room;
+
+  auto fail = [&](std::exception_ptr e) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (error == nullptr) {
+        error = e;
+      }
+      stop = true;
+    }
+    ready.notify_one();
+    room.notify_all();
+  };
+
+  // The pool is fed from another thread, so this one is free to consume
+  // Scans are handed out in order, so the one the consumer waits for never waits for room
+  auto producer = std::async(std::launch::async, [&]() {
+    try {
+      pool.ParallelFor(0, scans_.size(), 1, [&](size_t first, size_t last, size_t thread_idx) {
+        for (size_t i = first; i < last; i++) {
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            room.wait(lock, [&]() { return stop || i < consumed + max_pending; });
+            if (stop) {
+              return;
+            }
+          }
+
+          // Exceptions must not escape into the pool
+          try {
+            std::optional<Result> result;
+            {
+              metrics::ScopedTimer timer(counters.process_seconds, counters.in_progress);
+              result.emplace(process(scans_[i], thread_idx));
+            }
+            counters.scans_processed->Add(1);
+            counters.waiting->Add(1);
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              pending[i % max_pending] = std::move(result);
+            }
+            ready.notify_one();
+          }
+          catch (...) {
+            fail(std::current_exception());
+          }
+        }
+      });
+    }
+    catch (...) {
+      fail(std::current_exception());
+    }
+  });
+
+  try {
+    for (size_t i = 0; i < scans_.size(); i++) {
+      auto &slot = pending[i % max_pending];
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [&]() { return stop || slot.has_value(); });
+      if (stop) {
+        break;
+      }
+      Result result = std::move(*slot);
+      slot.reset();
+      consumed = i + 1;
+      lock.unlock();
+      room.notify_all();
+      counters.waiting->Add(-1);
+
+      // The pool is busy with the producer's job, so jobs that 'consume' submits run inline
+      ThreadPool::InlineScope inline_scope;
+      consume(scans_[i], std::move(result));
+    }
+  }
+  catch (...) {
+    fail(std::current_exception());
+  }
+  producer.get();
+
+  for (const auto &slot : pending) {
+    if (slot.has_value()) {
+      counters.waiting->Add(-1);
+    }
+  }
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
 } // namespace texel
@@ -0,0 +1,557 @@
+#include "SharedFrameCache.h"
+#include "Hash.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace texel {
+
+namespace {
+
+ErrHandle SystemError(const std::string &where, const std::string &what, const std::string &name, int code) {
+  std::ostringstream oss;
+  oss << "failed to " << what << " '" << name << "' ("
+      << std::error_code(code, std::generic_category()).message() << ")";
+  return ErrHandle(where, oss.str());
+}
+
+size_t FrameBytes(const DepthFrame &frame) {
+  return frame.Width() * frame.Height() * sizeof(uint16_t);
+}
+
+size_t FrameBytes(const ColorFrame &frame) {
+  return frame.Width() * frame.Height() * ColorFrame::Channels;
+}
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // unnamed namespace
+
+#ifdef __linux__
+
+namespace {
+
+// Processes of the cache see each other's atomics only if they need no locks
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "lock-free 64-bit atomics are required");
+
+const uint64_t Magic   = 0x31454843434c4554ull;   // "TELCCHE1"
+const size_t   Ways    = 8;                         // entries in a bucket
+
+// The state of an entry: the valid bit, the generation (changes on eviction) and references
+const uint64_t ValidBit       = 1ull << 63;
+const uint64_t GenerationStep = 1ull << 32;
+const uint64_t GenerationMask = ValidBit - GenerationStep;
+const uint64_t RefsMask       = GenerationStep - 1;
+
+// Defined by the process that creates the cache
+struct Layout {
+  uint64_t budget, chunk_size, n_chunks, n_buckets;
+  uint64_t entries_offset, chunk_map_offset, data_offset, total_size;
+};
+
+// Locks the process-shared mutex
+// A process may die while holding it, at worst the chunks it was about to use or free are lost
+class SharedLock {
+  public:
+    explicit SharedLock(pthread_mutex_t &mutex) : mutex_(mutex) {
+      if (pthread_mutex_lock(&mutex_) == EOWNERDEAD) {
+        pthread_mutex_consistent(&mutex_);
+      }
+    }
+    SharedLock(const SharedLock &) = delete;
+    SharedLock &operator =(const SharedLock &) = delete;
+    ~SharedLock() { pthread_mutex_unlock(&mutex_); }
+
+  private:
+    pthread_mutex_t &mutex_;
+};
+
+} // unnamed namespace
+
+//--------------------------------------------
+//--- SharedFrameCache::Header and ::Entry ---
+//--------------------------------------------
+
+struct SharedFrameCache::Header {
+  std::atomic<uint64_t> magic;    // written last by the creator
+  Layout layout;
+
+  // Guards inserts, evictions and the chunk map
+  pthread_mutex_t mutex;
+
+  std::atomic<uint64_t> clock;    // ticks on each use of a frame
+  std::atomic<uint64_t> hits, misses, evictions, frames, bytes;
+};
+
+// Readers check the key only while the entry is valid and pinned, so the fields besides 'state'
+// change only when nobody can see them
+struct alignas(64) SharedFrameCache::Entry {
+  std::atomic<uint64_t> state;
+  std::atomic<uint64_t> hash[2], idx_kind;
+  std::atomic<uint64_t> last_used;
+  uint64_t first_chunk, n_chunks, bytes;
+  uint32_t width, height;
+
+  bool Matches(const Key &key) const {
+    return hash[0].load(std::memory_order_relaxed) == key.hash[0] &&
+           hash[1].load(std::memory_order_relaxed) == key.hash[1] &&
+           idx_kind.load(std::memory_order_relaxed) == key.idx_kind;
+  }
+};
+
+//------------------------
+//--- SharedFrameCache ---
+//------------------------
+
+SharedFrameCache::SharedFrameCache()
+  : fd_(-1), mapped_size_(0), data_size_(0), base_(nullptr), writable_(nullptr), data_(nullptr),
+    header_(nullptr), entries_(nullptr), chunk_map_(nullptr) {
+}
+
+SharedFrameCache::~SharedFrameCache() {
+  Close();
+}
+
+void SharedFrameCache::Close() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<uint8_t *>(data_), data_size_);
+  }
+  if (base_ != nullptr) {
+    ::munmap(base_, mapped_size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  mapped_size_ = data_size_ = 0;
+  base_ = writable_ = nullptr;
+  data_ = nullptr;
+  header_ = nullptr;
+  entries_ = nullptr;
+  chunk_map_ = nullptr;
+}
+
+ErrHandle SharedFrameCache::Open(const shared_cache::Params &params) {
+  Close();
+  const auto &name = params.name;
+  Layout layout;
+  bool created = false;
+  for (size_t attempt = 0; ; attempt++) {
+    created = true;
+    fd_ = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd_ < 0 && errno == EEXIST) {
+      created = false;
+      fd_ = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0600);
+    }
+    if (fd_ < 0) {
+      return SystemError(TEXEL_WHERE, "open the shared memory object", name, errno);
+    }
+    if (created) {
+      break;
+    }
+
+    // The creator may still be initializing the cache
+    uint64_t magic = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (magic != Magic && std::chrono::steady_clock::now() <= deadline) {
+      struct stat info;
+      if (::fstat(fd_, &info) != 0) {
+        int code = errno;
+        Close();
+        return SystemError(TEXEL_WHERE, "inspect the shared memory object", name, code);
+      }
+      if ((size_t)info.st_size >= sizeof(Header)) {
+        void *mapped = ::mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapped == MAP_FAILED) {
+          int code = errno;
+          Close();
+          return SystemError(TEXEL_WHERE, "map the shared memory object", name, code);
+        }
+        auto header = static_cast<const Header *>(mapped);
+        magic = header->magic.load(std::memory_order_acquire);
+        if (magic == Magic) {
+          layout = header->layout;
+        }
+        ::munmap(mapped, sizeof(Header));
+      }
+      if (magic != Magic) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    if (magic == Magic) {
+      break;
+    }
+    if (magic != 0 || attempt > 0) {
+      Close();
+      return ErrHandle(TEXEL_WHERE, "the shared memory object '" + name + "' is not a frame cache");
+    }
+
+    // The creator died before publishing the cache, so the name is reclaimed once,
+    // unless another process has already replaced the object
+    int current = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0600);
+    if (current >= 0) {
+      struct stat ours, theirs;
+      bool same = ::fstat(fd_, &ours) == 0 && ::fstat(current, &theirs) == 0 &&
+                  ours.st_dev == theirs.st_dev && ours.st_ino == theirs.st_ino;
+      ::close(current);
+      if (same) {
+        ::shm_unlink(name.c_str());
+      }
+    }
+    Close();
+  }
+
+  if (created) {
+    size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+    layout.chunk_size = AlignUp(std::max<size_t>(params.chunk_size, 4096), 64);
+    layout.n_chunks   = std::max<size_t>(params.budget / layout.chunk_size, 1);
+    layout.budget     = layout.n_chunks * layout.chunk_size;
+    size_t max_frames = params.max_frames > 0 ? params.max_frames : layout.budget / (256 << 10);
+    layout.n_buckets  = std::max<size_t>((max_frames + Ways - 1) / Ways, 1);
+    layout.entries_offset   = AlignUp(sizeof(Header), 64);
+    layout.chunk_map_offset = AlignUp(layout.entries_offset + layout.n_buckets * Ways * sizeof(Entry), 64);
+    layout.data_offset      = AlignUp(layout.chunk_map_offset + (layout.n_chunks + 63) / 64 * 8, page);
+    layout.total_size       = layout.data_offset + layout.n_chunks * layout.chunk_size;
+
+    // The memory is reserved now, otherwise a full /dev/shm would kill the process on its first write
+    int code = ::posix_fallocate(fd_, 0, (off_t)layout.total_size);
+    if (code != 0) {
+      ::shm_unlink(name.c_str());
+      Close();
+      return SystemError(TEXEL_WHERE, "reserve " + std::to_string(layout.total_size >> 20) + " MB for",
+                         name, code);
+    }
+  }
+  else {
+    // Touching pages past the end of the object would raise SIGBUS, so a truncated or damaged cache is rejected
+    struct stat info;
+    if (::fstat(fd_, &info) != 0) {
+      int code = errno;
+      Close();
+      return SystemError(TEXEL_WHERE, "inspect the shared memory object", name, code);
+    }
+    bool consistent =
+        layout.chunk_size > 0 && layout.n_buckets > 0 && layout.n_chunks > 0 &&
+        layout.entries_offset >= sizeof(Header) &&
+        layout.chunk_map_offset >= layout.entries_offset + layout.n_buckets * Ways * sizeof(Entry) &&
+        layout.data_offset >= layout.chunk_map_offset + (layout.n_chunks + 63) / 64 * 8 &&
+        layout.total_size == layout.data_offset + layout.n_chunks * layout.chunk_size;
+    if (!consistent) {
+      Close();
+      return ErrHandle(TEXEL_WHERE, "the frame cache '" + name + "' has an inconsistent layout");
+    }
+    if ((uint64_t)info.st_size < layout.total_size) {
+      Close();
+      return ErrHandle(TEXEL_WHERE, "the frame cache '" + name + "' is truncated (" +
+                       std::to_string(info.st_size) + " of " + std::to_string(layout.total_size) + " bytes)");
+    }
+  }
+
+  void *mapped = ::mmap(nullptr, layout.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapped == MAP_FAILED) {
+    int code = errno;
+    Close();
+    return SystemError(TEXEL_WHERE, "map the shared memory object", name, code);
+  }
+  base_ = static_cast<uint8_t *>(mapped);
+  mapped_size_ = layout.total_size;
+
+  // Frames are handed out through a separate read-only view, so a stray write cannot corrupt them
+  data_size_ = layout.total_size - layout.data_offset;
+  mapped = ::mmap(nullptr, data_size_, PROT_READ, MAP_SHARED, fd_, (off_t)layout.data_offset);
+  if (mapped == MAP_FAILED) {
+    int code = errno;
+    data_size_ = 0;
+    Close();
+    return SystemError(TEXEL_WHERE, "map the shared memory object", name, code);
+  }
+  data_      = static_cast<const uint8_t *>(mapped);
+  writable_  = base_ + layout.data_offset;
+  header_    = reinterpret_cast<Header *>(base_);
+  entries_   = reinterpret_cast<Entry *>(base_ + layout.entries_offset);
+  chunk_map_ = reinterpret_cast<uint64_t *>(base_ + layout.chunk_map_offset);
+
+  if (created) {
+    // The memory is zeroed, so the entries are already invalid and all chunks are free
+    header_ = new (base_) Header();
+    header_->layout = layout;
+    for (size_t i = 0; i < layout.n_buckets * Ways; i++) {
+      new (&entries_[i]) Entry();
+    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header_->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    header_->magic.store(Magic, std::memory_order_release);
+  }
+  return ErrHandle();
+}
+
+ErrHandle SharedFrameCache::Remove(const std::string &name) {
+  if (::shm_unlink(name.c_str()) != 0 && errno != ENOENT) {
+    return SystemError(TEXEL_WHERE, "remove the shared memory object", name, errno);
+  }
+  return ErrHandle();
+}
+
+ErrHandle SharedFrameCache::Depth(const std::string &stream, size_t idx, const std::string &filename,
+                                  SharedDepthFrame &frame) {
+  return Get<DepthFrame>(Kind::Depth, stream, idx, filename, frame);
+}
+
+ErrHandle SharedFrameCache::Color(const std::string &stream, size_t idx, const std::string &filename,
+                                  SharedColorFrame &frame) {
+  return Get<ColorFrame>(Kind::Color, stream, idx, filename, frame);
+}
+
+template <typename Frame, typename Shared>
+ErrHandle SharedFrameCache::Get(Kind kind, const std::string &stream, size_t idx, const std::string &filename,
+                                Shared &frame) {
+  frame.Reset();
+  if (header_ == nullptr) {
+    return ErrHandle(TEXEL_WHERE, "the shared frame cache is not opened");
+  }
+
+  // Two independent hashes, a collision of 128 bits is not a concern
+  Key key;
+  key.idx_kind = (uint64_t)idx * 2 + (kind == Kind::Color);
+  for (uint64_t seed : { 0, 1 }) {
+    Xxh64 hasher(seed);
+    hasher.Update(stream.data(), stream.size());
+    hasher.Update(&key.idx_kind, sizeof(key.idx_kind));
+    key.hash[seed] = hasher.Digest();
+  }
+  if (Find(key, frame)) {
+    header_->hits.fetch_add(1, std::memory_order_relaxed);
+    return ErrHandle();
+  }
+  header_->misses.fetch_add(1, std::memory_order_relaxed);
+
+  // Decoding is the expensive part, so the cache is not locked meanwhile
+  auto decoded = std::make_shared<Frame>();
+  TEXEL_CHECK(Frame::Load(filename, *decoded));
+  if (Insert(key, reinterpret_cast<const uint8_t *>(decoded->Data()), decoded->Width(), decoded->Height(),
+             FrameBytes(*decoded), frame)) {
+    return ErrHandle();
+  }
+
+  // All memory is held by other frames, this one stays private
+  frame.data_    = decoded->Data();
+  frame.width_   = decoded->Width();
+  frame.height_  = decoded->Height();
+  frame.private_ = std::move(decoded);
+  return ErrHandle();
+}
+
+template <typename Shared>
+bool SharedFrameCache::Find(const Key &key, Shared &frame) {
+  Entry *bucket = Bucket(key);
+  for (size_t way = 0; way < Ways; way++) {
+    auto &entry = bucket[way];
+    uint64_t state = entry.state.load(std::memory_order_acquire);
+
+    // The key is read before pinning, the successful exchange proves the entry has not changed since
+    while ((state & ValidBit) != 0 && (state & RefsMask) != RefsMask && entry.Matches(key)) {
+      if (entry.state.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+        Pin(entry, frame);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Shared>
+bool SharedFrameCache::Insert(const Key &key, const uint8_t *data, size_t width, size_t height, size_t bytes,
+                              Shared &frame) {
+  size_t chunk_size = header_->layout.chunk_size;
+  size_t n_chunks = (bytes + chunk_size - 1) / chunk_size;
+  if (n_chunks == 0 || n_chunks > header_->layout.n_chunks) {
+    return false;
+  }
+
+  SharedLock lock(header_->mutex);
+  // Another process may have inserted the frame meanwhile
+  if (Find(key, frame)) {
+    return true;
+  }
+
+  // A free entry of the bucket or the least recently used one that is not pinned
+  Entry *bucket = Bucket(key), *slot = nullptr;
+  for (size_t way = 0; way < Ways && slot == nullptr; way++) {
+    if ((bucket[way].state.load(std::memory_order_acquire) & ValidBit) == 0) {
+      slot = &bucket[way];
+    }
+  }
+  while (slot == nullptr) {
+    Entry *victim = nullptr;
+    for (size_t way = 0; way < Ways; way++) {
+      uint64_t state = bucket[way].state.load(std::memory_order_acquire);
+      if ((state & ValidBit) != 0 && (state & RefsMask) == 0 && (victim == nullptr ||
+          bucket[way].last_used.load(std::memory_order_relaxed) < victim->last_used.load(std::memory_order_relaxed))) {
+        victim = &bucket[way];
+      }
+    }
+    if (victim == nullptr) {
+      return false;
+    }
+    // It fails if the victim has just been pinned
+    if (Evict(*victim)) {
+      slot = victim;
+    }
+  }
+
+  size_t first = 0;
+  if (!Allocate(n_chunks, first)) {
+    return false;
+  }
+  std::memcpy(writable_ + first * chunk_size, data, bytes);
+  slot->hash[0].store(key.hash[0], std::memory_order_relaxed);
+  slot->hash[1].store(key.hash[1], std::memory_order_relaxed);
+  slot->idx_kind.store(key.idx_kind, std::memory_order_relaxed);
+  slot->first_chunk = first;
+  slot->n_chunks    = n_chunks;
+  slot->bytes       = bytes;
+  slot->width       = (uint32_t)width;
+  slot->height      = (uint32_t)height;
+
+  // Published with a reference of this process
+  uint64_t state = slot->state.load(std::memory_order_relaxed);
+  slot->state.store(ValidBit | (state & GenerationMask) | 1, std::memory_order_release);
+  header_->frames.fetch_add(1, std::memory_order_relaxed);
+  header_->bytes.fetch_add(n_chunks * chunk_size, std::memory_order_relaxed);
+  Pin(*slot, frame);
+  return true;
+}
+
+template <typename Shared>
+void SharedFrameCache::Pin(Entry &entry, Shared &frame) {
+  entry.last_used.store(header_->clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+  frame.data_   = reinterpret_cast<decltype(frame.data_)>(data_ + entry.first_chunk * header_->layout.chunk_size);
+  frame.width_  = entry.width;
+  frame.height_ = entry.height;
+  frame.refs_   = &entry.state;
+}
+
+SharedFrameCache::Entry *SharedFrameCache::Bucket(const Key &key) const {
+  return entries_ + (key.hash[0] % header_->layout.n_buckets) * Ways;
+}
+
+bool SharedFrameCache::Evict(Entry &entry) {
+  uint64_t state = entry.state.load(std::memory_order_acquire);
+  if ((state & ValidBit) == 0 || (state & RefsMask) != 0) {
+    return false;
+  }
+  // A new generation, so readers that have seen the old key cannot pin the entry
+  uint64_t next = ((state & GenerationMask) + GenerationStep) & GenerationMask;
+  if (!entry.state.compare_exchange_strong(state, next, std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  for (size_t i = entry.first_chunk; i < entry.first_chunk + entry.n_chunks; i++) {
+    chunk_map_[i / 64] &= ~(1ull << (i % 64));
+  }
+  header_->frames.fetch_sub(1, std::memory_order_relaxed);
+  header_->bytes.fetch_sub(entry.n_chunks * header_->layout.chunk_size, std::memory_order_relaxed);
+  header_->evictions.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool SharedFrameCache::Allocate(size_t n_chunks, size_t &first) {
+  size_t total = header_->layout.n_chunks, n_entries = header_->layout.n_buckets * Ways;
+  while (true) {
+    // The first run of free chunks that is long enough
+    size_t run = 0;
+    for (size_t i = 0; i < total; i++) {
+      if (i % 64 == 0 && chunk_map_[i / 64] == ~0ull) {
+        run = 0;
+        i += 63;
+        continue;
+      }
+      run = (chunk_map_[i / 64] >> (i % 64)) & 1 ? 0 : run + 1;
+      if (run == n_chunks) {
+        first = i + 1 - n_chunks;
+        for (size_t j = first; j <= i; j++) {
+          chunk_map_[j / 64] |= 1ull << (j % 64);
+        }
+        return true;
+      }
+    }
+
+    // Otherwise the least recently used frame that is not pinned goes
+    Entry *victim = nullptr;
+    for (size_t i = 0; i < n_entries; i++) {
+      uint64_t state = entries_[i].state.load(std::memory_order_acquire);
+      if ((state & ValidBit) != 0 && (state & RefsMask) == 0 && (victim == nullptr ||
+          entries_[i].last_used.load(std::memory_order_relaxed) < victim->last_used.load(std::memory_order_relaxed))) {
+        victim = &entries_[i];
+      }
+    }
+    if (victim == nullptr) {
+      return false;
+    }
+    Evict(*victim);
+  }
+}
+
+shared_cache::Stats SharedFrameCache::Stats() const {
+  shared_cache::Stats stats;
+  if (header_ != nullptr) {
+    stats.hits      = header_->hits.load(std::memory_order_relaxed);
+    stats.misses    = header_->misses.load(std::memory_order_relaxed);
+    stats.evictions = header_->evictions.load(std::memory_order_relaxed);
+    stats.frames    = (size_t)header_->frames.load(std::memory_order_relaxed);
+    stats.bytes     = (size_t)header_->bytes.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+#else
+
+//------------------------
+//--- SharedFrameCache ---
+//------------------------
+
+SharedFrameCache::SharedFrameCache()
+  : fd_(-1), mapped_size_(0), data_size_(0), base_(nullptr), writable_(nullptr), data_(nullptr),
+    header_(nullptr), entries_(nullptr), chunk_map_(nullptr) {
+}
+
+SharedFrameCache::~SharedFrameCache() {
+  // nothing
+}
+
+ErrHandle SharedFrameCache::Open(const shared_cache::Params &) {
+  return ErrHandle(TEXEL_WHERE, "the shared frame cache is supported only on Linux");
+}
+
+ErrHandle SharedFrameCache::Remove(const std::string &) {
+  return ErrHandle();
+}
+
+ErrHandle SharedFrameCache::Depth(const std::string &, size_t, const std::string &, SharedDepthFrame &frame) {
+  frame.Reset();
+  return ErrHandle(TEXEL_WHERE, "the shared frame cache is not opened");
+}
+
+ErrHandle SharedFrameCache::Color(const std::string &, size_t, const std::string &, SharedColorFrame &frame) {
+  frame.Reset();
+  return ErrHandle(TEXEL_WHERE, "the shared frame cache is not opened");
+}
+
+shared_cache::Stats SharedFrameCache::Stats() const {
+  return shared_cache::Stats();
+}
+
+#endif
+
+} // namespace texel
@@ -0,0 +1,168 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+
+namespace texel {
+
+namespace shared_cache {
+
+struct Params {
+  // Name of the POSIX shared memory object, processes that use the same name share the cache
+  std::string name;
+
+  // Decoded frames are evicted when their total size exceeds the budget (in bytes)
+  // The process that creates the cache defines its layout, the others take it as is
+  size_t budget;
+
+  // Frames occupy whole chunks of this size
+  size_t chunk_size;
+
+  // Frames that can be cached at once, zero means one per 256 KB of the budget
+  size_t max_frames;
+
+  Params()
+    : name("/texel-frames"),
+      budget(size_t(4) << 30),
+      chunk_size(64 << 10),
+      max_frames(0) {
+  }
+};
+
+// Counters of all processes that share the cache
+struct Stats {
+  uint64_t hits, misses, evictions;
+  size_t frames, bytes;   // what is cached at the moment
+
+  Stats() : hits(0), misses(0), evictions(0), frames(0), bytes(0) { }
+};
+
+} // namespace shared_cache
+
+
+// A decoded frame of 'SharedFrameCache', the layout of values is the same as in 'DepthFrame' and 'ColorFrame'
+// The frame stays in the shared memory (mapped read-only) while the handle exists, handles must not
+// outlive the cache. If all the memory is held by other handles, the frame is a private copy instead
+template <typename Value, size_t Channels>
+class SharedFrame {
+  public:
+    SharedFrame() : data_(nullptr), width_(0), height_(0), refs_(nullptr) { }
+    SharedFrame(SharedFrame &&other) noexcept : SharedFrame() { Swap(other); }
+    SharedFrame &operator =(SharedFrame &&other) noexcept {
+      SharedFrame(std::move(other)).Swap(*this);
+      return *this;
+    }
+    SharedFrame(const SharedFrame &) = delete;
+    SharedFrame &operator =(const SharedFrame &) = delete;
+    ~SharedFrame() { Reset(); }
+
+    size_t Width() const { return width_; }
+    size_t Height() const { return height_; }
+    bool Empty() const { return data_ == nullptr; }
+
+    // 'false' for private copies
+    bool Shared() const { return refs_ != nullptr; }
+
+    const Value *Data() const { return data_; }
+    const Value *Row(size_t y) const { return data_ + y * width_ * Channels; }
+
+    // Releases the frame
+    void Reset() {
+      if (refs_ != nullptr) {
+        refs_->fetch_sub(1, std::memory_order_release);
+      }
+      data_ = nullptr;
+      width_ = height_ = 0;
+      refs_ = nullptr;
+      private_.reset();
+    }
+
+  private:
+    void Swap(SharedFrame &other) {
+      std::swap(data_, other.data_);
+      std::swap(width_, other.width_);
+      std::swap(height_, other.height_);
+      std::swap(refs_, other.refs_);
+      std::swap(private_, other.private_);
+    }
+
+    const Value *data_;
+    size_t width_, height_;
+    std::atomic<uint64_t> *refs_;         // the state of the cache entry, references are its lower bits
+    std::shared_ptr<const void> private_;
+
+  friend class SharedFrameCache;
+};
+
+using SharedDepthFrame = SharedFrame<uint16_t, 1>;
+using SharedColorFrame = SharedFrame<uint8_t, ColorFrame::Channels>;
+
+
+// Keeps decoded frames in POSIX shared memory, so worker processes of a data loader on one host decode
+// each frame once and share a single copy of it. Frames are identified by their stream (the frame directory)
+// and their index in the stream, the same as in 'FrameCache'
+//
+// Lookups are lock-free: a frame is found in a small bucket of the hash table and pinned by an atomic
+// reference count. Inserting and evicting take a process-shared (robust) mutex, frames in use are never
+// evicted. Two processes may decode the same frame at once, then the second copy is dropped
+// A process that dies while holding frames leaves them pinned until the cache is removed
+// Linux only, elsewhere 'Open()' fails
+class SharedFrameCache {
+  public:
+    SharedFrameCache();
+    SharedFrameCache(const SharedFrameCache &) = delete;
+    SharedFrameCache &operator =(const SharedFrameCache &) = delete;
+    ~SharedFrameCache();
+
+    // Creates the shared memory object or attaches to an existing one, which is rejected if it is truncated
+    // An object whose creator has not published it within 10 seconds is taken over once
+    ErrHandle Open(const shared_cache::Params &params = shared_cache::Params());
+
+    // Removes the shared memory object, processes that opened it keep using it
+    static ErrHandle Remove(const std::string &name);
+
+    // Returns the cached frame or loads 'filename' on a miss
+    ErrHandle Depth(const std::string &stream, size_t idx, const std::string &filename, SharedDepthFrame &frame);
+    ErrHandle Color(const std::string &stream, size_t idx, const std::string &filename, SharedColorFrame &frame);
+
+    shared_cache::Stats Stats() const;
+
+  private:
+    enum class Kind : uint32_t { Depth, Color };
+    struct Header;
+    struct Entry;
+    struct Key {
+      uint64_t hash[2];
+      uint64_t idx_kind;
+    };
+
+    template <typename Frame, typename Shared>
+    ErrHandle Get(Kind kind, const std::string &stream, size_t idx, const std::string &filename, Shared &frame);
+
+    // Pins the frame if it is cached
+    template <typename Shared>
+    bool Find(const Key &key, Shared &frame);
+
+    // Copies the frame into the cache and pins it, returns 'false' if there is no unused memory
+    template <typename Shared>
+    bool Insert(const Key &key, const uint8_t *data, size_t width, size_t height, size_t bytes, Shared &frame);
+
+    Entry *Bucket(const Key &key) const;
+    bool Evict(Entry &entry);
+    bool Allocate(size_t n_chunks, size_t &first);
+
+    template <typename Shared>
+    void Pin(Entry &entry, Shared &frame);
+
+    void Close();
+
+    int fd_;
+    size_t mapped_size_, data_size_;
+    uint8_t *base_;           // header, entries and the chunk map
+    uint8_t *writable_;       // frame data for inserts
+    const uint8_t *data_;     // the same, read-only
+    Header *header_;
+    Entry *entries_;
+    uint64_t *chunk_map_;
+};
+
+} // namespace texel
@@ -0,0 +1,217 @@
+#pragma once
+#include "Defs.h"
+
+// SSE2 is the baseline for x86-64, other platforms use a scalar emulation
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXEL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace texel {
+
+namespace simd {
+
+// Four packed floats, the basic block for our vectorized kernels
+// Comparisons return masks (all bits set or cleared) that are also stored as 'Float4'
+class Float4 {
+  public:
+    static constexpr size_t Width = 4;
+
+#ifdef TEXEL_SIMD_SSE2
+    Float4() : v_(_mm_setzero_ps()) { }
+    Float4(float value) : v_(_mm_set1_ps(value)) { }
+    Float4(float a, float b, float c, float d) : v_(_mm_setr_ps(a, b, c, d)) { }
+    explicit Float4(__m128 v) : v_(v) { }
+
+    static Float4 Load(const float *ptr) { return Float4(_mm_loadu_ps(ptr)); }
+    void Store(float *ptr) const { _mm_storeu_ps(ptr, v_); }
+
+    friend Float4 operator +(Float4 a, Float4 b) { return Float4(_mm_add_ps(a.v_, b.v_)); }
+    friend Float4 operator -(Float4 a, Float4 b) { return Float4(_mm_sub_ps(a.v_, b.v_)); }
+    friend Float4 operator *(Float4 a, Float4 b) { return Float4(_mm_mul_ps(a.v_, b.v_)); }
+    friend Float4 operator /(Float4 a, Float4 b) { return Float4(_mm_div_ps(a.v_, b.v_)); }
+    friend Float4 operator <(Float4 a, Float4 b) { return Float4(_mm_cmplt_ps(a.v_, b.v_)); }
+    friend Float4 operator <=(Float4 a, Float4 b) { return Float4(_mm_cmple_ps(a.v_, b.v_)); }
+    friend Float4 operator >(Float4 a, Float4 b) { return Float4(_mm_cmpgt_ps(a.v_, b.v_)); }
+    friend Float4 operator >=(Float4 a, Float4 b) { return Float4(_mm_cmpge_ps(a.v_, b.v_)); }
+    friend Float4 operator ==(Float4 a, Float4 b) { return Float4(_mm_cmpeq_ps(a.v_, b.v_)); }
+    friend Float4 operator &(Float4 a, Float4 b) { return Float4(_mm_and_ps(a.v_, b.v_)); }
+    friend Float4 operator |(Float4 a, Float4 b) { return Float4(_mm_or_ps(a.v_, b.v_)); }
+
+    friend Float4 Min(Float4 a, Float4 b) { return Float4(_mm_min_ps(a.v_, b.v_)); }
+    friend Float4 Max(Float4 a, Float4 b) { return Float4(_mm_max_ps(a.v_, b.v_)); }
+    friend Float4 Sqrt(Float4 a) { return Float4(_mm_sqrt_ps(a.v_)); }
+    friend Float4 Abs(Float4 a) {
+      return Float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v_));
+    }
+
+    // Picks values from 'a' where the mask is set, otherwise from 'b'
+    friend Float4 Select(Float4 mask, Float4 a, Float4 b) {
+      return Float4(_mm_or_ps(_mm_and_ps(mask.v_, a.v_), _mm_andnot_ps(mask.v_, b.v_)));
+    }
+
+    // Bit 'i' of the result is set if the mask is set for the 'i'-th value
+    friend int MoveMask(Float4 mask) { return _mm_movemask_ps(mask.v_); }
+
+    friend float HorizontalSum(Float4 a) {
+      __m128 shuf = _mm_shuffle_ps(a.v_, a.v_, _MM_SHUFFLE(2, 3, 0, 1));
+      __m128 sums = _mm_add_ps(a.v_, shuf);
+      shuf = _mm_movehl_ps(shuf, sums);
+      return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+
+    // Rounds to the nearest integers, NaN and values out of the range give INT_MIN
+    friend void RoundToInt(Float4 a, int32_t *ptr) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(ptr), _mm_cvtps_epi32(a.v_));
+    }
+
+    // Natural exponent (Cephes-like polynomial), relative error is about 1e-7
+    friend Float4 Exp(Float4 a) {
+      __m128 x = _mm_min_ps(_mm_max_ps(a.v_, _mm_set1_ps(-87.3f)), _mm_set1_ps(88.3f));
+      __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+      __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+      n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), _mm_set1_ps(1.0f)));
+      x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+      x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+      __m128 y = _mm_set1_ps(1.9875691500e-4f);
+      y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+      y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+      y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+      y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+      y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+      y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, x), x), x), _mm_set1_ps(1.0f));
+      __m128i pow2n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+      return Float4(_mm_mul_ps(y, _mm_castsi128_ps(pow2n)));
+    }
+
+    // Converts four unsigned 16-bit values
+    static Float4 FromUInt16(const uint16_t *ptr) {
+      __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr));
+      return Float4(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, _mm_setzero_si128())));
+    }
+
+    // Rounds and saturates values to the unsigned 16-bit range
+    void StoreUInt16(uint16_t *ptr) const {
+      // SSE2 packs only signed values, so shift the range
+      __m128i v = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v_, _mm_setzero_ps()), _mm_set1_ps(65535.0f)));
+      v = _mm_sub_epi32(v, _mm_set1_epi32(32768));
+      __m128i packed = _mm_xor_si128(_mm_packs_epi32(v, v), _mm_set1_epi16((short)0x8000));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(ptr), packed);
+    }
+
+  private:
+    __m128 v_;
+#else
+    Float4() : v_{ 0.0f, 0.0f, 0.0f, 0.0f } { }
+    Float4(float value) : v_{ value, value, value, value } { }
+    Float4(float a, float b, float c, float d) : v_{ a, b, c, d } { }
+
+    static Float4 Load(const float *ptr) { return Float4(ptr[0], ptr[1], ptr[2], ptr[3]); }
+    void Store(float *ptr) const { std::memcpy(ptr, v_, sizeof(v_)); }
+
+    friend Float4 operator +(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x + y; }); }
+    friend Float4 operator -(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x - y; }); }
+    friend Float4 operator *(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x * y; }); }
+    friend Float4 operator /(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x / y; }); }
+    friend Float4 operator <(Float4 a, Float4 b) { return Compare(a, b, [](float x, float y) { return x < y; }); }
+    friend Float4 operator <=(Float4 a, Float4 b) { return Compare(a, b, [](float x, float y) { return x <= y; }); }
+    friend Float4 operator >(Float4 a, Float4 b) { return Compare(a, b, [](float x, float y) { return x > y; }); }
+    friend Float4 operator >=(Float4 a, Float4 b) { return Compare(a, b, [](float x, float y) { return x >= y; }); }
+    friend Float4 operator ==(Float4 a, Float4 b) { return Compare(a, b, [](float x, float y) { return x == y; }); }
+    friend Float4 operator &(Float4 a, Float4 b) { return Bitwise(a, b, [](uint32_t x, uint32_t y) { return x & y; }); }
+    friend Float4 operator |(Float4 a, Float4 b) { return Bitwise(a, b, [](uint32_t x, uint32_t y) { return x | y; }); }
+
+    friend Float4 Min(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return y < x ? y : x; }); }
+    friend Float4 Max(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x < y ? y : x; }); }
+    friend Float4 Sqrt(Float4 a) { return Apply(a, a, [](float x, float) { return std::sqrt(x); }); }
+    friend Float4 Abs(Float4 a) { return Apply(a, a, [](float x, float) { return std::fabs(x); }); }
+
+    friend Float4 Select(Float4 mask, Float4 a, Float4 b) {
+      Float4 r;
+      for (size_t i = 0; i < Width; i++) {
+        r.v_[i] = Bits(mask.v_[i]) != 0 ? a.v_[i] : b.v_[i];
+      }
+      return r;
+    }
+
+    friend int MoveMask(Float4 mask) {
+      int bits = 0;
+      for (size_t i = 0; i < Width; i++) {
+        bits |= Bits(mask.v_[i]) != 0 ? (1 << i) : 0;
+      }
+      return bits;
+    }
+
+    friend float HorizontalSum(Float4 a) { return (a.v_[0] + a.v_[1]) + (a.v_[2] + a.v_[3]); }
+
+    // Like '_mm_cvtps_epi32', NaN and values out of the range give INT_MIN instead of undefined behavior
+    friend void RoundToInt(Float4 a, int32_t *ptr) {
+      for (size_t i = 0; i < Width; i++) {
+        float value = std::nearbyint(a.v_[i]);
+        ptr[i] = value >= -2147483648.0f && value < 2147483648.0f ? (int32_t)value :
+                                                                     std::numeric_limits<int32_t>::min();
+      }
+    }
+
+    friend Float4 Exp(Float4 a) { return Apply(a, a, [](float x, float) { return std::exp(x); }); }
+
+    static Float4 FromUInt16(const uint16_t *ptr) {
+      return Float4((float)ptr[0], (float)ptr[1], (float)ptr[2], (float)ptr[3]);
+    }
+
+    void StoreUInt16(uint16_t *ptr) const {
+      for (size_t i = 0; i < Width; i++) {
+        float value = std::nearbyint(std::min(std::max(v_[i], 0.0f), 65535.0f));
+        ptr[i] = (uint16_t)value;
+      }
+    }
+
+  private:
+    static uint32_t Bits(float value) {
+      uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
+    static float FromBits(uint32_t bits) {
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    template <class F>
+    static Float4 Apply(Float4 a, Float4 b, F f) {
+      Float4 r;
+      for (size_t i = 0; i < Width; i++) {
+        r.v_[i] = f(a.v_[i], b.v_[i]);
+      }
+      return r;
+    }
+    template <class F>
+    static Float4 Compare(Float4 a, Float4 b, F f) {
+      Float4 r;
+      for (size_t i = 0; i < Width; i++) {
+        r.v_[i] = FromBits(f(a.v_[i], b.v_[i]) ? 0xffffffffu : 0u);
+      }
+      return r;
+    }
+    template <class F>
+    static Float4 Bitwise(Float4 a, Float4 b, F f) {
+      Float4 r;
+      for (size_t i = 0; i < Width; i++) {
+        r.v_[i] = FromBits(f(Bits(a.v_[i]), Bits(b.v_[i])));
+      }
+      return r;
+    }
+
+    float v_[4];
+#endif
+};
+
+// The number of lanes set in a result of 'MoveMask()'
+inline int CountBits(int mask) {
+  static constexpr int Counts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+  return Counts[mask & 0xf];
+}
+
+} // namespace simd
+
+} // namespace texel
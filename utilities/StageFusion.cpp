@@ -0,0 +1,224 @@
+#include "StageFusion.h"
+#include "Simd.h"
+
+namespace texel {
+
+namespace {
+
+// Rows of a frame that are back-projected by one task
+constexpr size_t BlockRows = 32;
+
+// Matches frames of all streams by their names, falls back to the order of files
+void MatchSets(const std::vector<std::vector<std::string> > &files, std::vector<std::vector<size_t> > &sets) {
+  sets.assign(files.size(), std::vector<size_t>());
+  if (files.empty()) {
+    return;
+  }
+  std::vector<std::unordered_map<std::string, size_t> > stems(files.size());
+  for (size_t s = 1; s < files.size(); s++) {
+    for (size_t i = 0; i < files[s].size(); i++) {
+      stems[s].emplace(std::filesystem::path(files[s][i]).stem().string(), i);
+    }
+  }
+  for (size_t i = 0; i < files[0].size(); i++) {
+    auto stem = std::filesystem::path(files[0][i]).stem().string();
+    std::vector<size_t> set(1, i);
+    for (size_t s = 1; s < files.size(); s++) {
+      auto iter = stems[s].find(stem);
+      if (iter == stems[s].end()) {
+        break;
+      }
+      set.push_back(iter->second);
+    }
+    if (set.size() == files.size()) {
+      for (size_t s = 0; s < files.size(); s++) {
+        sets[s].push_back(set[s]);
+      }
+    }
+  }
+
+  if (sets[0].empty()) {
+    size_t n = files[0].size();
+    for (const auto &stream_files : files) {
+      n = std::min(n, stream_files.size());
+    }
+    for (auto &set : sets) {
+      for (size_t i = 0; i < n; i++) {
+        set.push_back(i);
+      }
+    }
+  }
+}
+
+} // unnamed namespace
+
+//-------------------
+//--- StageFusion ---
+//-------------------
+
+StageFusion::StageFusion(const fusion::Params &params, ThreadPool &pool)
+  : params_(params), pool_(pool) {
+}
+
+ErrHandle StageFusion::Bind(const scanogram::Stage &stage) {
+  cameras_.clear();
+  streams_.clear();
+  projectors_.clear();
+  files_.clear();
+  sets_.clear();
+
+  glm::vec3 box_min(-std::numeric_limits<float>::max()), box_max(std::numeric_limits<float>::max());
+  if (params_.margin >= 0.0f) {
+    glm::vec3 margin(params_.margin);
+    box_min = stage.BoundingBox().Offset() - margin;
+    box_max = stage.BoundingBox().Offset() + stage.BoundingBox().Size() + margin;
+  }
+
+  const auto &streams = stage.Streams();
+  for (size_t i = 0; i < streams.size(); i++) {
+    Camera camera;
+    std::string dir;
+    if (!streams[i].HasDepth(camera, dir)) {
+      continue;
+    }
+    std::vector<std::string> files;
+    TEXEL_CHECK(frames::ListFiles(dir, ".png", files));
+
+    cameras_.push_back(camera);
+    streams_.push_back(i);
+    projectors_.emplace_back(camera, params_.min_depth, params_.max_depth, box_min, box_max);
+    files_.emplace_back(std::move(files));
+  }
+  if (streams_.empty()) {
+    return ErrHandle(TEXEL_WHERE, "the stage has no streams with depth maps");
+  }
+  MatchSets(files_, sets_);
+  frames_.resize(streams_.size());
+  errors_.assign(streams_.size(), ErrHandle());
+  return ErrHandle();
+}
+
+ErrHandle StageFusion::Fuse(size_t idx, fusion::PointCloud &cloud) {
+  if (idx >= Size()) {
+    return ErrHandle(TEXEL_WHERE, "no such frame set");
+  }
+
+  // Frames of the set are decoded concurrently, into buffers reused between sets
+  pool_.ParallelFor(0, streams_.size(), [&](size_t s) {
+    errors_[s] = DepthFrame::Load(files_[s][sets_[s][idx]], frames_[s]);
+  });
+  std::vector<const DepthFrame *> frames(streams_.size());
+  for (size_t s = 0; s < streams_.size(); s++) {
+    TEXEL_CHECK(errors_[s]);
+    frames[s] = &frames_[s];
+  }
+  return Fuse(frames, cloud);
+}
+
+ErrHandle StageFusion::Fuse(const std::vector<const DepthFrame *> &frames, fusion::PointCloud &cloud) const {
+  using simd::Float4;
+  if (frames.size() != projectors_.size()) {
+    std::ostringstream oss;
+    oss << "expected " << projectors_.size() << " frames, one per fused stream, got " << frames.size();
+    return ErrHandle(TEXEL_WHERE, oss.str());
+  }
+  for (const auto *frame : frames) {
+    if (frame == nullptr) {
+      return ErrHandle(TEXEL_WHERE, "a frame of the set is missing");
+    }
+  }
+
+  // Blocks of rows of all frames form one sequence, each block may fill all its pixels
+  struct Block {
+    size_t stream, first_row, last_row;
+    size_t begin, count;
+  };
+  std::vector<Block> blocks;
+  size_t capacity = 0;
+  for (size_t s = 0; s < frames.size(); s++) {
+    const auto &frame = *frames[s];
+    for (size_t y = 0; y < frame.Height(); y += BlockRows) {
+      Block block;
+      block.stream    = s;
+      block.first_row = y;
+      block.last_row  = std::min(y + BlockRows, frame.Height());
+      block.begin     = capacity;
+      block.count     = 0;
+      blocks.push_back(block);
+      capacity += (block.last_row - block.first_row) * frame.Width();
+    }
+  }
+  if (cloud.x_.size() < capacity) {
+    cloud.x_.resize(capacity);
+    cloud.y_.resize(capacity);
+    cloud.z_.resize(capacity);
+  }
+
+  pool_.ParallelFor(0, blocks.size(), [&](size_t b) {
+    auto &block = blocks[b];
+    const auto &frame = *frames[block.stream];
+    const auto &projector = projectors_[block.stream];
+    float *out_x = cloud.x_.data() + block.begin;
+    float *out_y = cloud.y_.data() + block.begin;
+    float *out_z = cloud.z_.data() + block.begin;
+    size_t n = 0;
+    float px[Float4::Width], py[Float4::Width], pz[Float4::Width];
+    for (size_t y = block.first_row; y < block.last_row; y++) {
+      size_t x = projector.Groups(frame, y, Float4::Width, [&](size_t, int bits, Float4 vx, Float4 vy, Float4 vz) {
+        if (bits == 0xf) {
+          // The block has room for all its pixels, so whole groups are stored at once
+          vx.Store(out_x + n);
+          vy.Store(out_y + n);
+          vz.Store(out_z + n);
+          n += Float4::Width;
+          return;
+        }
+        if (bits == 0) {
+          return;
+        }
+        vx.Store(px);
+        vy.Store(py);
+        vz.Store(pz);
+        for (size_t k = 0; k < Float4::Width; k++) {
+          if ((bits & (1 << k)) != 0) {
+            out_x[n] = px[k];
+            out_y[n] = py[k];
+            out_z[n] = pz[k];
+            n++;
+          }
+        }
+      });
+
+      for (; x < frame.Width(); x++) {
+        glm::vec3 p;
+        if (projector.Pixel(frame, x, y, p)) {
+          out_x[n] = p.x;
+          out_y[n] = p.y;
+          out_z[n] = p.z;
+          n++;
+        }
+      }
+    }
+    block.count = n;
+  });
+
+  // Blocks move only towards the beginning, so they are compacted in place
+  cloud.offsets_.assign(frames.size() + 1, 0);
+  size_t size = 0;
+  for (const auto &block : blocks) {
+    if (size != block.begin && block.count > 0) {
+      std::memmove(cloud.x_.data() + size, cloud.x_.data() + block.begin, block.count * sizeof(float));
+      std::memmove(cloud.y_.data() + size, cloud.y_.data() + block.begin, block.count * sizeof(float));
+      std::memmove(cloud.z_.data() + size, cloud.z_.data() + block.begin, block.count * sizeof(float));
+    }
+    size += block.count;
+    cloud.offsets_[block.stream + 1] = size;
+  }
+  for (size_t s = 1; s < cloud.offsets_.size(); s++) {
+    cloud.offsets_[s] = std::max(cloud.offsets_[s], cloud.offsets_[s - 1]);
+  }
+  cloud.size_ = size;
+  return ErrHandle();
+}
+
+} // namespace texel
@@ -0,0 +1,110 @@
+#pragma once
+#include "Defs.h"
+#include "Frames.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include "Scanogram.h"
+
+namespace texel {
+
+// Fills point clouds
+class StageFusion;
+
+namespace fusion {
+
+struct Params {
+  // Depth values outside this range are invalid (in meters)
+  float min_depth, max_depth;
+
+  // Points are kept only inside the bounding box of the stage, extended by this margin (in meters)
+  // A negative value keeps all points
+  float margin;
+
+  Params() : min_depth(0.2f), max_depth(5.0f), margin(0.0f) { }
+};
+
+// Points of all sensors in the viewer space of the stage
+// Coordinates are stored as separate planes to simplify vectorization, buffers are reused between frames
+class PointCloud {
+  public:
+    PointCloud() : size_(0) { }
+    PointCloud(const PointCloud &) = default;
+    PointCloud(PointCloud &&) noexcept = default;
+    PointCloud &operator =(const PointCloud &) = default;
+    PointCloud &operator =(PointCloud &&) noexcept = default;
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    const float *X() const { return x_.data(); }
+    const float *Y() const { return y_.data(); }
+    const float *Z() const { return z_.data(); }
+
+    glm::vec3 At(size_t idx) const { return glm::vec3(x_[idx], y_[idx], z_[idx]); }
+
+    // Points of the 'i'-th fused stream are [Offsets()[i], Offsets()[i + 1])
+    const std::vector<size_t> &Offsets() const { return offsets_; }
+
+  private:
+    size_t size_;
+    std::vector<float> x_, y_, z_;      // at least 'size_' values
+    std::vector<size_t> offsets_;
+
+  friend class texel::StageFusion;
+};
+
+} // namespace fusion
+
+
+// Fuses synchronized depth maps of all sensors of a stage into one point cloud
+// Frames of different streams are matched by their names (or by their order, see 'frames::MatchByName()')
+// Frames of a set are decoded concurrently, then blocks of rows of all frames are back-projected and
+// transformed into the viewer space concurrently (four pixels at once). Each block writes its points
+// straight into the cloud, which is compacted in place, so there are no per-stream copies
+//
+// Usage:
+//   StageFusion fusion;
+//   fusion::PointCloud cloud;
+//   TEXEL_CHECK(fusion.Bind(stage));
+//   for (size_t i = 0; i < fusion.Size(); i++) {
+//     TEXEL_CHECK(fusion.Fuse(i, cloud));
+//     Process(cloud);
+//   }
+class StageFusion {
+  public:
+    explicit StageFusion(const fusion::Params &params = fusion::Params(),
+                         ThreadPool &pool = ThreadPool::Default());
+    StageFusion(const StageFusion &) = delete;
+    StageFusion &operator =(const StageFusion &) = delete;
+
+    // Matches frames of streams that contain depth maps, the others are ignored
+    ErrHandle Bind(const scanogram::Stage &stage);
+
+    // Depth cameras of the fused streams
+    const std::vector<Camera> &Cameras() const { return cameras_; }
+
+    // Indices of the fused streams in 'Stage::Streams()'
+    const std::vector<size_t> &Streams() const { return streams_; }
+
+    // The number of synchronized frame sets
+    size_t Size() const { return sets_.empty() ? 0 : sets_[0].size(); }
+
+    // Decodes frames of the set 'idx' and fuses them
+    ErrHandle Fuse(size_t idx, fusion::PointCloud &cloud);
+
+    // Fuses frames that are already decoded, one per fused stream in the order of 'Streams()'
+    ErrHandle Fuse(const std::vector<const DepthFrame *> &frames, fusion::PointCloud &cloud) const;
+
+  private:
+    fusion::Params params_;
+    ThreadPool &pool_;
+    std::vector<Camera> cameras_;
+    std::vector<size_t> streams_;
+    std::vector<geometry::DepthProjector> projectors_; // per stream, limited by the box of the stage
+    std::vector<std::vector<std::string> > files_;     // per stream
+    std::vector<std::vector<size_t> > sets_;           // per stream, indices of files of each set
+    std::vector<DepthFrame> frames_;
+    std::vector<ErrHandle> errors_;
+};
+
+} // namespace texel
@@ -0,0 +1,389 @@
+#define TEXEL_C_BUILD
+#include "TexelC.h"
+#include "Frames.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+// The C enumerations are plain casts of ours
+static_assert((int)scanogram::Gender::Female == TEXEL_GENDER_FEMALE, "texel_gender is out of sync");
+static_assert((int)scanogram::AgeGroup::Elderly == TEXEL_AGE_GROUP_ELDERLY, "texel_age_group is out of sync");
+static_assert((int)scanogram::ScannerType::FreeFusion == TEXEL_SCANNER_FREE_FUSION, "texel_scanner is out of sync");
+static_assert((int)scanogram::SensorType::AzureKinect == TEXEL_SENSOR_AZURE_KINECT, "texel_sensor is out of sync");
+static_assert((int)scanogram::ScanPass::Head == TEXEL_SCAN_PASS_HEAD, "texel_scan_pass is out of sync");
+
+namespace {
+
+thread_local std::string last_error;
+
+texel_status Fail(texel_status status, const std::string &message) {
+  last_error = message;
+  return status;
+}
+
+texel_status Fail(const ErrHandle &err) {
+  return Fail(TEXEL_ERROR, err.Message());
+}
+
+// Exceptions must not cross the C boundary
+template <typename Func>
+texel_status Guard(Func &&func) {
+  try {
+    return func();
+  }
+  catch (const std::exception &e) {
+    return Fail(TEXEL_ERROR, e.what());
+  }
+  catch (...) {
+    return Fail(TEXEL_ERROR, "unknown exception");
+  }
+}
+
+// Copies at most 'target->struct_size' bytes, the size set by the caller (who may know fewer fields)
+template <typename Info>
+texel_status CopyInfo(const Info &source, Info *target) {
+  if (target->struct_size < sizeof(size_t)) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "'struct_size' is not set");
+  }
+  Info result = source;
+  result.struct_size = std::min(sizeof(Info), target->struct_size);
+  std::memcpy(target, &result, result.struct_size);
+  return TEXEL_OK;
+}
+
+void ToCamera(const Camera &camera, texel_camera &result) {
+  result.width  = (uint32_t)camera.Width();
+  result.height = (uint32_t)camera.Height();
+  result.cx = camera.Cx();
+  result.cy = camera.Cy();
+  result.fx = camera.Fx();
+  result.fy = camera.Fy();
+  for (int i = 0; i < 3; i++) {
+    result.offset[i] = camera.Offset()[i];
+    for (int j = 0; j < 3; j++) {
+      result.rotation[i * 3 + j] = camera.Rotation()[i][j];
+    }
+  }
+}
+
+} // unnamed namespace
+
+//--------------------
+//--- texel_finder ---
+//--------------------
+
+// Everything the C structures point to is prepared once, so the pointers stay valid
+struct texel_finder {
+  struct Stream {
+    texel_stream_info info;
+    std::string depth_dir, color_dir, ir_dir;
+  };
+  struct Stage {
+    texel_stage_info info;
+    std::vector<Stream> streams;
+  };
+  struct Scan {
+    texel_scan_info info;
+    std::vector<int32_t> garments;
+    std::vector<Stage> stages;
+  };
+
+  ScanogramFinder finder;
+  std::vector<Scan> scans;
+};
+
+texel_status texel_finder_open(const char *dir, texel_finder **finder) {
+  if (dir == nullptr || finder == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  *finder = nullptr;
+  return Guard([&]() {
+    std::unique_ptr<texel_finder> result(new texel_finder());
+    auto err = result->finder.BindDirectory(dir);
+    if (err.Failed()) {
+      return Fail(err);
+    }
+
+    // Scans of the finder are not moved after binding, so their strings can be borrowed
+    while (result->finder.FindNext()) {
+      decltype(auto) info = result->finder.Current();
+      decltype(auto) scan = info.scan;
+      result->scans.emplace_back();
+      auto &entry = result->scans.back();
+
+      auto &c = entry.info;
+      std::memset(&c, 0, sizeof(c));
+      c.id        = info.id.c_str();
+      c.name      = info.name.c_str();
+      c.path      = info.path.c_str();
+      c.gender    = (int32_t)info.gender;
+      c.age_group = (int32_t)info.group;
+      c.scanner   = (int32_t)scan.Scanner();
+      c.timestamp = (int64_t)scan.DateTime().time_since_epoch().count();
+      size_t age = 0;
+      c.has_age    = scan.HasAgeValue(age);
+      c.age        = (uint32_t)age;
+      c.has_height = scan.HasHeightValue(c.height);
+      c.has_weight = scan.HasWeightValue(c.weight);
+
+      decltype(auto) consents = scan.Consents();
+      c.consents = (consents.make_depth_maps_publicly_available   ? TEXEL_CONSENT_DEPTH_MAPS : 0u) |
+                   (consents.make_color_frames_publicly_available ? TEXEL_CONSENT_COLOR_FRAMES : 0u) |
+                   (consents.make_scans_publicly_available        ? TEXEL_CONSENT_SCANS : 0u) |
+                   (consents.do_not_blur_face                     ? TEXEL_CONSENT_UNBLURRED_FACE : 0u) |
+                   (consents.commercial_use                       ? TEXEL_CONSENT_COMMERCIAL_USE : 0u);
+      decltype(auto) tags = scan.Tags();
+      c.hairstyle = (int32_t)tags.hairstyle;
+      c.clothing  = (int32_t)tags.clothing;
+      c.shoes     = (int32_t)tags.shoes;
+      c.lighting  = (int32_t)tags.lighting;
+      c.placement = (int32_t)tags.placement;
+      for (auto garment : scan.Garments()) {
+        entry.garments.emplace_back((int32_t)garment);
+      }
+      std::sort(entry.garments.begin(), entry.garments.end());
+
+      for (const auto &stage : scan.Stages()) {
+        entry.stages.emplace_back();
+        auto &stage_entry = entry.stages.back();
+        auto &s = stage_entry.info;
+        std::memset(&s, 0, sizeof(s));
+        s.pass = (int32_t)stage.Pass();
+        for (int i = 0; i < 3; i++) {
+          s.bbox_offset[i] = stage.BoundingBox().Offset()[i];
+          s.bbox_size[i]   = stage.BoundingBox().Size()[i];
+        }
+        s.n_streams = stage.Streams().size();
+
+        stage_entry.streams.resize(stage.Streams().size());
+        for (size_t i = 0; i < stage.Streams().size(); i++) {
+          decltype(auto) stream = stage.Streams()[i];
+          auto &stream_entry = stage_entry.streams[i];
+          auto &t = stream_entry.info;
+          std::memset(&t, 0, sizeof(t));
+          t.sensor      = (int32_t)stream.Sensor();
+          t.sensor_data = stream.SensorData().c_str();
+          Camera camera;
+          if (stream.HasDepth(camera, stream_entry.depth_dir)) {
+            ToCamera(camera, t.depth_camera);
+          }
+          if (stream.HasColor(camera, stream_entry.color_dir)) {
+            ToCamera(camera, t.color_camera);
+          }
+          if (stream.HasIR(camera, stream_entry.ir_dir)) {
+            ToCamera(camera, t.ir_camera);
+          }
+        }
+      }
+      c.n_stages = entry.stages.size();
+    }
+    result->finder.Reset();
+
+    // Our own strings and arrays do not move anymore (short strings move along with their owners)
+    auto c_str = [](const std::string &str) { return str.empty() ? nullptr : str.c_str(); };
+    for (auto &scan : result->scans) {
+      scan.info.garments   = scan.garments.data();
+      scan.info.n_garments = scan.garments.size();
+      for (auto &stage : scan.stages) {
+        for (auto &stream : stage.streams) {
+          stream.info.depth_dir = c_str(stream.depth_dir);
+          stream.info.color_dir = c_str(stream.color_dir);
+          stream.info.ir_dir    = c_str(stream.ir_dir);
+        }
+      }
+    }
+
+    *finder = result.release();
+    return TEXEL_OK;
+  });
+}
+
+void texel_finder_close(texel_finder *finder) {
+  delete finder;
+}
+
+size_t texel_finder_count(const texel_finder *finder) {
+  return finder != nullptr ? finder->scans.size() : 0;
+}
+
+texel_status texel_finder_scan(const texel_finder *finder, size_t scan, texel_scan_info *info) {
+  if (finder == nullptr || info == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  if (scan >= finder->scans.size()) {
+    return Fail(TEXEL_OUT_OF_RANGE, "no such scan");
+  }
+  return CopyInfo(finder->scans[scan].info, info);
+}
+
+texel_status texel_finder_stage(const texel_finder *finder, size_t scan, size_t stage,
+                                texel_stage_info *info) {
+  if (finder == nullptr || info == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  if (scan >= finder->scans.size() || stage >= finder->scans[scan].stages.size()) {
+    return Fail(TEXEL_OUT_OF_RANGE, "no such stage");
+  }
+  return CopyInfo(finder->scans[scan].stages[stage].info, info);
+}
+
+texel_status texel_finder_stream(const texel_finder *finder, size_t scan, size_t stage, size_t stream,
+                                 texel_stream_info *info) {
+  if (finder == nullptr || info == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  if (scan >= finder->scans.size() || stage >= finder->scans[scan].stages.size() ||
+      stream >= finder->scans[scan].stages[stage].streams.size()) {
+    return Fail(TEXEL_OUT_OF_RANGE, "no such stream");
+  }
+  return CopyInfo(finder->scans[scan].stages[stage].streams[stream].info, info);
+}
+
+//-----------------------
+//--- texel_file_list ---
+//-----------------------
+
+struct texel_file_list {
+  std::vector<std::string> files;
+};
+
+texel_status texel_list_frames(const char *dir, const char *extension, texel_file_list **list) {
+  if (dir == nullptr || extension == nullptr || list == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  *list = nullptr;
+  return Guard([&]() {
+    std::unique_ptr<texel_file_list> result(new texel_file_list());
+    auto err = frames::ListFiles(dir, extension, result->files);
+    if (err.Failed()) {
+      return Fail(err);
+    }
+    *list = result.release();
+    return TEXEL_OK;
+  });
+}
+
+void texel_file_list_free(texel_file_list *list) {
+  delete list;
+}
+
+size_t texel_file_list_size(const texel_file_list *list) {
+  return list != nullptr ? list->files.size() : 0;
+}
+
+const char *texel_file_list_get(const texel_file_list *list, size_t idx) {
+  if (list == nullptr || idx >= list->files.size()) {
+    return nullptr;
+  }
+  return list->files[idx].c_str();
+}
+
+//-------------------
+//--- texel_frame ---
+//-------------------
+
+struct texel_frame {
+  enum class Kind { None, Depth, Color };
+
+  Kind kind = Kind::None;
+  DepthFrame depth;
+  ColorFrame color;
+};
+
+namespace {
+
+// On failure, the frame becomes empty rather than keeping stale pixels
+template <typename Load>
+texel_status LoadFrame(texel_frame *frame, const void *source, texel_frame::Kind kind, Load &&load) {
+  if (frame == nullptr || source == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  return Guard([&]() {
+    frame->kind = texel_frame::Kind::None;
+    auto err = load(*frame);
+    if (err.Failed()) {
+      return Fail(err);
+    }
+    frame->kind = kind;
+    return TEXEL_OK;
+  });
+}
+
+} // unnamed namespace
+
+texel_status texel_frame_create(texel_frame **frame) {
+  if (frame == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  return Guard([&]() {
+    *frame = new texel_frame();
+    return TEXEL_OK;
+  });
+}
+
+void texel_frame_destroy(texel_frame *frame) {
+  delete frame;
+}
+
+texel_status texel_frame_load_depth(texel_frame *frame, const char *filename) {
+  return LoadFrame(frame, filename, texel_frame::Kind::Depth,
+                   [&](texel_frame &target) { return DepthFrame::Load(filename, target.depth); });
+}
+
+texel_status texel_frame_load_color(texel_frame *frame, const char *filename) {
+  return LoadFrame(frame, filename, texel_frame::Kind::Color,
+                   [&](texel_frame &target) { return ColorFrame::Load(filename, target.color); });
+}
+
+texel_status texel_frame_decode_depth(texel_frame *frame, const uint8_t *data, size_t size) {
+  return LoadFrame(frame, data, texel_frame::Kind::Depth,
+                   [&](texel_frame &target) { return DepthFrame::Decode(data, size, target.depth); });
+}
+
+texel_status texel_frame_decode_color(texel_frame *frame, const uint8_t *data, size_t size) {
+  return LoadFrame(frame, data, texel_frame::Kind::Color,
+                   [&](texel_frame &target) { return ColorFrame::Decode(data, size, target.color); });
+}
+
+texel_status texel_frame_view_get(const texel_frame *frame, texel_frame_view *view) {
+  if (frame == nullptr || view == nullptr) {
+    return Fail(TEXEL_INVALID_ARGUMENT, "null argument");
+  }
+  texel_frame_view result;
+  std::memset(&result, 0, sizeof(result));
+  switch (frame->kind) {
+    case texel_frame::Kind::Depth:
+      result.data            = frame->depth.Data();
+      result.width           = (uint32_t)frame->depth.Width();
+      result.height          = (uint32_t)frame->depth.Height();
+      result.channels        = 1;
+      result.bytes_per_value = sizeof(uint16_t);
+      break;
+
+    case texel_frame::Kind::Color:
+      result.data            = frame->color.Data();
+      result.width           = (uint32_t)frame->color.Width();
+      result.height          = (uint32_t)frame->color.Height();
+      result.channels        = ColorFrame::Channels;
+      result.bytes_per_value = 1;
+      break;
+
+    case texel_frame::Kind::None:
+    default:
+      return Fail(TEXEL_ERROR, "the frame is not loaded");
+  }
+  result.stride = (size_t)result.width * result.channels * result.bytes_per_value;
+  return CopyInfo(result, view);
+}
+
+//---------------
+//--- general ---
+//---------------
+
+uint32_t texel_api_version(void) {
+  return TEXEL_API_VERSION;
+}
+
+const char *texel_last_error(void) {
+  return last_error.c_str();
+}
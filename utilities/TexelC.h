@@ -0,0 +1,157 @@
+/*
+ * A stable C interface to the dataset utilities, for Python (ctypes/cffi), Rust and other FFI consumers
+ *
+ * Rules of the interface:
+ *   - functions return TEXEL_OK or an error code, 'texel_last_error()' explains the last failure of the thread;
+ *   - strings and arrays are borrowed, they are valid until the object that provided them is destroyed;
+ *   - frame pixels are borrowed too, they are valid until the frame is loaded again or destroyed;
+ *   - structures filled by the library start with 'struct_size', set it to 'sizeof' of the structure
+ *     before the call: the library writes only that many bytes, so structures may grow at the end
+ *     without breaking older callers. Check 'texel_api_version()' before using new fields.
+ */
+#ifndef TEXEL_C_H
+#define TEXEL_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+  #if defined(TEXEL_C_BUILD)
+    #define TEXEL_API __declspec(dllexport)
+  #else
+    #define TEXEL_API __declspec(dllimport)
+  #endif
+#else
+  #define TEXEL_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXEL_API_VERSION 2
+
+typedef enum texel_status {
+  TEXEL_OK = 0,
+  TEXEL_ERROR = 1,               /* see 'texel_last_error()' */
+  TEXEL_INVALID_ARGUMENT = 2,
+  TEXEL_OUT_OF_RANGE = 3
+} texel_status;
+
+/* The values match 'texel::scanogram' enumerations */
+typedef enum texel_gender { TEXEL_GENDER_NEUTRAL = 0, TEXEL_GENDER_MALE = 1, TEXEL_GENDER_FEMALE = 2 } texel_gender;
+typedef enum texel_age_group {
+  TEXEL_AGE_GROUP_NA = 0, TEXEL_AGE_GROUP_CHILD = 1, TEXEL_AGE_GROUP_ADULT = 2, TEXEL_AGE_GROUP_ELDERLY = 3
+} texel_age_group;
+typedef enum texel_scanner {
+  TEXEL_SCANNER_PORTAL_MX = 0, TEXEL_SCANNER_PORTAL_RX = 1, TEXEL_SCANNER_FREE_FUSION = 2
+} texel_scanner;
+typedef enum texel_sensor { TEXEL_SENSOR_SYNTHETIC = 0, TEXEL_SENSOR_AZURE_KINECT = 1 } texel_sensor;
+typedef enum texel_scan_pass { TEXEL_SCAN_PASS_BODY = 0, TEXEL_SCAN_PASS_HEAD = 1 } texel_scan_pass;
+
+/* Bits of 'texel_scan_info::consents' */
+#define TEXEL_CONSENT_DEPTH_MAPS     (1u << 0)
+#define TEXEL_CONSENT_COLOR_FRAMES   (1u << 1)
+#define TEXEL_CONSENT_SCANS          (1u << 2)
+#define TEXEL_CONSENT_UNBLURRED_FACE (1u << 3)
+#define TEXEL_CONSENT_COMMERCIAL_USE (1u << 4)
+
+typedef struct texel_scan_info {
+  size_t struct_size;            /* set by the caller */
+  const char *id;
+  const char *name;              /* "NA" if the person hid it */
+  const char *path;              /* the '*.scan.xml' file */
+  int32_t gender;                /* texel_gender */
+  int32_t age_group;             /* texel_age_group */
+  int32_t scanner;               /* texel_scanner */
+  int64_t timestamp;             /* seconds since the UNIX epoch */
+
+  /* Optional values, check the 'has_*' flags */
+  int32_t has_age, has_height, has_weight;
+  uint32_t age;
+  float height, weight;          /* centimeters and kilograms */
+
+  uint32_t consents;             /* TEXEL_CONSENT_* bits */
+
+  /* Values of 'texel::scanogram' tag enumerations */
+  int32_t hairstyle, clothing, shoes, lighting, placement;
+  const int32_t *garments;
+  size_t n_garments;
+
+  size_t n_stages;
+} texel_scan_info;
+
+typedef struct texel_stage_info {
+  size_t struct_size;            /* set by the caller */
+  int32_t pass;                  /* texel_scan_pass */
+  float bbox_offset[3], bbox_size[3];
+  size_t n_streams;
+} texel_stage_info;
+
+typedef struct texel_camera {
+  uint32_t width, height;
+  float cx, cy, fx, fy;
+  float offset[3];               /* meters */
+  float rotation[9];             /* row by row */
+} texel_camera;
+
+typedef struct texel_stream_info {
+  size_t struct_size;            /* set by the caller */
+  int32_t sensor;                /* texel_sensor */
+  const char *sensor_data;
+
+  /* Directories are null if the stream has no frames of this kind */
+  const char *depth_dir, *color_dir, *ir_dir;
+  texel_camera depth_camera, color_camera, ir_camera;
+} texel_stream_info;
+
+/* A borrowed view of decoded pixels, rows follow each other without padding */
+typedef struct texel_frame_view {
+  size_t struct_size;            /* set by the caller */
+  const void *data;              /* uint16_t millimeters for depth, interleaved uint8_t RGB for color */
+  uint32_t width, height;
+  uint32_t channels;             /* 1 or 3 */
+  uint32_t bytes_per_value;      /* 2 or 1 */
+  size_t stride;                 /* bytes per row */
+} texel_frame_view;
+
+typedef struct texel_finder texel_finder;
+typedef struct texel_file_list texel_file_list;
+typedef struct texel_frame texel_frame;
+
+TEXEL_API uint32_t texel_api_version(void);
+
+/* The message of the last failed call in this thread, valid until the next failure */
+TEXEL_API const char *texel_last_error(void);
+
+/* Scans of the directory and its subdirectories ('*.scan.xml') */
+TEXEL_API texel_status texel_finder_open(const char *dir, texel_finder **finder);
+TEXEL_API void texel_finder_close(texel_finder *finder);
+TEXEL_API size_t texel_finder_count(const texel_finder *finder);
+TEXEL_API texel_status texel_finder_scan(const texel_finder *finder, size_t scan,
+                                         texel_scan_info *info);
+TEXEL_API texel_status texel_finder_stage(const texel_finder *finder, size_t scan, size_t stage,
+                                          texel_stage_info *info);
+TEXEL_API texel_status texel_finder_stream(const texel_finder *finder, size_t scan, size_t stage, size_t stream,
+                                           texel_stream_info *info);
+
+/* Sorted frame files of a directory with the given extension (".png" for depth, ".jpg" for color) */
+TEXEL_API texel_status texel_list_frames(const char *dir, const char *extension, texel_file_list **list);
+TEXEL_API void texel_file_list_free(texel_file_list *list);
+TEXEL_API size_t texel_file_list_size(const texel_file_list *list);
+TEXEL_API const char *texel_file_list_get(const texel_file_list *list, size_t idx);
+
+/* A frame keeps its buffer between loads, so reuse it for sequential frames */
+TEXEL_API texel_status texel_frame_create(texel_frame **frame);
+TEXEL_API void texel_frame_destroy(texel_frame *frame);
+TEXEL_API texel_status texel_frame_load_depth(texel_frame *frame, const char *filename);
+TEXEL_API texel_status texel_frame_load_color(texel_frame *frame, const char *filename);
+TEXEL_API texel_status texel_frame_decode_depth(texel_frame *frame, const uint8_t *data, size_t size);
+TEXEL_API texel_status texel_frame_decode_color(texel_frame *frame, const uint8_t *data, size_t size);
+TEXEL_API texel_status texel_frame_view_get(const texel_frame *frame, texel_frame_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TEXEL_C_H */
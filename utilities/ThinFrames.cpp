@@ -0,0 +1,110 @@
+#include <iostream>
+#include "FrameDedup.h"
+#include "Metrics.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+// Both paths are expected to be absolute and normalized
+bool IsInside(const std::filesystem::path &path, const std::filesystem::path &root) {
+  auto rel = path.lexically_relative(root);
+  return !rel.empty() && *rel.begin() != "..";
+}
+
+ErrHandle ThinFrames(const std::filesystem::path &dir, const std::filesystem::path &output,
+                     size_t &n_frames, size_t &n_keyframes) {
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(dir.string()));
+  auto root = std::filesystem::absolute(dir).lexically_normal();
+  auto out_root = output.empty() ? output : std::filesystem::absolute(output).lexically_normal();
+  if (!out_root.empty() && (out_root == root || IsInside(out_root, root))) {
+    return ErrHandle(TEXEL_WHERE, "the output must be located outside the source directory");
+  }
+
+  FrameDedup dedup;
+  FileCopier copier(false);
+  std::unordered_set<std::string> exported;
+  while (finder.FindNext()) {
+    decltype(auto) info = finder.Current();
+    std::cout << std::endl << "'" << info.id << "':" << std::endl;
+
+    // Annotations are copied as is, frame directories keep their names
+    auto xml = std::filesystem::absolute(info.path).lexically_normal();
+    if (!out_root.empty() && IsInside(xml, root) && exported.insert(xml.string()).second) {
+      auto dst = out_root / xml.lexically_relative(root);
+      std::filesystem::create_directories(dst.parent_path());
+      file_copy::Method method;
+      TEXEL_CHECK(copier.Copy(xml.string(), dst.string(), method));
+    }
+
+    decltype(auto) stages = info.scan.Stages();
+    for (size_t stage_idx = 0; stage_idx < stages.size(); stage_idx++) {
+      decltype(auto) streams = stages[stage_idx].Streams();
+      for (size_t stream_idx = 0; stream_idx < streams.size(); stream_idx++) {
+        const auto &stream = streams[stream_idx];
+        Camera camera;
+        std::string depth_dir, color_dir;
+        if (!stream.HasDepth(camera, depth_dir)) {
+          continue;
+        }
+        stream.HasColor(camera, color_dir);
+
+        frame_dedup::Selection selection;
+        auto err = dedup.Select(stream, selection);
+        std::cout << "  Stage " << stage_idx << ", stream " << stream_idx << ": ";
+        if (err.Failed()) {
+          std::cout << "skipped" << std::endl << err.Message() << std::endl;
+          continue;
+        }
+        std::cout << selection.keyframes.size() << " of " << selection.files.size() << " frames kept, "
+                  << "dropped ones differ by " << selection.max_difference.change << " mm and "
+                  << selection.max_difference.flipped * 100.0f << "% of cells at most" << std::endl;
+        n_frames += selection.files.size();
+        n_keyframes += selection.keyframes.size();
+
+        // Different scans may share frames
+        auto depth = std::filesystem::path(depth_dir).lexically_normal();
+        if (out_root.empty() || !exported.insert(depth.string()).second) {
+          continue;
+        }
+        if (!IsInside(depth, root)) {
+          std::cout << "  Not exported, frames are located outside the source directory" << std::endl;
+          continue;
+        }
+        auto color = std::filesystem::path(color_dir).lexically_normal();
+        bool with_color = !color_dir.empty() && IsInside(color, root) && exported.insert(color.string()).second;
+        TEXEL_CHECK(FrameDedup::ExportKeyframes(stream, selection,
+                                                (out_root / depth.lexically_relative(root)).string(),
+                                                with_color ? (out_root / color.lexically_relative(root)).string() : "",
+                                                copier));
+      }
+    }
+  }
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Wrong arguments, use as './ThinFrames <path_to_directory_with_scans> [<output_directory>]'"
+              << std::endl;
+    return 1;
+  }
+  std::filesystem::path dir(argv[1]);
+  std::filesystem::path output(argc == 3 ? argv[2] : "");
+
+  MetricsExporter exporter;
+  auto metrics_err = exporter.StartFromEnvironment();
+  if (metrics_err.Failed()) {
+    std::cerr << "Metrics are not exported:" << std::endl << metrics_err.Message();
+  }
+
+  size_t n_frames{}, n_keyframes{};
+  auto err = ThinFrames(dir, output, n_frames, n_keyframes);
+  if (err.Failed()) {
+    std::cerr << "Failed to thin frames from the '" << dir.string() << "' directory:" << std::endl;
+    std::cerr << err.Message();
+    return 1;
+  }
+  std::cout << std::endl << "Kept " << n_keyframes << " of " << n_frames << " depth maps" << std::endl;
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include "Manifest.h"
+#include "Metrics.h"
+#include "ScanogramFinder.h"
+
+using namespace texel;
+
+// Creates a new manifest or updates the existing one (only new and changed files are hashed)
+ErrHandle CreateManifest(const std::string &dir, const std::string &filename, bool full) {
+  Manifest manifest;
+  manifest::Params params;
+  params.incremental = !full;
+  if (params.incremental && std::filesystem::is_regular_file(filename)) {
+    TEXEL_CHECK(Manifest::Load(filename, manifest));
+  }
+
+  ScanogramFinder finder;
+  TEXEL_CHECK(finder.BindDirectory(dir));
+  TEXEL_CHECK(manifest.Build(finder, dir, params));
+  TEXEL_CHECK(manifest.Save(filename));
+
+  size_t n_files = 0;
+  for (const auto &group : manifest.Groups()) {
+    n_files += group.entries.size();
+  }
+  std::cout << "The manifest describes " << n_files << " files of "
+            << manifest.Groups().size() << " persons" << std::endl;
+  return ErrHandle();
+}
+
+ErrHandle VerifyManifest(const std::string &dir, const std::string &filename, bool full,
+                         bool &succeeded) {
+  Manifest manifest;
+  TEXEL_CHECK(Manifest::Load(filename, manifest));
+
+  manifest::Params params;
+  params.incremental = !full;
+  manifest::Report report;
+  TEXEL_CHECK(manifest.Verify(dir, params, report));
+
+  size_t n_problems = 0;
+  for (const auto &scan : report.problems) {
+    std::cout << std::endl << "'" << scan.first << "':" << std::endl;
+    for (const auto &problem : scan.second) {
+      std::cout << "  " << problem.path << ": " << ToUserFriendly(problem.status) << std::endl;
+    }
+    n_problems += scan.second.size();
+  }
+  std::cout << std::endl << "Checked " << report.files << " files, hashed " << report.hashed_files
+            << " (" << report.hashed_bytes / (1024 * 1024) << " MB), "
+            << n_problems << " problems found" << std::endl;
+  succeeded = n_problems == 0;
+
+  // Remember new modification times of the verified files
+  if (report.hashed_files > 0) {
+    TEXEL_CHECK(manifest.Save(filename));
+  }
+  return ErrHandle();
+}
+
+int main(int argc, char **argv) {
+  bool full = argc == 5 && std::string(argv[4]) == "--full";
+  std::string mode = argc >= 2 ? argv[1] : "";
+  if (argc < 4 || argc > 5 || (argc == 5 && !full) || (mode != "create" && mode != "verify")) {
+    std::cerr << "Wrong arguments, use as './VerifyDataset create|verify <path_to_directory_with_scans> "
+                 "<manifest_file> [--full]'" << std::endl;
+    return 1;
+  }
+
+  MetricsExporter exporter;
+  auto metrics_err = exporter.StartFromEnvironment();
+  if (metrics_err.Failed()) {
+    std::cerr << "Metrics are not exported:" << std::endl << metrics_err.Message();
+  }
+
+  bool succeeded = true;
+  auto err = mode == "create" ? CreateManifest(argv[2], argv[3], full)
+                              : VerifyManifest(argv[2], argv[3], full, succeeded);
+  if (err.Failed()) {
+    std::cerr << "Failed to " << mode << " the manifest for the '" << argv[2] << "' directory:" << std::endl;
+    std::cerr << err.Message();
+    return 1;
+  }
+  return succeeded ? 0 : 2;
+}